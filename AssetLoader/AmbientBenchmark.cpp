@@ -0,0 +1,80 @@
+#include "Precomp.h"
+#include "Assets.h"
+#include "ObjModel.h"
+#include "RayTracer.h"
+#include "AmbientOcclusion.h"
+
+static double ElapsedMs(const LARGE_INTEGER& start, const LARGE_INTEGER& end, const LARGE_INTEGER& frequency)
+{
+    return (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+bool RunAmbientOcclusionBenchmark(const std::wstring& modelFilename, uint32_t raysPerVertex)
+{
+    if (raysPerVertex == 0)
+    {
+        raysPerVertex = 1;
+    }
+
+    std::unique_ptr<ObjModel> model(new ObjModel);
+    if (!LoadSourceModel(modelFilename, model.get()))
+    {
+        wprintf(L"Failed to load %s.\n", modelFilename.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    RayTracer tracer;
+    QueryPerformanceCounter(&start);
+    tracer.Build(model->Vertices, model->Indices);
+    QueryPerformanceCounter(&end);
+    double buildMs = ElapsedMs(start, end, frequency);
+
+    AmbientBakeSettings settings = AmbientBakeSettings::GetDefault(tracer);
+    settings.RaysPerVertex = raysPerVertex;
+
+    wprintf(L"Ambient occlusion bake, %s\n", modelFilename.c_str());
+    wprintf(L"  %Iu vertices, %u triangles, %u rays per vertex, max distance %.2f\n",
+        model->Vertices.size(), tracer.GetNumTriangles(), raysPerVertex, settings.MaxDistance);
+    wprintf(L"  Build: %8.2f ms, %u nodes\n", buildMs, tracer.GetNumNodes());
+
+    // Both bakes must agree, since each vertex only depends on its own rays
+    std::vector<ModelAmbientVertex> results[2];
+    const wchar_t* names[] = { L"1 thread", L"All threads" };
+    double baselineMs = 0.0;
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        settings.Multithreaded = i == 1;
+
+        QueryPerformanceCounter(&start);
+        uint64_t numRays = BakeAmbientOcclusion(tracer, model->Vertices, settings, &results[i]);
+        QueryPerformanceCounter(&end);
+
+        double ms = ElapsedMs(start, end, frequency);
+        if (i == 0)
+        {
+            baselineMs = ms;
+        }
+        wprintf(L"  %-12s %10.2f ms, %8.2f Mrays/s, %5.2fx\n", names[i], ms, numRays / (ms * 1000.0), baselineMs / ms);
+    }
+
+    if (memcmp(results[0].data(), results[1].data(), results[0].size() * sizeof(ModelAmbientVertex)) != 0)
+    {
+        wprintf(L"  Multithreaded bake differs from the single threaded one.\n");
+        return false;
+    }
+
+    uint64_t totalVisibility = 0;
+    uint32_t numUnoccluded = 0;
+    for (auto& vertex : results[0])
+    {
+        totalVisibility += vertex.Visibility;
+        numUnoccluded += vertex.Visibility == 255 ? 1 : 0;
+    }
+    wprintf(L"  Average visibility %.3f, %u vertices unoccluded\n",
+        results[0].empty() ? 1.0 : totalVisibility / (255.0 * results[0].size()), numUnoccluded);
+
+    return true;
+}
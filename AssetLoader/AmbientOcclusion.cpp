@@ -0,0 +1,154 @@
+#include "Precomp.h"
+#include "AmbientOcclusion.h"
+#include "RayTracer.h"
+#include "Parallel.h"
+
+// Vertices per ParallelFor index, so each task traces a few thousand rays
+static const uint32_t VerticesPerTask = 256;
+
+static uint32_t Hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32_t HashFloat(float f, uint32_t seed)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return Hash(bits ^ seed);
+}
+
+// [0, 1) from the top 24 bits
+static float ToUnitFloat(uint32_t x)
+{
+    return (x >> 8) * (1.f / 16777216.f);
+}
+
+// Van der Corput sequence, for the second coordinate of Hammersley points
+static float RadicalInverse(uint32_t i)
+{
+    i = (i << 16) | (i >> 16);
+    i = ((i & 0x55555555) << 1) | ((i & 0xAAAAAAAA) >> 1);
+    i = ((i & 0x33333333) << 2) | ((i & 0xCCCCCCCC) >> 2);
+    i = ((i & 0x0F0F0F0F) << 4) | ((i & 0xF0F0F0F0) >> 4);
+    i = ((i & 0x00FF00FF) << 8) | ((i & 0xFF00FF00) >> 8);
+    return ToUnitFloat(i);
+}
+
+static uint8_t ToUnorm8(float value)
+{
+    return (uint8_t)(min(max(value, 0.f), 1.f) * 255.f + 0.5f);
+}
+
+// Returns how many rays were traced
+static uint32_t BakeVertex(const RayTracer& tracer, const ModelVertex& vertex, const AmbientBakeSettings& settings, ModelAmbientVertex* ambient)
+{
+    XMVECTOR normal = XMLoadFloat3(&vertex.Normal);
+    if (XMVectorGetX(XMVector3LengthSq(normal)) < 1e-12f)
+    {
+        // Nothing to orient a hemisphere with, so leave it unoccluded
+        ambient->BentNormal[0] = ambient->BentNormal[1] = ambient->BentNormal[2] = ToUnorm8(0.5f);
+        ambient->Visibility = 255;
+        return 0;
+    }
+    normal = XMVector3Normalize(normal);
+
+    XMFLOAT3 n;
+    XMStoreFloat3(&n, normal);
+
+    // Orthonormal basis around the normal, without branching on its direction (Duff et al. 2017)
+    float sign = n.z >= 0.f ? 1.f : -1.f;
+    float a = -1.f / (sign + n.z);
+    float b = n.x * n.y * a;
+    XMVECTOR tangent = XMVectorSet(1.f + sign * n.x * n.x * a, sign * b, -sign * n.x, 0.f);
+    XMVECTOR bitangent = XMVectorSet(b, sign + n.y * n.y * a, -n.y, 0.f);
+
+    // Hammersley points, rotated by a random offset per vertex so neighbours don't band
+    uint32_t seed = HashFloat(vertex.Position.x, HashFloat(vertex.Position.y, HashFloat(vertex.Position.z,
+        HashFloat(n.x, HashFloat(n.y, HashFloat(n.z, 0))))));
+    float offsetU = ToUnitFloat(seed);
+    float offsetV = ToUnitFloat(Hash(seed));
+
+    XMVECTOR origin = XMLoadFloat3(&vertex.Position) + normal * settings.Bias;
+    XMVECTOR bent = XMVectorZero();
+    uint32_t unoccluded = 0;
+    for (uint32_t i = 0; i < settings.RaysPerVertex; ++i)
+    {
+        float u = (i + 0.5f) / settings.RaysPerVertex + offsetU;
+        float v = RadicalInverse(i) + offsetV;
+        u -= floorf(u);
+        v -= floorf(v);
+
+        // Cosine weighted: uniform on the disc, projected up onto the hemisphere
+        float r = sqrtf(u);
+        float phi = XM_2PI * v;
+        XMVECTOR direction = tangent * (r * cosf(phi)) + bitangent * (r * sinf(phi)) + normal * sqrtf(max(1.f - u, 0.f));
+
+        if (!tracer.IsOccluded(origin, direction, settings.MaxDistance))
+        {
+            bent += direction;
+            ++unoccluded;
+        }
+    }
+
+    bent = unoccluded > 0 ? XMVector3Normalize(bent) : normal;
+
+    XMFLOAT3 bentNormal;
+    XMStoreFloat3(&bentNormal, bent);
+    ambient->BentNormal[0] = ToUnorm8(bentNormal.x * 0.5f + 0.5f);
+    ambient->BentNormal[1] = ToUnorm8(bentNormal.y * 0.5f + 0.5f);
+    ambient->BentNormal[2] = ToUnorm8(bentNormal.z * 0.5f + 0.5f);
+    ambient->Visibility = ToUnorm8((float)unoccluded / settings.RaysPerVertex);
+    return settings.RaysPerVertex;
+}
+
+AmbientBakeSettings AmbientBakeSettings::GetDefault(const RayTracer& tracer)
+{
+    float diagonal = XMVectorGetX(XMVector3Length(XMLoadFloat3(&tracer.GetBoundsMax()) - XMLoadFloat3(&tracer.GetBoundsMin())));
+
+    AmbientBakeSettings settings;
+    settings.RaysPerVertex = 64;
+    settings.MaxDistance = diagonal / 20.f;
+    settings.Bias = diagonal * 1e-5f;
+    settings.Multithreaded = true;
+    return settings;
+}
+
+uint64_t BakeAmbientOcclusion(const RayTracer& tracer, const std::vector<ModelVertex>& vertices, const AmbientBakeSettings& settings,
+    std::vector<ModelAmbientVertex>* ambient)
+{
+    uint32_t numVertices = (uint32_t)vertices.size();
+    ambient->resize(numVertices);
+
+    std::atomic<uint64_t> numRays(0);
+    auto bakeRange = [&](uint32_t task)
+    {
+        uint64_t taskRays = 0;
+        uint32_t end = min((task + 1) * VerticesPerTask, numVertices);
+        for (uint32_t i = task * VerticesPerTask; i < end; ++i)
+        {
+            taskRays += BakeVertex(tracer, vertices[i], settings, &(*ambient)[i]);
+        }
+        numRays += taskRays;
+    };
+
+    uint32_t numTasks = (numVertices + VerticesPerTask - 1) / VerticesPerTask;
+    if (settings.Multithreaded)
+    {
+        ParallelFor(numTasks, bakeRange);
+    }
+    else
+    {
+        for (uint32_t task = 0; task < numTasks; ++task)
+        {
+            bakeRange(task);
+        }
+    }
+
+    return numRays;
+}
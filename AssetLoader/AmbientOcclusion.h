@@ -0,0 +1,23 @@
+#pragma once
+
+#include "AssetLoader.h"
+
+class RayTracer;
+
+struct AmbientBakeSettings
+{
+    uint32_t RaysPerVertex;
+    float MaxDistance;          // Farthest an occluder counts from, in model units
+    float Bias;                 // Ray origins are pushed this far off the surface along the normal
+    bool Multithreaded;         // Spread vertices over ParallelFor, or bake on the calling thread
+
+    // 64 rays per vertex, out to a 20th of the model's bounding box diagonal
+    static AmbientBakeSettings GetDefault(const RayTracer& tracer);
+};
+
+// Traces cosine weighted rays over the hemisphere around each vertex normal, and writes the
+// fraction that escape and their average direction (the bent normal) per vertex.
+// Deterministic: each vertex's rays are seeded from its position & normal, so vertices split
+// along UV seams get the same result. Returns how many rays were traced.
+uint64_t BakeAmbientOcclusion(const RayTracer& tracer, const std::vector<ModelVertex>& vertices, const AmbientBakeSettings& settings,
+    std::vector<ModelAmbientVertex>* ambient);
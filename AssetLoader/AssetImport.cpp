@@ -0,0 +1,130 @@
+#include "Precomp.h"
+#include "AssetImport.h"
+#include "Assets.h"
+#include "ObjModel.h"
+#include "Parallel.h"
+#include "Debug.h"
+#include "StringHelpers.h"
+
+struct PendingTexture
+{
+    AssetType Type;
+    std::wstring SourcePath;
+};
+
+static bool BuildTextureBlob(const std::wstring& sourcePath, AssetType type, std::vector<uint8_t>* data)
+{
+    // Imports may run on the caller's worker threads, and WIC needs COM on every thread that uses it
+    HRESULT hr = CoInitializeEx(nullptr, COINIT_MULTITHREADED);
+
+    bool result = BuildTextureData(sourcePath, type == AssetType::BumpTexture, type == AssetType::SpecularTexture, data);
+
+    if (SUCCEEDED(hr))
+    {
+        CoUninitialize();
+    }
+
+    return result;
+}
+
+bool ImportModel(const std::wstring& sourceRoot, const std::wstring& modelPath, ImportedModel* model)
+{
+    model->Data.clear();
+    model->Textures.clear();
+
+    std::wstring root = sourceRoot;
+    NormalizeSlashes(root);
+    EnsureTrailingSlash(root);
+
+    std::wstring assetPath = modelPath;
+    NormalizeSlashes(assetPath);
+    if (_wcsnicmp(assetPath.c_str(), root.c_str(), root.size()) != 0)
+    {
+        assetPath = root + assetPath;
+    }
+
+    std::unique_ptr<ObjModel> objModel(new ObjModel);
+    if (!LoadSourceModel(assetPath, objModel.get()))
+    {
+        LogError(L"Failed to parse model: %s.", assetPath.c_str());
+        return false;
+    }
+
+    // Only record textures while building the model, then build them all in parallel below
+    std::map<std::wstring, PendingTexture> pending;
+    auto recordTexture = [&](AssetType type, const std::wstring& sourcePath, std::wstring* outputRelativePath)
+    {
+        SourceAsset asset(type, std::wstring(sourcePath));
+        std::wstring relativePath = asset.Path;
+        if (_wcsnicmp(relativePath.c_str(), root.c_str(), root.size()) == 0)
+        {
+            relativePath = relativePath.substr(root.size());
+        }
+
+        *outputRelativePath = ReplaceExtension(relativePath, L"texture");
+        if (pending.find(*outputRelativePath) == pending.end())
+        {
+            PendingTexture texture;
+            texture.Type = type;
+            texture.SourcePath = root + relativePath;
+            pending[*outputRelativePath] = texture;
+        }
+        return true;
+    };
+
+    // No offline bakes. The caller is waiting on the import, and readers do without them
+    ModelBakeOptions bake{};
+    if (!BuildModelData(objModel, recordTexture, bake, &model->Data))
+    {
+        LogError(L"Failed to build model: %s.", assetPath.c_str());
+        return false;
+    }
+
+    // Free up memory before the texture work starts
+    objModel.reset();
+
+    std::vector<const PendingTexture*> sources;
+    for (auto& pair : pending)
+    {
+        ImportedTexture texture;
+        texture.Name = pair.first;
+        model->Textures.push_back(texture);
+        sources.push_back(&pair.second);
+    }
+
+    std::atomic<bool> failed(false);
+    ParallelFor((uint32_t)sources.size(), [&](uint32_t i)
+    {
+        if (!BuildTextureBlob(sources[i]->SourcePath, sources[i]->Type, &model->Textures[i].Data))
+        {
+            failed = true;
+        }
+    });
+
+    if (failed)
+    {
+        LogError(L"Failed to build textures for model: %s.", assetPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool ImportTexture(const std::wstring& textureFilename, ImportTextureType type, std::vector<uint8_t>* data)
+{
+    AssetType assetType = AssetType::Texture;
+    switch (type)
+    {
+    case ImportTextureType::Bump:       assetType = AssetType::BumpTexture; break;
+    case ImportTextureType::Specular:   assetType = AssetType::SpecularTexture; break;
+    default:                            break;
+    }
+
+    if (!BuildTextureBlob(textureFilename, assetType, data))
+    {
+        LogError(L"Failed to build texture: %s.", textureFilename.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+//*****************************************************
+// PUBLIC HEADER. For use from calling applications
+//
+// In-process access to the asset build pipeline, for
+// importing assets at runtime without going through
+// AssetLoader.exe and the file system. Blobs are byte
+// for byte what AssetLoader.exe would write to disk,
+// so they are parsed using the structs in AssetLoader.h.
+//*****************************************************
+
+enum class ImportTextureType
+{
+    Standard = 0,   // Mipmapped texture
+    Bump,           // Height map, converted to a normal map
+    Specular,       // Single channel specular expanded to RGBA
+};
+
+struct ImportedTexture
+{
+    std::wstring Name;          // Matches the texture path stored in the model's ModelPart entries
+    std::vector<uint8_t> Data;  // TextureHeader followed by pixel data
+};
+
+struct ImportedModel
+{
+    std::vector<uint8_t> Data;              // ModelHeader followed by vertices, indices, objects, and parts
+    std::vector<ImportedTexture> Textures;  // Every texture referenced by the model, once each
+};
+
+// Runs body(i) for every i in [0, count) and returns once all have completed
+typedef std::function<void(uint32_t count, const std::function<void(uint32_t)>& body)> AssetTaskScheduler;
+
+// Routes all parallel work in the importer through the caller's scheduler, so the runtime can
+// share its own worker threads. Pass an empty function to go back to the built in threads.
+// Must not be called while an import is in progress.
+void SetAssetTaskScheduler(const AssetTaskScheduler& scheduler);
+
+// Imports a .obj or .glb model and all of its textures. sourceRoot is stripped from texture
+// paths, the same way AssetLoader.exe makes output paths relative to SourceRoot.
+bool ImportModel(const std::wstring& sourceRoot, const std::wstring& modelPath, ImportedModel* model);
+
+bool ImportTexture(const std::wstring& textureFilename, ImportTextureType type, std::vector<uint8_t>* data);
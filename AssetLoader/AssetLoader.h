@@ -21,7 +21,8 @@ struct ModelVertex
 
 #pragma pack(1)
 
-// Followed directly by all vertices, then all indices, then all objects
+// Followed directly by all vertices, then all indices, then all objects, then optionally a
+// ModelAmbientHeader, then optionally a ModelVisibilityHeader
 struct ModelHeader
 {
     static const uint32_t ExpectedSignature = 'MODL';
@@ -49,7 +50,45 @@ struct ModelPart
     uint32_t NumIndices;
 };
 
-// MODEL
+// Ambient occlusion baked by AssetLoader. Followed directly by NumVertices ModelAmbientVertex
+// entries, in the same order as the model's vertices
+struct ModelAmbientHeader
+{
+    static const uint32_t ExpectedSignature = 'MDAO';
+
+    uint32_t Signature;
+    uint32_t NumVertices;
+    uint32_t RaysPerVertex;
+    float MaxDistance;      // Farthest an occluder counted from, in model units
+};
+
+// Laid out as DXGI_FORMAT_R8G8B8A8_UNORM, to use directly as a vertex stream
+struct ModelAmbientVertex
+{
+    uint8_t BentNormal[3];  // Average unoccluded direction in model space, mapped from [-1, 1]
+    uint8_t Visibility;     // Fraction of the hemisphere that's unoccluded, cosine weighted
+};
+
+// Potentially visible sets baked by AssetLoader. The model's bounds are split into a grid of
+// cells, and each cell has a bit per part (numbered across all objects, in file order) that's set
+// if the part may be seen from anywhere in the cell. Followed directly by WordsPerCell uint32_t
+// per cell, for cells ordered by x, then y, then z. Part i's bit is 1 << (i % 32) of word i / 32
+struct ModelVisibilityHeader
+{
+    static const uint32_t ExpectedSignature = 'MPVS';
+
+    uint32_t Signature;
+    uint32_t NumParts;
+    uint32_t CellsX;
+    uint32_t CellsY;
+    uint32_t CellsZ;
+    uint32_t WordsPerCell;
+    XMFLOAT3 BoundsMin;     // Corner of the first cell, in model units
+    XMFLOAT3 CellSize;
+    uint32_t SamplesPerCell;
+};
+
+// TEXTURE
 
 #pragma pack(1)
 
@@ -66,5 +105,33 @@ struct TextureHeader
     DXGI_FORMAT Format;
 };
 
+// VIRTUAL TEXTURE
+
+// Followed directly by NumTiles VirtualTextureTile entries (the page index), then all page data.
+// Tiles are ordered by mip (finest first), then row-major within the mip, so the index of
+// tile (x, y) in a mip is the sum of the tile counts of all finer mips + y * tilesWide + x.
+struct VirtualTextureHeader
+{
+    static const uint32_t ExpectedSignature = 'VTEX';
+
+    uint32_t Signature;
+    uint32_t Width;         // Size of mip 0, in texels
+    uint32_t Height;
+    uint32_t MipLevels;     // Last mip always fits within a single tile
+    uint32_t TileSize;      // Texels of unique content along each side of a tile
+    uint32_t TileBorder;    // Texels of border on each side, so pages are TileSize + 2 * TileBorder wide
+    DXGI_FORMAT Format;     // Format of every page
+    uint32_t PageSize;      // Bytes per page
+    uint32_t NumTiles;
+};
+
+struct VirtualTextureTile
+{
+    uint32_t Mip;
+    uint32_t X;             // Tile coordinates within the mip
+    uint32_t Y;
+    uint64_t Offset;        // Byte offset of the page from the start of the file
+};
+
 #pragma pack(pop)
 
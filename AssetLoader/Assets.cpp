@@ -3,24 +3,30 @@
 #include "Debug.h"
 #include "ObjModel.h"
 #include "StringHelpers.h"
+#include "BuildReport.h"
+#include "BuildCache.h"
 
 static std::map<AssetType, std::wstring> Extensions;
 
 static std::wstring SourceRoot;
 static std::wstring OutputRoot;
+static ModelBakeOptions BakeOptions;
 
 // Ensures that all subdirectories up to the file exist
 static bool EnsurePathExists(const std::wstring& path);
 static bool DoesAssetNeedBuilt(const std::wstring& assetFilename, const std::wstring& outputFilename, bool* needsBuild);
 
-static bool BuildModel(const std::wstring& assetFilename, const std::wstring& outputFilename);
+static bool BuildModel(const std::wstring& assetFilename, const std::wstring& outputFilename, std::vector<SourceAsset>* dependencies);
 static bool BuildTexture(const std::wstring& assetFilename, const std::wstring& outputFilename, bool saveDerivativeMap = false, bool expandChannels = false);
+static bool BuildVirtualTexture(const std::wstring& assetFilename, const std::wstring& outputFilename);
 
 
 bool ProcessAssets(
     const std::wstring& sourceRoot,
     const std::wstring& outputRoot,
-    const std::vector<SourceAsset>& assets)
+    const std::vector<SourceAsset>& assets,
+    const ModelBakeOptions& bake,
+    const std::wstring& reportName)
 {
     if (Extensions.empty())
     {
@@ -29,10 +35,12 @@ bool ProcessAssets(
         Extensions[AssetType::Texture] = L"texture";
         Extensions[AssetType::BumpTexture] = L"texture";
         Extensions[AssetType::SpecularTexture] = L"texture";
+        Extensions[AssetType::VirtualTexture] = L"vtexture";
     }
 
     SourceRoot = sourceRoot;
     OutputRoot = outputRoot;
+    BakeOptions = bake;
 
     // For each source asset:
     //  1. Compute the final output filename
@@ -49,6 +57,12 @@ bool ProcessAssets(
         }
     }
 
+    if (!WriteBuildReport(OutputRoot, reportName))
+    {
+        LogError(L"Failed to write build report.");
+        return false;
+    }
+
     return true;
 }
 
@@ -97,7 +111,7 @@ bool DoesAssetNeedBuilt(const std::wstring& assetFilename, const std::wstring& o
     {
         // File exists, is source asset last modified time newer than built content?
         FileHandle outputFile(CreateFile(outputFilename.c_str(), GENERIC_READ,
-            FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+            FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
         if (!outputFile.IsValid())
         {
             LogError(L"Failed to access file: %s.", outputFilename.c_str());
@@ -159,9 +173,18 @@ bool BuildAsset(const SourceAsset& asset, std::wstring& outputRelativePath)
         return false;
     }
 
+    AssetReport report{};
+    report.Type = Extensions[asset.Type];
+    report.Source = assetPath;
+    report.Output = outputRelativePath;
+
     if (!needsBuild)
     {
         Log(L"  Content up to date. Skipping.");
+        if (AnalyzeOutputFile(outputFilename, &report))
+        {
+            AddAssetReport(report);
+        }
         return true;
     }
 
@@ -171,11 +194,50 @@ bool BuildAsset(const SourceAsset& asset, std::wstring& outputRelativePath)
         return false;
     }
 
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    // Other textures, etc. that this asset's output references
+    std::vector<SourceAsset> dependencies;
+
+    std::wstring cacheKey;
+    if (IsBuildCacheEnabled())
+    {
+        bool hit = false;
+        if (ComputeBuildKey(asset.Type, assetFilename, assetPath, BakeOptions, &cacheKey) &&
+            FetchFromBuildCache(cacheKey, outputFilename, &dependencies, &hit) && hit)
+        {
+            Log(L"  Fetched from build cache.");
+
+            for (auto& dependency : dependencies)
+            {
+                std::wstring dependencyOutput;
+                if (!BuildAsset(dependency, dependencyOutput))
+                {
+                    LogError(L"Failed to build dependency: %s.", dependency.Path.c_str());
+                    return false;
+                }
+            }
+
+            QueryPerformanceCounter(&end);
+
+            report.Built = true;
+            report.Cached = true;
+            report.BuildMs = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+            if (AnalyzeOutputFile(outputFilename, &report))
+            {
+                AddAssetReport(report);
+            }
+            return true;
+        }
+    }
+
     // Build asset
     switch (asset.Type)
     {
     case AssetType::Model:
-        if (!BuildModel(assetFilename, outputFilename))
+        if (!BuildModel(assetFilename, outputFilename, &dependencies))
         {
             LogError(L"Failed to build asset: %s.", assetFilename.c_str());
             return false;
@@ -206,16 +268,51 @@ bool BuildAsset(const SourceAsset& asset, std::wstring& outputRelativePath)
         }
         break;
 
+    case AssetType::VirtualTexture:
+        if (!BuildVirtualTexture(assetFilename, outputFilename))
+        {
+            LogError(L"Failed to build asset: %s.", assetFilename.c_str());
+            return false;
+        }
+        break;
+
     default:
         LogError(L"Unimplemented.");
         return true;
     }
 
+    if (!cacheKey.empty())
+    {
+        // Store dependencies relative to SourceRoot, since other machines may have it elsewhere
+        for (auto& dependency : dependencies)
+        {
+            if (_wcsnicmp(dependency.Path.c_str(), SourceRoot.c_str(), SourceRoot.size()) == 0)
+            {
+                dependency.Path = dependency.Path.substr(SourceRoot.size());
+            }
+        }
+
+        if (!PublishToBuildCache(cacheKey, outputFilename, dependencies))
+        {
+            // Not fatal. The output is still valid locally
+            Log(L"  Failed to publish to build cache.");
+        }
+    }
+
+    QueryPerformanceCounter(&end);
+
+    report.Built = true;
+    report.BuildMs = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+    if (AnalyzeOutputFile(outputFilename, &report))
+    {
+        AddAssetReport(report);
+    }
+
     Log(L"  Done.");
     return true;
 }
 
-bool BuildModel(const std::wstring& assetFilename, const std::wstring& outputFilename)
+bool BuildModel(const std::wstring& assetFilename, const std::wstring& outputFilename, std::vector<SourceAsset>* dependencies)
 {
     std::unique_ptr<ObjModel> objModel(new ObjModel);
     if (!objModel)
@@ -224,12 +321,13 @@ bool BuildModel(const std::wstring& assetFilename, const std::wstring& outputFil
         return false;
     }
 
-    if (!objModel->Load(assetFilename.c_str()))
+    if (!LoadSourceModel(assetFilename, objModel.get()))
     {
         LogError(L"Failed to parse model: %s.", assetFilename.c_str());
+        return false;
     }
 
-    if (!SaveModel(objModel, outputFilename))
+    if (!SaveModel(objModel, outputFilename, BakeOptions, dependencies))
     {
         LogError(L"Failed to save model file: %s.", outputFilename.c_str());
         return false;
@@ -248,3 +346,88 @@ bool BuildTexture(const std::wstring& assetFilename, const std::wstring& outputF
 
     return true;
 }
+
+bool BuildVirtualTexture(const std::wstring& assetFilename, const std::wstring& outputFilename)
+{
+    if (!SaveVirtualTexture(assetFilename, outputFilename))
+    {
+        LogError(L"Failed to save virtual texture file: %s.", outputFilename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool SaveBlob(const std::wstring& outputFilename, const std::vector<uint8_t>& data)
+{
+    std::wstring tempFilename = GetTempFilename(outputFilename);
+    FileHandle outputFile(CreateFile(tempFilename.c_str(), GENERIC_WRITE,
+        0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!outputFile.IsValid())
+    {
+        LogError(L"Failed to create output file: %s.", tempFilename.c_str());
+        return false;
+    }
+
+    DWORD bytesWritten{};
+    bool written = WriteFile(outputFile.Get(), data.data(), (DWORD)data.size(), &bytesWritten, nullptr) && bytesWritten == data.size();
+    outputFile.Close();
+
+    if (!written)
+    {
+        DeleteFile(tempFilename.c_str());
+        LogError(L"Error writing output file.");
+        return false;
+    }
+
+    return ReplaceOutputFile(tempFilename, outputFilename);
+}
+
+std::wstring GetTempFilename(const std::wstring& filename)
+{
+    wchar_t computerName[MAX_COMPUTERNAME_LENGTH + 1] = {};
+    DWORD size = _countof(computerName);
+    GetComputerName(computerName, &size);
+
+    wchar_t suffix[64] = {};
+    swprintf_s(suffix, L".%u.%u.tmp", GetCurrentProcessId(), GetCurrentThreadId());
+    return filename + L"." + computerName + suffix;
+}
+
+bool ReplaceOutputFile(const std::wstring& tempFilename, const std::wstring& outputFilename)
+{
+    // Readers share delete access, so this only fails while another writer has the output open
+    for (int attempt = 0; ; ++attempt)
+    {
+        if (MoveFileEx(tempFilename.c_str(), outputFilename.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+        {
+            return true;
+        }
+
+        DWORD error = GetLastError();
+        if (error != ERROR_SHARING_VIOLATION && error != ERROR_ACCESS_DENIED)
+        {
+            DeleteFile(tempFilename.c_str());
+            LogError(L"Failed to replace output file: %s.", outputFilename.c_str());
+            return false;
+        }
+
+        if (attempt == 10)
+        {
+            break;
+        }
+        Sleep(50);
+    }
+
+    // Another shard is producing the same output (such as a texture shared by models in
+    // different shards) from the same source, so its file is as good as ours
+    DeleteFile(tempFilename.c_str());
+    if (GetFileAttributes(outputFilename.c_str()) == INVALID_FILE_ATTRIBUTES)
+    {
+        LogError(L"Failed to replace output file: %s.", outputFilename.c_str());
+        return false;
+    }
+
+    Log(L"  Output in use by another build. Keeping its copy.");
+    return true;
+}
@@ -6,6 +6,7 @@ enum class AssetType
     Texture,        // Save out as standard mipmapped texture
     BumpTexture,    // Process single channel texture into texture-space derivative height map and save as texture
     SpecularTexture,// If single channel texture, expand to RGBA as "standard" spec color map
+    VirtualTexture, // Save out as a tiled, bordered mip pyramid in a page file for streaming
 };
 
 struct SourceAsset
@@ -25,10 +26,20 @@ struct SourceAsset
     }
 };
 
+// Offline bakes appended to models after their parts. They trace a lot of rays, so each is opt in
+struct ModelBakeOptions
+{
+    bool AmbientOcclusion;      // ModelAmbientHeader, using AmbientBakeSettings::GetDefault
+    bool Visibility;            // ModelVisibilityHeader, using VisibilityBakeSettings::GetDefault
+};
+
+// Writes the build report as <reportName>.json and .csv in the output root
 bool ProcessAssets(
     const std::wstring& sourceRoot,
     const std::wstring& outputRoot,
-    const std::vector<SourceAsset>& assets);
+    const std::vector<SourceAsset>& assets,
+    const ModelBakeOptions& bake,
+    const std::wstring& reportName);
 
 bool DoesAssetNeedBuilt(const SourceAsset& asset, bool* needsBuild);
 
@@ -36,7 +47,46 @@ bool BuildAsset(const SourceAsset& asset, std::wstring& outputRelativePath);
 
 struct ObjModel;
 
-bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& outputFilename);
+// Builds a texture referenced by a model and returns the path the model should store for it
+typedef std::function<bool(AssetType type, const std::wstring& sourcePath, std::wstring* outputRelativePath)> TextureBuildFunction;
+
+// Loads .obj or .glb into the intermediate model representation
+bool LoadSourceModel(const std::wstring& assetFilename, ObjModel* objModel);
+
+// Build* produce the final file contents in memory. Save* build and then write them to disk
+bool BuildModelData(const std::unique_ptr<ObjModel>& objModel, const TextureBuildFunction& buildTexture, const ModelBakeOptions& bake, std::vector<uint8_t>* data);
+bool BuildTextureData(const std::wstring& assetFilename, bool saveDerivativeMap, bool expandChannels, std::vector<uint8_t>* data);
+
+bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& outputFilename, const ModelBakeOptions& bake, std::vector<SourceAsset>* dependencies = nullptr);
 bool SaveTexture(const std::wstring& assetFilename, const std::wstring& outputFilename, bool saveDerivativeMap = false, bool expandChannels = false);
+bool SaveBlob(const std::wstring& outputFilename, const std::vector<uint8_t>& data);
+
+// Outputs are written to GetTempFilename(outputFilename) and then moved over the output with
+// ReplaceOutputFile, so other processes (such as shards sharing an output root) never see a
+// partly written file. The temp name is unique per process and machine.
+std::wstring GetTempFilename(const std::wstring& filename);
+bool ReplaceOutputFile(const std::wstring& tempFilename, const std::wstring& outputFilename);
+
+inline void AppendData(std::vector<uint8_t>* data, const void* source, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)source;
+    data->insert(data->end(), p, p + size);
+}
+
+bool SaveVirtualTexture(const std::wstring& assetFilename, const std::wstring& outputFilename, uint32_t tileSize = 128, uint32_t tileBorder = 4, bool compress = true);
+
+// Loads DDS, TGA, or any WIC supported image
+bool LoadTextureImage(const std::wstring& assetFilename, TexMetadata* metadata, ScratchImage& image);
 
 bool ConvertToBumpMapToNormalMap(const std::wstring& bumpFilename, const std::wstring& outputFilename);
+
+// Times repeated imports of the same content from OBJ and GLB and prints the results
+bool RunImportBenchmark(const std::wstring& objFilename, const std::wstring& glbFilename, uint32_t iterations);
+
+// Bakes ambient occlusion for a model's vertices on one thread and then all of them, and prints
+// the ray throughput of each
+bool RunAmbientOcclusionBenchmark(const std::wstring& modelFilename, uint32_t raysPerVertex);
+
+// Bakes potentially visible sets for a model's parts on one thread and then all of them, and prints
+// the ray throughput of each and how much of the model each cell sees on average
+bool RunVisibilityBenchmark(const std::wstring& modelFilename, uint32_t samplesPerCell);
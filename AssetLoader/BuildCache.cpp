@@ -0,0 +1,300 @@
+#include "Precomp.h"
+#include "Assets.h"
+#include "BuildCache.h"
+#include "Debug.h"
+#include "StringHelpers.h"
+#include <bcrypt.h>
+
+#pragma comment(lib, "bcrypt.lib")
+
+// Bump whenever a change to the build code changes its output, to invalidate old entries
+static const char BuildCacheVersion[] = "AssetLoader build cache 3";
+
+static std::wstring CacheRoot;
+
+// Incremental SHA-256 through the Windows CNG API
+struct Sha256
+{
+    BCRYPT_ALG_HANDLE Algorithm;
+    BCRYPT_HASH_HANDLE Hash;
+
+    Sha256() : Algorithm(nullptr), Hash(nullptr) {}
+
+    ~Sha256()
+    {
+        if (Hash) BCryptDestroyHash(Hash);
+        if (Algorithm) BCryptCloseAlgorithmProvider(Algorithm, 0);
+    }
+
+    bool Initialize()
+    {
+        return BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&Algorithm, BCRYPT_SHA256_ALGORITHM, nullptr, 0)) &&
+               BCRYPT_SUCCESS(BCryptCreateHash(Algorithm, &Hash, nullptr, 0, nullptr, 0, 0));
+    }
+
+    bool Add(const void* data, size_t size)
+    {
+        return BCRYPT_SUCCESS(BCryptHashData(Hash, (PUCHAR)data, (ULONG)size, 0));
+    }
+
+    bool Finish(std::wstring* hex)
+    {
+        uint8_t digest[32];
+        if (!BCRYPT_SUCCESS(BCryptFinishHash(Hash, digest, sizeof(digest), 0)))
+        {
+            return false;
+        }
+
+        wchar_t text[sizeof(digest) * 2 + 1] = {};
+        for (int i = 0; i < (int)sizeof(digest); ++i)
+        {
+            swprintf_s(text + i * 2, 3, L"%02x", digest[i]);
+        }
+        *hex = text;
+        return true;
+    }
+};
+
+static bool ReadWholeFile(const std::wstring& filename, std::vector<char>* data)
+{
+    FileHandle file(CreateFile(filename.c_str(), GENERIC_READ,
+        FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid())
+    {
+        return false;
+    }
+
+    DWORD bytesRead{};
+    data->resize(GetFileSize(file.Get(), nullptr));
+    return data->empty() || (ReadFile(file.Get(), data->data(), (DWORD)data->size(), &bytesRead, nullptr) && bytesRead == data->size());
+}
+
+static std::wstring GetDirectory(const std::wstring& filename)
+{
+    size_t slash = filename.find_last_of(L"/\\");
+    return (slash == std::wstring::npos) ? std::wstring() : filename.substr(0, slash + 1);
+}
+
+static std::wstring GetCacheFilename(const std::wstring& key)
+{
+    return CacheRoot + key.substr(0, 2) + L"/" + key;
+}
+
+// Renaming within a directory is atomic, so readers either see the whole file or nothing.
+// Never replaces an existing entry.
+static bool PublishFile(const std::wstring& tempFilename, const std::wstring& filename)
+{
+    if (!MoveFileEx(tempFilename.c_str(), filename.c_str(), MOVEFILE_WRITE_THROUGH))
+    {
+        DWORD error = GetLastError();
+        DeleteFile(tempFilename.c_str());
+        if (error != ERROR_ALREADY_EXISTS && error != ERROR_FILE_EXISTS)
+        {
+            LogError(L"Failed to publish cache entry: %s.", filename.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+void SetBuildCacheRoot(const std::wstring& cacheRoot)
+{
+    CacheRoot = cacheRoot;
+    if (!CacheRoot.empty())
+    {
+        NormalizeSlashes(CacheRoot);
+        EnsureTrailingSlash(CacheRoot);
+    }
+}
+
+bool IsBuildCacheEnabled()
+{
+    return !CacheRoot.empty();
+}
+
+bool ComputeBuildKey(AssetType type, const std::wstring& assetFilename, const std::wstring& assetPath, const ModelBakeOptions& bake, std::wstring* key)
+{
+    Sha256 hash;
+    if (!hash.Initialize())
+    {
+        LogError(L"Failed to initialize hashing.");
+        return false;
+    }
+
+    std::vector<char> data;
+    if (!ReadWholeFile(assetFilename, &data))
+    {
+        LogError(L"Failed to read source asset: %s.", assetFilename.c_str());
+        return false;
+    }
+
+    // Output paths of referenced textures are derived from the asset's location, so it's part of the key
+    std::string path = ConvertToUtf8(assetPath);
+    uint32_t typeValue = (uint32_t)type;
+
+    hash.Add(BuildCacheVersion, sizeof(BuildCacheVersion));
+    hash.Add(&typeValue, sizeof(typeValue));
+    hash.Add(path.c_str(), path.size() + 1);
+    hash.Add(data.data(), data.size());
+
+    if (type == AssetType::Model)
+    {
+        uint32_t bakeValue = (bake.AmbientOcclusion ? 1 : 0) | (bake.Visibility ? 2 : 0);
+        hash.Add(&bakeValue, sizeof(bakeValue));
+
+        // OBJ materials live in separate files. Scan for them the same way ObjModel does.
+        std::wstring directory = GetDirectory(assetFilename);
+        const char* p = data.data();
+        const char* end = p + data.size();
+        while (p < end)
+        {
+            const char* line = p;
+            while (p < end && *p != '\n' && *p != '\r')
+            {
+                ++p;
+            }
+
+            if (p - line > 7 && _strnicmp(line, "mtllib ", 7) == 0)
+            {
+                std::vector<char> material;
+                if (ReadWholeFile(directory + ConvertToWide(std::string(line + 7, p)), &material))
+                {
+                    hash.Add(material.data(), material.size());
+                }
+            }
+
+            while (p < end && (*p == '\n' || *p == '\r'))
+            {
+                ++p;
+            }
+        }
+    }
+
+    if (!hash.Finish(key))
+    {
+        LogError(L"Failed to compute build key.");
+        return false;
+    }
+
+    return true;
+}
+
+bool FetchFromBuildCache(const std::wstring& key, const std::wstring& outputFilename, std::vector<SourceAsset>* dependencies, bool* hit)
+{
+    *hit = false;
+    dependencies->clear();
+
+    std::wstring cacheFilename = GetCacheFilename(key);
+    if (GetFileAttributes(cacheFilename.c_str()) == INVALID_FILE_ATTRIBUTES)
+    {
+        return true;
+    }
+
+    // The dependency list is always published before the entry itself. One "<type> <path>" per line.
+    std::vector<char> deps;
+    if (ReadWholeFile(cacheFilename + L".deps", &deps))
+    {
+        std::string text(deps.begin(), deps.end());
+        size_t start = 0;
+        while (start < text.size())
+        {
+            size_t end = text.find('\n', start);
+            if (end == std::string::npos)
+            {
+                end = text.size();
+            }
+
+            std::string line = text.substr(start, end - start);
+            size_t space = line.find(' ');
+            if (space != std::string::npos)
+            {
+                AssetType type = (AssetType)atoi(line.c_str());
+                dependencies->push_back(SourceAsset(type, ConvertFromUtf8(line.substr(space + 1))));
+            }
+
+            start = end + 1;
+        }
+    }
+
+    std::wstring tempFilename = GetTempFilename(outputFilename);
+    if (!CopyFile(cacheFilename.c_str(), tempFilename.c_str(), FALSE))
+    {
+        LogError(L"Failed to copy from build cache: %s.", cacheFilename.c_str());
+        return false;
+    }
+
+    // CopyFile keeps the cache entry's timestamp, which may be older than the source asset.
+    // Stamp the output as new so the next incremental build sees it as up to date.
+    FileHandle outputFile(CreateFile(tempFilename.c_str(), FILE_WRITE_ATTRIBUTES,
+        0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (outputFile.IsValid())
+    {
+        FILETIME now{};
+        GetSystemTimeAsFileTime(&now);
+        SetFileTime(outputFile.Get(), nullptr, nullptr, &now);
+    }
+    outputFile.Close();
+
+    if (!ReplaceOutputFile(tempFilename, outputFilename))
+    {
+        return false;
+    }
+
+    *hit = true;
+    return true;
+}
+
+bool PublishToBuildCache(const std::wstring& key, const std::wstring& outputFilename, const std::vector<SourceAsset>& dependencies)
+{
+    std::wstring cacheFilename = GetCacheFilename(key);
+    std::wstring directory = GetDirectory(cacheFilename);
+
+    // Both levels may be created concurrently by other writers
+    if ((!CreateDirectory(CacheRoot.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS) ||
+        (!CreateDirectory(directory.c_str(), nullptr) && GetLastError() != ERROR_ALREADY_EXISTS))
+    {
+        LogError(L"Failed to create cache directory: %s.", directory.c_str());
+        return false;
+    }
+
+    if (!dependencies.empty())
+    {
+        std::string text;
+        for (auto& dependency : dependencies)
+        {
+            char type[16] = {};
+            sprintf_s(type, "%d ", (int)dependency.Type);
+            text += type + ConvertToUtf8(dependency.Path) + "\n";
+        }
+
+        std::wstring depsFilename = cacheFilename + L".deps";
+        std::wstring tempFilename = GetTempFilename(depsFilename);
+
+        FileHandle depsFile(CreateFile(tempFilename.c_str(), GENERIC_WRITE,
+            0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+        DWORD bytesWritten{};
+        bool written = depsFile.IsValid() && WriteFile(depsFile.Get(), text.c_str(), (DWORD)text.size(), &bytesWritten, nullptr);
+        depsFile.Close();
+
+        if (!written)
+        {
+            DeleteFile(tempFilename.c_str());
+            LogError(L"Failed to write cache entry: %s.", tempFilename.c_str());
+            return false;
+        }
+
+        if (!PublishFile(tempFilename, depsFilename))
+        {
+            return false;
+        }
+    }
+
+    std::wstring tempFilename = GetTempFilename(cacheFilename);
+    if (!CopyFile(outputFilename.c_str(), tempFilename.c_str(), FALSE))
+    {
+        LogError(L"Failed to write cache entry: %s.", tempFilename.c_str());
+        return false;
+    }
+
+    return PublishFile(tempFilename, cacheFilename);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+// Content addressed cache of build outputs. Entries are keyed by a hash of everything that
+// affects the output, so the cache directory can be shared between any number of AssetLoader
+// processes and machines (e.g. on a network share). Entries are immutable once published.
+//
+// Layout: <CacheRoot>/<first 2 chars of key>/<key>       output file
+//                                            <key>.deps  assets the output references, if any
+
+// An empty root disables the cache
+void SetBuildCacheRoot(const std::wstring& cacheRoot);
+bool IsBuildCacheEnabled();
+
+// Hashes the tool version, asset type (which determines all other build parameters), the bakes
+// enabled for models, the source relative asset path, and the contents of the asset and any
+// material libraries it uses.
+bool ComputeBuildKey(AssetType type, const std::wstring& assetFilename, const std::wstring& assetPath, const ModelBakeOptions& bake, std::wstring* key);
+
+// On a hit, copies the cached output to outputFilename and returns its dependencies,
+// which still need to be built (or fetched) by the caller.
+bool FetchFromBuildCache(const std::wstring& key, const std::wstring& outputFilename, std::vector<SourceAsset>* dependencies, bool* hit);
+
+// Atomically publishes a built output. If another writer published the same key first,
+// their entry is kept; both are identical by construction.
+bool PublishToBuildCache(const std::wstring& key, const std::wstring& outputFilename, const std::vector<SourceAsset>& dependencies);
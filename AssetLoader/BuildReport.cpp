@@ -0,0 +1,368 @@
+#include "Precomp.h"
+#include "BuildReport.h"
+#include "Debug.h"
+#include "AssetLoader.h"
+#include "StringHelpers.h"
+
+// Only added to from BuildAsset, which ProcessAssets runs one asset at a time
+static std::vector<AssetReport> Reports;
+
+// Simulates a FIFO post-transform vertex cache, as found on most hardware, and returns
+// the number of vertices transformed per triangle. 0.5 is ideal, 3.0 is worst case.
+static float ComputeAcmr(const uint32_t* indices, uint32_t numIndices)
+{
+    static const uint32_t CacheSize = 32;
+
+    uint32_t cache[CacheSize];
+    memset(cache, 0xFF, sizeof(cache));
+
+    uint32_t next = 0;
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i < numIndices; ++i)
+    {
+        bool hit = false;
+        for (uint32_t c = 0; c < CacheSize; ++c)
+        {
+            if (cache[c] == indices[i])
+            {
+                hit = true;
+                break;
+            }
+        }
+
+        if (!hit)
+        {
+            cache[next] = indices[i];
+            next = (next + 1) % CacheSize;
+            ++misses;
+        }
+    }
+
+    uint32_t numTriangles = numIndices / 3;
+    return numTriangles > 0 ? (float)misses / numTriangles : 0.f;
+}
+
+static const char* FormatName(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:    return "R8G8B8A8_UNORM";
+    case DXGI_FORMAT_B8G8R8A8_UNORM:    return "B8G8R8A8_UNORM";
+    case DXGI_FORMAT_B8G8R8X8_UNORM:    return "B8G8R8X8_UNORM";
+    case DXGI_FORMAT_R8G8_UNORM:        return "R8G8_UNORM";
+    case DXGI_FORMAT_R8_UNORM:          return "R8_UNORM";
+    case DXGI_FORMAT_R16_UNORM:         return "R16_UNORM";
+    case DXGI_FORMAT_BC1_UNORM:         return "BC1_UNORM";
+    case DXGI_FORMAT_BC2_UNORM:         return "BC2_UNORM";
+    case DXGI_FORMAT_BC3_UNORM:         return "BC3_UNORM";
+    case DXGI_FORMAT_BC4_UNORM:         return "BC4_UNORM";
+    case DXGI_FORMAT_BC5_UNORM:         return "BC5_UNORM";
+    case DXGI_FORMAT_BC7_UNORM:         return "BC7_UNORM";
+    case DXGI_FORMAT_UNKNOWN:           return "";
+    default:                            return "OTHER";
+    }
+}
+
+static std::string EscapeJson(const std::wstring& input)
+{
+    std::string utf8 = ConvertToUtf8(input);
+    std::string output;
+    for (size_t i = 0; i < utf8.size(); ++i)
+    {
+        if ((uint8_t)utf8[i] < 0x20)
+        {
+            // Control characters aren't allowed in JSON strings as they are
+            char escaped[8];
+            sprintf_s(escaped, "\\u%04x", (uint8_t)utf8[i]);
+            output += escaped;
+            continue;
+        }
+
+        if (utf8[i] == '"' || utf8[i] == '\\')
+        {
+            output.push_back('\\');
+        }
+        output.push_back(utf8[i]);
+    }
+    return output;
+}
+
+// Quotes a CSV field and doubles any quotes in it (RFC 4180), so commas & line breaks are kept
+static std::string QuoteCsv(const std::wstring& input)
+{
+    std::string utf8 = ConvertToUtf8(input);
+    std::string output("\"");
+    for (size_t i = 0; i < utf8.size(); ++i)
+    {
+        if (utf8[i] == '"')
+        {
+            output.push_back('"');
+        }
+        output.push_back(utf8[i]);
+    }
+    output.push_back('"');
+    return output;
+}
+
+static bool ReadExactly(HANDLE file, void* data, DWORD size)
+{
+    DWORD bytesRead{};
+    return ReadFile(file, data, size, &bytesRead, nullptr) && bytesRead == size;
+}
+
+bool AnalyzeOutputFile(const std::wstring& outputFilename, AssetReport* report)
+{
+    FileHandle file(CreateFile(outputFilename.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid())
+    {
+        LogError(L"Failed to open output file: %s.", outputFilename.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(file.Get(), &fileSize);
+    report->FileBytes = (uint64_t)fileSize.QuadPart;
+
+    DWORD bytesRead{};
+    uint32_t signature = 0;
+    if (!ReadFile(file.Get(), &signature, sizeof(signature), &bytesRead, nullptr) || bytesRead != sizeof(signature))
+    {
+        LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+        return false;
+    }
+
+    LARGE_INTEGER offset{};
+    SetFilePointerEx(file.Get(), offset, nullptr, FILE_BEGIN);
+
+    if (signature == ModelHeader::ExpectedSignature)
+    {
+        ModelHeader header{};
+        if (!ReadFile(file.Get(), &header, sizeof(header), &bytesRead, nullptr))
+        {
+            LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+            return false;
+        }
+
+        report->NumVertices = header.NumVertices;
+        report->NumIndices = header.NumIndices;
+        report->NumObjects = header.NumObjects;
+        report->VertexBytes = (uint64_t)header.NumVertices * sizeof(ModelVertex);
+        report->IndexBytes = (uint64_t)header.NumIndices * sizeof(uint32_t);
+
+        // Only the indices are needed for the cache simulation
+        offset.QuadPart = (LONGLONG)(sizeof(header) + report->VertexBytes);
+        SetFilePointerEx(file.Get(), offset, nullptr, FILE_BEGIN);
+
+        std::unique_ptr<uint32_t[]> indices(new uint32_t[header.NumIndices]);
+        if (!ReadFile(file.Get(), indices.get(), (DWORD)report->IndexBytes, &bytesRead, nullptr))
+        {
+            LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+            return false;
+        }
+
+        report->Acmr = ComputeAcmr(indices.get(), header.NumIndices);
+
+        // Then the objects, each followed by its parts
+        for (uint32_t i = 0; i < header.NumObjects; ++i)
+        {
+            ModelObject object{};
+            if (!ReadExactly(file.Get(), &object, sizeof(object)))
+            {
+                LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+                return false;
+            }
+
+            report->NumParts += object.NumParts;
+            report->ObjectBytes += sizeof(object) + (uint64_t)object.NumParts * sizeof(ModelPart);
+            offset.QuadPart = (LONGLONG)(object.NumParts * sizeof(ModelPart));
+            SetFilePointerEx(file.Get(), offset, nullptr, FILE_CURRENT);
+        }
+
+        // Then any baked chunks, each starting with its signature
+        uint64_t chunkOffset = sizeof(header) + report->VertexBytes + report->IndexBytes + report->ObjectBytes;
+        while (chunkOffset + sizeof(signature) <= report->FileBytes)
+        {
+            offset.QuadPart = (LONGLONG)chunkOffset;
+            SetFilePointerEx(file.Get(), offset, nullptr, FILE_BEGIN);
+            if (!ReadExactly(file.Get(), &signature, sizeof(signature)))
+            {
+                LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+                return false;
+            }
+            SetFilePointerEx(file.Get(), offset, nullptr, FILE_BEGIN);
+
+            uint64_t chunkBytes = 0;
+            if (signature == ModelAmbientHeader::ExpectedSignature)
+            {
+                ModelAmbientHeader ambientHeader{};
+                if (!ReadExactly(file.Get(), &ambientHeader, sizeof(ambientHeader)))
+                {
+                    LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+                    return false;
+                }
+                chunkBytes = sizeof(ambientHeader) + (uint64_t)ambientHeader.NumVertices * sizeof(ModelAmbientVertex);
+                report->AmbientBytes += chunkBytes;
+            }
+            else if (signature == ModelVisibilityHeader::ExpectedSignature)
+            {
+                ModelVisibilityHeader visibilityHeader{};
+                if (!ReadExactly(file.Get(), &visibilityHeader, sizeof(visibilityHeader)))
+                {
+                    LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+                    return false;
+                }
+                uint64_t numWords = (uint64_t)visibilityHeader.CellsX * visibilityHeader.CellsY * visibilityHeader.CellsZ * visibilityHeader.WordsPerCell;
+                chunkBytes = sizeof(visibilityHeader) + numWords * sizeof(uint32_t);
+                report->VisibilityBytes += chunkBytes;
+            }
+            else
+            {
+                LogError(L"Unknown chunk in model file: %s.", outputFilename.c_str());
+                return false;
+            }
+
+            chunkOffset += chunkBytes;
+        }
+    }
+    else if (signature == TextureHeader::ExpectedSignature)
+    {
+        TextureHeader header{};
+        if (!ReadFile(file.Get(), &header, sizeof(header), &bytesRead, nullptr))
+        {
+            LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+            return false;
+        }
+
+        report->Width = header.Width;
+        report->Height = header.Height;
+        report->MipLevels = header.MipLevels;
+        report->Format = header.Format;
+        report->PixelBytes = report->FileBytes - sizeof(header);
+    }
+    else if (signature == VirtualTextureHeader::ExpectedSignature)
+    {
+        VirtualTextureHeader header{};
+        if (!ReadFile(file.Get(), &header, sizeof(header), &bytesRead, nullptr))
+        {
+            LogError(L"Failed to read output file: %s.", outputFilename.c_str());
+            return false;
+        }
+
+        report->Width = header.Width;
+        report->Height = header.Height;
+        report->MipLevels = header.MipLevels;
+        report->Format = header.Format;
+        report->NumTiles = header.NumTiles;
+        report->PixelBytes = (uint64_t)header.NumTiles * header.PageSize;
+    }
+    else
+    {
+        LogError(L"Unknown output file type: %s.", outputFilename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void AddAssetReport(const AssetReport& report)
+{
+    for (auto& existing : Reports)
+    {
+        if (existing.Output == report.Output)
+        {
+            return;
+        }
+    }
+
+    Reports.push_back(report);
+}
+
+static bool WriteTextFile(const std::wstring& filename, const std::string& text)
+{
+    FileHandle file(CreateFile(filename.c_str(), GENERIC_WRITE,
+        0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid())
+    {
+        LogError(L"Failed to create report file: %s.", filename.c_str());
+        return false;
+    }
+
+    DWORD bytesWritten{};
+    if (!WriteFile(file.Get(), text.c_str(), (DWORD)text.size(), &bytesWritten, nullptr))
+    {
+        LogError(L"Error writing report file.");
+        return false;
+    }
+
+    return true;
+}
+
+bool WriteBuildReport(const std::wstring& outputRoot, const std::wstring& reportName)
+{
+    char line[2048];
+
+    uint64_t totalFileBytes = 0;
+    uint64_t totalVertexBytes = 0;
+    uint64_t totalIndexBytes = 0;
+    uint64_t totalPixelBytes = 0;
+    double totalBuildMs = 0.0;
+
+    std::string json = "{\n  \"assets\": [\n";
+    std::string csv = "type,source,output,built,cached,build_ms,file_bytes,vertices,indices,objects,parts,acmr,"
+        "vertex_bytes,index_bytes,object_bytes,ambient_bytes,visibility_bytes,width,height,mips,format,pixel_bytes,tiles\n";
+
+    for (size_t i = 0; i < Reports.size(); ++i)
+    {
+        const AssetReport& r = Reports[i];
+        std::string type = ConvertToUtf8(r.Type);
+        std::string source = EscapeJson(r.Source);
+        std::string output = EscapeJson(r.Output);
+
+        // Paths have no length limit, so only the fixed size fields go through line
+        json += "    { \"type\": \"" + type + "\", \"source\": \"" + source + "\", \"output\": \"" + output + "\", ";
+        sprintf_s(line,
+            "\"built\": %s, \"cached\": %s, \"buildMs\": %.3f, \"fileBytes\": %llu,\n"
+            "      \"vertices\": %u, \"indices\": %u, \"objects\": %u, \"parts\": %u, \"acmr\": %.4f,\n"
+            "      \"vertexBytes\": %llu, \"indexBytes\": %llu, \"objectBytes\": %llu, \"ambientBytes\": %llu, \"visibilityBytes\": %llu,\n"
+            "      \"width\": %u, \"height\": %u, \"mips\": %u, \"format\": \"%s\", \"pixelBytes\": %llu, \"tiles\": %u }%s\n",
+            r.Built ? "true" : "false", r.Cached ? "true" : "false", r.BuildMs, r.FileBytes,
+            r.NumVertices, r.NumIndices, r.NumObjects, r.NumParts, r.Acmr,
+            r.VertexBytes, r.IndexBytes, r.ObjectBytes, r.AmbientBytes, r.VisibilityBytes,
+            r.Width, r.Height, r.MipLevels, FormatName(r.Format), r.PixelBytes, r.NumTiles,
+            (i + 1 < Reports.size()) ? "," : "");
+        json += line;
+
+        csv += QuoteCsv(r.Type) + "," + QuoteCsv(r.Source) + "," + QuoteCsv(r.Output) + ",";
+        sprintf_s(line, "%d,%d,%.3f,%llu,%u,%u,%u,%u,%.4f,%llu,%llu,%llu,%llu,%llu,%u,%u,%u,%s,%llu,%u\n",
+            r.Built ? 1 : 0, r.Cached ? 1 : 0, r.BuildMs, r.FileBytes,
+            r.NumVertices, r.NumIndices, r.NumObjects, r.NumParts, r.Acmr,
+            r.VertexBytes, r.IndexBytes, r.ObjectBytes, r.AmbientBytes, r.VisibilityBytes,
+            r.Width, r.Height, r.MipLevels, FormatName(r.Format), r.PixelBytes, r.NumTiles);
+        csv += line;
+
+        totalFileBytes += r.FileBytes;
+        totalVertexBytes += r.VertexBytes;
+        totalIndexBytes += r.IndexBytes;
+        totalPixelBytes += r.PixelBytes;
+        if (r.Type != L"texture")
+        {
+            // Textures are already counted in the time of the model that built them
+            totalBuildMs += r.BuildMs;
+        }
+    }
+
+    sprintf_s(line,
+        "  ],\n  \"totals\": { \"assets\": %u, \"buildMs\": %.3f, \"fileBytes\": %llu, \"vertexBytes\": %llu, \"indexBytes\": %llu, \"pixelBytes\": %llu }\n}\n",
+        (uint32_t)Reports.size(), totalBuildMs, totalFileBytes, totalVertexBytes, totalIndexBytes, totalPixelBytes);
+    json += line;
+
+    if (!WriteTextFile(outputRoot + reportName + L".json", json) ||
+        !WriteTextFile(outputRoot + reportName + L".csv", csv))
+    {
+        LogError(L"Failed to write build report.");
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// Statistics for one built asset, gathered from its output file so up to date assets
+// that were skipped are still reported.
+struct AssetReport
+{
+    std::wstring Type;          // Output extension: model, texture, vtexture
+    std::wstring Source;        // Relative to SourceRoot
+    std::wstring Output;        // Relative to OutputRoot
+    bool Built;                 // false if the output was already up to date
+    bool Cached;                // Built by fetching from the build cache
+    double BuildMs;             // Includes any textures built on behalf of a model
+    uint64_t FileBytes;
+
+    // Model
+    uint32_t NumVertices;
+    uint32_t NumIndices;
+    uint32_t NumObjects;
+    uint32_t NumParts;          // One draw range each
+    float Acmr;                 // Average post-transform cache misses per triangle, 32 entry FIFO
+    uint64_t VertexBytes;
+    uint64_t IndexBytes;
+    uint64_t ObjectBytes;       // ModelObject and ModelPart entries
+    uint64_t AmbientBytes;      // ModelAmbientHeader and its vertices, if baked
+    uint64_t VisibilityBytes;   // ModelVisibilityHeader and its cells, if baked
+
+    // Texture & virtual texture
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t MipLevels;
+    DXGI_FORMAT Format;
+    uint64_t PixelBytes;        // For virtual textures, all pages
+    uint32_t NumTiles;
+};
+
+// Fills in the size and content statistics for an output file
+bool AnalyzeOutputFile(const std::wstring& outputFilename, AssetReport* report);
+
+// Adds to the report for this run. Assets reported more than once (textures shared by
+// several models) are only kept once. Not thread safe.
+void AddAssetReport(const AssetReport& report);
+
+// Writes <reportName>.json and <reportName>.csv to the output root
+bool WriteBuildReport(const std::wstring& outputRoot, const std::wstring& reportName);
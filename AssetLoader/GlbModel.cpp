@@ -0,0 +1,717 @@
+#include "Precomp.h"
+#include "GlbModel.h"
+#include "ObjModel.h"
+#include "Json.h"
+#include "Debug.h"
+#include "StringHelpers.h"
+
+#pragma pack(push, 1)
+
+struct GlbHeader
+{
+    static const uint32_t ExpectedMagic = 0x46546C67;   // 'glTF'
+
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Length;
+};
+
+struct GlbChunkHeader
+{
+    static const uint32_t JsonType = 0x4E4F534A;        // 'JSON'
+    static const uint32_t BinType = 0x004E4942;         // 'BIN\0'
+
+    uint32_t Length;
+    uint32_t Type;
+};
+
+#pragma pack(pop)
+
+// glTF component types
+static const uint32_t ComponentUnsignedByte = 5121;
+static const uint32_t ComponentUnsignedShort = 5123;
+static const uint32_t ComponentUnsignedInt = 5125;
+static const uint32_t ComponentFloat = 5126;
+
+static const uint32_t ModeTriangles = 4;
+
+// A typed view directly into the mapped binary chunk. Nothing is copied.
+struct GlbAccessor
+{
+    const uint8_t* Data;
+    uint32_t Count;
+    uint32_t Stride;
+    uint32_t ComponentType;
+    uint32_t NumComponents;
+    bool Normalized;
+};
+
+// Unmaps the view when going out of scope
+struct MappedView
+{
+    const uint8_t* Data;
+
+    MappedView(const void* data) : Data((const uint8_t*)data) {}
+    ~MappedView() { if (Data) UnmapViewOfFile(Data); }
+};
+
+// Whole numbers read from the JSON, or -1 if missing, negative, fractional or too big. Casting
+// those straight to an unsigned (or too small) type is undefined
+static int64_t ToInteger(double value)
+{
+    return (value >= 0.0 && value <= 9007199254740992.0 && value == floor(value)) ? (int64_t)value : -1;
+}
+
+static int ToIndex(double value)
+{
+    int64_t index = ToInteger(value);
+    return index <= INT32_MAX ? (int)index : -1;
+}
+
+static uint32_t ComponentSize(uint32_t componentType)
+{
+    switch (componentType)
+    {
+    case ComponentUnsignedByte:     return 1;
+    case ComponentUnsignedShort:    return 2;
+    case ComponentUnsignedInt:      return 4;
+    case ComponentFloat:            return 4;
+    default:                        return 0;
+    }
+}
+
+static uint32_t NumComponents(const std::string& type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    return 0;
+}
+
+static bool GetAccessor(const JsonValue& gltf, const uint8_t* bin, uint64_t binSize, int index, GlbAccessor* accessor)
+{
+    const JsonValue* accessors = gltf.Find("accessors");
+    const JsonValue* desc = (accessors && index >= 0) ? accessors->At((size_t)index) : nullptr;
+    if (!desc)
+    {
+        LogError(L"Invalid accessor index %d.", index);
+        return false;
+    }
+
+    const JsonValue* bufferViews = gltf.Find("bufferViews");
+    int viewIndex = ToIndex(desc->GetNumber("bufferView", -1));
+    const JsonValue* view = (bufferViews && viewIndex >= 0) ? bufferViews->At((size_t)viewIndex) : nullptr;
+    if (!view)
+    {
+        // Sparse or zero-initialized accessors aren't supported
+        LogError(L"Accessor %d has no buffer view.", index);
+        return false;
+    }
+
+    if (view->GetNumber("buffer", 0) != 0)
+    {
+        LogError(L"Only the embedded GLB binary buffer is supported.");
+        return false;
+    }
+
+    int64_t count = ToInteger(desc->GetNumber("count", 0));
+    int64_t stride = ToInteger(view->GetNumber("byteStride", 0));
+    int64_t viewOffset = ToInteger(view->GetNumber("byteOffset", 0));
+    int64_t viewLength = ToInteger(view->GetNumber("byteLength", 0));
+    int64_t accessorOffset = ToInteger(desc->GetNumber("byteOffset", 0));
+    if (count < 0 || count > UINT32_MAX || stride < 0 || stride > UINT32_MAX || viewOffset < 0 || viewLength < 0 || accessorOffset < 0)
+    {
+        LogError(L"Invalid sizes on accessor %d.", index);
+        return false;
+    }
+
+    accessor->Count = (uint32_t)count;
+    accessor->ComponentType = (uint32_t)ToInteger(desc->GetNumber("componentType", 0));
+    accessor->NumComponents = NumComponents(desc->GetString("type"));
+    const JsonValue* normalized = desc->Find("normalized");
+    accessor->Normalized = normalized && normalized->Bool;
+
+    uint32_t elementSize = ComponentSize(accessor->ComponentType) * accessor->NumComponents;
+    if (elementSize == 0)
+    {
+        LogError(L"Unsupported accessor format on accessor %d.", index);
+        return false;
+    }
+
+    accessor->Stride = (uint32_t)stride;
+    if (accessor->Stride == 0)
+    {
+        accessor->Stride = elementSize;
+    }
+
+    uint64_t offset = (uint64_t)viewOffset + (uint64_t)accessorOffset;
+    uint64_t length = accessor->Count > 0 ? (uint64_t)accessor->Stride * (accessor->Count - 1) + elementSize : 0;
+    if (offset + length > binSize || length > (uint64_t)viewLength)
+    {
+        LogError(L"Accessor %d is out of bounds.", index);
+        return false;
+    }
+
+    accessor->Data = bin + offset;
+    return true;
+}
+
+// Attributes are read assuming a fixed layout, and the accessor's length was only validated for its
+// own format, so one that doesn't match would read past it. POSITION & NORMAL must be float VEC3,
+// TEXCOORD_0 float VEC2 (or the normalized integer VEC2s glTF also allows), and indices unsigned
+// integer SCALARs.
+static bool IsFloatVector(const GlbAccessor& accessor, uint32_t numComponents)
+{
+    return accessor.NumComponents == numComponents && accessor.ComponentType == ComponentFloat;
+}
+
+static bool IsTexCoord(const GlbAccessor& accessor)
+{
+    return IsFloatVector(accessor, 2) ||
+        (accessor.NumComponents == 2 && accessor.Normalized &&
+        (accessor.ComponentType == ComponentUnsignedByte || accessor.ComponentType == ComponentUnsignedShort));
+}
+
+static bool IsIndexScalar(const GlbAccessor& accessor)
+{
+    return accessor.NumComponents == 1 &&
+        (accessor.ComponentType == ComponentUnsignedByte || accessor.ComponentType == ComponentUnsignedShort ||
+        accessor.ComponentType == ComponentUnsignedInt);
+}
+
+// Reads component c of element i as a float, applying normalization for integer types
+static float ReadFloat(const GlbAccessor& accessor, uint32_t i, uint32_t c)
+{
+    const uint8_t* p = accessor.Data + (size_t)i * accessor.Stride;
+    switch (accessor.ComponentType)
+    {
+    case ComponentFloat:
+    {
+        float value;
+        memcpy(&value, p + c * 4, sizeof(value));
+        return value;
+    }
+    case ComponentUnsignedByte:
+        return accessor.Normalized ? p[c] / 255.f : (float)p[c];
+    case ComponentUnsignedShort:
+    {
+        uint16_t value;
+        memcpy(&value, p + c * 2, sizeof(value));
+        return accessor.Normalized ? value / 65535.f : (float)value;
+    }
+    default:
+        return 0.f;
+    }
+}
+
+static uint32_t ReadIndex(const GlbAccessor& accessor, uint32_t i)
+{
+    const uint8_t* p = accessor.Data + (size_t)i * accessor.Stride;
+    switch (accessor.ComponentType)
+    {
+    case ComponentUnsignedByte:
+        return *p;
+    case ComponentUnsignedShort:
+    {
+        uint16_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    case ComponentUnsignedInt:
+    {
+        uint32_t value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+    default:
+        return 0;
+    }
+}
+
+static std::wstring DecodeUri(const std::string& uri)
+{
+    std::string decoded;
+    for (size_t i = 0; i < uri.size(); ++i)
+    {
+        if (uri[i] == '%' && i + 2 < uri.size())
+        {
+            char hex[3] = { uri[i + 1], uri[i + 2], 0 };
+            decoded.push_back((char)strtoul(hex, nullptr, 16));
+            i += 2;
+        }
+        else
+        {
+            decoded.push_back(uri[i]);
+        }
+    }
+    return ConvertToWide(decoded);
+}
+
+static std::wstring GetTexturePath(const JsonValue& gltf, const JsonValue* textureInfo, const std::wstring& basePath)
+{
+    if (!textureInfo)
+    {
+        return std::wstring();
+    }
+
+    const JsonValue* textures = gltf.Find("textures");
+    int textureIndex = ToIndex(textureInfo->GetNumber("index", -1));
+    const JsonValue* texture = (textures && textureIndex >= 0) ? textures->At((size_t)textureIndex) : nullptr;
+    const JsonValue* images = gltf.Find("images");
+    int imageIndex = texture ? ToIndex(texture->GetNumber("source", -1)) : -1;
+    const JsonValue* image = (images && imageIndex >= 0) ? images->At((size_t)imageIndex) : nullptr;
+    if (!image)
+    {
+        return std::wstring();
+    }
+
+    const std::string& uri = image->GetString("uri");
+    if (uri.empty() || _strnicmp(uri.c_str(), "data:", 5) == 0)
+    {
+        // Images embedded in buffer views or data URIs would need to be extracted to disk first
+        Log(L"Skipping embedded image. Only external image files are supported.");
+        return std::wstring();
+    }
+
+    return basePath + DecodeUri(uri);
+}
+
+static XMMATRIX GetLocalTransform(const JsonValue& node)
+{
+    const JsonValue* matrix = node.Find("matrix");
+    if (matrix && matrix->Size() == 16)
+    {
+        // glTF stores column major, column vector matrices, which is the same memory
+        // layout as our row major, row vector convention.
+        XMFLOAT4X4 m;
+        for (int i = 0; i < 16; ++i)
+        {
+            m.m[i / 4][i % 4] = (float)matrix->At(i)->Number;
+        }
+        return XMLoadFloat4x4(&m);
+    }
+
+    XMVECTOR scale = XMVectorSplatOne();
+    XMVECTOR rotation = XMQuaternionIdentity();
+    XMVECTOR translation = XMVectorZero();
+
+    const JsonValue* s = node.Find("scale");
+    if (s && s->Size() == 3)
+    {
+        scale = XMVectorSet((float)s->At(0)->Number, (float)s->At(1)->Number, (float)s->At(2)->Number, 0.f);
+    }
+    const JsonValue* r = node.Find("rotation");
+    if (r && r->Size() == 4)
+    {
+        rotation = XMVectorSet((float)r->At(0)->Number, (float)r->At(1)->Number, (float)r->At(2)->Number, (float)r->At(3)->Number);
+    }
+    const JsonValue* t = node.Find("translation");
+    if (t && t->Size() == 3)
+    {
+        translation = XMVectorSet((float)t->At(0)->Number, (float)t->At(1)->Number, (float)t->At(2)->Number, 1.f);
+    }
+
+    return XMMatrixScalingFromVector(scale) * XMMatrixRotationQuaternion(rotation) * XMMatrixTranslationFromVector(translation);
+}
+
+static bool ImportMesh(const JsonValue& gltf, const uint8_t* bin, uint64_t binSize, const JsonValue& node, FXMMATRIX world, ObjModel* model)
+{
+    const JsonValue* meshes = gltf.Find("meshes");
+    int meshIndex = ToIndex(node.GetNumber("mesh", -1));
+    const JsonValue* mesh = (meshes && meshIndex >= 0) ? meshes->At((size_t)meshIndex) : nullptr;
+    if (!mesh)
+    {
+        LogError(L"Invalid mesh index.");
+        return false;
+    }
+
+    model->Objects.push_back(ObjModelObject());
+    ObjModelObject& object = model->Objects.back();
+    object.Name = node.GetString("name");
+    if (object.Name.empty())
+    {
+        object.Name = mesh->GetString("name");
+    }
+
+    XMVECTOR det;
+    XMMATRIX normalTransform = XMMatrixTranspose(XMMatrixInverse(&det, world));
+
+    const JsonValue* materials = gltf.Find("materials");
+    const JsonValue* primitives = mesh->Find("primitives");
+    for (size_t iPrim = 0; primitives && iPrim < primitives->Size(); ++iPrim)
+    {
+        const JsonValue& primitive = *primitives->At(iPrim);
+        if (primitive.GetNumber("mode", ModeTriangles) != ModeTriangles)
+        {
+            Log(L"Skipping non triangle list primitive.");
+            continue;
+        }
+
+        const JsonValue* attributes = primitive.Find("attributes");
+        if (!attributes || !attributes->Find("POSITION"))
+        {
+            LogError(L"Primitive has no positions.");
+            return false;
+        }
+
+        GlbAccessor positions{};
+        if (!GetAccessor(gltf, bin, binSize, ToIndex(attributes->GetNumber("POSITION", -1)), &positions))
+        {
+            return false;
+        }
+        if (!IsFloatVector(positions, 3))
+        {
+            LogError(L"Positions must be float VEC3.");
+            return false;
+        }
+
+        GlbAccessor normals{};
+        bool hasNormals = attributes->Find("NORMAL") != nullptr;
+        if (hasNormals)
+        {
+            if (!GetAccessor(gltf, bin, binSize, ToIndex(attributes->GetNumber("NORMAL", -1)), &normals))
+            {
+                return false;
+            }
+            if (!IsFloatVector(normals, 3) || normals.Count < positions.Count)
+            {
+                LogError(L"Normals must be float VEC3, one per position.");
+                return false;
+            }
+        }
+
+        GlbAccessor texCoords{};
+        bool hasTexCoords = attributes->Find("TEXCOORD_0") != nullptr;
+        if (hasTexCoords)
+        {
+            if (!GetAccessor(gltf, bin, binSize, ToIndex(attributes->GetNumber("TEXCOORD_0", -1)), &texCoords))
+            {
+                return false;
+            }
+            if (!IsTexCoord(texCoords) || texCoords.Count < positions.Count)
+            {
+                LogError(L"Texture coordinates must be VEC2, one per position.");
+                return false;
+            }
+        }
+
+        uint32_t baseVertex = (uint32_t)model->Vertices.size();
+        model->Vertices.resize(baseVertex + positions.Count);
+
+        for (uint32_t i = 0; i < positions.Count; ++i)
+        {
+            ModelVertex& v = model->Vertices[baseVertex + i];
+            memset(&v, 0, sizeof(v));
+
+            XMFLOAT3 position(ReadFloat(positions, i, 0), ReadFloat(positions, i, 1), ReadFloat(positions, i, 2));
+            XMStoreFloat3(&v.Position, XMVector3TransformCoord(XMLoadFloat3(&position), world));
+
+            if (hasNormals)
+            {
+                XMFLOAT3 normal(ReadFloat(normals, i, 0), ReadFloat(normals, i, 1), ReadFloat(normals, i, 2));
+                XMStoreFloat3(&v.Normal, XMVector3Normalize(XMVector3TransformNormal(XMLoadFloat3(&normal), normalTransform)));
+            }
+
+            if (hasTexCoords)
+            {
+                // U is mirrored to match the ObjModel texcoord convention, so both importers
+                // produce the same .model output. glTF V is already top down.
+                v.TexCoord = XMFLOAT2(1.f - ReadFloat(texCoords, i, 0), ReadFloat(texCoords, i, 1));
+            }
+        }
+
+        ObjModelPart part{};
+        part.StartIndex = (uint32_t)model->Indices.size();
+
+        const JsonValue* indicesIndex = primitive.Find("indices");
+        if (indicesIndex)
+        {
+            GlbAccessor indices{};
+            if (!GetAccessor(gltf, bin, binSize, ToIndex(indicesIndex->Number), &indices))
+            {
+                return false;
+            }
+            if (!IsIndexScalar(indices))
+            {
+                LogError(L"Indices must be unsigned integer SCALAR.");
+                return false;
+            }
+
+            model->Indices.resize(part.StartIndex + indices.Count);
+            uint32_t* pDst = model->Indices.data() + part.StartIndex;
+            for (uint32_t i = 0; i < indices.Count; ++i)
+            {
+                uint32_t index = ReadIndex(indices, i);
+                if (index >= positions.Count)
+                {
+                    LogError(L"Index out of range.");
+                    return false;
+                }
+
+                // Parts share one vertex range at runtime, so indices are made absolute
+                pDst[i] = baseVertex + index;
+            }
+            part.NumIndices = indices.Count;
+        }
+        else
+        {
+            for (uint32_t i = 0; i < positions.Count; ++i)
+            {
+                model->Indices.push_back(baseVertex + i);
+            }
+            part.NumIndices = positions.Count;
+        }
+
+        // Everything after reads indices three at a time
+        if (part.NumIndices % 3 != 0)
+        {
+            LogError(L"Primitive's index count isn't a multiple of 3.");
+            return false;
+        }
+
+        if (!hasNormals)
+        {
+            // Fall back to face normals, accumulated per vertex
+            for (uint32_t i = part.StartIndex; i + 2 < part.StartIndex + part.NumIndices; i += 3)
+            {
+                ModelVertex& a = model->Vertices[model->Indices[i]];
+                ModelVertex& b = model->Vertices[model->Indices[i + 1]];
+                ModelVertex& c = model->Vertices[model->Indices[i + 2]];
+                XMVECTOR pa = XMLoadFloat3(&a.Position);
+                XMVECTOR n = XMVector3Cross(XMLoadFloat3(&b.Position) - pa, XMLoadFloat3(&c.Position) - pa);
+                XMStoreFloat3(&a.Normal, XMLoadFloat3(&a.Normal) + n);
+                XMStoreFloat3(&b.Normal, XMLoadFloat3(&b.Normal) + n);
+                XMStoreFloat3(&c.Normal, XMLoadFloat3(&c.Normal) + n);
+            }
+            for (uint32_t i = baseVertex; i < (uint32_t)model->Vertices.size(); ++i)
+            {
+                XMStoreFloat3(&model->Vertices[i].Normal, XMVector3Normalize(XMLoadFloat3(&model->Vertices[i].Normal)));
+            }
+        }
+
+        int materialIndex = ToIndex(primitive.GetNumber("material", -1));
+        if (materials && materialIndex >= 0 && materials->At((size_t)materialIndex))
+        {
+            const JsonValue& material = *materials->At((size_t)materialIndex);
+            part.Material = material.GetString("name");
+            if (part.Material.empty())
+            {
+                char name[32] = {};
+                sprintf_s(name, "material%d", materialIndex);
+                part.Material = name;
+            }
+        }
+
+        object.Parts.push_back(part);
+    }
+
+    return true;
+}
+
+static bool ImportNode(const JsonValue& gltf, const uint8_t* bin, uint64_t binSize, int nodeIndex, FXMMATRIX parentWorld, int depth, ObjModel* model)
+{
+    const JsonValue* nodes = gltf.Find("nodes");
+    const JsonValue* node = (nodes && nodeIndex >= 0) ? nodes->At((size_t)nodeIndex) : nullptr;
+    if (!node || depth > 64)
+    {
+        LogError(L"Invalid node hierarchy.");
+        return false;
+    }
+
+    XMMATRIX world = GetLocalTransform(*node) * parentWorld;
+
+    if (node->Find("mesh"))
+    {
+        if (!ImportMesh(gltf, bin, binSize, *node, world, model))
+        {
+            return false;
+        }
+    }
+
+    const JsonValue* children = node->Find("children");
+    for (size_t i = 0; children && i < children->Size(); ++i)
+    {
+        if (!ImportNode(gltf, bin, binSize, ToIndex(children->At(i)->Number), world, depth + 1, model))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool LoadGlbModel(const wchar_t* filename, ObjModel* model)
+{
+    FileHandle file(CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid())
+    {
+        LogError(L"Failed to open file %s.", filename);
+        return false;
+    }
+
+    // Doesn't currently support files over 4GB
+    DWORD fileSize = GetFileSize(file.Get(), nullptr);
+    if (fileSize < sizeof(GlbHeader) + sizeof(GlbChunkHeader))
+    {
+        LogError(L"File too small to be a GLB file.");
+        return false;
+    }
+
+    HandleT<HandleTraits::HANDLENullTraits> mapping(CreateFileMapping(file.Get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+    if (!mapping.IsValid())
+    {
+        LogError(L"Failed to map file.");
+        return false;
+    }
+
+    MappedView view(MapViewOfFile(mapping.Get(), FILE_MAP_READ, 0, 0, 0));
+    if (!view.Data)
+    {
+        LogError(L"Failed to map view of file.");
+        return false;
+    }
+
+    const GlbHeader* header = (const GlbHeader*)view.Data;
+    if (header->Magic != GlbHeader::ExpectedMagic || header->Version != 2 || header->Length > fileSize)
+    {
+        LogError(L"Invalid GLB file.");
+        return false;
+    }
+
+    const GlbChunkHeader* jsonChunk = (const GlbChunkHeader*)(view.Data + sizeof(GlbHeader));
+    const uint8_t* jsonData = (const uint8_t*)(jsonChunk + 1);
+    if (jsonChunk->Type != GlbChunkHeader::JsonType || jsonData + jsonChunk->Length > view.Data + header->Length)
+    {
+        LogError(L"Invalid GLB JSON chunk.");
+        return false;
+    }
+
+    // The binary chunk is optional, and immediately follows the (4 byte aligned) JSON chunk
+    const uint8_t* bin = nullptr;
+    uint64_t binSize = 0;
+    const uint8_t* next = jsonData + jsonChunk->Length;
+    if (next + sizeof(GlbChunkHeader) <= view.Data + header->Length)
+    {
+        const GlbChunkHeader* binChunk = (const GlbChunkHeader*)next;
+        bin = (const uint8_t*)(binChunk + 1);
+        binSize = binChunk->Length;
+        if (binChunk->Type != GlbChunkHeader::BinType || bin + binSize > view.Data + header->Length)
+        {
+            LogError(L"Invalid GLB binary chunk.");
+            return false;
+        }
+    }
+
+    JsonValue gltf;
+    if (!ParseJson((const char*)jsonData, jsonChunk->Length, &gltf))
+    {
+        LogError(L"Failed to parse GLB JSON chunk.");
+        return false;
+    }
+
+    wchar_t basePath[1024] = {};
+    wcscpy_s(basePath, filename);
+
+    wchar_t* slash1 = wcsrchr(basePath, L'\\');
+    wchar_t* slash2 = wcsrchr(basePath, L'/');
+    if (!slash1) slash1 = slash2;
+    if (slash1 && slash2 && slash2 > slash1)
+    {
+        slash1 = slash2;
+    }
+    if (slash1)
+    {
+        *(slash1 + 1) = 0;
+    }
+    else
+    {
+        basePath[0] = 0;
+    }
+
+    // Materials map onto the same texture slots the OBJ material library uses
+    const JsonValue* materials = gltf.Find("materials");
+    for (size_t i = 0; materials && i < materials->Size(); ++i)
+    {
+        const JsonValue& src = *materials->At(i);
+
+        ObjMaterial material{};
+        material.Name = src.GetString("name");
+        if (material.Name.empty())
+        {
+            char name[32] = {};
+            sprintf_s(name, "material%d", (int)i);
+            material.Name = name;
+        }
+        material.DiffuseColor = XMFLOAT3(1.f, 1.f, 1.f);
+
+        const JsonValue* pbr = src.Find("pbrMetallicRoughness");
+        if (pbr)
+        {
+            const JsonValue* baseColor = pbr->Find("baseColorFactor");
+            if (baseColor && baseColor->Size() == 4)
+            {
+                material.DiffuseColor = XMFLOAT3((float)baseColor->At(0)->Number, (float)baseColor->At(1)->Number, (float)baseColor->At(2)->Number);
+                material.Transparency = 1.f - (float)baseColor->At(3)->Number;
+            }
+
+            std::wstring path = GetTexturePath(gltf, pbr->Find("baseColorTexture"), basePath);
+            if (!path.empty())
+            {
+                material.TextureMaps[ObjMaterial::TextureType::Diffuse] = path;
+            }
+        }
+
+        std::wstring path = GetTexturePath(gltf, src.Find("normalTexture"), basePath);
+        if (!path.empty())
+        {
+            material.TextureMaps[ObjMaterial::TextureType::Normal] = path;
+        }
+
+        model->Materials.push_back(material);
+    }
+
+    // Walk the default scene. If there is none, treat every root node as part of the scene
+    const JsonValue* scenes = gltf.Find("scenes");
+    int sceneIndex = ToIndex(gltf.GetNumber("scene", 0));
+    const JsonValue* scene = (scenes && sceneIndex >= 0) ? scenes->At((size_t)sceneIndex) : nullptr;
+    const JsonValue* roots = scene ? scene->Find("nodes") : nullptr;
+    if (roots)
+    {
+        for (size_t i = 0; i < roots->Size(); ++i)
+        {
+            if (!ImportNode(gltf, bin, binSize, ToIndex(roots->At(i)->Number), XMMatrixIdentity(), 0, model))
+            {
+                LogError(L"Failed to import scene.");
+                return false;
+            }
+        }
+    }
+    else
+    {
+        const JsonValue* nodes = gltf.Find("nodes");
+        std::vector<bool> isChild(nodes ? nodes->Size() : 0);
+        for (size_t i = 0; nodes && i < nodes->Size(); ++i)
+        {
+            const JsonValue* children = nodes->At(i)->Find("children");
+            for (size_t c = 0; children && c < children->Size(); ++c)
+            {
+                int child = ToIndex(children->At(c)->Number);
+                if (child >= 0 && (size_t)child < isChild.size()) isChild[child] = true;
+            }
+        }
+        for (size_t i = 0; i < isChild.size(); ++i)
+        {
+            if (!isChild[i] && !ImportNode(gltf, bin, binSize, (int)i, XMMatrixIdentity(), 0, model))
+            {
+                LogError(L"Failed to import scene.");
+                return false;
+            }
+        }
+    }
+
+    model->GenerateTangentSpace();
+
+    return true;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+struct ObjModel;
+
+// Imports a binary glTF 2.0 (.glb) file into the same intermediate used by the OBJ path.
+// The file is memory mapped and accessors are read in place from the binary chunk.
+// Node transforms are baked into the vertices, one ObjModelObject per mesh node.
+bool LoadGlbModel(const wchar_t* filename, ObjModel* model);
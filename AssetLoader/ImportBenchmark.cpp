@@ -0,0 +1,78 @@
+#include "Precomp.h"
+#include "Assets.h"
+#include "ObjModel.h"
+#include "GlbModel.h"
+#include "Debug.h"
+
+struct ImportTiming
+{
+    double AverageMs;
+    double MinMs;
+    size_t NumVertices;
+    size_t NumIndices;
+};
+
+static bool TimeImport(const std::wstring& filename, bool isGlb, uint32_t iterations, ImportTiming* timing)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    double totalMs = 0.0;
+    timing->MinMs = DBL_MAX;
+
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        // Fresh model each time so the timing includes every allocation
+        std::unique_ptr<ObjModel> model(new ObjModel);
+
+        LARGE_INTEGER start, end;
+        QueryPerformanceCounter(&start);
+
+        bool loaded = isGlb ? LoadGlbModel(filename.c_str(), model.get()) : model->Load(filename.c_str());
+
+        QueryPerformanceCounter(&end);
+
+        if (!loaded)
+        {
+            LogError(L"Failed to load %s.", filename.c_str());
+            return false;
+        }
+
+        double ms = (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+        totalMs += ms;
+        timing->MinMs = min(timing->MinMs, ms);
+        timing->NumVertices = model->Vertices.size();
+        timing->NumIndices = model->Indices.size();
+    }
+
+    timing->AverageMs = totalMs / iterations;
+    return true;
+}
+
+bool RunImportBenchmark(const std::wstring& objFilename, const std::wstring& glbFilename, uint32_t iterations)
+{
+    if (iterations == 0)
+    {
+        iterations = 1;
+    }
+
+    ImportTiming obj{};
+    ImportTiming glb{};
+    if (!TimeImport(objFilename, false, iterations, &obj) ||
+        !TimeImport(glbFilename, true, iterations, &glb))
+    {
+        return false;
+    }
+
+    wprintf(L"Import benchmark (%u iterations)\n", iterations);
+    wprintf(L"  OBJ: avg %8.2f ms, min %8.2f ms, %Iu vertices, %Iu indices (%s)\n",
+        obj.AverageMs, obj.MinMs, obj.NumVertices, obj.NumIndices, objFilename.c_str());
+    wprintf(L"  GLB: avg %8.2f ms, min %8.2f ms, %Iu vertices, %Iu indices (%s)\n",
+        glb.AverageMs, glb.MinMs, glb.NumVertices, glb.NumIndices, glbFilename.c_str());
+    if (glb.AverageMs > 0.0)
+    {
+        wprintf(L"  GLB speedup: %.2fx\n", obj.AverageMs / glb.AverageMs);
+    }
+
+    return true;
+}
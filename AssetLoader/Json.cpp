@@ -0,0 +1,264 @@
+#include "Precomp.h"
+#include "Json.h"
+#include "Debug.h"
+
+namespace
+{
+    // Objects & arrays nest by recursion, so hostile input could otherwise run out of stack.
+    // glTF itself never goes more than a handful of levels deep.
+    const uint32_t MaxDepth = 64;
+
+    struct JsonParser
+    {
+        const char* p;
+        const char* end;
+
+        void SkipWhitespace()
+        {
+            while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            {
+                ++p;
+            }
+        }
+
+        bool Match(const char* literal)
+        {
+            size_t length = strlen(literal);
+            if ((size_t)(end - p) < length || strncmp(p, literal, length) != 0)
+            {
+                return false;
+            }
+            p += length;
+            return true;
+        }
+
+        bool ParseString(std::string* out)
+        {
+            if (p >= end || *p != '"')
+            {
+                return false;
+            }
+            ++p;
+
+            while (p < end && *p != '"')
+            {
+                if (*p == '\\')
+                {
+                    ++p;
+                    if (p >= end)
+                    {
+                        return false;
+                    }
+
+                    switch (*p)
+                    {
+                    case 'b': out->push_back('\b'); break;
+                    case 'f': out->push_back('\f'); break;
+                    case 'n': out->push_back('\n'); break;
+                    case 'r': out->push_back('\r'); break;
+                    case 't': out->push_back('\t'); break;
+                    case 'u':
+                    {
+                        // Only ASCII code points are kept. Paths and names we care about don't need more
+                        if (end - p < 5)
+                        {
+                            return false;
+                        }
+                        char hex[5] = { p[1], p[2], p[3], p[4], 0 };
+                        unsigned long codePoint = strtoul(hex, nullptr, 16);
+                        out->push_back(codePoint < 0x80 ? (char)codePoint : '?');
+                        p += 4;
+                        break;
+                    }
+                    default: out->push_back(*p); break;
+                    }
+                    ++p;
+                }
+                else
+                {
+                    out->push_back(*p++);
+                }
+            }
+
+            if (p >= end)
+            {
+                return false;
+            }
+
+            ++p;    // Closing quote
+            return true;
+        }
+
+        bool ParseValue(JsonValue* value, uint32_t depth)
+        {
+            SkipWhitespace();
+            if (p >= end || depth >= MaxDepth)
+            {
+                return false;
+            }
+
+            switch (*p)
+            {
+            case '{':
+                value->ValueType = JsonValue::Type::Object;
+                ++p;
+                SkipWhitespace();
+                if (p < end && *p == '}')
+                {
+                    ++p;
+                    return true;
+                }
+                for (;;)
+                {
+                    SkipWhitespace();
+                    value->Members.push_back(std::make_pair(std::string(), JsonValue()));
+                    auto& member = value->Members.back();
+                    if (!ParseString(&member.first))
+                    {
+                        return false;
+                    }
+                    SkipWhitespace();
+                    if (p >= end || *p != ':')
+                    {
+                        return false;
+                    }
+                    ++p;
+                    if (!ParseValue(&member.second, depth + 1))
+                    {
+                        return false;
+                    }
+                    SkipWhitespace();
+                    if (p < end && *p == ',')
+                    {
+                        ++p;
+                        continue;
+                    }
+                    if (p < end && *p == '}')
+                    {
+                        ++p;
+                        return true;
+                    }
+                    return false;
+                }
+
+            case '[':
+                value->ValueType = JsonValue::Type::Array;
+                ++p;
+                SkipWhitespace();
+                if (p < end && *p == ']')
+                {
+                    ++p;
+                    return true;
+                }
+                for (;;)
+                {
+                    value->Elements.push_back(JsonValue());
+                    if (!ParseValue(&value->Elements.back(), depth + 1))
+                    {
+                        return false;
+                    }
+                    SkipWhitespace();
+                    if (p < end && *p == ',')
+                    {
+                        ++p;
+                        continue;
+                    }
+                    if (p < end && *p == ']')
+                    {
+                        ++p;
+                        return true;
+                    }
+                    return false;
+                }
+
+            case '"':
+                value->ValueType = JsonValue::Type::String;
+                return ParseString(&value->String);
+
+            case 't':
+                value->ValueType = JsonValue::Type::Bool;
+                value->Bool = true;
+                return Match("true");
+
+            case 'f':
+                value->ValueType = JsonValue::Type::Bool;
+                value->Bool = false;
+                return Match("false");
+
+            case 'n':
+                value->ValueType = JsonValue::Type::Null;
+                return Match("null");
+
+            default:
+            {
+                // strtod needs a terminated string, so copy the number out first
+                char number[64] = {};
+                size_t length = 0;
+                while (p < end && length < _countof(number) - 1 &&
+                    (isdigit((uint8_t)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+                {
+                    number[length++] = *p++;
+                }
+                if (length == 0)
+                {
+                    return false;
+                }
+                value->ValueType = JsonValue::Type::Number;
+                value->Number = strtod(number, nullptr);
+                return true;
+            }
+            }
+        }
+    };
+}
+
+static const std::string EmptyString;
+
+const JsonValue* JsonValue::Find(const char* key) const
+{
+    if (ValueType != Type::Object)
+    {
+        return nullptr;
+    }
+
+    for (auto& member : Members)
+    {
+        if (member.first == key)
+        {
+            return &member.second;
+        }
+    }
+    return nullptr;
+}
+
+const JsonValue* JsonValue::At(size_t index) const
+{
+    if (ValueType != Type::Array || index >= Elements.size())
+    {
+        return nullptr;
+    }
+    return &Elements[index];
+}
+
+double JsonValue::GetNumber(const char* key, double defaultValue) const
+{
+    const JsonValue* value = Find(key);
+    return (value && value->ValueType == Type::Number) ? value->Number : defaultValue;
+}
+
+const std::string& JsonValue::GetString(const char* key) const
+{
+    const JsonValue* value = Find(key);
+    return (value && value->ValueType == Type::String) ? value->String : EmptyString;
+}
+
+bool ParseJson(const char* text, size_t length, JsonValue* root)
+{
+    JsonParser parser{ text, text + length };
+    if (!parser.ParseValue(root, 0))
+    {
+        LogError(L"Malformed JSON near offset %d.", (int)(parser.p - text));
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+// Minimal JSON document model. Only what's needed to read glTF headers,
+// so numbers are always doubles and there is no writer.
+struct JsonValue
+{
+    enum class Type
+    {
+        Null = 0,
+        Bool,
+        Number,
+        String,
+        Array,
+        Object,
+    };
+
+    Type ValueType;
+    bool Bool;
+    double Number;
+    std::string String;
+    std::vector<JsonValue> Elements;                            // Array
+    std::vector<std::pair<std::string, JsonValue>> Members;     // Object
+
+    JsonValue() : ValueType(Type::Null), Bool(false), Number(0) {}
+
+    bool IsNull() const { return ValueType == Type::Null; }
+
+    // Returns nullptr if this isn't an object, or the key doesn't exist
+    const JsonValue* Find(const char* key) const;
+
+    // Returns nullptr if this isn't an array, or index is out of range
+    const JsonValue* At(size_t index) const;
+
+    size_t Size() const { return ValueType == Type::Array ? Elements.size() : Members.size(); }
+
+    // Convenience accessors which fall back to a default when the value is missing or the wrong type
+    double GetNumber(const char* key, double defaultValue) const;
+    const std::string& GetString(const char* key) const;
+};
+
+// Parses a complete JSON document. Returns false on malformed input, or if objects & arrays
+// nest more than 64 deep.
+bool ParseJson(const char* text, size_t length, JsonValue* root);
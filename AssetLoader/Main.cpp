@@ -2,11 +2,14 @@
 #include "Assets.h"
 #include "Debug.h"
 #include "StringHelpers.h"
+#include "BuildCache.h"
 
 static bool ReadConfig(
     const std::wstring& configFilename,
     std::wstring& sourceRoot,
     std::wstring& outputRoot,
+    std::wstring& cacheRoot,
+    ModelBakeOptions& bake,
     std::vector<SourceAsset>& assets);
 
 int wmain(int argc, wchar_t* argv[])
@@ -19,41 +22,103 @@ int wmain(int argc, wchar_t* argv[])
         return -1;
     }
 
+    // AssetLoader.exe -benchimport <model.obj> <model.glb> [iterations]
+    if (argc > 3 && _wcsicmp(argv[1], L"-benchimport") == 0)
+    {
+        uint32_t iterations = (argc > 4) ? (uint32_t)_wtoi(argv[4]) : 10;
+        bool succeeded = RunImportBenchmark(argv[2], argv[3], iterations);
+        CoUninitialize();
+        return succeeded ? 0 : -4;
+    }
+
+    // AssetLoader.exe -benchao <model> [raysPerVertex]
+    if (argc > 2 && _wcsicmp(argv[1], L"-benchao") == 0)
+    {
+        uint32_t raysPerVertex = (argc > 3) ? (uint32_t)_wtoi(argv[3]) : 64;
+        bool succeeded = RunAmbientOcclusionBenchmark(argv[2], raysPerVertex);
+        CoUninitialize();
+        return succeeded ? 0 : -4;
+    }
+
+    // AssetLoader.exe -benchpvs <model> [samplesPerCell]
+    if (argc > 2 && _wcsicmp(argv[1], L"-benchpvs") == 0)
+    {
+        uint32_t samplesPerCell = (argc > 3) ? (uint32_t)_wtoi(argv[3]) : 16;
+        bool succeeded = RunVisibilityBenchmark(argv[2], samplesPerCell);
+        CoUninitialize();
+        return succeeded ? 0 : -4;
+    }
+
     std::wstring configFilename(L"AssetLoader.cfg");    // Default config file
+    uint32_t shardIndex = 0;
+    uint32_t shardCount = 1;
 
-    // Check if an override file was specified on command line
-    if (argc > 1)
+    // AssetLoader.exe [configFile] [-shard i/n]
+    for (int i = 1; i < argc; ++i)
     {
+        if (_wcsicmp(argv[i], L"-shard") == 0 && i + 1 < argc)
+        {
+            // Only build every n-th asset of the config, so several machines can split it
+            if (swscanf_s(argv[++i], L"%u/%u", &shardIndex, &shardCount) != 2 || shardCount == 0 || shardIndex >= shardCount)
+            {
+                LogError(L"Invalid shard %s. Expected index/count, such as 0/4.", argv[i]);
+                CoUninitialize();
+                return -2;
+            }
+            continue;
+        }
+
         // Check if the parameter is a valid file path.
-        if (GetFileAttributes(argv[1]) == INVALID_FILE_ATTRIBUTES)
+        if (GetFileAttributes(argv[i]) == INVALID_FILE_ATTRIBUTES)
         {
-            LogError(L"Config file %s doesn't exist.", argv[1]);
+            LogError(L"Config file %s doesn't exist.", argv[i]);
             CoUninitialize();
             return -2;
         }
 
-        configFilename = argv[1];
+        configFilename = argv[i];
     }
 
     std::wstring sourceRoot;    // Root directory of source assets
     std::wstring outputRoot;    // Root where processed output files should go
+    std::wstring cacheRoot;     // Optional shared build cache
+    ModelBakeOptions bake{};    // Optional offline bakes for models
     std::vector<SourceAsset> assets;
 
-    if (!ReadConfig(configFilename, sourceRoot, outputRoot, assets))
+    if (!ReadConfig(configFilename, sourceRoot, outputRoot, cacheRoot, bake, assets))
     {
         LogError(L"Failed to load config file: %s.", configFilename.c_str());
         CoUninitialize();
         return -3;
     }
 
+    if (shardCount > 1)
+    {
+        std::vector<SourceAsset> shard;
+        for (uint32_t i = shardIndex; i < (uint32_t)assets.size(); i += shardCount)
+        {
+            shard.push_back(assets[i]);
+        }
+        assets.swap(shard);
+    }
+
+    SetBuildCacheRoot(cacheRoot);
+
     // Make sure both roots are standardized on / and also end in /
     NormalizeSlashes(sourceRoot);
     EnsureTrailingSlash(sourceRoot);
     NormalizeSlashes(outputRoot);
     EnsureTrailingSlash(outputRoot);
 
+    // Shards running at the same time each write their own report
+    std::wstring reportName(L"BuildReport");
+    if (shardCount > 1)
+    {
+        reportName += L".shard" + std::to_wstring(shardIndex) + L"of" + std::to_wstring(shardCount);
+    }
+
     // Process assets
-    ProcessAssets(sourceRoot, outputRoot, assets);
+    ProcessAssets(sourceRoot, outputRoot, assets, bake, reportName);
 
     CoUninitialize();
 
@@ -64,6 +129,8 @@ static bool ReadConfig(
     const std::wstring& configFilename,
     std::wstring& sourceRoot,
     std::wstring& outputRoot,
+    std::wstring& cacheRoot,
+    ModelBakeOptions& bake,
     std::vector<SourceAsset>& assets)
 {
     FileHandle configFile(CreateFile(configFilename.c_str(), GENERIC_READ,
@@ -118,10 +185,26 @@ static bool ReadConfig(
         {
             outputRoot = ConvertToWide(TrimLeadingWhitespace(line + 12));
         }
+        else if (_strnicmp(line, "CacheRoot:", 10) == 0)
+        {
+            cacheRoot = ConvertToWide(TrimLeadingWhitespace(line + 11));
+        }
+        else if (_strnicmp(line, "BakeAmbientOcclusion:", 21) == 0)
+        {
+            bake.AmbientOcclusion = atoi(TrimLeadingWhitespace(line + 21)) != 0;
+        }
+        else if (_strnicmp(line, "BakeVisibility:", 15) == 0)
+        {
+            bake.Visibility = atoi(TrimLeadingWhitespace(line + 15)) != 0;
+        }
         else if (_strnicmp(line, "Model:", 6) == 0)
         {
             assets.push_back(SourceAsset(AssetType::Model, ConvertToWide(TrimLeadingWhitespace(line + 7))));
         }
+        else if (_strnicmp(line, "VirtualTexture:", 15) == 0)
+        {
+            assets.push_back(SourceAsset(AssetType::VirtualTexture, ConvertToWide(TrimLeadingWhitespace(line + 16))));
+        }
 
         // Advance p to next line
         ++p;
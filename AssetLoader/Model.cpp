@@ -1,9 +1,13 @@
 #include "Precomp.h"
 #include "Assets.h"
 #include "ObjModel.h"
+#include "GlbModel.h"
 #include "Debug.h"
 #include "StringHelpers.h"
 #include "AssetLoader.h"
+#include "RayTracer.h"
+#include "AmbientOcclusion.h"
+#include "PotentiallyVisibleSets.h"
 
 static std::wstring FindTexture(const std::unique_ptr<ObjModel>& model, const std::string& materialName, ObjMaterial::TextureType textureType)
 {
@@ -25,43 +29,56 @@ static std::wstring FindTexture(const std::unique_ptr<ObjModel>& model, const st
     return texture;
 }
 
-bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& outputFilename)
+bool LoadSourceModel(const std::wstring& assetFilename, ObjModel* objModel)
 {
-    FileHandle outputFile(CreateFile(outputFilename.c_str(), GENERIC_WRITE,
-        0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
-    if (!outputFile.IsValid())
+    // Binary glTF is imported into the same intermediate representation as OBJ
+    if (assetFilename.size() > 4 && _wcsicmp(assetFilename.c_str() + assetFilename.size() - 4, L".glb") == 0)
     {
-        LogError(L"Failed to create output file: %s.", outputFilename.c_str());
+        return LoadGlbModel(assetFilename.c_str(), objModel);
+    }
+
+    return objModel->Load(assetFilename.c_str());
+}
+
+bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& outputFilename, const ModelBakeOptions& bake, std::vector<SourceAsset>* dependencies)
+{
+    // Textures referenced by the model are built as separate assets on disk
+    auto buildTexture = [dependencies](AssetType type, const std::wstring& sourcePath, std::wstring* outputRelativePath)
+    {
+        SourceAsset texture(type, std::wstring(sourcePath));
+        if (dependencies)
+        {
+            dependencies->push_back(texture);
+        }
+        return BuildAsset(texture, *outputRelativePath);
+    };
+
+    std::vector<uint8_t> data;
+    if (!BuildModelData(objModel, buildTexture, bake, &data))
+    {
+        LogError(L"Failed to build model.");
         return false;
     }
 
-    DWORD bytesWritten{};
+    return SaveBlob(outputFilename, data);
+}
 
+bool BuildModelData(const std::unique_ptr<ObjModel>& objModel, const TextureBuildFunction& buildTexture, const ModelBakeOptions& bake, std::vector<uint8_t>* data)
+{
     ModelHeader header{};
     header.Signature = ModelHeader::ExpectedSignature;
     header.NumVertices = (uint32_t)objModel->Vertices.size();
     header.NumIndices = (uint32_t)objModel->Indices.size();
     header.NumObjects = (uint32_t)objModel->Objects.size();
 
-    if (!WriteFile(outputFile.Get(), &header, sizeof(header), &bytesWritten, nullptr))
-    {
-        LogError(L"Error writing output file.");
-        return false;
-    }
+    data->clear();
+    AppendData(data, &header, sizeof(header));
 
     // Write all vertices next
-    if (!WriteFile(outputFile.Get(), objModel->Vertices.data(), header.NumVertices * sizeof(ModelVertex), &bytesWritten, nullptr))
-    {
-        LogError(L"Error writing output file.");
-        return false;
-    }
+    AppendData(data, objModel->Vertices.data(), header.NumVertices * sizeof(ModelVertex));
 
     // Write all indices next
-    if (!WriteFile(outputFile.Get(), objModel->Indices.data(), header.NumIndices * sizeof(uint32_t), &bytesWritten, nullptr))
-    {
-        LogError(L"Error writing output file.");
-        return false;
-    }
+    AppendData(data, objModel->Indices.data(), header.NumIndices * sizeof(uint32_t));
 
     // Write out objects
     for (int iObj = 0; iObj < (int)objModel->Objects.size(); ++iObj)
@@ -72,14 +89,10 @@ bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& ou
         strcpy_s(object.Name, srcObject.Name.c_str());
         object.NumParts = (uint32_t)srcObject.Parts.size();
 
-        if (!WriteFile(outputFile.Get(), &object, sizeof(object), &bytesWritten, nullptr))
-        {
-            LogError(L"Error writing output file.");
-            return false;
-        }
+        AppendData(data, &object, sizeof(object));
 
         // Write out parts
-        for (int iPart = 0; iPart < srcObject.Parts.size(); ++iPart)
+        for (int iPart = 0; iPart < (int)srcObject.Parts.size(); ++iPart)
         {
             const ObjModelPart& srcPart = srcObject.Parts[iPart];
 
@@ -88,9 +101,9 @@ bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& ou
 
             if (!textureName.empty())
             {
-                if (!BuildAsset(SourceAsset(AssetType::Texture, std::move(textureName)), textureName))
+                if (!buildTexture(AssetType::Texture, textureName, &textureName))
                 {
-                    LogError(L"Error writing output file.");
+                    LogError(L"Error building texture.");
                     return false;
                 }
             }
@@ -100,21 +113,35 @@ bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& ou
 
             if (!textureName.empty())
             {
-                if (!BuildAsset(SourceAsset(AssetType::BumpTexture, std::move(textureName)), textureName))
+                if (!buildTexture(AssetType::BumpTexture, textureName, &textureName))
                 {
-                    LogError(L"Error writing output file.");
+                    LogError(L"Error building texture.");
                     return false;
                 }
             }
+            else
+            {
+                // No height map, but the material may already provide a tangent space normal map
+                textureName = FindTexture(objModel, srcPart.Material, ObjMaterial::TextureType::Normal);
+
+                if (!textureName.empty())
+                {
+                    if (!buildTexture(AssetType::Texture, textureName, &textureName))
+                    {
+                        LogError(L"Error building texture.");
+                        return false;
+                    }
+                }
+            }
             wcscpy_s(part.NormalTexture, textureName.c_str());
 
             textureName = FindTexture(objModel, srcPart.Material, ObjMaterial::TextureType::SpecularColor);
 
             if (!textureName.empty())
             {
-                if (!BuildAsset(SourceAsset(AssetType::SpecularTexture, std::move(textureName)), textureName))
+                if (!buildTexture(AssetType::SpecularTexture, textureName, &textureName))
                 {
-                    LogError(L"Error writing output file.");
+                    LogError(L"Error building texture.");
                     return false;
                 }
             }
@@ -123,12 +150,57 @@ bool SaveModel(const std::unique_ptr<ObjModel>& objModel, const std::wstring& ou
             part.StartIndex = srcPart.StartIndex;
             part.NumIndices = srcPart.NumIndices;
 
-            if (!WriteFile(outputFile.Get(), &part, sizeof(part), &bytesWritten, nullptr))
+            AppendData(data, &part, sizeof(part));
+        }
+    }
+
+    // Baked data goes last, so readers that don't know about it can stop before it
+    if (!bake.AmbientOcclusion && !bake.Visibility)
+    {
+        return true;
+    }
+
+    RayTracer tracer;
+    tracer.Build(objModel->Vertices, objModel->Indices);
+
+    if (bake.AmbientOcclusion)
+    {
+        AmbientBakeSettings settings = AmbientBakeSettings::GetDefault(tracer);
+
+        std::vector<ModelAmbientVertex> ambient;
+        BakeAmbientOcclusion(tracer, objModel->Vertices, settings, &ambient);
+
+        ModelAmbientHeader ambientHeader{};
+        ambientHeader.Signature = ModelAmbientHeader::ExpectedSignature;
+        ambientHeader.NumVertices = header.NumVertices;
+        ambientHeader.RaysPerVertex = settings.RaysPerVertex;
+        ambientHeader.MaxDistance = settings.MaxDistance;
+        AppendData(data, &ambientHeader, sizeof(ambientHeader));
+        AppendData(data, ambient.data(), ambient.size() * sizeof(ModelAmbientVertex));
+    }
+
+    if (bake.Visibility)
+    {
+        // Then the potentially visible sets, with a bit per part
+        std::vector<VisibilityPart> parts;
+        for (auto& object : objModel->Objects)
+        {
+            for (auto& part : object.Parts)
             {
-                LogError(L"Error writing output file.");
-                return false;
+                VisibilityPart visibilityPart{};
+                visibilityPart.StartIndex = part.StartIndex;
+                visibilityPart.NumIndices = part.NumIndices;
+                parts.push_back(visibilityPart);
             }
         }
+
+        ModelVisibilityHeader visibilityHeader{};
+        std::vector<uint32_t> cells;
+        BakeVisibility(tracer, objModel->Vertices, objModel->Indices, parts, VisibilityBakeSettings::GetDefault(tracer), &visibilityHeader, &cells);
+
+        visibilityHeader.Signature = ModelVisibilityHeader::ExpectedSignature;
+        AppendData(data, &visibilityHeader, sizeof(visibilityHeader));
+        AppendData(data, cells.data(), cells.size() * sizeof(uint32_t));
     }
 
     return true;
@@ -13,6 +13,7 @@ struct ObjMaterial
         Transparency,
         Bump,           // Heightmap, uses R channel only
         Displacement,
+        Normal,         // Tangent space normal map, used as-is (glTF)
     };
 
     std::string Name;
@@ -48,6 +49,9 @@ struct ObjModel
 
     bool Load(const wchar_t* filename);
 
+    // Computes per-vertex tangent & bitangent from positions, normals, and texcoords of all parts
+    void GenerateTangentSpace();
+
 private:
     std::vector<XMFLOAT3> Positions;    // x, y, z
     std::vector<XMFLOAT4> Tangents;     // may not be normalized
@@ -62,6 +66,4 @@ private:
     void ReadTexCoord(const char* line);
     void ReadNormal(const char* line);
     void ReadFace(char* line, ObjModelPart* part);
-
-    void GenerateTangentSpace();
 };
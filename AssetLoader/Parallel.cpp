@@ -0,0 +1,58 @@
+#include "Precomp.h"
+#include "Parallel.h"
+#include "AssetImport.h"
+
+// Set by the host application when AssetLoader is used as a library
+static AssetTaskScheduler Scheduler;
+
+void SetAssetTaskScheduler(const AssetTaskScheduler& scheduler)
+{
+    Scheduler = scheduler;
+}
+
+void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& body)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    if (Scheduler)
+    {
+        Scheduler(count, body);
+        return;
+    }
+
+    uint32_t numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0)
+    {
+        numThreads = 1;
+    }
+    if (numThreads > count)
+    {
+        numThreads = count;
+    }
+
+    // Each worker (including the calling thread) pulls the next index until the range is exhausted
+    std::atomic<uint32_t> next(0);
+    auto worker = [&]()
+    {
+        for (uint32_t i = next++; i < count; i = next++)
+        {
+            body(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < numThreads; ++i)
+    {
+        threads.push_back(std::thread(worker));
+    }
+
+    worker();
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
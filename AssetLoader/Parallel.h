@@ -0,0 +1,6 @@
+#pragma once
+
+// Runs body(i) for every i in [0, count) spread across all hardware threads.
+// Blocks until every index has been processed. The body must be thread safe.
+// Uses the scheduler from SetAssetTaskScheduler instead, if one was provided.
+void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& body);
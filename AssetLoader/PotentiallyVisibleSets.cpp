@@ -0,0 +1,193 @@
+#include "Precomp.h"
+#include "PotentiallyVisibleSets.h"
+#include "RayTracer.h"
+#include "Parallel.h"
+
+static uint32_t Hash(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// [0, 1) from the top 24 bits
+static float ToUnitFloat(uint32_t x)
+{
+    return (x >> 8) * (1.f / 16777216.f);
+}
+
+// A part's triangles, for picking points spread evenly over its surface
+struct PartSampler
+{
+    std::vector<uint32_t>   FirstIndices;       // Of each triangle
+    std::vector<float>      CumulativeAreas;    // Of the triangles up to and including each
+    XMFLOAT3                Min;
+    XMFLOAT3                Max;
+};
+
+static void BuildSampler(const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices, const VisibilityPart& part,
+    PartSampler* sampler)
+{
+    XMVECTOR minBounds = XMVectorReplicate(FLT_MAX);
+    XMVECTOR maxBounds = XMVectorReplicate(-FLT_MAX);
+    float totalArea = 0.f;
+    for (uint32_t i = part.StartIndex; i + 3 <= part.StartIndex + part.NumIndices; i += 3)
+    {
+        XMVECTOR v0 = XMLoadFloat3(&vertices[indices[i]].Position);
+        XMVECTOR v1 = XMLoadFloat3(&vertices[indices[i + 1]].Position);
+        XMVECTOR v2 = XMLoadFloat3(&vertices[indices[i + 2]].Position);
+        minBounds = XMVectorMin(minBounds, XMVectorMin(v0, XMVectorMin(v1, v2)));
+        maxBounds = XMVectorMax(maxBounds, XMVectorMax(v0, XMVectorMax(v1, v2)));
+
+        totalArea += 0.5f * XMVectorGetX(XMVector3Length(XMVector3Cross(v1 - v0, v2 - v0)));
+        sampler->FirstIndices.push_back(i);
+        sampler->CumulativeAreas.push_back(totalArea);
+    }
+
+    // Without any area, every triangle is as likely as the next
+    if (totalArea <= 0.f)
+    {
+        for (uint32_t i = 0; i < (uint32_t)sampler->CumulativeAreas.size(); ++i)
+        {
+            sampler->CumulativeAreas[i] = (float)(i + 1);
+        }
+    }
+
+    XMStoreFloat3(&sampler->Min, minBounds);
+    XMStoreFloat3(&sampler->Max, maxBounds);
+}
+
+static XMVECTOR SamplePart(const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices, const PartSampler& sampler,
+    uint32_t seed)
+{
+    float area = ToUnitFloat(seed) * sampler.CumulativeAreas.back();
+    size_t triangle = std::upper_bound(sampler.CumulativeAreas.begin(), sampler.CumulativeAreas.end(), area) - sampler.CumulativeAreas.begin();
+    triangle = min(triangle, sampler.CumulativeAreas.size() - 1);
+
+    // Folded back into the triangle when outside it
+    float u = ToUnitFloat(Hash(seed));
+    float v = ToUnitFloat(Hash(Hash(seed)));
+    if (u + v > 1.f)
+    {
+        u = 1.f - u;
+        v = 1.f - v;
+    }
+
+    uint32_t first = sampler.FirstIndices[triangle];
+    XMVECTOR v0 = XMLoadFloat3(&vertices[indices[first]].Position);
+    XMVECTOR v1 = XMLoadFloat3(&vertices[indices[first + 1]].Position);
+    XMVECTOR v2 = XMLoadFloat3(&vertices[indices[first + 2]].Position);
+    return v0 + (v1 - v0) * u + (v2 - v0) * v;
+}
+
+// Returns how many rays were traced
+static uint64_t BakeCell(const RayTracer& tracer, const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices,
+    const std::vector<PartSampler>& samplers, const ModelVisibilityHeader& header, const VisibilityBakeSettings& settings,
+    uint32_t cell, uint32_t* bits)
+{
+    uint32_t x = cell % header.CellsX;
+    uint32_t y = (cell / header.CellsX) % header.CellsY;
+    uint32_t z = cell / (header.CellsX * header.CellsY);
+
+    XMVECTOR cellSize = XMLoadFloat3(&header.CellSize);
+    XMVECTOR cellMin = XMLoadFloat3(&header.BoundsMin) + XMVectorSet((float)x, (float)y, (float)z, 0.f) * cellSize;
+    XMVECTOR cellMax = cellMin + cellSize;
+
+    std::vector<XMFLOAT3> points(settings.SamplesPerCell);
+    for (uint32_t i = 0; i < settings.SamplesPerCell; ++i)
+    {
+        uint32_t seed = Hash(cell ^ Hash(i));
+        XMVECTOR offset = XMVectorSet(ToUnitFloat(seed), ToUnitFloat(Hash(seed)), ToUnitFloat(Hash(Hash(seed))), 0.f);
+        XMStoreFloat3(&points[i], cellMin + offset * cellSize);
+    }
+
+    uint64_t numRays = 0;
+    uint32_t numSamples = settings.SamplesPerCell * settings.SamplesPerPart;
+    for (uint32_t part = 0; part < (uint32_t)samplers.size(); ++part)
+    {
+        const PartSampler& sampler = samplers[part];
+        bool visible = sampler.FirstIndices.empty() || numSamples == 0 ||
+            (XMVector3LessOrEqual(cellMin, XMLoadFloat3(&sampler.Max)) && XMVector3LessOrEqual(XMLoadFloat3(&sampler.Min), cellMax));
+
+        // Each point in the cell is paired with a different point on the part
+        for (uint32_t i = 0; i < numSamples && !visible; ++i)
+        {
+            XMVECTOR origin = XMLoadFloat3(&points[i % settings.SamplesPerCell]);
+            XMVECTOR direction = SamplePart(vertices, indices, sampler, Hash(cell ^ Hash(part ^ Hash(i)))) - origin;
+            float length = XMVectorGetX(XMVector3Length(direction));
+
+            ++numRays;
+            visible = length <= settings.Bias || !tracer.IsOccluded(origin, direction, 1.f - settings.Bias / length);
+        }
+
+        if (visible)
+        {
+            bits[part / 32] |= 1u << (part % 32);
+        }
+    }
+
+    return numRays;
+}
+
+VisibilityBakeSettings VisibilityBakeSettings::GetDefault(const RayTracer& tracer)
+{
+    float diagonal = XMVectorGetX(XMVector3Length(XMLoadFloat3(&tracer.GetBoundsMax()) - XMLoadFloat3(&tracer.GetBoundsMin())));
+
+    VisibilityBakeSettings settings;
+    settings.MaxCellsPerAxis = 16;
+    settings.SamplesPerCell = 16;
+    settings.SamplesPerPart = 4;
+    settings.Bias = diagonal * 1e-5f;
+    settings.Multithreaded = true;
+    return settings;
+}
+
+uint64_t BakeVisibility(const RayTracer& tracer, const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices,
+    const std::vector<VisibilityPart>& parts, const VisibilityBakeSettings& settings, ModelVisibilityHeader* header, std::vector<uint32_t>* cells)
+{
+    // Cubes along the longest side, and enough of them along the others to cover the bounds
+    XMFLOAT3 size;
+    XMStoreFloat3(&size, XMVectorMax(XMLoadFloat3(&tracer.GetBoundsMax()) - XMLoadFloat3(&tracer.GetBoundsMin()), XMVectorZero()));
+    float cellSize = max(max(max(size.x, size.y), size.z) / max(settings.MaxCellsPerAxis, 1u), 1e-6f);
+
+    header->NumParts = (uint32_t)parts.size();
+    header->CellsX = max((uint32_t)ceilf(size.x / cellSize), 1u);
+    header->CellsY = max((uint32_t)ceilf(size.y / cellSize), 1u);
+    header->CellsZ = max((uint32_t)ceilf(size.z / cellSize), 1u);
+    header->WordsPerCell = (header->NumParts + 31) / 32;
+    header->BoundsMin = tracer.GetBoundsMin();
+    header->CellSize = XMFLOAT3(cellSize, cellSize, cellSize);
+    header->SamplesPerCell = settings.SamplesPerCell;
+
+    std::vector<PartSampler> samplers(parts.size());
+    for (size_t i = 0; i < parts.size(); ++i)
+    {
+        BuildSampler(vertices, indices, parts[i], &samplers[i]);
+    }
+
+    uint32_t numCells = header->CellsX * header->CellsY * header->CellsZ;
+    cells->assign((size_t)numCells * header->WordsPerCell, 0);
+
+    std::atomic<uint64_t> numRays(0);
+    auto bakeCell = [&](uint32_t cell)
+    {
+        numRays += BakeCell(tracer, vertices, indices, samplers, *header, settings, cell, cells->data() + (size_t)cell * header->WordsPerCell);
+    };
+
+    if (settings.Multithreaded)
+    {
+        ParallelFor(numCells, bakeCell);
+    }
+    else
+    {
+        for (uint32_t cell = 0; cell < numCells; ++cell)
+        {
+            bakeCell(cell);
+        }
+    }
+
+    return numRays;
+}
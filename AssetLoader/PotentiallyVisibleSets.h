@@ -0,0 +1,34 @@
+#pragma once
+
+#include "AssetLoader.h"
+
+class RayTracer;
+
+// Range of the model's indices making up a part, which is what visibility is decided for
+struct VisibilityPart
+{
+    uint32_t StartIndex;
+    uint32_t NumIndices;
+};
+
+struct VisibilityBakeSettings
+{
+    uint32_t MaxCellsPerAxis;   // Cells along the longest side of the model's bounds. Cells are cubes
+    uint32_t SamplesPerCell;    // Points in each cell that parts are traced to from
+    uint32_t SamplesPerPart;    // Points on the part traced to from each of those, at most
+    float Bias;                 // Rays stop this far short of the point on the part
+    bool Multithreaded;         // Spread cells over ParallelFor, or bake on the calling thread
+
+    // 16 cells along the longest side, and up to 16 x 4 rays per cell & part
+    static VisibilityBakeSettings GetDefault(const RayTracer& tracer);
+};
+
+// Splits the model's bounds into a grid of cells, and finds the parts that may be seen from each
+// by tracing from points sampled in the cell to points sampled over the part's triangles (by
+// area). A part is visible once any ray gets through, and parts whose bounds touch the cell
+// always are. Parts only seen through gaps smaller than the sampling can be missed, so sets are
+// potentially, not conservatively, visible. Deterministic: every sample is seeded from its cell,
+// part & index. Fills in header (except the signature) and cells, as laid out in
+// ModelVisibilityHeader. Returns how many rays were traced.
+uint64_t BakeVisibility(const RayTracer& tracer, const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices,
+    const std::vector<VisibilityPart>& parts, const VisibilityBakeSettings& settings, ModelVisibilityHeader* header, std::vector<uint32_t>* cells);
@@ -12,6 +12,10 @@
 #include <vector>
 #include <string>
 #include <map>
+#include <functional>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
 // DDS library
 #include <DirectXTex.h>
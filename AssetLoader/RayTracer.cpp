@@ -0,0 +1,439 @@
+#include "Precomp.h"
+#include "RayTracer.h"
+
+static const uint32_t LeafFlag = 0x80000000;
+static const uint32_t EmptyChild = 0xFFFFFFFF;
+
+// Triangles per leaf, one per SSE lane
+static const uint32_t LeafTriangles = 4;
+
+// Bins per axis when looking for the cheapest split
+static const uint32_t NumBins = 16;
+
+// Below this depth nodes are split at the median instead, which always halves them. Keeps the
+// tree shallow enough for the traversal stack however the triangles are laid out
+static const uint32_t MaxSahDepth = 48;
+
+// Enough for 3 pending siblings at each level of the deepest possible tree
+static const uint32_t MaxTraversalStack = 256;
+
+static float SurfaceArea(FXMVECTOR boxMin, FXMVECTOR boxMax)
+{
+    XMFLOAT3 size;
+    XMStoreFloat3(&size, XMVectorMax(boxMax - boxMin, XMVectorZero()));
+    return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static float GetComponent(const XMFLOAT3& v, uint32_t axis)
+{
+    return (&v.x)[axis];
+}
+
+RayTracer::RayTracer()
+    : NumTriangles(0)
+    , BoundsMin(0.f, 0.f, 0.f)
+    , BoundsMax(0.f, 0.f, 0.f)
+    , Vertices(nullptr)
+    , Indices(nullptr)
+{
+}
+
+void RayTracer::Build(const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices)
+{
+    Nodes.clear();
+    Leaves.clear();
+    NumTriangles = (uint32_t)indices.size() / 3;
+    Vertices = vertices.data();
+    Indices = indices.data();
+
+    Triangles.resize(NumTriangles);
+    for (uint32_t i = 0; i < NumTriangles; ++i)
+    {
+        XMVECTOR v0 = XMLoadFloat3(&vertices[indices[i * 3]].Position);
+        XMVECTOR v1 = XMLoadFloat3(&vertices[indices[i * 3 + 1]].Position);
+        XMVECTOR v2 = XMLoadFloat3(&vertices[indices[i * 3 + 2]].Position);
+        XMVECTOR triangleMin = XMVectorMin(XMVectorMin(v0, v1), v2);
+        XMVECTOR triangleMax = XMVectorMax(XMVectorMax(v0, v1), v2);
+
+        BuildTriangle& triangle = Triangles[i];
+        XMStoreFloat3(&triangle.Min, triangleMin);
+        XMStoreFloat3(&triangle.Max, triangleMax);
+        XMStoreFloat3(&triangle.Center, (triangleMin + triangleMax) * 0.5f);
+        triangle.Index = i;
+    }
+
+    // The root is always a 4 wide node, even over a single leaf, so traversal can start at node 0
+    Nodes.push_back(Node());
+    Node& root = Nodes[0];
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        root.MinX[i] = root.MinY[i] = root.MinZ[i] = 0.f;
+        root.MaxX[i] = root.MaxY[i] = root.MaxZ[i] = 0.f;
+        root.Children[i] = EmptyChild;
+    }
+
+    if (NumTriangles > 0)
+    {
+        std::vector<BuildNode> binaryNodes;
+        binaryNodes.reserve(2 * NumTriangles);
+        BuildBinary(&binaryNodes, 0, NumTriangles, 0);
+
+        BoundsMin = binaryNodes[0].Min;
+        BoundsMax = binaryNodes[0].Max;
+        if (binaryNodes[0].Count > 0)
+        {
+            uint32_t leaf = AddLeaf(binaryNodes[0]);
+            Node& single = Nodes[0];
+            single.MinX[0] = BoundsMin.x;
+            single.MinY[0] = BoundsMin.y;
+            single.MinZ[0] = BoundsMin.z;
+            single.MaxX[0] = BoundsMax.x;
+            single.MaxY[0] = BoundsMax.y;
+            single.MaxZ[0] = BoundsMax.z;
+            single.Children[0] = LeafFlag | leaf;
+        }
+        else
+        {
+            Nodes.clear();
+            Collapse(binaryNodes, 0);
+        }
+    }
+
+    Triangles.clear();
+    Triangles.shrink_to_fit();
+    Vertices = nullptr;
+    Indices = nullptr;
+}
+
+uint32_t RayTracer::BuildBinary(std::vector<BuildNode>* nodes, uint32_t first, uint32_t count, uint32_t depth)
+{
+    BuildTriangle* triangles = Triangles.data() + first;
+
+    XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+    XMVECTOR centerMin = boundsMin;
+    XMVECTOR centerMax = boundsMax;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        XMVECTOR center = XMLoadFloat3(&triangles[i].Center);
+        boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&triangles[i].Min));
+        boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&triangles[i].Max));
+        centerMin = XMVectorMin(centerMin, center);
+        centerMax = XMVectorMax(centerMax, center);
+    }
+
+    uint32_t index = (uint32_t)nodes->size();
+    nodes->push_back(BuildNode());
+    XMStoreFloat3(&(*nodes)[index].Min, boundsMin);
+    XMStoreFloat3(&(*nodes)[index].Max, boundsMax);
+    (*nodes)[index].First = first;
+    (*nodes)[index].Second = 0;
+    (*nodes)[index].Count = count;
+
+    // A leaf is tested in one go, so there's no point splitting one any further
+    if (count <= LeafTriangles)
+    {
+        return index;
+    }
+
+    XMFLOAT3 lowest, highest;
+    XMStoreFloat3(&lowest, centerMin);
+    XMStoreFloat3(&highest, centerMax);
+
+    float bestCost = FLT_MAX;
+    uint32_t bestAxis = UINT32_MAX;
+    uint32_t bestSplit = 0;
+    for (uint32_t axis = 0; axis < 3 && depth < MaxSahDepth; ++axis)
+    {
+        float low = GetComponent(lowest, axis);
+        float extent = GetComponent(highest, axis) - low;
+        if (extent <= 0.f)
+        {
+            continue;
+        }
+        float scale = NumBins / extent;
+
+        XMVECTOR binMin[NumBins];
+        XMVECTOR binMax[NumBins];
+        uint32_t binCount[NumBins];
+        for (uint32_t b = 0; b < NumBins; ++b)
+        {
+            binMin[b] = XMVectorReplicate(FLT_MAX);
+            binMax[b] = XMVectorReplicate(-FLT_MAX);
+            binCount[b] = 0;
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            uint32_t b = min((uint32_t)((GetComponent(triangles[i].Center, axis) - low) * scale), NumBins - 1);
+            binMin[b] = XMVectorMin(binMin[b], XMLoadFloat3(&triangles[i].Min));
+            binMax[b] = XMVectorMax(binMax[b], XMLoadFloat3(&triangles[i].Max));
+            ++binCount[b];
+        }
+
+        // Split s puts bins below s on the left
+        float rightCosts[NumBins];
+        XMVECTOR rightMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR rightMax = XMVectorReplicate(-FLT_MAX);
+        uint32_t numRight = 0;
+        for (uint32_t b = NumBins - 1; b > 0; --b)
+        {
+            rightMin = XMVectorMin(rightMin, binMin[b]);
+            rightMax = XMVectorMax(rightMax, binMax[b]);
+            numRight += binCount[b];
+            rightCosts[b] = numRight * SurfaceArea(rightMin, rightMax);
+        }
+
+        XMVECTOR leftMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR leftMax = XMVectorReplicate(-FLT_MAX);
+        uint32_t numLeft = 0;
+        for (uint32_t split = 1; split < NumBins; ++split)
+        {
+            leftMin = XMVectorMin(leftMin, binMin[split - 1]);
+            leftMax = XMVectorMax(leftMax, binMax[split - 1]);
+            numLeft += binCount[split - 1];
+            if (numLeft == 0 || numLeft == count)
+            {
+                continue;
+            }
+
+            float cost = numLeft * SurfaceArea(leftMin, leftMax) + rightCosts[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    uint32_t leftCount = count / 2;
+    if (bestAxis != UINT32_MAX)
+    {
+        float low = GetComponent(lowest, bestAxis);
+        float scale = NumBins / (GetComponent(highest, bestAxis) - low);
+        leftCount = (uint32_t)(std::partition(triangles, triangles + count, [=](const BuildTriangle& triangle)
+        {
+            return min((uint32_t)((GetComponent(triangle.Center, bestAxis) - low) * scale), NumBins - 1) < bestSplit;
+        }) - triangles);
+    }
+    else
+    {
+        // Too deep, or every center in the same place: halve along the widest axis
+        uint32_t axis = 0;
+        for (uint32_t i = 1; i < 3; ++i)
+        {
+            if (GetComponent(highest, i) - GetComponent(lowest, i) > GetComponent(highest, axis) - GetComponent(lowest, axis))
+            {
+                axis = i;
+            }
+        }
+        std::nth_element(triangles, triangles + leftCount, triangles + count, [=](const BuildTriangle& a, const BuildTriangle& b)
+        {
+            return GetComponent(a.Center, axis) < GetComponent(b.Center, axis);
+        });
+    }
+
+    uint32_t left = BuildBinary(nodes, first, leftCount, depth + 1);
+    uint32_t right = BuildBinary(nodes, first + leftCount, count - leftCount, depth + 1);
+    (*nodes)[index].First = left;
+    (*nodes)[index].Second = right;
+    (*nodes)[index].Count = 0;
+    return index;
+}
+
+uint32_t RayTracer::Collapse(const std::vector<BuildNode>& nodes, uint32_t node)
+{
+    // Open up the largest inner child until there are 4, so each 4 wide node replaces up to 3 binary ones
+    uint32_t children[4] = { nodes[node].First, nodes[node].Second };
+    uint32_t numChildren = 2;
+    while (numChildren < 4)
+    {
+        uint32_t largest = UINT32_MAX;
+        float largestArea = -1.f;
+        for (uint32_t i = 0; i < numChildren; ++i)
+        {
+            const BuildNode& child = nodes[children[i]];
+            float area = SurfaceArea(XMLoadFloat3(&child.Min), XMLoadFloat3(&child.Max));
+            if (child.Count == 0 && area > largestArea)
+            {
+                largest = i;
+                largestArea = area;
+            }
+        }
+        if (largest == UINT32_MAX)
+        {
+            break;
+        }
+
+        uint32_t opened = children[largest];
+        children[largest] = nodes[opened].First;
+        children[numChildren++] = nodes[opened].Second;
+    }
+
+    // Nodes grows while children are collapsed, so fill this one in by index afterwards
+    uint32_t index = (uint32_t)Nodes.size();
+    Nodes.push_back(Node());
+
+    uint32_t collapsed[4];
+    for (uint32_t i = 0; i < numChildren; ++i)
+    {
+        const BuildNode& child = nodes[children[i]];
+        collapsed[i] = child.Count > 0 ? LeafFlag | AddLeaf(child) : Collapse(nodes, children[i]);
+    }
+
+    Node& result = Nodes[index];
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+        if (i < numChildren)
+        {
+            const BuildNode& child = nodes[children[i]];
+            result.MinX[i] = child.Min.x;
+            result.MinY[i] = child.Min.y;
+            result.MinZ[i] = child.Min.z;
+            result.MaxX[i] = child.Max.x;
+            result.MaxY[i] = child.Max.y;
+            result.MaxZ[i] = child.Max.z;
+            result.Children[i] = collapsed[i];
+        }
+        else
+        {
+            result.MinX[i] = result.MinY[i] = result.MinZ[i] = 0.f;
+            result.MaxX[i] = result.MaxY[i] = result.MaxZ[i] = 0.f;
+            result.Children[i] = EmptyChild;
+        }
+    }
+    return index;
+}
+
+uint32_t RayTracer::AddLeaf(const BuildNode& node)
+{
+    assert(node.Count <= LeafTriangles);
+
+    Leaf leaf;
+    ZeroMemory(&leaf, sizeof(leaf));
+    for (uint32_t i = 0; i < node.Count; ++i)
+    {
+        const uint32_t* triangle = Indices + Triangles[node.First + i].Index * 3;
+        const XMFLOAT3& v0 = Vertices[triangle[0]].Position;
+        const XMFLOAT3& v1 = Vertices[triangle[1]].Position;
+        const XMFLOAT3& v2 = Vertices[triangle[2]].Position;
+
+        leaf.V0X[i] = v0.x;
+        leaf.V0Y[i] = v0.y;
+        leaf.V0Z[i] = v0.z;
+        leaf.E1X[i] = v1.x - v0.x;
+        leaf.E1Y[i] = v1.y - v0.y;
+        leaf.E1Z[i] = v1.z - v0.z;
+        leaf.E2X[i] = v2.x - v0.x;
+        leaf.E2Y[i] = v2.y - v0.y;
+        leaf.E2Z[i] = v2.z - v0.z;
+    }
+
+    Leaves.push_back(leaf);
+    return (uint32_t)Leaves.size() - 1;
+}
+
+bool RayTracer::IsOccluded(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const
+{
+    if (Leaves.empty())
+    {
+        return false;
+    }
+
+    XMFLOAT3 o, d;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&d, direction);
+
+    // Keeps the slab test free of 0 * infinity when the ray is parallel to an axis
+    static const float minComponent = 1e-20f;
+    XMFLOAT3 safe(
+        fabsf(d.x) < minComponent ? _copysignf(minComponent, d.x) : d.x,
+        fabsf(d.y) < minComponent ? _copysignf(minComponent, d.y) : d.y,
+        fabsf(d.z) < minComponent ? _copysignf(minComponent, d.z) : d.z);
+
+    const __m128 ox = _mm_set1_ps(o.x);
+    const __m128 oy = _mm_set1_ps(o.y);
+    const __m128 oz = _mm_set1_ps(o.z);
+    const __m128 dx = _mm_set1_ps(d.x);
+    const __m128 dy = _mm_set1_ps(d.y);
+    const __m128 dz = _mm_set1_ps(d.z);
+    const __m128 invX = _mm_set1_ps(1.f / safe.x);
+    const __m128 invY = _mm_set1_ps(1.f / safe.y);
+    const __m128 invZ = _mm_set1_ps(1.f / safe.z);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 tMax = _mm_set1_ps(maxDistance);
+
+    uint32_t stack[MaxTraversalStack];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        uint32_t item = stack[--stackSize];
+        if (item & LeafFlag)
+        {
+            // Moller-Trumbore against all 4 triangles
+            const Leaf& leaf = Leaves[item & ~LeafFlag];
+            __m128 e1x = _mm_loadu_ps(leaf.E1X);
+            __m128 e1y = _mm_loadu_ps(leaf.E1Y);
+            __m128 e1z = _mm_loadu_ps(leaf.E1Z);
+            __m128 e2x = _mm_loadu_ps(leaf.E2X);
+            __m128 e2y = _mm_loadu_ps(leaf.E2Y);
+            __m128 e2z = _mm_loadu_ps(leaf.E2Z);
+
+            __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+            __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+            __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+            __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+
+            // Unused (all 0) triangles get an infinite inverse, so u below is NaN and never passes
+            __m128 invDet = _mm_div_ps(one, det);
+
+            __m128 sx = _mm_sub_ps(ox, _mm_loadu_ps(leaf.V0X));
+            __m128 sy = _mm_sub_ps(oy, _mm_loadu_ps(leaf.V0Y));
+            __m128 sz = _mm_sub_ps(oz, _mm_loadu_ps(leaf.V0Z));
+            __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+            __m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+            __m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+            __m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+            __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+            __m128 hit = _mm_and_ps(_mm_cmpge_ps(u, zero), _mm_cmpge_ps(v, zero));
+            hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_add_ps(u, v), one));
+            hit = _mm_and_ps(hit, _mm_and_ps(_mm_cmpgt_ps(t, zero), _mm_cmple_ps(t, tMax)));
+            if (_mm_movemask_ps(hit))
+            {
+                return true;
+            }
+            continue;
+        }
+
+        // Slab test against all 4 child boxes
+        const Node& node = Nodes[item];
+        __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MinX), ox), invX);
+        __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MaxX), ox), invX);
+        __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MinY), oy), invY);
+        __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MaxY), oy), invY);
+        __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MinZ), oz), invZ);
+        __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.MaxZ), oz), invZ);
+
+        __m128 enter = _mm_max_ps(_mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)), _mm_max_ps(_mm_min_ps(t0z, t1z), zero));
+        __m128 leave = _mm_min_ps(_mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)), _mm_min_ps(_mm_max_ps(t0z, t1z), tMax));
+        int mask = _mm_movemask_ps(_mm_cmple_ps(enter, leave));
+
+        for (uint32_t i = 0; i < 4; ++i)
+        {
+            if ((mask & (1 << i)) && node.Children[i] != EmptyChild)
+            {
+                assert(stackSize < MaxTraversalStack);
+                stack[stackSize++] = node.Children[i];
+            }
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "AssetLoader.h"
+
+// Ray tracer over a triangle mesh, for baking. A 4 wide bounding volume hierarchy: each node
+// holds the boxes of up to 4 children and each leaf up to 4 triangles, both stored as structures
+// of arrays so a ray is tested against all 4 at once with SSE. Built as a binary tree with a
+// binned surface area heuristic, then collapsed to 4 wide by pulling up grandchildren.
+//
+// Only occlusion (any hit) queries, which is all baking visibility needs. Safe to query from
+// any number of threads once built.
+class RayTracer
+{
+public:
+    RayTracer();
+
+    void Build(const std::vector<ModelVertex>& vertices, const std::vector<uint32_t>& indices);
+
+    // True if the ray hits any triangle (either side) at a distance in (0, maxDistance].
+    // Distances are in units of direction's length.
+    bool IsOccluded(FXMVECTOR origin, FXMVECTOR direction, float maxDistance) const;
+
+    uint32_t GetNumTriangles() const { return NumTriangles; }
+    uint32_t GetNumNodes() const { return (uint32_t)Nodes.size(); }
+
+    // Bounds of every triangle
+    const XMFLOAT3& GetBoundsMin() const { return BoundsMin; }
+    const XMFLOAT3& GetBoundsMax() const { return BoundsMax; }
+
+private:
+    // Children are node indices, LeafFlag | index into Leaves, or EmptyChild
+    struct Node
+    {
+        float       MinX[4];
+        float       MinY[4];
+        float       MinZ[4];
+        float       MaxX[4];
+        float       MaxY[4];
+        float       MaxZ[4];
+        uint32_t    Children[4];
+    };
+
+    // Up to 4 triangles as a first vertex and two edges. Unused ones are all 0, which never hit
+    struct Leaf
+    {
+        float       V0X[4];
+        float       V0Y[4];
+        float       V0Z[4];
+        float       E1X[4];
+        float       E1Y[4];
+        float       E1Z[4];
+        float       E2X[4];
+        float       E2Y[4];
+        float       E2Z[4];
+    };
+
+    // Triangle bounds, partitioned in place while building
+    struct BuildTriangle
+    {
+        XMFLOAT3    Min;
+        XMFLOAT3    Max;
+        XMFLOAT3    Center;
+        uint32_t    Index;
+    };
+
+    // Binary tree, before collapsing. Leaves have Count > 0 triangles from First
+    struct BuildNode
+    {
+        XMFLOAT3    Min;
+        XMFLOAT3    Max;
+        uint32_t    First;      // Leaf: first triangle. Otherwise: left child, with right at Second
+        uint32_t    Second;
+        uint32_t    Count;
+    };
+
+    uint32_t BuildBinary(std::vector<BuildNode>* nodes, uint32_t first, uint32_t count, uint32_t depth);
+    uint32_t Collapse(const std::vector<BuildNode>& nodes, uint32_t node);
+    uint32_t AddLeaf(const BuildNode& node);
+
+    std::vector<Node>           Nodes;
+    std::vector<Leaf>           Leaves;
+    uint32_t                    NumTriangles;
+    XMFLOAT3                    BoundsMin;
+    XMFLOAT3                    BoundsMax;
+
+    // Scratch for building
+    const ModelVertex*          Vertices;
+    const uint32_t*             Indices;
+    std::vector<BuildTriangle>  Triangles;
+};
@@ -35,6 +35,32 @@ inline std::wstring ConvertToWide(const std::string& input)
     return output;
 }
 
+inline std::string ConvertToUtf8(const std::wstring& input)
+{
+    if (input.empty())
+    {
+        return std::string();
+    }
+
+    int size = WideCharToMultiByte(CP_UTF8, 0, input.c_str(), (int)input.size(), nullptr, 0, nullptr, nullptr);
+    std::string output(size, ' ');
+    WideCharToMultiByte(CP_UTF8, 0, input.c_str(), (int)input.size(), &output[0], size, nullptr, nullptr);
+    return output;
+}
+
+inline std::wstring ConvertFromUtf8(const std::string& input)
+{
+    if (input.empty())
+    {
+        return std::wstring();
+    }
+
+    int size = MultiByteToWideChar(CP_UTF8, 0, input.c_str(), (int)input.size(), nullptr, 0);
+    std::wstring output(size, L' ');
+    MultiByteToWideChar(CP_UTF8, 0, input.c_str(), (int)input.size(), &output[0], size);
+    return output;
+}
+
 inline void NormalizeSlashes(std::wstring& path)
 {
     for (int i = 0; i < (int)path.size(); ++i)
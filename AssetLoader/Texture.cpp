@@ -5,38 +5,53 @@
 #include "AssetLoader.h"
 #include <wincodec.h>
 
-bool SaveTexture(const std::wstring& assetFilename, const std::wstring& outputFilename, bool saveDerivativeMap, bool expandChannels)
+bool LoadTextureImage(const std::wstring& assetFilename, TexMetadata* metadata, ScratchImage& image)
 {
-    FileHandle outputFile(CreateFile(outputFilename.c_str(), GENERIC_WRITE,
-        0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
-    if (!outputFile.IsValid())
-    {
-        LogError(L"Failed to create output file: %s.", outputFilename.c_str());
-        return false;
-    }
-
-    DWORD bytesWritten{};
-
-    TexMetadata metadata;
-    ScratchImage image;
     // Try for DDS first
-    HRESULT hr = LoadFromDDSFile(assetFilename.c_str(), DDS_FLAGS_NONE, &metadata, image);
+    HRESULT hr = LoadFromDDSFile(assetFilename.c_str(), DDS_FLAGS_NONE, metadata, image);
     if (FAILED(hr))
     {
         // No? then try TGA
-        hr = LoadFromTGAFile(assetFilename.c_str(), &metadata, image);
+        hr = LoadFromTGAFile(assetFilename.c_str(), metadata, image);
         if (FAILED(hr))
         {
             // Boo, use WIC as the catch-all
-            hr = LoadFromWICFile(assetFilename.c_str(), WIC_FLAGS_NONE, &metadata, image);
+            hr = LoadFromWICFile(assetFilename.c_str(), WIC_FLAGS_NONE, metadata, image);
             if (FAILED(hr))
             {
-                LogError(L"Failed to load texture image.");
+                LogError(L"Failed to load texture image: %s.", assetFilename.c_str());
                 return false;
             }
         }
     }
 
+    return true;
+}
+
+bool SaveTexture(const std::wstring& assetFilename, const std::wstring& outputFilename, bool saveDerivativeMap, bool expandChannels)
+{
+    std::vector<uint8_t> data;
+    if (!BuildTextureData(assetFilename, saveDerivativeMap, expandChannels, &data))
+    {
+        LogError(L"Failed to build texture.");
+        return false;
+    }
+
+    return SaveBlob(outputFilename, data);
+}
+
+bool BuildTextureData(const std::wstring& assetFilename, bool saveDerivativeMap, bool expandChannels, std::vector<uint8_t>* data)
+{
+    TexMetadata metadata;
+    ScratchImage image;
+    if (!LoadTextureImage(assetFilename, &metadata, image))
+    {
+        LogError(L"Failed to load texture image.");
+        return false;
+    }
+
+    HRESULT hr = S_OK;
+
     if (saveDerivativeMap)
     {
 #if 0 // Build normal maps instead
@@ -119,17 +134,10 @@ bool SaveTexture(const std::wstring& assetFilename, const std::wstring& outputFi
     header.Height = (uint32_t)mipChainMetadata.height;
     header.MipLevels = (uint32_t)mipChainMetadata.mipLevels;
 
-    if (!WriteFile(outputFile.Get(), &header, sizeof(header), &bytesWritten, nullptr))
-    {
-        LogError(L"Error writing output file.");
-        return false;
-    }
-
-    if (!WriteFile(outputFile.Get(), mipChain.GetPixels(), (uint32_t)mipChain.GetPixelsSize(), &bytesWritten, nullptr))
-    {
-        LogError(L"Error writing output file.");
-        return false;
-    }
+    data->clear();
+    data->reserve(sizeof(header) + mipChain.GetPixelsSize());
+    AppendData(data, &header, sizeof(header));
+    AppendData(data, mipChain.GetPixels(), mipChain.GetPixelsSize());
 
     return true;
 }
@@ -138,24 +146,14 @@ bool ConvertToBumpMapToNormalMap(const std::wstring& bumpFilename, const std::ws
 {
     TexMetadata metadata;
     ScratchImage image;
-    // Try for DDS first
-    HRESULT hr = LoadFromDDSFile(bumpFilename.c_str(), DDS_FLAGS_NONE, &metadata, image);
-    if (FAILED(hr))
+    if (!LoadTextureImage(bumpFilename, &metadata, image))
     {
-        // No? then try TGA
-        hr = LoadFromTGAFile(bumpFilename.c_str(), &metadata, image);
-        if (FAILED(hr))
-        {
-            // Boo, use WIC as the catch-all
-            hr = LoadFromWICFile(bumpFilename.c_str(), WIC_FLAGS_NONE, &metadata, image);
-            if (FAILED(hr))
-            {
-                LogError(L"Failed to load texture image.");
-                return false;
-            }
-        }
+        LogError(L"Failed to load texture image.");
+        return false;
     }
 
+    HRESULT hr = S_OK;
+
     ScratchImage normalMap;
     hr = ComputeNormalMap(image.GetImages(), image.GetImageCount(), metadata, CNMAP_CHANNEL_RED, 10.f, DXGI_FORMAT_R8G8B8A8_UNORM, normalMap);
     if (FAILED(hr))
@@ -0,0 +1,232 @@
+#include "Precomp.h"
+#include "Assets.h"
+#include "Debug.h"
+#include "Parallel.h"
+#include "AssetLoader.h"
+
+// Copies a bordered tile out of a mip level, wrapping at the image edges so tiling
+// textures filter correctly across the seam. Both images are R8G8B8A8.
+static void CopyTile(const Image& mip, uint32_t tileX, uint32_t tileY, uint32_t tileSize, uint32_t tileBorder, const Image& tile)
+{
+    uint32_t pageSize = tileSize + 2 * tileBorder;
+    int32_t originX = (int32_t)(tileX * tileSize) - (int32_t)tileBorder;
+    int32_t originY = (int32_t)(tileY * tileSize) - (int32_t)tileBorder;
+    int32_t width = (int32_t)mip.width;
+    int32_t height = (int32_t)mip.height;
+
+    for (uint32_t y = 0; y < pageSize; ++y)
+    {
+        int32_t srcY = ((originY + (int32_t)y) % height + height) % height;
+        const uint32_t* pSrc = (const uint32_t*)(mip.pixels + srcY * mip.rowPitch);
+        uint32_t* pDst = (uint32_t*)(tile.pixels + y * tile.rowPitch);
+
+        for (uint32_t x = 0; x < pageSize; ++x)
+        {
+            int32_t srcX = ((originX + (int32_t)x) % width + width) % width;
+            pDst[x] = pSrc[srcX];
+        }
+    }
+}
+
+static bool HasTransparency(const Image& image)
+{
+    for (size_t y = 0; y < image.height; ++y)
+    {
+        const uint8_t* p = image.pixels + y * image.rowPitch;
+        for (size_t x = 0; x < image.width; ++x)
+        {
+            if (p[x * 4 + 3] != 255)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool SaveVirtualTexture(const std::wstring& assetFilename, const std::wstring& outputFilename, uint32_t tileSize, uint32_t tileBorder, bool compress)
+{
+    uint32_t pageSize = tileSize + 2 * tileBorder;
+    if (tileSize == 0 || (compress && (pageSize % 4) != 0))
+    {
+        LogError(L"Invalid tile size. Compressed pages must be a multiple of 4 texels wide.");
+        return false;
+    }
+
+    TexMetadata metadata;
+    ScratchImage image;
+    if (!LoadTextureImage(assetFilename, &metadata, image))
+    {
+        LogError(L"Failed to load texture image.");
+        return false;
+    }
+
+    HRESULT hr = S_OK;
+
+    // Tiles are cut from uncompressed RGBA, regardless of the source format
+    if (IsCompressed(metadata.format))
+    {
+        ScratchImage originalImage(std::move(image));
+        hr = Decompress(originalImage.GetImages(), originalImage.GetImageCount(), metadata, DXGI_FORMAT_R8G8B8A8_UNORM, image);
+        if (FAILED(hr))
+        {
+            LogError(L"Failed to decompress source texture.");
+            return false;
+        }
+    }
+    else if (metadata.format != DXGI_FORMAT_R8G8B8A8_UNORM)
+    {
+        ScratchImage originalImage(std::move(image));
+        hr = Convert(originalImage.GetImages(), originalImage.GetImageCount(), metadata,
+            DXGI_FORMAT_R8G8B8A8_UNORM, TEX_FILTER_BOX, 0.f, image);
+        if (FAILED(hr))
+        {
+            LogError(L"Failed to convert source texture to RGBA.");
+            return false;
+        }
+    }
+
+    // Only generate mips down to the first level that fits in a single tile. Anything
+    // coarser than that would just be padding.
+    uint32_t width = (uint32_t)image.GetMetadata().width;
+    uint32_t height = (uint32_t)image.GetMetadata().height;
+    uint32_t mipLevels = 1;
+    while (max(width >> (mipLevels - 1), height >> (mipLevels - 1)) > tileSize)
+    {
+        ++mipLevels;
+    }
+
+    ScratchImage mipChain;
+    if (mipLevels > 1)
+    {
+        hr = GenerateMipMaps(*image.GetImage(0, 0, 0), TEX_FILTER_BOX | TEX_FILTER_FORCE_NON_WIC, mipLevels, mipChain);
+    }
+    else
+    {
+        // Already fits in a single tile. GenerateMipMaps rejects a single level request
+        hr = mipChain.InitializeFromImage(*image.GetImage(0, 0, 0));
+    }
+    if (FAILED(hr))
+    {
+        LogError(L"Failed to create mips for texture.");
+        return false;
+    }
+
+    DXGI_FORMAT pageFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+    if (compress)
+    {
+        pageFormat = HasTransparency(*mipChain.GetImage(0, 0, 0)) ? DXGI_FORMAT_BC3_UNORM : DXGI_FORMAT_BC1_UNORM;
+    }
+
+    size_t rowPitch = 0;
+    size_t slicePitch = 0;
+    ComputePitch(pageFormat, pageSize, pageSize, rowPitch, slicePitch);
+
+    // Build the page index. Every page is the same size, so offsets are known up front
+    // and each tile can be produced independently.
+    std::vector<VirtualTextureTile> tiles;
+    for (uint32_t mip = 0; mip < mipLevels; ++mip)
+    {
+        const Image* mipImage = mipChain.GetImage(mip, 0, 0);
+        uint32_t tilesWide = ((uint32_t)mipImage->width + tileSize - 1) / tileSize;
+        uint32_t tilesHigh = ((uint32_t)mipImage->height + tileSize - 1) / tileSize;
+
+        for (uint32_t y = 0; y < tilesHigh; ++y)
+        {
+            for (uint32_t x = 0; x < tilesWide; ++x)
+            {
+                VirtualTextureTile tile{};
+                tile.Mip = mip;
+                tile.X = x;
+                tile.Y = y;
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    VirtualTextureHeader header{};
+    header.Signature = VirtualTextureHeader::ExpectedSignature;
+    header.Width = width;
+    header.Height = height;
+    header.MipLevels = mipLevels;
+    header.TileSize = tileSize;
+    header.TileBorder = tileBorder;
+    header.Format = pageFormat;
+    header.PageSize = (uint32_t)slicePitch;
+    header.NumTiles = (uint32_t)tiles.size();
+
+    uint64_t dataOffset = sizeof(header) + tiles.size() * sizeof(VirtualTextureTile);
+    for (uint32_t i = 0; i < (uint32_t)tiles.size(); ++i)
+    {
+        tiles[i].Offset = dataOffset + (uint64_t)i * header.PageSize;
+    }
+
+    std::unique_ptr<uint8_t[]> pages(new uint8_t[tiles.size() * header.PageSize]);
+    if (!pages)
+    {
+        LogError(L"Failed to allocate page data.");
+        return false;
+    }
+
+    // Cut and compress every tile in parallel
+    std::atomic<bool> failed(false);
+    ParallelFor((uint32_t)tiles.size(), [&](uint32_t i)
+    {
+        const VirtualTextureTile& tile = tiles[i];
+
+        ScratchImage page;
+        if (FAILED(page.Initialize2D(DXGI_FORMAT_R8G8B8A8_UNORM, pageSize, pageSize, 1, 1)))
+        {
+            failed = true;
+            return;
+        }
+
+        CopyTile(*mipChain.GetImage(tile.Mip, 0, 0), tile.X, tile.Y, tileSize, tileBorder, *page.GetImage(0, 0, 0));
+
+        const Image* result = page.GetImage(0, 0, 0);
+        ScratchImage compressed;
+        if (compress)
+        {
+            if (FAILED(Compress(*result, pageFormat, TEX_COMPRESS_DEFAULT, 0.5f, compressed)))
+            {
+                failed = true;
+                return;
+            }
+            result = compressed.GetImage(0, 0, 0);
+        }
+
+        assert(result->slicePitch == header.PageSize);
+        memcpy(pages.get() + (size_t)i * header.PageSize, result->pixels, header.PageSize);
+    });
+
+    if (failed)
+    {
+        LogError(L"Failed to build virtual texture pages.");
+        return false;
+    }
+
+    std::wstring tempFilename = GetTempFilename(outputFilename);
+    FileHandle outputFile(CreateFile(tempFilename.c_str(), GENERIC_WRITE,
+        0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!outputFile.IsValid())
+    {
+        LogError(L"Failed to create output file: %s.", tempFilename.c_str());
+        return false;
+    }
+
+    DWORD bytesWritten{};
+    bool written =
+        WriteFile(outputFile.Get(), &header, sizeof(header), &bytesWritten, nullptr) &&
+        WriteFile(outputFile.Get(), tiles.data(), (DWORD)(tiles.size() * sizeof(VirtualTextureTile)), &bytesWritten, nullptr) &&
+        WriteFile(outputFile.Get(), pages.get(), (DWORD)(tiles.size() * header.PageSize), &bytesWritten, nullptr);
+    outputFile.Close();
+
+    if (!written)
+    {
+        DeleteFile(tempFilename.c_str());
+        LogError(L"Error writing output file.");
+        return false;
+    }
+
+    return ReplaceOutputFile(tempFilename, outputFilename);
+}
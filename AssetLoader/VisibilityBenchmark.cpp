@@ -0,0 +1,103 @@
+#include "Precomp.h"
+#include "Assets.h"
+#include "ObjModel.h"
+#include "RayTracer.h"
+#include "PotentiallyVisibleSets.h"
+
+static double ElapsedMs(const LARGE_INTEGER& start, const LARGE_INTEGER& end, const LARGE_INTEGER& frequency)
+{
+    return (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+static uint32_t CountBits(uint32_t x)
+{
+    uint32_t count = 0;
+    for (; x; x &= x - 1)
+    {
+        ++count;
+    }
+    return count;
+}
+
+bool RunVisibilityBenchmark(const std::wstring& modelFilename, uint32_t samplesPerCell)
+{
+    if (samplesPerCell == 0)
+    {
+        samplesPerCell = 1;
+    }
+
+    std::unique_ptr<ObjModel> model(new ObjModel);
+    if (!LoadSourceModel(modelFilename, model.get()))
+    {
+        wprintf(L"Failed to load %s.\n", modelFilename.c_str());
+        return false;
+    }
+
+    std::vector<VisibilityPart> parts;
+    for (auto& object : model->Objects)
+    {
+        for (auto& part : object.Parts)
+        {
+            VisibilityPart visibilityPart{};
+            visibilityPart.StartIndex = part.StartIndex;
+            visibilityPart.NumIndices = part.NumIndices;
+            parts.push_back(visibilityPart);
+        }
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    RayTracer tracer;
+    QueryPerformanceCounter(&start);
+    tracer.Build(model->Vertices, model->Indices);
+    QueryPerformanceCounter(&end);
+    double buildMs = ElapsedMs(start, end, frequency);
+
+    VisibilityBakeSettings settings = VisibilityBakeSettings::GetDefault(tracer);
+    settings.SamplesPerCell = samplesPerCell;
+
+    // Both bakes must agree, since each cell only depends on its own rays
+    ModelVisibilityHeader header{};
+    std::vector<uint32_t> results[2];
+    const wchar_t* names[] = { L"1 thread", L"All threads" };
+    double baselineMs = 0.0;
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        settings.Multithreaded = i == 1;
+
+        QueryPerformanceCounter(&start);
+        uint64_t numRays = BakeVisibility(tracer, model->Vertices, model->Indices, parts, settings, &header, &results[i]);
+        QueryPerformanceCounter(&end);
+
+        double ms = ElapsedMs(start, end, frequency);
+        if (i == 0)
+        {
+            baselineMs = ms;
+            wprintf(L"Potentially visible sets, %s\n", modelFilename.c_str());
+            wprintf(L"  %u parts, %u triangles, %u x %u x %u cells of %.2f, %u x %u samples per cell & part\n",
+                header.NumParts, tracer.GetNumTriangles(), header.CellsX, header.CellsY, header.CellsZ, header.CellSize.x,
+                settings.SamplesPerCell, settings.SamplesPerPart);
+            wprintf(L"  Build: %8.2f ms, %u nodes\n", buildMs, tracer.GetNumNodes());
+        }
+        wprintf(L"  %-12s %10.2f ms, %8.2f Mrays/s, %5.2fx\n", names[i], ms, numRays / (ms * 1000.0), baselineMs / ms);
+    }
+
+    if (results[0] != results[1])
+    {
+        wprintf(L"  Multithreaded bake differs from the single threaded one.\n");
+        return false;
+    }
+
+    uint64_t numVisible = 0;
+    for (auto word : results[0])
+    {
+        numVisible += CountBits(word);
+    }
+    uint64_t numCells = (uint64_t)header.CellsX * header.CellsY * header.CellsZ;
+    wprintf(L"  Average %.1f%% of parts visible per cell, %Iu bytes\n",
+        (numCells * header.NumParts) == 0 ? 100.0 : 100.0 * numVisible / (numCells * header.NumParts),
+        sizeof(ModelVisibilityHeader) + results[0].size() * sizeof(uint32_t));
+
+    return true;
+}
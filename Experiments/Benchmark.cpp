@@ -0,0 +1,1732 @@
+#include "Precomp.h"
+#include "Benchmark.h"
+#include "Culling.h"
+#include "OcclusionCulling.h"
+#include "CameraPath.h"
+#include "ContentLoader.h"
+#include "ConstantRing.h"
+#include "LightClustering.h"
+#include "SoftwareRenderer.h"
+#include "FrameTimings.h"
+#include "DrawQueue.h"
+#include "FramePipeline.h"
+#include "JobSystem.h"
+#include "TransformSystem.h"
+#include "Bvh.h"
+#include "Brdf.h"
+#include "RangeAllocator.h"
+#include "TextureStreamer.h"
+#include <stdio.h>
+#include <random>
+
+void OpenConsole()
+{
+    static bool opened = false;
+    if (opened)
+    {
+        return;
+    }
+
+    // WinMain apps have no console, so borrow the parent's if there is one
+    if (!AttachConsole(ATTACH_PARENT_PROCESS))
+    {
+        AllocConsole();
+    }
+
+    FILE* stream = nullptr;
+    freopen_s(&stream, "CONOUT$", "w", stdout);
+    opened = true;
+}
+
+// Same projection as the interactive app
+static XMMATRIX GetBenchmarkProjection()
+{
+    return XMMatrixPerspectiveFovRH(XMConvertToRadians(70.f), 1280 / 720.f, 0.5f, 10000.f);
+}
+
+static double ElapsedMs(const LARGE_INTEGER& start, const LARGE_INTEGER& end, const LARGE_INTEGER& frequency)
+{
+    return (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+bool RunCullingBenchmark(uint32_t numParts, uint32_t iterations)
+{
+    OpenConsole();
+
+    if (numParts == 0 || iterations == 0)
+    {
+        wprintf(L"Nothing to cull.\n");
+        return false;
+    }
+
+    // Roughly sponza sized world, boxes of a few units up to a few tens of units
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-1500.f, 1500.f);
+    std::uniform_real_distribution<float> size(1.f, 40.f);
+
+    CullingBoxes boxes;
+    boxes.Reserve(numParts);
+    for (uint32_t i = 0; i < numParts; ++i)
+    {
+        XMFLOAT3 center(position(random), position(random) * 0.25f, position(random));
+        XMFLOAT3 extents(size(random), size(random), size(random));
+        XMMATRIX world = XMMatrixRotationRollPitchYaw(position(random), position(random), position(random));
+        boxes.AddTransformed(center, extents, world);
+    }
+
+    XMMATRIX projection = GetBenchmarkProjection();
+
+    std::vector<uint32_t> visibleSimd(numParts);
+    std::vector<uint32_t> visibleScalar(numParts);
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    double simdMs = 0.0;
+    double scalarMs = 0.0;
+    uint64_t totalVisible = 0;
+
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        // Spin the camera around the middle of the world, so the visible set keeps changing
+        float angle = XM_2PI * (float)i / (float)iterations;
+        XMVECTOR eye = XMVectorSet(cosf(angle) * 500.f, 50.f, sinf(angle) * 500.f, 1.f);
+        XMMATRIX view = XMMatrixLookAtRH(eye, XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+        XMMATRIX viewProjection = view * projection;
+
+        QueryPerformanceCounter(&start);
+        uint32_t numSimd = FrustumCull(boxes, viewProjection, visibleSimd.data());
+        QueryPerformanceCounter(&end);
+        simdMs += ElapsedMs(start, end, frequency);
+
+        QueryPerformanceCounter(&start);
+        uint32_t numScalar = FrustumCullScalar(boxes, viewProjection, visibleScalar.data());
+        QueryPerformanceCounter(&end);
+        scalarMs += ElapsedMs(start, end, frequency);
+
+        if (numSimd != numScalar || memcmp(visibleSimd.data(), visibleScalar.data(), numSimd * sizeof(uint32_t)) != 0)
+        {
+            wprintf(L"Culling mismatch on iteration %u: SIMD %u visible, scalar %u visible.\n", i, numSimd, numScalar);
+            return false;
+        }
+
+        totalVisible += numSimd;
+    }
+
+#if defined(__AVX__)
+    const wchar_t* instructionSet = L"AVX";
+#else
+    const wchar_t* instructionSet = L"SSE";
+#endif
+
+    wprintf(L"Frustum culling, %u parts, %u iterations (%s)\n", numParts, iterations, instructionSet);
+    wprintf(L"  Average visible: %.1f\n", (double)totalVisible / iterations);
+    wprintf(L"  SIMD:   %8.4f ms per cull\n", simdMs / iterations);
+    wprintf(L"  Scalar: %8.4f ms per cull\n", scalarMs / iterations);
+    wprintf(L"  Speedup: %.2fx\n", scalarMs / simdMs);
+    return true;
+}
+
+bool RunOcclusionBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename, const std::wstring& cameraPath)
+{
+    OpenConsole();
+
+    // No device, so only the CPU side of the model is loaded
+    ContentLoader loader(nullptr, contentRoot);
+
+    std::vector<std::shared_ptr<Object>> objects(1);
+    if (!loader.LoadObject(modelFilename, &objects[0]))
+    {
+        wprintf(L"Failed to load %s.\n", modelFilename.c_str());
+        return false;
+    }
+
+    std::vector<CameraKey> path;
+    if (cameraPath.empty())
+    {
+        GetDefaultCameraPath(600, &path);
+    }
+    else if (!LoadCameraPath(cameraPath, &path))
+    {
+        wprintf(L"Failed to load camera path %s.\n", cameraPath.c_str());
+        return false;
+    }
+
+    std::unique_ptr<OcclusionBuffer> occlusion = OcclusionBuffer::Create(OcclusionBufferWidth, OcclusionBufferHeight);
+    if (!occlusion)
+    {
+        wprintf(L"Failed to create occlusion buffer.\n");
+        return false;
+    }
+
+    std::unique_ptr<JobSystem> jobs = JobSystem::Create();
+    if (!jobs)
+    {
+        wprintf(L"Failed to create job system.\n");
+        return false;
+    }
+
+    SelectOccluders(objects, OccluderTriangleBudget);
+
+    // Parts don't move, so bounds and occluders are gathered once
+    CullingBoxes bounds;
+    for (auto& object : objects)
+    {
+        XMMATRIX root = XMLoadFloat4x4(&object->RootTransform);
+        for (auto& part : object->Parts)
+        {
+            XMMATRIX world = XMLoadFloat4x4(&part->RelativeTransform) * root;
+            bounds.AddTransformed(part->BoundsCenter, part->BoundsExtents, world);
+
+            if (part->IsOccluder)
+            {
+                occlusion->AddOccluder(object->Positions.data(), object->Indices.data() + part->StartIndex, part->NumIndices, world);
+            }
+        }
+    }
+
+    XMMATRIX projection = GetBenchmarkProjection();
+    std::vector<uint32_t> visible(bounds.Size());
+
+    LARGE_INTEGER frequency, start, rendered, end;
+    QueryPerformanceFrequency(&frequency);
+
+    uint64_t totalFrustumVisible = 0;
+    uint64_t totalVisible = 0;
+    uint64_t totalBinned = 0;
+    double totalRenderMs = 0.0;
+    double totalTestMs = 0.0;
+    double maxMs = 0.0;
+
+    for (auto& key : path)
+    {
+        XMMATRIX viewProjection = ComputeCameraView(key.Position, key.Yaw, key.Pitch) * projection;
+
+        uint32_t numFrustumVisible = FrustumCull(bounds, viewProjection, visible.data());
+
+        QueryPerformanceCounter(&start);
+        occlusion->Render(viewProjection, jobs.get());
+        QueryPerformanceCounter(&rendered);
+        uint32_t numVisible = occlusion->TestVisibility(bounds, visible.data(), numFrustumVisible, visible.data());
+        QueryPerformanceCounter(&end);
+
+        totalFrustumVisible += numFrustumVisible;
+        totalVisible += numVisible;
+        totalBinned += occlusion->GetNumBinnedTriangles();
+        totalRenderMs += ElapsedMs(start, rendered, frequency);
+        totalTestMs += ElapsedMs(rendered, end, frequency);
+        maxMs = max(maxMs, ElapsedMs(start, end, frequency));
+    }
+
+    double numFrames = (double)path.size();
+    double culledPercent = totalFrustumVisible ? 100.0 * (double)(totalFrustumVisible - totalVisible) / (double)totalFrustumVisible : 0.0;
+
+    wprintf(L"Occlusion culling, %s, %u frames\n", cameraPath.empty() ? L"default path" : cameraPath.c_str(), (uint32_t)path.size());
+    wprintf(L"  Parts: %u, occluder triangles: %u, buffer: %ux%u\n", bounds.Size(), occlusion->GetNumOccluderTriangles(), OcclusionBufferWidth, OcclusionBufferHeight);
+    wprintf(L"  Average binned triangles: %.0f\n", (double)totalBinned / numFrames);
+    wprintf(L"  Average visible after frustum culling: %.1f\n", (double)totalFrustumVisible / numFrames);
+    wprintf(L"  Average visible after occlusion culling: %.1f (%.1f%% of frustum visible parts culled)\n", (double)totalVisible / numFrames, culledPercent);
+    wprintf(L"  Rasterize: %8.4f ms per frame\n", totalRenderMs / numFrames);
+    wprintf(L"  Test:      %8.4f ms per frame\n", totalTestMs / numFrames);
+    wprintf(L"  Worst frame: %8.4f ms\n", maxMs);
+    return true;
+}
+
+bool RunConstantsBenchmark(uint32_t drawsPerFrame, uint32_t frames)
+{
+    OpenConsole();
+
+    if (drawsPerFrame == 0 || frames == 0)
+    {
+        wprintf(L"Nothing to write.\n");
+        return false;
+    }
+
+    // Matches DeferredRenderer11's geometry pass constants
+    struct DrawConstants
+    {
+        XMFLOAT4X4 World;
+        XMFLOAT4X4 View;
+        XMFLOAT4X4 Projection;
+    };
+
+    static const uint32_t capacity = 16 * 1024 * 1024;
+    static const uint32_t frameLatency = 2;
+    static const uint32_t alignment = 256;
+
+    RingAllocator allocator(capacity);
+    std::vector<uint8_t> memory(capacity);
+
+    DrawConstants constants;
+    XMStoreFloat4x4(&constants.View, XMMatrixLookAtRH(XMVectorSet(0.f, 10.f, 0.f, 1.f), XMVectorSet(0.f, 10.f, -1.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f)));
+    XMStoreFloat4x4(&constants.Projection, GetBenchmarkProjection());
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    uint64_t written = 0;
+    uint32_t failed = 0;
+
+    QueryPerformanceCounter(&start);
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        if (frame >= frameLatency)
+        {
+            allocator.Retire(frame - frameLatency);
+        }
+
+        for (uint32_t i = 0; i < drawsPerFrame; ++i)
+        {
+            uint32_t offset = 0;
+            if (!allocator.Allocate(sizeof(DrawConstants), alignment, &offset))
+            {
+                ++failed;
+                continue;
+            }
+
+            XMStoreFloat4x4(&constants.World, XMMatrixTranslation((float)i, 0.f, (float)frame));
+            memcpy(memory.data() + offset, &constants, sizeof(constants));
+            ++written;
+        }
+
+        allocator.EndFrame(frame);
+    }
+    QueryPerformanceCounter(&end);
+
+    double ms = ElapsedMs(start, end, frequency);
+
+    wprintf(L"Constant ring, %u draws per frame, %u frames, %u KB ring\n", drawsPerFrame, frames, capacity / 1024);
+    wprintf(L"  Constants written: %llu (%u didn't fit)\n", written, failed);
+    wprintf(L"  Total: %.3f ms\n", ms);
+    wprintf(L"  %.0f constants per ms (%.1f MB/s)\n", (double)written / ms, (double)written * sizeof(DrawConstants) / (ms * 1000.0));
+    return true;
+}
+
+bool RunLightClusteringBenchmark(uint32_t frames)
+{
+    OpenConsole();
+
+    if (frames == 0)
+    {
+        wprintf(L"Nothing to cluster.\n");
+        return false;
+    }
+
+    std::unique_ptr<LightClusters> clusters = LightClusters::Create();
+    if (!clusters)
+    {
+        wprintf(L"Failed to create light clusters.\n");
+        return false;
+    }
+
+    std::unique_ptr<JobSystem> jobs = JobSystem::Create();
+    if (!jobs)
+    {
+        wprintf(L"Failed to create job system.\n");
+        return false;
+    }
+
+    XMMATRIX projection = GetBenchmarkProjection();
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    static const uint32_t lightCounts[] = { 1000, 10000, 100000 };
+    for (uint32_t count = 0; count < _countof(lightCounts); ++count)
+    {
+        uint32_t numLights = lightCounts[count];
+
+        // Same sponza sized world as the culling benchmark, with lights of a few units up to a few tens of units
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> position(-1500.f, 1500.f);
+        std::uniform_real_distribution<float> radius(5.f, 50.f);
+
+        std::vector<XMFLOAT4> worldLights(numLights);
+        for (auto& light : worldLights)
+        {
+            light = XMFLOAT4(position(random), position(random) * 0.25f, position(random), radius(random));
+        }
+
+        std::vector<XMFLOAT4> viewLights(numLights);
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+        uint64_t totalReferences = 0;
+        uint64_t totalOccupied = 0;
+        uint32_t maxPerCluster = 0;
+        uint64_t totalDropped = 0;
+
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            float angle = XM_2PI * (float)i / (float)frames;
+            XMVECTOR eye = XMVectorSet(cosf(angle) * 500.f, 50.f, sinf(angle) * 500.f, 1.f);
+            XMMATRIX view = XMMatrixLookAtRH(eye, XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f));
+
+            // Transforming to view space is part of the per frame cost, so it's timed too
+            QueryPerformanceCounter(&start);
+            for (uint32_t j = 0; j < numLights; ++j)
+            {
+                XMVECTOR center = XMVector3TransformCoord(XMLoadFloat4(&worldLights[j]), view);
+                XMStoreFloat4(&viewLights[j], XMVectorSetW(center, worldLights[j].w));
+            }
+            clusters->Build(viewLights.data(), numLights, projection, jobs.get());
+            QueryPerformanceCounter(&end);
+
+            double ms = ElapsedMs(start, end, frequency);
+            totalMs += ms;
+            maxMs = max(maxMs, ms);
+
+            for (auto& cluster : clusters->GetClusters())
+            {
+                if (cluster.Count > 0)
+                {
+                    ++totalOccupied;
+                    totalReferences += cluster.Count;
+                    maxPerCluster = max(maxPerCluster, cluster.Count);
+                }
+            }
+            totalDropped += clusters->GetNumDroppedLights();
+        }
+
+        wprintf(L"Light clustering, %u lights, %u frames, %ux%ux%u clusters\n", numLights, frames, ClusterTilesX, ClusterTilesY, ClusterSlices);
+        wprintf(L"  Build: %8.4f ms per frame, worst %8.4f ms\n", totalMs / frames, maxMs);
+        wprintf(L"  Average occupied clusters: %.1f\n", (double)totalOccupied / frames);
+        wprintf(L"  Average lights per occupied cluster: %.1f (max %u, %.1f dropped per frame)\n",
+            totalOccupied ? (double)totalReferences / totalOccupied : 0.0, maxPerCluster, (double)totalDropped / frames);
+    }
+
+    return true;
+}
+
+bool RunSoftwareRenderBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename, const std::wstring& imageFilename)
+{
+    OpenConsole();
+
+    // No device, so only the CPU side of the model is loaded
+    ContentLoader loader(nullptr, contentRoot);
+
+    std::shared_ptr<Object> object;
+    if (!loader.LoadObject(modelFilename, &object))
+    {
+        wprintf(L"Failed to load %s.\n", modelFilename.c_str());
+        return false;
+    }
+
+    std::unique_ptr<SoftwareRenderer> renderer = SoftwareRenderer::Create(1280, 720);
+    if (!renderer)
+    {
+        wprintf(L"Failed to create software renderer.\n");
+        return false;
+    }
+    renderer->AddObject(object);
+
+    std::unique_ptr<JobSystem> jobs = JobSystem::Create();
+    if (!jobs)
+    {
+        wprintf(L"Failed to create job system.\n");
+        return false;
+    }
+
+    std::vector<CameraKey> path;
+    GetDefaultCameraPath(120, &path);
+
+    XMMATRIX projection = GetBenchmarkProjection();
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    uint64_t totalBinned = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+
+    for (uint32_t i = 0; i < (uint32_t)path.size(); ++i)
+    {
+        const CameraKey& key = path[i];
+
+        QueryPerformanceCounter(&start);
+        renderer->Render(ComputeCameraView(key.Position, key.Yaw, key.Pitch), projection, jobs.get());
+        QueryPerformanceCounter(&end);
+
+        double ms = ElapsedMs(start, end, frequency);
+        totalMs += ms;
+        maxMs = max(maxMs, ms);
+        totalBinned += renderer->GetNumBinnedTriangles();
+
+        if (i == 0 && !imageFilename.empty() && !renderer->SaveImage(imageFilename))
+        {
+            wprintf(L"Failed to save %s.\n", imageFilename.c_str());
+            return false;
+        }
+    }
+
+    double numFrames = (double)path.size();
+
+    wprintf(L"Software rendering, default path, %u frames, %ux%u\n", (uint32_t)path.size(), renderer->GetWidth(), renderer->GetHeight());
+    wprintf(L"  Average binned triangles: %.0f\n", (double)totalBinned / numFrames);
+    wprintf(L"  Frame: %8.4f ms average, worst %8.4f ms\n", totalMs / numFrames, maxMs);
+    if (!imageFilename.empty())
+    {
+        wprintf(L"  First frame saved to %s\n", imageFilename.c_str());
+    }
+    return true;
+}
+
+bool RunCameraPathBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename, const std::wstring& cameraPath,
+    BenchmarkBackend backend, const std::wstring& csvFilename)
+{
+    OpenConsole();
+
+    // No device, so only the CPU side of the model is loaded
+    ContentLoader loader(nullptr, contentRoot);
+
+    std::vector<std::shared_ptr<Object>> objects(1);
+    if (!loader.LoadObject(modelFilename, &objects[0]))
+    {
+        wprintf(L"Failed to load %s.\n", modelFilename.c_str());
+        return false;
+    }
+
+    std::vector<CameraKey> path;
+    if (cameraPath.empty())
+    {
+        GetDefaultCameraPath(600, &path);
+    }
+    else if (!LoadCameraPath(cameraPath, &path))
+    {
+        wprintf(L"Failed to load camera path %s.\n", cameraPath.c_str());
+        return false;
+    }
+
+    std::unique_ptr<OcclusionBuffer> occlusion = OcclusionBuffer::Create(OcclusionBufferWidth, OcclusionBufferHeight);
+    if (!occlusion)
+    {
+        wprintf(L"Failed to create occlusion buffer.\n");
+        return false;
+    }
+
+    std::unique_ptr<JobSystem> jobs = JobSystem::Create();
+    if (!jobs)
+    {
+        wprintf(L"Failed to create job system.\n");
+        return false;
+    }
+
+    std::unique_ptr<SoftwareRenderer> software;
+    if (backend == BenchmarkBackend::Software)
+    {
+        software = SoftwareRenderer::Create(1280, 720);
+        if (!software)
+        {
+            wprintf(L"Failed to create software renderer.\n");
+            return false;
+        }
+        software->AddObject(objects[0]);
+    }
+
+    SelectOccluders(objects, OccluderTriangleBudget);
+
+    // Same stages as DeferredRenderer11 (see DrawStats), with the software renderer standing in
+    // for submission & lighting
+    enum Stage { Cull, Occlusion, Sort, Render, Frame, NumStages };
+    FrameTimings timings({ L"Cull", L"Occlusion", L"Sort", L"Render", L"Frame" });
+
+    XMMATRIX projection = GetBenchmarkProjection();
+
+    CullingBoxes bounds;
+    std::vector<const Object::Part*> parts;
+    std::vector<uint32_t> visible;
+    DrawQueue draws;
+
+    LARGE_INTEGER frequency, frameStart, stageStart, stageEnd;
+    QueryPerformanceFrequency(&frequency);
+
+    for (auto& key : path)
+    {
+        double stageMs[NumStages] = {};
+        XMMATRIX view = ComputeCameraView(key.Position, key.Yaw, key.Pitch);
+        XMMATRIX viewProjection = view * projection;
+
+        // Gathered every frame, as the renderer does
+        QueryPerformanceCounter(&frameStart);
+        bounds.Clear();
+        parts.clear();
+        occlusion->ClearOccluders();
+        for (auto& object : objects)
+        {
+            XMMATRIX root = XMLoadFloat4x4(&object->RootTransform);
+            for (auto& part : object->Parts)
+            {
+                XMMATRIX world = XMLoadFloat4x4(&part->RelativeTransform) * root;
+                bounds.AddTransformed(part->BoundsCenter, part->BoundsExtents, world);
+                parts.push_back(part.get());
+
+                if (part->IsOccluder)
+                {
+                    occlusion->AddOccluder(object->Positions.data(), object->Indices.data() + part->StartIndex, part->NumIndices, world);
+                }
+            }
+        }
+
+        visible.resize(bounds.Size());
+        uint32_t numVisible = FrustumCull(bounds, viewProjection, visible.data());
+        QueryPerformanceCounter(&stageEnd);
+        stageMs[Cull] = ElapsedMs(frameStart, stageEnd, frequency);
+
+        stageStart = stageEnd;
+        occlusion->Render(viewProjection, jobs.get());
+        numVisible = occlusion->TestVisibility(bounds, visible.data(), numVisible, visible.data());
+        QueryPerformanceCounter(&stageEnd);
+        stageMs[Occlusion] = ElapsedMs(stageStart, stageEnd, frequency);
+
+        // Keys as in the geometry pass (same 10000 unit depth range). There are no pools without a device
+        stageStart = stageEnd;
+        draws.Clear();
+        for (uint32_t i = 0; i < numVisible; ++i)
+        {
+            uint32_t index = visible[i];
+            XMVECTOR center = XMVectorSet(bounds.CenterX[index], bounds.CenterY[index], bounds.CenterZ[index], 1.f);
+            float viewDepth = -XMVectorGetZ(XMVector3Transform(center, view));
+            draws.Add(DrawQueue::MakeKey(0, 0, parts[index]->MaterialId, viewDepth / 10000.f), index);
+        }
+        draws.Sort();
+        QueryPerformanceCounter(&stageEnd);
+        stageMs[Sort] = ElapsedMs(stageStart, stageEnd, frequency);
+
+        if (software)
+        {
+            stageStart = stageEnd;
+            software->Render(view, projection, jobs.get());
+            QueryPerformanceCounter(&stageEnd);
+            stageMs[Render] = ElapsedMs(stageStart, stageEnd, frequency);
+        }
+
+        stageMs[Frame] = ElapsedMs(frameStart, stageEnd, frequency);
+        timings.AddFrame(stageMs);
+    }
+
+    std::wstring title = std::wstring(L"Camera path, ") + (backend == BenchmarkBackend::Software ? L"software" : L"null") +
+        L" backend, " + (cameraPath.empty() ? std::wstring(L"default path") : cameraPath);
+    timings.PrintSummary(title);
+
+    if (!csvFilename.empty())
+    {
+        if (!timings.SaveCsv(csvFilename))
+        {
+            wprintf(L"Failed to save %s.\n", csvFilename.c_str());
+            return false;
+        }
+        wprintf(L"  Frames saved to %s\n", csvFilename.c_str());
+    }
+    return true;
+}
+
+// Busy waits, standing in for a frame's CPU work
+static void Spin(double ms, const LARGE_INTEGER& frequency)
+{
+    LARGE_INTEGER start, now;
+    QueryPerformanceCounter(&start);
+    do
+    {
+        QueryPerformanceCounter(&now);
+    } while (ElapsedMs(start, now, frequency) < ms);
+}
+
+bool RunFramePipelineBenchmark(uint32_t frames)
+{
+    OpenConsole();
+
+    if (frames == 0)
+    {
+        wprintf(L"Nothing to run.\n");
+        return false;
+    }
+
+    // Roughly what the interactive app spends on each side, +-50% per frame
+    static const double updateCostMs = 3.0;
+    static const double renderCostMs = 5.0;
+    static const uint32_t numObjects = 1000;
+    static const uint32_t numLights = 1024;
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    bool succeeded = true;
+    for (uint32_t latency = 0; latency <= MaxFrameLatency && succeeded; ++latency)
+    {
+        std::unique_ptr<FramePipeline> pipeline = FramePipeline::Create(latency);
+        if (!pipeline)
+        {
+            wprintf(L"Failed to create frame pipeline.\n");
+            return false;
+        }
+
+        enum Stage { Update, Render, Frame, Latency, NumStages };
+        FrameTimings timings({ L"Update", L"Render", L"Frame", L"Latency" });
+
+        // The null backend: checks each snapshot arrives in order and unchanged, both before
+        // and after the simulated render (so it can't have been overwritten meanwhile)
+        std::wstring error;
+        std::thread renderThread([&]()
+        {
+            std::mt19937 random(5678);
+            std::uniform_real_distribution<double> cost(0.5 * renderCostMs, 1.5 * renderCostMs);
+
+            auto isIntact = [](const SceneSnapshot& snapshot)
+            {
+                if (snapshot.Transforms.size() != numObjects || snapshot.LightSpheres.size() != numLights)
+                {
+                    return false;
+                }
+                for (uint32_t i = 0; i < numObjects; ++i)
+                {
+                    if (snapshot.Transforms[i]._41 != (float)snapshot.FrameIndex || snapshot.Transforms[i]._42 != (float)i)
+                    {
+                        return false;
+                    }
+                }
+                return snapshot.LightSpheres.back().x == (float)snapshot.FrameIndex;
+            };
+
+            uint64_t expectedFrame = 0;
+            LARGE_INTEGER lastEnd {};
+            for (;;)
+            {
+                const SceneSnapshot* snapshot = pipeline->BeginRender();
+                if (!snapshot)
+                {
+                    break;
+                }
+
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                bool intact = snapshot->FrameIndex == expectedFrame && isIntact(*snapshot);
+                Spin(cost(random), frequency);
+                intact = intact && isIntact(*snapshot);
+                QueryPerformanceCounter(&end);
+
+                double stageMs[NumStages] = {};
+                stageMs[Update] = snapshot->UpdateMs;
+                stageMs[Render] = ElapsedMs(start, end, frequency);
+                stageMs[Frame] = lastEnd.QuadPart ? ElapsedMs(lastEnd, end, frequency) : stageMs[Render];
+                stageMs[Latency] = ElapsedMs(snapshot->InputTime, end, frequency);
+                timings.AddFrame(stageMs);
+                lastEnd = end;
+
+                if (!intact)
+                {
+                    error = L"Snapshot " + std::to_wstring(expectedFrame) + L" was out of order or modified while rendering.";
+                    pipeline->EndRender();
+                    pipeline->Stop();
+                    break;
+                }
+
+                ++expectedFrame;
+                pipeline->EndRender();
+            }
+        });
+
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<double> cost(0.5 * updateCostMs, 1.5 * updateCostMs);
+
+        LARGE_INTEGER runStart, runEnd;
+        QueryPerformanceCounter(&runStart);
+        for (uint32_t i = 0; i < frames; ++i)
+        {
+            SceneSnapshot* snapshot = pipeline->BeginUpdate();
+            if (!snapshot)
+            {
+                break;
+            }
+
+            LARGE_INTEGER start, end;
+            QueryPerformanceCounter(&start);
+            snapshot->InputTime = start;
+            snapshot->TimeStep = 1.0 / 60.0;
+            snapshot->Measured = true;
+            snapshot->Transforms.resize(numObjects);
+            for (uint32_t j = 0; j < numObjects; ++j)
+            {
+                XMStoreFloat4x4(&snapshot->Transforms[j], XMMatrixTranslation((float)snapshot->FrameIndex, (float)j, 0.f));
+            }
+            snapshot->LightSpheres.assign(numLights, XMFLOAT4((float)snapshot->FrameIndex, 0.f, 0.f, 1.f));
+            snapshot->LightColors.assign(numLights, XMFLOAT3(1.f, 1.f, 1.f));
+            Spin(cost(random), frequency);
+            QueryPerformanceCounter(&end);
+            snapshot->UpdateMs = ElapsedMs(start, end, frequency);
+
+            pipeline->EndUpdate();
+        }
+        pipeline->Stop();
+        renderThread.join();
+        QueryPerformanceCounter(&runEnd);
+
+        if (!error.empty())
+        {
+            wprintf(L"%s\n", error.c_str());
+            succeeded = false;
+        }
+
+        std::wstring title = L"Frame pipeline, latency " + std::to_wstring(latency) + L", null backend";
+        timings.PrintSummary(title);
+        wprintf(L"  %.3f ms per frame overall. Waiting: update %.1f ms, render %.1f ms\n", ElapsedMs(runStart, runEnd, frequency) / frames,
+            pipeline->GetUpdateWaitMs(), pipeline->GetRenderWaitMs());
+    }
+
+    return succeeded;
+}
+
+bool RunJobScalingBenchmark(uint32_t numParts, uint32_t frames)
+{
+    OpenConsole();
+
+    if (numParts == 0 || frames == 0)
+    {
+        wprintf(L"Nothing to prepare.\n");
+        return false;
+    }
+
+    // Synthetic scene: parts of a few units up to a few tens of units, spread over objects
+    // through the same sponza sized world as the culling benchmark
+    static const uint32_t partsPerObject = 100;
+    static const uint32_t partsPerJob = 1024;
+    static const uint32_t numMaterials = 64;
+
+    struct SyntheticPart
+    {
+        XMFLOAT4X4  RelativeTransform;
+        XMFLOAT3    BoundsCenter;
+        XMFLOAT3    BoundsExtents;
+        uint32_t    Object;
+        uint32_t    MaterialId;
+    };
+
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> position(-1500.f, 1500.f);
+    std::uniform_real_distribution<float> offset(-50.f, 50.f);
+    std::uniform_real_distribution<float> size(1.f, 40.f);
+
+    uint32_t numObjects = (numParts + partsPerObject - 1) / partsPerObject;
+    std::vector<XMFLOAT3> objectPositions(numObjects);
+    for (auto& objectPosition : objectPositions)
+    {
+        objectPosition = XMFLOAT3(position(random), position(random) * 0.25f, position(random));
+    }
+
+    std::vector<SyntheticPart> parts(numParts);
+    for (uint32_t i = 0; i < numParts; ++i)
+    {
+        SyntheticPart& part = parts[i];
+        XMStoreFloat4x4(&part.RelativeTransform, XMMatrixTranslation(offset(random), offset(random), offset(random)));
+        part.BoundsCenter = XMFLOAT3(0.f, 0.f, 0.f);
+        part.BoundsExtents = XMFLOAT3(size(random), size(random), size(random));
+        part.Object = i / partsPerObject;
+        part.MaterialId = i % numMaterials;
+    }
+
+    XMMATRIX projection = GetBenchmarkProjection();
+
+    // Same stages as DeferredRenderer11's frame preparation. Constants are written to system memory
+    CullingBoxes bounds;
+    bounds.Resize(numParts);
+    TransformSystem transforms;
+    std::vector<uint32_t> objectTransforms(numObjects);
+    std::vector<uint32_t> partTransforms(numParts);
+    for (uint32_t i = 0; i < numParts; ++i)
+    {
+        if (i % partsPerObject == 0)
+        {
+            const XMFLOAT3& p = objectPositions[parts[i].Object];
+            objectTransforms[parts[i].Object] = transforms.Add(NoParentTransform, XMMatrixTranslation(p.x, p.y, p.z));
+        }
+        partTransforms[i] = transforms.Add(objectTransforms[parts[i].Object], XMLoadFloat4x4(&parts[i].RelativeTransform));
+    }
+    transforms.Update(nullptr);
+    std::vector<uint32_t> visible(numParts);
+    std::vector<uint32_t> rangeVisible((numParts + partsPerJob - 1) / partsPerJob);
+    std::vector<uint64_t> keys;
+    std::vector<XMFLOAT4X4> constants;
+    DrawQueue draws;
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    uint32_t maxThreads = max(std::thread::hardware_concurrency(), 1u);
+    std::vector<uint32_t> threadCounts;
+    for (uint32_t threads = 1; threads < maxThreads; threads *= 2)
+    {
+        threadCounts.push_back(threads);
+    }
+    threadCounts.push_back(maxThreads);
+
+    wprintf(L"Job system scaling, %u parts in %u objects, %u frames\n", numParts, numObjects, frames);
+    wprintf(L"  %7s %12s %12s %8s %10s\n", L"Threads", L"ms/frame", L"worst ms", L"Speedup", L"Steals");
+
+    double baselineMs = 0.0;
+    uint64_t baselineChecksum = 0;
+    bool succeeded = true;
+    for (uint32_t threads : threadCounts)
+    {
+        std::unique_ptr<JobSystem> jobs = JobSystem::Create(threads - 1);
+        if (!jobs)
+        {
+            wprintf(L"Failed to create job system.\n");
+            return false;
+        }
+
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+        uint64_t checksum = 0;
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            // A quarter of the objects bob up and down, so their parts need new world matrices every frame
+            for (uint32_t i = 0; i < numObjects; i += 4)
+            {
+                XMFLOAT3 p = objectPositions[i];
+                transforms.SetLocal(objectTransforms[i], XMMatrixTranslation(p.x, p.y + 10.f * sinf(0.1f * (frame + i)), p.z));
+            }
+
+            float angle = XM_2PI * (float)frame / (float)frames;
+            XMVECTOR eye = XMVectorSet(cosf(angle) * 500.f, 50.f, sinf(angle) * 500.f, 1.f);
+            XMFLOAT4X4 view, viewProjection;
+            XMStoreFloat4x4(&view, XMMatrixLookAtRH(eye, XMVectorSet(0.f, 0.f, 0.f, 1.f), XMVectorSet(0.f, 1.f, 0.f, 0.f)));
+            XMStoreFloat4x4(&viewProjection, XMLoadFloat4x4(&view) * projection);
+
+            QueryPerformanceCounter(&start);
+
+            transforms.Update(jobs.get());
+            JobHandle cull = jobs->ParallelFor(numParts, partsPerJob, [&](uint32_t begin, uint32_t rangeEnd)
+            {
+                for (uint32_t i = begin; i < rangeEnd; ++i)
+                {
+                    const SyntheticPart& part = parts[i];
+                    bounds.SetTransformed(i, part.BoundsCenter, part.BoundsExtents, XMLoadFloat4x4(&transforms.GetWorld(partTransforms[i])));
+                }
+                rangeVisible[begin / partsPerJob] = FrustumCullRange(bounds, begin, rangeEnd - begin, XMLoadFloat4x4(&viewProjection), &visible[begin]);
+            });
+            jobs->Wait(cull);
+
+            uint32_t numVisible = 0;
+            for (uint32_t i = 0; i < (uint32_t)rangeVisible.size(); ++i)
+            {
+                memmove(&visible[numVisible], &visible[i * partsPerJob], rangeVisible[i] * sizeof(uint32_t));
+                numVisible += rangeVisible[i];
+            }
+
+            keys.resize(numVisible);
+            JobHandle keyJobs = jobs->ParallelFor(numVisible, partsPerJob, [&](uint32_t begin, uint32_t rangeEnd)
+            {
+                XMMATRIX viewTransform = XMLoadFloat4x4(&view);
+                for (uint32_t i = begin; i < rangeEnd; ++i)
+                {
+                    uint32_t index = visible[i];
+                    XMVECTOR center = XMVectorSet(bounds.CenterX[index], bounds.CenterY[index], bounds.CenterZ[index], 1.f);
+                    float viewDepth = -XMVectorGetZ(XMVector3Transform(center, viewTransform));
+                    keys[i] = DrawQueue::MakeKey(0, 0, parts[index].MaterialId, viewDepth / 10000.f);
+                }
+            });
+            jobs->Wait(keyJobs);
+
+            draws.Clear();
+            for (uint32_t i = 0; i < numVisible; ++i)
+            {
+                draws.Add(keys[i], visible[i]);
+            }
+            draws.Sort();
+
+            const std::vector<DrawPacket>& packets = draws.GetPackets();
+            constants.resize(packets.size());
+            JobHandle writes = jobs->ParallelFor((uint32_t)packets.size(), 512, [&](uint32_t begin, uint32_t rangeEnd)
+            {
+                for (uint32_t i = begin; i < rangeEnd; ++i)
+                {
+                    constants[i] = transforms.GetWorld(partTransforms[packets[i].Index]);
+                }
+            });
+            jobs->Wait(writes);
+
+            QueryPerformanceCounter(&end);
+
+            double ms = ElapsedMs(start, end, frequency);
+            totalMs += ms;
+            maxMs = max(maxMs, ms);
+
+            // Same draws in the same order, whatever the thread count
+            for (auto& packet : packets)
+            {
+                checksum = checksum * 31 + packet.Index;
+            }
+        }
+
+        double averageMs = totalMs / frames;
+        if (threads == 1)
+        {
+            baselineMs = averageMs;
+            baselineChecksum = checksum;
+        }
+        else if (checksum != baselineChecksum)
+        {
+            wprintf(L"  Draws with %u threads differ from 1 thread.\n", threads);
+            succeeded = false;
+        }
+
+        wprintf(L"  %7u %12.4f %12.4f %7.2fx %10llu\n", threads, averageMs, maxMs, baselineMs / averageMs, jobs->GetNumSteals());
+    }
+
+    return succeeded;
+}
+
+bool RunBvhBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename)
+{
+    OpenConsole();
+
+    // No device, so only the CPU side of the model is loaded
+    ContentLoader loader(nullptr, contentRoot);
+
+    std::vector<std::shared_ptr<Object>> objects(1);
+    if (!loader.LoadObject(modelFilename, &objects[0]))
+    {
+        wprintf(L"Failed to load %s.\n", modelFilename.c_str());
+        return false;
+    }
+
+    std::vector<CameraKey> path;
+    GetDefaultCameraPath(600, &path);
+
+    // Two sets of items: the parts, as culled by the renderer, and clusters of up to
+    // trianglesPerCluster of each part's triangles in world space, as picked against
+    static const uint32_t trianglesPerCluster = 32;
+    static const uint32_t frameRepeats = 10;
+
+    CullingBoxes partBounds;
+    CullingBoxes clusterBounds;
+    std::vector<XMFLOAT3> triangles;
+    std::vector<uint32_t> clusterStarts;
+    for (auto& object : objects)
+    {
+        XMMATRIX root = XMLoadFloat4x4(&object->RootTransform);
+        for (auto& part : object->Parts)
+        {
+            XMMATRIX world = XMLoadFloat4x4(&part->RelativeTransform) * root;
+            partBounds.AddTransformed(part->BoundsCenter, part->BoundsExtents, world);
+
+            const uint32_t* indices = object->Indices.data() + part->StartIndex;
+            for (uint32_t i = 0; i < part->NumIndices; i += 3 * trianglesPerCluster)
+            {
+                clusterStarts.push_back((uint32_t)triangles.size());
+                XMVECTOR clusterMin = XMVectorReplicate(FLT_MAX);
+                XMVECTOR clusterMax = XMVectorReplicate(-FLT_MAX);
+                for (uint32_t j = i; j < min(i + 3 * trianglesPerCluster, part->NumIndices); ++j)
+                {
+                    XMVECTOR position = XMVector3TransformCoord(XMLoadFloat3(&object->Positions[indices[j]]), world);
+                    clusterMin = XMVectorMin(clusterMin, position);
+                    clusterMax = XMVectorMax(clusterMax, position);
+                    triangles.push_back(XMFLOAT3());
+                    XMStoreFloat3(&triangles.back(), position);
+                }
+
+                XMFLOAT3 center, extents;
+                XMStoreFloat3(&center, (clusterMin + clusterMax) * 0.5f);
+                XMStoreFloat3(&extents, (clusterMax - clusterMin) * 0.5f);
+                clusterBounds.Add(center, extents);
+            }
+        }
+    }
+    clusterStarts.push_back((uint32_t)triangles.size());
+
+    if (partBounds.Size() == 0 || clusterBounds.Size() == 0)
+    {
+        wprintf(L"Nothing to build a tree over.\n");
+        return false;
+    }
+
+    std::unique_ptr<JobSystem> jobs = JobSystem::Create();
+    if (!jobs)
+    {
+        wprintf(L"Failed to create job system.\n");
+        return false;
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    wprintf(L"Bvh, %u parts, %u clusters of up to %u triangles, %u triangles\n", partBounds.Size(), clusterBounds.Size(),
+        trianglesPerCluster, (uint32_t)triangles.size() / 3);
+    wprintf(L"  %-8s %10s %10s %10s %6s %10s %10s\n", L"Items", L"Build ms", L"Jobs ms", L"Refit ms", L"Depth", L"Nodes", L"SAH cost");
+
+    // Built on the calling thread first, so the job built trees are the ones queried
+    Bvh parts;
+    Bvh clusters;
+    const wchar_t* names[] = { L"Parts", L"Clusters" };
+    const CullingBoxes* itemBounds[] = { &partBounds, &clusterBounds };
+    Bvh* trees[] = { &parts, &clusters };
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        QueryPerformanceCounter(&start);
+        trees[i]->Build(*itemBounds[i], nullptr);
+        QueryPerformanceCounter(&end);
+        double serialMs = ElapsedMs(start, end, frequency);
+
+        QueryPerformanceCounter(&start);
+        trees[i]->Build(*itemBounds[i], jobs.get());
+        QueryPerformanceCounter(&end);
+        double jobsMs = ElapsedMs(start, end, frequency);
+
+        QueryPerformanceCounter(&start);
+        trees[i]->Refit(*itemBounds[i]);
+        QueryPerformanceCounter(&end);
+        double refitMs = ElapsedMs(start, end, frequency);
+
+        wprintf(L"  %-8s %10.3f %10.3f %10.3f %6u %10u %10.1f\n", names[i], serialMs, jobsMs, refitMs,
+            trees[i]->GetDepth(), (uint32_t)trees[i]->GetNodes().size(), trees[i]->GetSahCost());
+    }
+
+    XMMATRIX projection = GetBenchmarkProjection();
+    std::vector<uint32_t> visible(partBounds.Size());
+    std::vector<uint32_t> queried(clusterBounds.Size());
+
+    double cullMs = 0.0;
+    double frustumQueryMs = 0.0;
+    uint64_t totalVisible = 0;
+
+    double rayQueryMs = 0.0;
+    double bruteRayMs = 0.0;
+    uint64_t clustersTested = 0;
+    uint32_t hits = 0;
+
+    double overlapQueryMs = 0.0;
+    double bruteOverlapMs = 0.0;
+    uint64_t totalOverlapping = 0;
+
+    bool succeeded = true;
+    for (auto& key : path)
+    {
+        XMMATRIX view = ComputeCameraView(key.Position, key.Yaw, key.Pitch);
+        XMMATRIX viewProjection = view * projection;
+
+        // Frustum culling the parts, against the linear kernel
+        uint32_t numVisible = 0;
+        QueryPerformanceCounter(&start);
+        for (uint32_t repeat = 0; repeat < frameRepeats; ++repeat)
+        {
+            numVisible = FrustumCull(partBounds, viewProjection, visible.data());
+        }
+        QueryPerformanceCounter(&end);
+        cullMs += ElapsedMs(start, end, frequency) / frameRepeats;
+
+        uint32_t numQueried = 0;
+        QueryPerformanceCounter(&start);
+        for (uint32_t repeat = 0; repeat < frameRepeats; ++repeat)
+        {
+            numQueried = parts.FrustumQuery(viewProjection, queried.data());
+        }
+        QueryPerformanceCounter(&end);
+        frustumQueryMs += ElapsedMs(start, end, frequency) / frameRepeats;
+
+        std::sort(queried.begin(), queried.begin() + numQueried);
+        if (numQueried != numVisible || !std::equal(visible.begin(), visible.begin() + numVisible, queried.begin()))
+        {
+            wprintf(L"  Frustum query differs from FrustumCull (%u parts vs %u).\n", numQueried, numVisible);
+            succeeded = false;
+        }
+        totalVisible += numVisible;
+
+        // Picking the triangle under the center of the view, against testing every triangle
+        XMVECTOR origin = XMLoadFloat3(&key.Position);
+        XMVECTOR direction = XMVector3TransformNormal(XMVectorSet(0.f, 0.f, -1.f, 0.f), XMMatrixTranspose(view));
+        auto intersectCluster = [&](uint32_t cluster, float* closest)
+        {
+            ++clustersTested;
+            bool hit = false;
+            for (uint32_t i = clusterStarts[cluster]; i < clusterStarts[cluster + 1]; i += 3)
+            {
+                float distance;
+                if (IntersectRayTriangle(origin, direction, triangles[i], triangles[i + 1], triangles[i + 2], &distance) && distance < *closest)
+                {
+                    *closest = distance;
+                    hit = true;
+                }
+            }
+            return hit;
+        };
+
+        float pickDistance = FLT_MAX;
+        QueryPerformanceCounter(&start);
+        uint32_t picked = clusters.RayQuery(origin, direction, FLT_MAX, intersectCluster, &pickDistance);
+        QueryPerformanceCounter(&end);
+        rayQueryMs += ElapsedMs(start, end, frequency);
+
+        float bruteDistance = FLT_MAX;
+        QueryPerformanceCounter(&start);
+        for (uint32_t i = 0; i < (uint32_t)triangles.size(); i += 3)
+        {
+            float distance;
+            if (IntersectRayTriangle(origin, direction, triangles[i], triangles[i + 1], triangles[i + 2], &distance))
+            {
+                bruteDistance = min(bruteDistance, distance);
+            }
+        }
+        QueryPerformanceCounter(&end);
+        bruteRayMs += ElapsedMs(start, end, frequency);
+
+        // The same triangle is found either way, so only rounding in the box tests could make them differ
+        if ((picked == UINT32_MAX) != (bruteDistance == FLT_MAX) || (picked != UINT32_MAX && fabsf(pickDistance - bruteDistance) > 1e-4f * bruteDistance))
+        {
+            wprintf(L"  Ray query hit at %f, testing every triangle hit at %f.\n", pickDistance, bruteDistance);
+            succeeded = false;
+        }
+        hits += picked != UINT32_MAX ? 1 : 0;
+
+        // Clusters within a few units of the camera, as for collision, against testing every box
+        static const float radius = 100.f;
+        XMFLOAT3 boxMin(key.Position.x - radius, key.Position.y - radius, key.Position.z - radius);
+        XMFLOAT3 boxMax(key.Position.x + radius, key.Position.y + radius, key.Position.z + radius);
+
+        QueryPerformanceCounter(&start);
+        uint32_t numOverlapping = clusters.OverlapQuery(boxMin, boxMax, queried.data());
+        QueryPerformanceCounter(&end);
+        overlapQueryMs += ElapsedMs(start, end, frequency);
+
+        uint32_t numBrute = 0;
+        QueryPerformanceCounter(&start);
+        for (uint32_t i = 0; i < clusterBounds.Size(); ++i)
+        {
+            if (fabsf(clusterBounds.CenterX[i] - key.Position.x) <= clusterBounds.ExtentX[i] + radius &&
+                fabsf(clusterBounds.CenterY[i] - key.Position.y) <= clusterBounds.ExtentY[i] + radius &&
+                fabsf(clusterBounds.CenterZ[i] - key.Position.z) <= clusterBounds.ExtentZ[i] + radius)
+            {
+                ++numBrute;
+            }
+        }
+        QueryPerformanceCounter(&end);
+        bruteOverlapMs += ElapsedMs(start, end, frequency);
+
+        if (numOverlapping != numBrute)
+        {
+            wprintf(L"  Overlap query found %u clusters, testing every box found %u.\n", numOverlapping, numBrute);
+            succeeded = false;
+        }
+        totalOverlapping += numOverlapping;
+    }
+
+    double numFrames = (double)path.size();
+    wprintf(L"  Default path, %u frames\n", (uint32_t)path.size());
+    wprintf(L"  Frustum: %8.4f ms per frame, FrustumCull %8.4f ms, %.1f parts visible\n",
+        frustumQueryMs / numFrames, cullMs / numFrames, (double)totalVisible / numFrames);
+    wprintf(L"  Ray:     %8.4f ms per pick, every triangle %8.4f ms, %.1f clusters tested, %u of %u hit\n",
+        rayQueryMs / numFrames, bruteRayMs / numFrames, (double)clustersTested / numFrames, hits, (uint32_t)path.size());
+    wprintf(L"  Overlap: %8.4f ms per query, every box %8.4f ms, %.1f clusters found\n",
+        overlapQueryMs / numFrames, bruteOverlapMs / numFrames, (double)totalOverlapping / numFrames);
+    return succeeded;
+}
+
+static XMFLOAT3 RandomDirection(std::mt19937& random)
+{
+    // Rejection sampled, so directions are uniform over the sphere
+    std::uniform_real_distribution<float> coordinate(-1.f, 1.f);
+    for (;;)
+    {
+        XMVECTOR v = XMVectorSet(coordinate(random), coordinate(random), coordinate(random), 0.f);
+        float lengthSq = XMVectorGetX(XMVector3LengthSq(v));
+        if (lengthSq > 1e-4f && lengthSq <= 1.f)
+        {
+            XMFLOAT3 direction;
+            XMStoreFloat3(&direction, XMVector3Normalize(v));
+            return direction;
+        }
+    }
+}
+
+bool RunBrdfBenchmark(uint32_t numSamples, uint32_t iterations)
+{
+    OpenConsole();
+
+    if (numSamples == 0 || iterations == 0)
+    {
+        wprintf(L"Nothing to shade.\n");
+        return false;
+    }
+
+    // Lights & views are mostly in front of the surface, as when shading a G-buffer. A few are
+    // behind it, where the BRDF is 0
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::vector<float> inputs[13];
+    for (auto& input : inputs)
+    {
+        input.resize(numSamples);
+    }
+    for (uint32_t i = 0; i < numSamples; ++i)
+    {
+        XMFLOAT3 n = RandomDirection(random);
+        XMFLOAT3 directions[2] = { RandomDirection(random), RandomDirection(random) };
+        for (auto& d : directions)
+        {
+            if (d.x * n.x + d.y * n.y + d.z * n.z < 0.f && unit(random) < 0.9f)
+            {
+                d = XMFLOAT3(-d.x, -d.y, -d.z);
+            }
+        }
+
+        const XMFLOAT3* vectors[3] = { &directions[0], &n, &directions[1] };
+        for (uint32_t v = 0; v < 3; ++v)
+        {
+            inputs[v * 3 + 0][i] = vectors[v]->x;
+            inputs[v * 3 + 1][i] = vectors[v]->y;
+            inputs[v * 3 + 2][i] = vectors[v]->z;
+        }
+        inputs[9][i] = 0.05f + 0.95f * unit(random);
+        inputs[10][i] = 0.02f + 0.98f * unit(random);
+        inputs[11][i] = 0.02f + 0.98f * unit(random);
+        inputs[12][i] = 0.02f + 0.98f * unit(random);
+    }
+
+    BrdfSamples samples = { inputs[0].data(), inputs[1].data(), inputs[2].data(), inputs[3].data(), inputs[4].data(),
+        inputs[5].data(), inputs[6].data(), inputs[7].data(), inputs[8].data(), inputs[9].data(), inputs[10].data(),
+        inputs[11].data(), inputs[12].data() };
+
+    std::vector<float> simd[3], scalar[3];
+    for (uint32_t c = 0; c < 3; ++c)
+    {
+        simd[c].resize(numSamples);
+        scalar[c].resize(numSamples);
+    }
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+
+    double simdMs = 0.0;
+    double scalarMs = 0.0;
+    for (uint32_t i = 0; i < iterations; ++i)
+    {
+        QueryPerformanceCounter(&start);
+        ComputeBRDFRange(samples, 0, numSamples, simd[0].data(), simd[1].data(), simd[2].data());
+        QueryPerformanceCounter(&end);
+        simdMs += ElapsedMs(start, end, frequency);
+
+        QueryPerformanceCounter(&start);
+        ComputeBRDFRangeScalar(samples, 0, numSamples, scalar[0].data(), scalar[1].data(), scalar[2].data());
+        QueryPerformanceCounter(&end);
+        scalarMs += ElapsedMs(start, end, frequency);
+    }
+
+    // Relative to the value, or absolute below 1. The only difference should be pow(x, 5)
+    const float tolerance = 1e-4f;
+    float maxError = 0.f;
+    uint64_t numNonZero = 0;
+    for (uint32_t i = 0; i < numSamples; ++i)
+    {
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+            float a = simd[c][i];
+            float b = scalar[c][i];
+            float error = fabsf(a - b) / max(fabsf(b), 1.f);
+            if (!(error <= tolerance))
+            {
+                wprintf(L"BRDF mismatch on sample %u: SIMD %g, scalar %g.\n", i, a, b);
+                return false;
+            }
+            maxError = max(maxError, error);
+        }
+        numNonZero += scalar[0][i] > 0.f ? 1 : 0;
+    }
+
+#if defined(__AVX__)
+    const wchar_t* instructionSet = L"AVX";
+#else
+    const wchar_t* instructionSet = L"SSE";
+#endif
+
+    double evaluations = (double)numSamples * iterations;
+    wprintf(L"BRDF, %u samples, %u iterations (%s)\n", numSamples, iterations, instructionSet);
+    wprintf(L"  Lit samples: %.1f%%, max relative error %g\n", 100.0 * numNonZero / numSamples, maxError);
+    wprintf(L"  SIMD:   %8.2f M evaluations/s\n", evaluations / (simdMs * 1000.0));
+    wprintf(L"  Scalar: %8.2f M evaluations/s\n", evaluations / (scalarMs * 1000.0));
+    wprintf(L"  Speedup: %.2fx\n", scalarMs / simdMs);
+    return true;
+}
+
+// Live ranges of the allocator under test, by offset, to check its results against
+typedef std::map<uint32_t, uint32_t> RangeMap;
+
+static bool CheckRanges(const RangeAllocator& allocator, const RangeMap& ranges, uint64_t usedSize, const wchar_t* step)
+{
+    if (allocator.GetUsedSize() != usedSize || allocator.GetNumAllocations() != (uint32_t)ranges.size())
+    {
+        wprintf(L"Range allocator lost track of its ranges after %s: %u used in %u ranges, expected %llu in %u.\n", step,
+            allocator.GetUsedSize(), allocator.GetNumAllocations(), usedSize, (uint32_t)ranges.size());
+        return false;
+    }
+    return true;
+}
+
+bool RunRangeAllocatorBenchmark(uint32_t operations)
+{
+    OpenConsole();
+
+    if (operations == 0)
+    {
+        wprintf(L"Nothing to allocate.\n");
+        return false;
+    }
+
+    // Sized like a geometry pool's vertex range. Sizes are spread over every power of two up to
+    // a few thousand, as parts are, and allocations slightly outnumber frees to fill it up
+    static const uint32_t capacity = 1024 * 1024;
+    RangeAllocator allocator(capacity);
+    std::mt19937 random(1234);
+
+    RangeMap ranges;
+    std::vector<uint32_t> offsets;
+    uint64_t usedSize = 0;
+    uint32_t numAllocated = 0;
+    uint32_t numFreed = 0;
+    uint32_t numFailed = 0;
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    double ms = 0.0;
+
+    for (uint32_t i = 0; i < operations; ++i)
+    {
+        if (offsets.empty() || random() % 100 < 55)
+        {
+            uint32_t size = 1 + random() % (1u << (random() % 13));
+            uint32_t offset = 0;
+
+            QueryPerformanceCounter(&start);
+            bool allocated = allocator.Allocate(size, &offset);
+            QueryPerformanceCounter(&end);
+            ms += ElapsedMs(start, end, frequency);
+
+            if (!allocated)
+            {
+                ++numFailed;
+                continue;
+            }
+
+            // Must not overlap the ranges on either side
+            auto next = ranges.lower_bound(offset);
+            bool overlaps = (uint64_t)offset + size > capacity || (next != ranges.end() && next->first < offset + size);
+            if (next != ranges.begin())
+            {
+                auto prev = std::prev(next);
+                overlaps |= prev->first + prev->second > offset;
+            }
+            if (overlaps)
+            {
+                wprintf(L"Range [%u, %u) overlaps another range.\n", offset, offset + size);
+                return false;
+            }
+
+            ranges[offset] = size;
+            offsets.push_back(offset);
+            usedSize += size;
+            ++numAllocated;
+        }
+        else
+        {
+            uint32_t pick = random() % (uint32_t)offsets.size();
+            uint32_t offset = offsets[pick];
+            offsets[pick] = offsets.back();
+            offsets.pop_back();
+
+            QueryPerformanceCounter(&start);
+            allocator.Free(offset);
+            QueryPerformanceCounter(&end);
+            ms += ElapsedMs(start, end, frequency);
+
+            usedSize -= ranges[offset];
+            ranges.erase(offset);
+            ++numFreed;
+        }
+
+        if (!CheckRanges(allocator, ranges, usedSize, L"allocating and freeing"))
+        {
+            return false;
+        }
+    }
+
+    uint32_t largestFree = allocator.GetLargestFreeRange();
+
+    // Compaction: every range is stamped with its own value, and has to read back the same after
+    // its data is moved as reported, the way GeometryPool copies it
+    std::vector<uint32_t> memory(capacity, 0xFFFFFFFF);
+    for (auto& range : ranges)
+    {
+        std::fill(memory.begin() + range.first, memory.begin() + range.first + range.second, range.first);
+    }
+
+    std::vector<RangeMove> moves;
+    QueryPerformanceCounter(&start);
+    allocator.Compact(&moves);
+    QueryPerformanceCounter(&end);
+    double compactMs = ElapsedMs(start, end, frequency);
+
+    std::vector<uint32_t> compacted(capacity, 0xFFFFFFFF);
+    uint32_t unmoved = moves.empty() ? (uint32_t)usedSize : moves.front().NewOffset;
+    std::copy(memory.begin(), memory.begin() + unmoved, compacted.begin());
+    for (auto& move : moves)
+    {
+        std::copy(memory.begin() + move.OldOffset, memory.begin() + move.OldOffset + move.Size, compacted.begin() + move.NewOffset);
+    }
+
+    // Packed in the same order, so each range's new offset is the size of everything before it
+    RangeMap packed;
+    uint32_t offset = 0;
+    for (auto& range : ranges)
+    {
+        for (uint32_t i = offset; i < offset + range.second; ++i)
+        {
+            if (compacted[i] != range.first)
+            {
+                wprintf(L"Range at %u wasn't moved to %u intact by compaction.\n", range.first, offset);
+                return false;
+            }
+        }
+        packed[offset] = range.second;
+        offset += range.second;
+    }
+
+    if (!CheckRanges(allocator, packed, usedSize, L"compaction"))
+    {
+        return false;
+    }
+    if (allocator.GetLargestFreeRange() != capacity - usedSize)
+    {
+        wprintf(L"Compaction left %u free at the end, expected %llu.\n", allocator.GetLargestFreeRange(), capacity - usedSize);
+        return false;
+    }
+
+    // Neighbor merging: freeing everything in random order has to leave one free range again
+    offsets.clear();
+    for (auto& range : packed)
+    {
+        offsets.push_back(range.first);
+    }
+    std::shuffle(offsets.begin(), offsets.end(), random);
+    for (auto rangeOffset : offsets)
+    {
+        allocator.Free(rangeOffset);
+        usedSize -= packed[rangeOffset];
+        packed.erase(rangeOffset);
+    }
+
+    if (!CheckRanges(allocator, packed, usedSize, L"freeing everything"))
+    {
+        return false;
+    }
+    if (allocator.GetLargestFreeRange() != capacity)
+    {
+        wprintf(L"Freed neighbors weren't merged: the largest free range is %u of %u.\n", allocator.GetLargestFreeRange(), capacity);
+        return false;
+    }
+
+    wprintf(L"Range allocator, %u operations on %u units\n", operations, capacity);
+    wprintf(L"  Allocated: %u (%u didn't fit), freed: %u\n", numAllocated, numFailed, numFreed);
+    wprintf(L"  %.1f ns per allocate or free\n", ms * 1e6 / (numAllocated + numFailed + numFreed));
+    wprintf(L"  Before compaction: %u ranges, %u used, largest free range %u\n", (uint32_t)ranges.size(), (uint32_t)offset, largestFree);
+    wprintf(L"  Compaction: %u ranges moved in %.3f ms\n", (uint32_t)moves.size(), compactMs);
+    return true;
+}
+
+// Stands in for the content loader's textures, checking every change the streamer asks for
+class FakeStreamBackend : public TextureStreamBackend
+{
+public:
+    FakeStreamBackend() : Uploads(0), Evictions(0), Failed(false) {}
+
+    bool SetResidentMips(uint32_t id, uint32_t mostDetailedMip) override
+    {
+        uint32_t& resident = ResidentMips[id];
+        if (mostDetailedMip + 1 == resident)
+        {
+            ++Uploads;
+        }
+        else if (mostDetailedMip == resident + 1)
+        {
+            ++Evictions;
+        }
+        else
+        {
+            wprintf(L"Texture %u went from mip %u to %u, not a single level.\n", id, resident, mostDetailedMip);
+            Failed = true;
+        }
+        resident = mostDetailedMip;
+        return true;
+    }
+
+    std::vector<uint32_t> ResidentMips;     // By texture id
+    uint32_t Uploads;
+    uint32_t Evictions;
+    bool Failed;
+};
+
+// Full mip chain, down to 1x1
+static uint32_t GetMipLevels(uint32_t size)
+{
+    uint32_t mipLevels = 1;
+    while ((size >> mipLevels) > 0)
+    {
+        ++mipLevels;
+    }
+    return mipLevels;
+}
+
+static uint32_t AddFakeTexture(TextureStreamer* streamer, FakeStreamBackend* backend, uint32_t size, uint32_t bytesPerPixel)
+{
+    uint32_t id = streamer->AddTexture(size, GetMipLevels(size), bytesPerPixel);
+    backend->ResidentMips.resize(max((uint32_t)backend->ResidentMips.size(), id + 1));
+    backend->ResidentMips[id] = streamer->GetResidentMip(id);
+    return id;
+}
+
+bool RunTextureStreamingBenchmark(uint32_t frames)
+{
+    OpenConsole();
+
+    if (frames == 0)
+    {
+        wprintf(L"Nothing to stream.\n");
+        return false;
+    }
+
+    // A level's worth of textures, with a budget for a quarter of what they could stream in
+    static const uint32_t numTextures = 256;
+    static const uint32_t bytesPerPixel = 4;
+    std::mt19937 random(1234);
+
+    FakeStreamBackend backend;
+    TextureStreamer streamer(&backend, UINT64_MAX);
+    std::vector<uint32_t> ids(numTextures);
+    std::vector<uint32_t> sizes(numTextures);
+    uint64_t fullBytes = 0;
+    for (uint32_t i = 0; i < numTextures; ++i)
+    {
+        sizes[i] = 256u << (random() % 4);
+        ids[i] = AddFakeTexture(&streamer, &backend, sizes[i], bytesPerPixel);
+        fullBytes += TextureStreamer::GetMipChainBytes(sizes[i], GetMipLevels(sizes[i]), bytesPerPixel, 0);
+    }
+
+    uint64_t baseBytes = streamer.GetStats().ResidentBytes;
+    uint64_t budget = baseBytes + (fullBytes - baseBytes) / 4;
+    streamer.SetBudget(budget);
+
+    LARGE_INTEGER frequency, start, end;
+    QueryPerformanceFrequency(&frequency);
+    double ms = 0.0;
+
+    // The camera sweeps across the textures, seeing a quarter of them at a time at random sizes
+    uint64_t frame = 1;
+    uint64_t totalUploads = 0;
+    uint64_t totalEvictions = 0;
+    uint64_t peakBytes = 0;
+    for (; frame <= frames; ++frame)
+    {
+        for (uint32_t i = 0; i < numTextures / 4; ++i)
+        {
+            streamer.MarkVisible(ids[(frame * 2 + i) % numTextures], (float)(64 + random() % 2048));
+        }
+
+        backend.Uploads = 0;
+        backend.Evictions = 0;
+        QueryPerformanceCounter(&start);
+        streamer.Update(frame);
+        QueryPerformanceCounter(&end);
+        ms += ElapsedMs(start, end, frequency);
+
+        const TextureStreamStats& stats = streamer.GetStats();
+        if (backend.Failed)
+        {
+            return false;
+        }
+        if (backend.Uploads > MaxMipUploadsPerFrame || backend.Uploads != stats.Uploads || backend.Evictions != stats.Evictions)
+        {
+            wprintf(L"Frame %llu made %u uploads and %u evictions, reported as %u and %u (at most %u uploads a frame).\n", frame,
+                backend.Uploads, backend.Evictions, stats.Uploads, stats.Evictions, MaxMipUploadsPerFrame);
+            return false;
+        }
+
+        uint64_t residentBytes = 0;
+        for (uint32_t i = 0; i < numTextures; ++i)
+        {
+            if (backend.ResidentMips[ids[i]] != streamer.GetResidentMip(ids[i]))
+            {
+                wprintf(L"Texture %u has mip %u resident, but the streamer thinks it's %u.\n", ids[i], backend.ResidentMips[ids[i]], streamer.GetResidentMip(ids[i]));
+                return false;
+            }
+            residentBytes += TextureStreamer::GetMipChainBytes(sizes[i], GetMipLevels(sizes[i]), bytesPerPixel, backend.ResidentMips[ids[i]]);
+        }
+        if (residentBytes != stats.ResidentBytes || residentBytes > budget)
+        {
+            wprintf(L"Frame %llu has %llu bytes resident, reported as %llu, with a budget of %llu.\n", frame, residentBytes, stats.ResidentBytes, budget);
+            return false;
+        }
+
+        totalUploads += backend.Uploads;
+        totalEvictions += backend.Evictions;
+        peakBytes = max(peakBytes, residentBytes);
+    }
+
+    // Dropping the budget to just the always resident mips, with nothing in view, has to evict
+    // every streamed mip in one update
+    streamer.SetBudget(baseBytes);
+    streamer.Update(frame++);
+    if (backend.Failed)
+    {
+        return false;
+    }
+    if (streamer.GetStats().ResidentBytes != baseBytes)
+    {
+        wprintf(L"%llu bytes still resident after lowering the budget to %llu.\n", streamer.GetStats().ResidentBytes, baseBytes);
+        return false;
+    }
+
+    // Least recently used goes first: three textures fully streamed in, then seen for one, two
+    // and three more frames, then the budget lowered by a byte. Only the one seen longest ago
+    // may give up its top mip
+    FakeStreamBackend lruBackend;
+    TextureStreamer lru(&lruBackend, UINT64_MAX);
+    uint32_t lruIds[3];
+    for (auto& id : lruIds)
+    {
+        id = AddFakeTexture(&lru, &lruBackend, 256, bytesPerPixel);
+    }
+
+    uint64_t lruFrame = 1;
+    for (; lruFrame < 16 && lru.GetStats().FullyResident < 3; ++lruFrame)
+    {
+        for (auto id : lruIds)
+        {
+            lru.MarkVisible(id, 256.f);
+        }
+        lru.Update(lruFrame);
+    }
+    for (uint32_t first = 0; first < 3; ++first, ++lruFrame)
+    {
+        for (uint32_t i = first; i < 3; ++i)
+        {
+            lru.MarkVisible(lruIds[i], 256.f);
+        }
+        lru.Update(lruFrame);
+    }
+
+    lru.SetBudget(lru.GetStats().ResidentBytes - 1);
+    lru.MarkVisible(lruIds[2], 256.f);
+    lru.Update(lruFrame);
+    if (lruBackend.Failed)
+    {
+        return false;
+    }
+    if (lru.GetResidentMip(lruIds[0]) != 1 || lru.GetResidentMip(lruIds[1]) != 0 || lru.GetResidentMip(lruIds[2]) != 0)
+    {
+        wprintf(L"Expected the least recently used texture to lose its top mip, but mips %u, %u & %u are resident.\n",
+            lru.GetResidentMip(lruIds[0]), lru.GetResidentMip(lruIds[1]), lru.GetResidentMip(lruIds[2]));
+        return false;
+    }
+
+    wprintf(L"Texture streaming, %u textures, %u frames, %llu MB budget of %llu MB\n", numTextures, frames, budget >> 20, fullBytes >> 20);
+    wprintf(L"  Uploads: %llu (%.2f a frame, at most %u), evictions: %llu\n", totalUploads, (double)totalUploads / frames,
+        MaxMipUploadsPerFrame, totalEvictions);
+    wprintf(L"  Peak resident: %llu MB\n", peakBytes >> 20);
+    wprintf(L"  Update: %.3f ms a frame\n", ms / frames);
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// Headless benchmarks, run from the command line before any window or device is created.
+// Results are printed to the console the app was launched from (or a new one).
+
+enum class BenchmarkBackend
+{
+    Null = 0,       // CPU stages only: culling, occlusion & draw sorting
+    Software,       // As Null, then rasterized & lit with the SoftwareRenderer
+};
+
+// Attaches stdout to a console. Also used by the interactive camera path benchmark
+void OpenConsole();
+
+// Culls numParts random boxes against a moving camera, comparing the SIMD
+// kernel to the scalar one. Returns false if their results ever differ.
+bool RunCullingBenchmark(uint32_t numParts, uint32_t iterations);
+
+// Flies a camera path (a recorded one, or the default loop if cameraPath is empty) through
+// the model with frustum and occlusion culling, reporting how much was culled and the cost.
+bool RunOcclusionBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename, const std::wstring& cameraPath);
+
+// Writes per draw constants (world, view & projection, as in the geometry pass) through a
+// RingAllocator into system memory, with frames retiring two frames late as on a GPU.
+bool RunConstantsBenchmark(uint32_t drawsPerFrame, uint32_t frames);
+
+// Bins 1K, 10K & 100K random point lights into light clusters from a moving camera, reporting
+// the build cost and how many lights end up in each cluster.
+bool RunLightClusteringBenchmark(uint32_t frames);
+
+// Renders the default camera loop through the model with the CPU software renderer at the
+// interactive app's resolution, reporting the frame times. The first frame is saved as a
+// bitmap to imageFilename if it's not empty, for comparing against a known good image.
+bool RunSoftwareRenderBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename, const std::wstring& imageFilename);
+
+// Plays a camera path (a recorded one, or the default loop if cameraPath is empty) through the
+// model a key per frame, timing each CPU stage of the frame the way the interactive
+// -benchpath mode does. Prints avg/p50/p95/p99/max per stage and saves every frame to csvFilename.
+bool RunCameraPathBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename, const std::wstring& cameraPath,
+    BenchmarkBackend backend, const std::wstring& csvFilename);
+
+// Runs an update thread and a render thread through a FramePipeline at each latency from 0 to
+// MaxFrameLatency, with busy waits standing in for their work (the null backend). Reports the
+// frame times and input to present latency of each, and returns false if a snapshot ever
+// arrives out of order or is changed while it's being rendered.
+bool RunFramePipelineBenchmark(uint32_t frames);
+
+// Prepares a synthetic scene of numParts parts for drawing (transforms, frustum culling, draw
+// keys, sorting & constants) the way DeferredRenderer11 does, on a JobSystem with 1, 2, 4...
+// up to every core. Reports the scaling, and returns false if the draws ever differ from the
+// single threaded run.
+bool RunJobScalingBenchmark(uint32_t numParts, uint32_t frames);
+
+// Builds Bvhs over the model's parts and over clusters of its triangles, serially and as jobs,
+// then flies the default camera loop through it with frustum, ray (picking the triangle at the
+// center of the view) and box overlap queries. Reports their cost against testing every item,
+// and returns false if any query result differs from that.
+bool RunBvhBenchmark(const std::wstring& contentRoot, const std::wstring& modelFilename);
+
+// Evaluates the BRDF for numSamples random light, normal & view directions and materials, with
+// the SIMD batch kernel and one sample at a time with the scalar port, reporting evaluations per
+// second. Returns false if the two ever differ by more than float rounding.
+bool RunBrdfBenchmark(uint32_t numSamples, uint32_t iterations);
+
+// Allocates and frees operations random ranges with the RangeAllocator GeometryPool uses,
+// checking every range against the others, then compacts and frees what's left. Reports the
+// cost, and returns false if ranges ever overlap, compaction doesn't keep each range's data, or
+// freed neighbors aren't merged back into one range.
+bool RunRangeAllocatorBenchmark(uint32_t operations);
+
+// Streams textures of a synthetic level through a TextureStreamer, with a fake backend in place
+// of the GPU, as the camera sweeps across them under a budget. Returns false if a change ever
+// skips a mip level, a frame makes more than MaxMipUploadsPerFrame uploads, the budget is
+// exceeded, lowering it doesn't evict every streamed mip, or least recently used textures aren't
+// evicted first.
+bool RunTextureStreamingBenchmark(uint32_t frames);
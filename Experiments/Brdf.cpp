@@ -0,0 +1,200 @@
+#include "Precomp.h"
+#include "Brdf.h"
+#include <intrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// The kernels below follow ComputeBRDF one operation at a time, in the same order, so the only
+// difference is pow(x, 5) becoming x * x * x * x * x. Dot products add x, y then z, and H is
+// normalized to 0 when L + V is 0, as XMVector3Dot & XMVector3Normalize do.
+
+static __m128 Dot3(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+static __m128 Saturate(__m128 x)
+{
+    return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.f));
+}
+
+#if defined(__AVX__)
+static __m256 Dot3(__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+{
+    return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+}
+
+static __m256 Saturate(__m256 x)
+{
+    return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+}
+#endif
+
+void ComputeBRDFRange(const BrdfSamples& samples, uint32_t first, uint32_t count, float* red, float* green, float* blue)
+{
+    const uint32_t end = first + count;
+    uint32_t i = first;
+
+#if defined(__AVX__)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.f);
+        const __m256 two = _mm256_set1_ps(2.f);
+        const __m256 quarter = _mm256_set1_ps(0.25f);
+        const __m256 pi = _mm256_set1_ps(BrdfPI);
+        const __m256 minVDotH = _mm256_set1_ps(FLT_MIN);
+
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 lx = _mm256_loadu_ps(samples.LX + i);
+            __m256 ly = _mm256_loadu_ps(samples.LY + i);
+            __m256 lz = _mm256_loadu_ps(samples.LZ + i);
+            __m256 nx = _mm256_loadu_ps(samples.NX + i);
+            __m256 ny = _mm256_loadu_ps(samples.NY + i);
+            __m256 nz = _mm256_loadu_ps(samples.NZ + i);
+            __m256 vx = _mm256_loadu_ps(samples.VX + i);
+            __m256 vy = _mm256_loadu_ps(samples.VY + i);
+            __m256 vz = _mm256_loadu_ps(samples.VZ + i);
+
+            __m256 hx = _mm256_add_ps(lx, vx);
+            __m256 hy = _mm256_add_ps(ly, vy);
+            __m256 hz = _mm256_add_ps(lz, vz);
+            __m256 length = _mm256_sqrt_ps(Dot3(hx, hy, hz, hx, hy, hz));
+            __m256 nonZero = _mm256_cmp_ps(length, zero, _CMP_NEQ_OQ);
+            hx = _mm256_and_ps(_mm256_div_ps(hx, length), nonZero);
+            hy = _mm256_and_ps(_mm256_div_ps(hy, length), nonZero);
+            hz = _mm256_and_ps(_mm256_div_ps(hz, length), nonZero);
+
+            __m256 nDotH = Saturate(Dot3(nx, ny, nz, hx, hy, hz));
+            __m256 nDotL = Saturate(Dot3(nx, ny, nz, lx, ly, lz));
+            __m256 nDotV = Saturate(Dot3(nx, ny, nz, vx, vy, vz));
+            __m256 hDotL = Saturate(Dot3(hx, hy, hz, lx, ly, lz));
+            __m256 vDotH = Saturate(Dot3(vx, vy, vz, hx, hy, hz));
+
+            // D_GGX
+            __m256 roughness = _mm256_loadu_ps(samples.Roughness + i);
+            __m256 a = _mm256_mul_ps(roughness, roughness);
+            __m256 a2 = _mm256_mul_ps(a, a);
+            __m256 denom = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(nDotH, nDotH), _mm256_sub_ps(a2, one)), one);
+            __m256 d = _mm256_div_ps(a2, _mm256_mul_ps(_mm256_mul_ps(pi, denom), denom));
+
+            // Vis_CookTorrance
+            vDotH = _mm256_max_ps(vDotH, minVDotH);
+            __m256 visA = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(two, nDotH), nDotV), vDotH);
+            __m256 visB = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(two, nDotH), nDotL), vDotH);
+            __m256 vis = _mm256_min_ps(one, _mm256_min_ps(visA, visB));
+
+            // F_Schlick
+            __m256 x = _mm256_sub_ps(one, hDotL);
+            __m256 x2 = _mm256_mul_ps(x, x);
+            __m256 t = _mm256_mul_ps(_mm256_mul_ps(x2, x2), x);
+            __m256 scale = _mm256_mul_ps(_mm256_mul_ps(quarter, d), vis);
+
+            __m256 specular = _mm256_loadu_ps(samples.SpecularR + i);
+            __m256 f = _mm256_add_ps(specular, _mm256_mul_ps(_mm256_sub_ps(one, specular), t));
+            _mm256_storeu_ps(red + i, _mm256_mul_ps(f, scale));
+
+            specular = _mm256_loadu_ps(samples.SpecularG + i);
+            f = _mm256_add_ps(specular, _mm256_mul_ps(_mm256_sub_ps(one, specular), t));
+            _mm256_storeu_ps(green + i, _mm256_mul_ps(f, scale));
+
+            specular = _mm256_loadu_ps(samples.SpecularB + i);
+            f = _mm256_add_ps(specular, _mm256_mul_ps(_mm256_sub_ps(one, specular), t));
+            _mm256_storeu_ps(blue + i, _mm256_mul_ps(f, scale));
+        }
+    }
+#endif
+
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.f);
+        const __m128 two = _mm_set1_ps(2.f);
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        const __m128 pi = _mm_set1_ps(BrdfPI);
+        const __m128 minVDotH = _mm_set1_ps(FLT_MIN);
+
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 lx = _mm_loadu_ps(samples.LX + i);
+            __m128 ly = _mm_loadu_ps(samples.LY + i);
+            __m128 lz = _mm_loadu_ps(samples.LZ + i);
+            __m128 nx = _mm_loadu_ps(samples.NX + i);
+            __m128 ny = _mm_loadu_ps(samples.NY + i);
+            __m128 nz = _mm_loadu_ps(samples.NZ + i);
+            __m128 vx = _mm_loadu_ps(samples.VX + i);
+            __m128 vy = _mm_loadu_ps(samples.VY + i);
+            __m128 vz = _mm_loadu_ps(samples.VZ + i);
+
+            __m128 hx = _mm_add_ps(lx, vx);
+            __m128 hy = _mm_add_ps(ly, vy);
+            __m128 hz = _mm_add_ps(lz, vz);
+            __m128 length = _mm_sqrt_ps(Dot3(hx, hy, hz, hx, hy, hz));
+            __m128 nonZero = _mm_cmpneq_ps(length, zero);
+            hx = _mm_and_ps(_mm_div_ps(hx, length), nonZero);
+            hy = _mm_and_ps(_mm_div_ps(hy, length), nonZero);
+            hz = _mm_and_ps(_mm_div_ps(hz, length), nonZero);
+
+            __m128 nDotH = Saturate(Dot3(nx, ny, nz, hx, hy, hz));
+            __m128 nDotL = Saturate(Dot3(nx, ny, nz, lx, ly, lz));
+            __m128 nDotV = Saturate(Dot3(nx, ny, nz, vx, vy, vz));
+            __m128 hDotL = Saturate(Dot3(hx, hy, hz, lx, ly, lz));
+            __m128 vDotH = Saturate(Dot3(vx, vy, vz, hx, hy, hz));
+
+            // D_GGX
+            __m128 roughness = _mm_loadu_ps(samples.Roughness + i);
+            __m128 a = _mm_mul_ps(roughness, roughness);
+            __m128 a2 = _mm_mul_ps(a, a);
+            __m128 denom = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(nDotH, nDotH), _mm_sub_ps(a2, one)), one);
+            __m128 d = _mm_div_ps(a2, _mm_mul_ps(_mm_mul_ps(pi, denom), denom));
+
+            // Vis_CookTorrance
+            vDotH = _mm_max_ps(vDotH, minVDotH);
+            __m128 visA = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(two, nDotH), nDotV), vDotH);
+            __m128 visB = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(two, nDotH), nDotL), vDotH);
+            __m128 vis = _mm_min_ps(one, _mm_min_ps(visA, visB));
+
+            // F_Schlick
+            __m128 x = _mm_sub_ps(one, hDotL);
+            __m128 x2 = _mm_mul_ps(x, x);
+            __m128 t = _mm_mul_ps(_mm_mul_ps(x2, x2), x);
+            __m128 scale = _mm_mul_ps(_mm_mul_ps(quarter, d), vis);
+
+            __m128 specular = _mm_loadu_ps(samples.SpecularR + i);
+            __m128 f = _mm_add_ps(specular, _mm_mul_ps(_mm_sub_ps(one, specular), t));
+            _mm_storeu_ps(red + i, _mm_mul_ps(f, scale));
+
+            specular = _mm_loadu_ps(samples.SpecularG + i);
+            f = _mm_add_ps(specular, _mm_mul_ps(_mm_sub_ps(one, specular), t));
+            _mm_storeu_ps(green + i, _mm_mul_ps(f, scale));
+
+            specular = _mm_loadu_ps(samples.SpecularB + i);
+            f = _mm_add_ps(specular, _mm_mul_ps(_mm_sub_ps(one, specular), t));
+            _mm_storeu_ps(blue + i, _mm_mul_ps(f, scale));
+        }
+    }
+
+    // Remainder
+    if (i < end)
+    {
+        ComputeBRDFRangeScalar(samples, i, end - i, red, green, blue);
+    }
+}
+
+void ComputeBRDFRangeScalar(const BrdfSamples& samples, uint32_t first, uint32_t count, float* red, float* green, float* blue)
+{
+    const uint32_t end = first + count;
+    for (uint32_t i = first; i < end; ++i)
+    {
+        XMVECTOR L = XMVectorSet(samples.LX[i], samples.LY[i], samples.LZ[i], 0.f);
+        XMVECTOR N = XMVectorSet(samples.NX[i], samples.NY[i], samples.NZ[i], 0.f);
+        XMVECTOR V = XMVectorSet(samples.VX[i], samples.VY[i], samples.VZ[i], 0.f);
+        XMVECTOR specularColor = XMVectorSet(samples.SpecularR[i], samples.SpecularG[i], samples.SpecularB[i], 0.f);
+
+        XMFLOAT3 color;
+        XMStoreFloat3(&color, ComputeBRDF(L, N, V, samples.Roughness[i], specularColor));
+        red[i] = color.x;
+        green[i] = color.y;
+        blue[i] = color.z;
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// C++ ports of the BRDF functions in Shaders/Common.hlsli, for shading on the CPU.
+// Keep these in sync with the shader versions (same names, same math).
+
+static const float BrdfPI = 3.14159265359f;
+
+inline float Saturate(float x)
+{
+    return min(max(x, 0.f), 1.f);
+}
+
+inline float D_GGX(float roughness, float nDotH)
+{
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float denom = nDotH * nDotH * (a2 - 1) + 1;
+    return a2 / (BrdfPI * denom * denom);
+}
+
+inline float Vis_Implicit(float nDotL, float nDotV)
+{
+    return nDotL * nDotV;
+}
+
+inline float Vis_CookTorrance(float nDotH, float nDotL, float nDotV, float vDotH)
+{
+    // The GPU gives min(1, inf) = 1 when vDotH is 0. Avoid the 0 / 0 NaN case here instead
+    vDotH = max(vDotH, FLT_MIN);
+    float a = (2 * nDotH * nDotV) / vDotH;
+    float b = (2 * nDotH * nDotL) / vDotH;
+    return min(1.f, min(a, b));
+}
+
+inline XMVECTOR F_Schlick(FXMVECTOR specularColor, float hDotL)
+{
+    float t = powf(1 - hDotL, 5);
+    return specularColor + (XMVectorSplatOne() - specularColor) * t;
+}
+
+// L is Light direction (pointing away from surface).
+// N is surface Normal
+// V is the View direction (pointing away from surface).
+// Same as the shader without USE_IMPLICIT_VIS.
+inline XMVECTOR ComputeBRDF(FXMVECTOR L, FXMVECTOR N, FXMVECTOR V, float roughness, GXMVECTOR specularColor)
+{
+    XMVECTOR H = XMVector3Normalize(L + V);
+    float nDotH = Saturate(XMVectorGetX(XMVector3Dot(N, H)));
+    float nDotL = Saturate(XMVectorGetX(XMVector3Dot(N, L)));
+    float nDotV = Saturate(XMVectorGetX(XMVector3Dot(N, V)));
+    float hDotL = Saturate(XMVectorGetX(XMVector3Dot(H, L)));
+    float vDotH = Saturate(XMVectorGetX(XMVector3Dot(V, H)));
+
+    return F_Schlick(specularColor, hDotL) *
+        (0.25f * D_GGX(roughness, nDotH) * Vis_CookTorrance(nDotH, nDotL, nDotV, vDotH));
+}
+
+// Inputs for evaluating many BRDFs at once, as structure of arrays so the batch kernels can
+// shade 4 (SSE) or 8 (AVX) samples per instruction. Each points at one float per sample.
+// Directions are normalized. Uniform inputs (a single light, one material) are repeated.
+struct BrdfSamples
+{
+    const float* LX;
+    const float* LY;
+    const float* LZ;
+    const float* NX;
+    const float* NY;
+    const float* NZ;
+    const float* VX;
+    const float* VY;
+    const float* VZ;
+    const float* Roughness;
+    const float* SpecularR;
+    const float* SpecularG;
+    const float* SpecularB;
+};
+
+// ComputeBRDF for samples [first, first + count), written to red, green & blue at the same
+// indices, so ranges can be shaded in parallel. Matches ComputeBRDF to within float rounding
+// (pow is expanded to multiplies), which RunBrdfBenchmark checks.
+void ComputeBRDFRange(const BrdfSamples& samples, uint32_t first, uint32_t count, float* red, float* green, float* blue);
+
+// One sample at a time with ComputeBRDF. Used for validation and as a baseline.
+void ComputeBRDFRangeScalar(const BrdfSamples& samples, uint32_t first, uint32_t count, float* red, float* green, float* blue);
@@ -0,0 +1,600 @@
+#include "Precomp.h"
+#include "Bvh.h"
+#include "JobSystem.h"
+
+// Bins per axis when looking for the cheapest split
+static const uint32_t NumBins = 16;
+
+// Nodes with up to this many items are left as leaves, if the heuristic says that's cheaper
+static const uint32_t MaxLeafItems = 8;
+
+// Cost of testing a node's box, relative to testing an item's
+static const float NodeTestCost = 1.f;
+
+// Nodes with at least this many items build their two subtrees in parallel
+static const uint32_t ItemsPerBuildJob = 4096;
+
+// Node frustum tests are off by at most this, relative to the magnitude of their terms
+static const float FrustumSlack = 1e-5f;
+
+struct BvhBin
+{
+    XMVECTOR    Min;
+    XMVECTOR    Max;
+    uint32_t    Count;
+};
+
+static float SurfaceArea(FXMVECTOR boxMin, FXMVECTOR boxMax)
+{
+    XMFLOAT3 size;
+    XMStoreFloat3(&size, XMVectorMax(boxMax - boxMin, XMVectorZero()));
+    return 2.f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
+
+static float GetComponent(const XMFLOAT3& v, uint32_t axis)
+{
+    return (&v.x)[axis];
+}
+
+static void CopyBox(const CullingBoxes& from, uint32_t i, CullingBoxes* to, uint32_t j)
+{
+    to->CenterX[j] = from.CenterX[i];
+    to->CenterY[j] = from.CenterY[i];
+    to->CenterZ[j] = from.CenterZ[i];
+    to->ExtentX[j] = from.ExtentX[i];
+    to->ExtentY[j] = from.ExtentY[i];
+    to->ExtentZ[j] = from.ExtentZ[i];
+}
+
+// Slab test. distance is where the ray enters the box (0 if it starts inside)
+static bool IntersectRayBox(FXMVECTOR origin, FXMVECTOR invDirection, const BvhNode& node, float maxDistance, float* distance)
+{
+    XMVECTOR t0 = (XMLoadFloat3(&node.Min) - origin) * invDirection;
+    XMVECTOR t1 = (XMLoadFloat3(&node.Max) - origin) * invDirection;
+
+    XMFLOAT3 tMin, tMax;
+    XMStoreFloat3(&tMin, XMVectorMin(t0, t1));
+    XMStoreFloat3(&tMax, XMVectorMax(t0, t1));
+
+    float enter = max(max(tMin.x, tMin.y), max(tMin.z, 0.f));
+    float leave = min(min(tMax.x, tMax.y), min(tMax.z, maxDistance));
+    *distance = enter;
+    return enter <= leave;
+}
+
+Bvh::Bvh()
+    : NumNodes(0), Depth(0)
+{
+}
+
+void Bvh::Build(const CullingBoxes& boxes, JobSystem* jobs)
+{
+    uint32_t count = boxes.Size();
+
+    BuildItems.resize(count);
+    Items.resize(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        XMVECTOR center = XMVectorSet(boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i], 0.f);
+        XMVECTOR extents = XMVectorSet(boxes.ExtentX[i], boxes.ExtentY[i], boxes.ExtentZ[i], 0.f);
+        XMStoreFloat3(&BuildItems[i].Center, center);
+        XMStoreFloat3(&BuildItems[i].Min, center - extents);
+        XMStoreFloat3(&BuildItems[i].Max, center + extents);
+        Items[i] = i;
+    }
+
+    Nodes.clear();
+    Depth = 0;
+    NumNodes = 0;
+    LeafBoxes.Resize(count);
+    if (count == 0)
+    {
+        return;
+    }
+
+    // A binary tree with a leaf per item is as big as it gets
+    Nodes.resize(2 * count - 1);
+    NumNodes = 1;
+    BuildNode(0, 0, count, 0, jobs);
+    Nodes.resize(NumNodes);
+
+    // Children always come after their parent
+    std::vector<uint32_t> depths(Nodes.size(), 0);
+    for (uint32_t i = 0; i < (uint32_t)Nodes.size(); ++i)
+    {
+        if (Nodes[i].Count == 0)
+        {
+            depths[Nodes[i].First] = depths[Nodes[i].First + 1] = depths[i] + 1;
+        }
+        Depth = max(Depth, depths[i]);
+    }
+
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        CopyBox(boxes, Items[i], &LeafBoxes, i);
+    }
+}
+
+void Bvh::BuildNode(uint32_t node, uint32_t first, uint32_t count, uint32_t depth, JobSystem* jobs)
+{
+    uint32_t* items = Items.data() + first;
+    BuildItem* buildItems = BuildItems.data() + first;
+
+    XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+    XMVECTOR centerMin = boundsMin;
+    XMVECTOR centerMax = boundsMax;
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const BuildItem& item = buildItems[i];
+        XMVECTOR center = XMLoadFloat3(&item.Center);
+        boundsMin = XMVectorMin(boundsMin, XMLoadFloat3(&item.Min));
+        boundsMax = XMVectorMax(boundsMax, XMLoadFloat3(&item.Max));
+        centerMin = XMVectorMin(centerMin, center);
+        centerMax = XMVectorMax(centerMax, center);
+    }
+
+    // Nodes is sized up front, so this stays valid while other jobs add nodes
+    BvhNode& bvhNode = Nodes[node];
+    XMStoreFloat3(&bvhNode.Min, boundsMin);
+    XMStoreFloat3(&bvhNode.Max, boundsMax);
+    bvhNode.First = first;
+    bvhNode.Count = count;
+    if (count == 1 || depth == MaxBvhDepth)
+    {
+        return;
+    }
+
+    // Cost of each split between bins, along each axis the centers are spread over, is the
+    // number of items on each side weighted by the surface area of their bounds
+    XMFLOAT3 lowest, highest;
+    XMStoreFloat3(&lowest, centerMin);
+    XMStoreFloat3(&highest, centerMax);
+
+    float bestCost = FLT_MAX;
+    uint32_t bestAxis = UINT32_MAX;
+    uint32_t bestSplit = 0;
+    for (uint32_t axis = 0; axis < 3; ++axis)
+    {
+        float low = GetComponent(lowest, axis);
+        float extent = GetComponent(highest, axis) - low;
+        if (extent <= 0.f)
+        {
+            continue;
+        }
+        float scale = NumBins / extent;
+
+        BvhBin bins[NumBins];
+        for (auto& bin : bins)
+        {
+            bin.Min = XMVectorReplicate(FLT_MAX);
+            bin.Max = XMVectorReplicate(-FLT_MAX);
+            bin.Count = 0;
+        }
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const BuildItem& item = buildItems[i];
+            uint32_t b = min((uint32_t)((GetComponent(item.Center, axis) - low) * scale), NumBins - 1);
+            bins[b].Min = XMVectorMin(bins[b].Min, XMLoadFloat3(&item.Min));
+            bins[b].Max = XMVectorMax(bins[b].Max, XMLoadFloat3(&item.Max));
+            ++bins[b].Count;
+        }
+
+        // Everything from each bin up, then sweep up from the bottom. Split s puts bins below s on the left
+        float rightCosts[NumBins];
+        XMVECTOR rightMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR rightMax = XMVectorReplicate(-FLT_MAX);
+        uint32_t numRight = 0;
+        for (uint32_t b = NumBins - 1; b > 0; --b)
+        {
+            rightMin = XMVectorMin(rightMin, bins[b].Min);
+            rightMax = XMVectorMax(rightMax, bins[b].Max);
+            numRight += bins[b].Count;
+            rightCosts[b] = numRight * SurfaceArea(rightMin, rightMax);
+        }
+
+        XMVECTOR leftMin = XMVectorReplicate(FLT_MAX);
+        XMVECTOR leftMax = XMVectorReplicate(-FLT_MAX);
+        uint32_t numLeft = 0;
+        for (uint32_t split = 1; split < NumBins; ++split)
+        {
+            leftMin = XMVectorMin(leftMin, bins[split - 1].Min);
+            leftMax = XMVectorMax(leftMax, bins[split - 1].Max);
+            numLeft += bins[split - 1].Count;
+            if (numLeft == 0 || numLeft == count)
+            {
+                continue;
+            }
+
+            float cost = numLeft * SurfaceArea(leftMin, leftMax) + rightCosts[split];
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+            }
+        }
+    }
+
+    uint32_t leftCount = count / 2;
+    if (bestAxis != UINT32_MAX)
+    {
+        // Compared without dividing by the area, which is 0 for flat nodes
+        float area = SurfaceArea(boundsMin, boundsMax);
+        if (count <= MaxLeafItems && count * area <= NodeTestCost * area + bestCost)
+        {
+            return;
+        }
+
+        // Same binning as above, so the split lands where it was costed
+        float low = GetComponent(lowest, bestAxis);
+        float scale = NumBins / (GetComponent(highest, bestAxis) - low);
+        uint32_t i = 0;
+        uint32_t j = count;
+        while (i < j)
+        {
+            if (min((uint32_t)((GetComponent(buildItems[i].Center, bestAxis) - low) * scale), NumBins - 1) < bestSplit)
+            {
+                ++i;
+            }
+            else
+            {
+                --j;
+                std::swap(buildItems[i], buildItems[j]);
+                std::swap(items[i], items[j]);
+            }
+        }
+        leftCount = i;
+    }
+    else if (count <= MaxLeafItems)
+    {
+        // Every center is in the same place, so no split separates anything
+        return;
+    }
+
+    uint32_t left = (uint32_t)InterlockedExchangeAdd(&NumNodes, 2);
+    bvhNode.First = left;
+    bvhNode.Count = 0;
+
+    // Each side only touches its own range of Items, so the two can be built at once
+    if (jobs && count >= ItemsPerBuildJob)
+    {
+        JobHandle leftJob = jobs->Run([=]()
+        {
+            BuildNode(left, first, leftCount, depth + 1, jobs);
+        });
+        BuildNode(left + 1, first + leftCount, count - leftCount, depth + 1, jobs);
+        jobs->Wait(leftJob);
+    }
+    else
+    {
+        BuildNode(left, first, leftCount, depth + 1, jobs);
+        BuildNode(left + 1, first + leftCount, count - leftCount, depth + 1, jobs);
+    }
+}
+
+void Bvh::Refit(const CullingBoxes& boxes)
+{
+    assert(boxes.Size() == GetNumItems());
+
+    for (uint32_t i = 0; i < GetNumItems(); ++i)
+    {
+        CopyBox(boxes, Items[i], &LeafBoxes, i);
+    }
+
+    // Children always come after their parent, so going backwards visits them first
+    for (uint32_t i = (uint32_t)Nodes.size(); i-- > 0;)
+    {
+        BvhNode& node = Nodes[i];
+        XMVECTOR boundsMin, boundsMax;
+        if (node.Count > 0)
+        {
+            boundsMin = XMVectorReplicate(FLT_MAX);
+            boundsMax = XMVectorReplicate(-FLT_MAX);
+            for (uint32_t j = node.First; j < node.First + node.Count; ++j)
+            {
+                XMVECTOR center = XMVectorSet(LeafBoxes.CenterX[j], LeafBoxes.CenterY[j], LeafBoxes.CenterZ[j], 0.f);
+                XMVECTOR extents = XMVectorSet(LeafBoxes.ExtentX[j], LeafBoxes.ExtentY[j], LeafBoxes.ExtentZ[j], 0.f);
+                boundsMin = XMVectorMin(boundsMin, center - extents);
+                boundsMax = XMVectorMax(boundsMax, center + extents);
+            }
+        }
+        else
+        {
+            const BvhNode& left = Nodes[node.First];
+            const BvhNode& right = Nodes[node.First + 1];
+            boundsMin = XMVectorMin(XMLoadFloat3(&left.Min), XMLoadFloat3(&right.Min));
+            boundsMax = XMVectorMax(XMLoadFloat3(&left.Max), XMLoadFloat3(&right.Max));
+        }
+        XMStoreFloat3(&node.Min, boundsMin);
+        XMStoreFloat3(&node.Max, boundsMax);
+    }
+}
+
+void Bvh::GetItemRange(uint32_t node, uint32_t* first, uint32_t* end) const
+{
+    // A subtree's items are contiguous, from its leftmost leaf to its rightmost
+    uint32_t leftmost = node;
+    while (Nodes[leftmost].Count == 0)
+    {
+        leftmost = Nodes[leftmost].First;
+    }
+    uint32_t rightmost = node;
+    while (Nodes[rightmost].Count == 0)
+    {
+        rightmost = Nodes[rightmost].First + 1;
+    }
+
+    *first = Nodes[leftmost].First;
+    *end = Nodes[rightmost].First + Nodes[rightmost].Count;
+}
+
+uint32_t Bvh::FrustumQuery(CXMMATRIX viewProjection, uint32_t* visible) const
+{
+    if (Nodes.empty())
+    {
+        return 0;
+    }
+
+    XMFLOAT4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+
+    XMVECTOR planeVectors[6];
+    XMVECTOR absPlanes[6];
+    for (int p = 0; p < 6; ++p)
+    {
+        planeVectors[p] = XMLoadFloat4(&planes[p]);
+        absPlanes[p] = XMVectorAbs(planeVectors[p]);
+    }
+
+    // Planes a node is entirely inside of aren't tested again below it. Once that's all of
+    // them, everything below is visible. Depth first, so the stack never holds more than one
+    // node per level
+    struct Entry
+    {
+        uint32_t    Node;
+        uint32_t    Planes;
+    };
+    Entry stack[MaxBvhDepth + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize].Node = 0;
+    stack[stackSize++].Planes = 0x3F;
+
+    uint32_t numVisible = 0;
+    while (stackSize > 0)
+    {
+        Entry entry = stack[--stackSize];
+        const BvhNode& node = Nodes[entry.Node];
+
+        XMVECTOR nodeMin = XMLoadFloat3(&node.Min);
+        XMVECTOR nodeMax = XMLoadFloat3(&node.Max);
+        XMVECTOR center = XMVectorSetW((nodeMin + nodeMax) * 0.5f, 1.f);
+        XMVECTOR extents = (nodeMax - nodeMin) * 0.5f;
+
+        // With some slack for rounding, so a node is never culled (or taken as inside) when the
+        // test on one of its items could come out the other way
+        bool outside = false;
+        for (int p = 0; p < 6 && !outside; ++p)
+        {
+            if (entry.Planes & (1 << p))
+            {
+                float d = XMVectorGetX(XMVector4Dot(planeVectors[p], center));
+                float r = XMVectorGetX(XMVector3Dot(absPlanes[p], extents));
+                float slack = FrustumSlack * (XMVectorGetX(XMVector4Dot(absPlanes[p], XMVectorAbs(center))) + r);
+                outside = d + r < -slack;
+                if (d - r >= slack)
+                {
+                    entry.Planes &= ~(1 << p);
+                }
+            }
+        }
+        if (outside)
+        {
+            continue;
+        }
+
+        if (entry.Planes == 0)
+        {
+            uint32_t first, end;
+            GetItemRange(entry.Node, &first, &end);
+            for (uint32_t i = first; i < end; ++i)
+            {
+                visible[numVisible++] = Items[i];
+            }
+        }
+        else if (node.Count > 0)
+        {
+            // Every plane, as FrustumCull does
+            for (uint32_t i = node.First; i < node.First + node.Count; ++i)
+            {
+                if (IsBoxVisible(LeafBoxes, i, planes))
+                {
+                    visible[numVisible++] = Items[i];
+                }
+            }
+        }
+        else
+        {
+            stack[stackSize].Node = node.First + 1;
+            stack[stackSize++].Planes = entry.Planes;
+            stack[stackSize].Node = node.First;
+            stack[stackSize++].Planes = entry.Planes;
+        }
+    }
+
+    return numVisible;
+}
+
+uint32_t Bvh::RayQuery(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+    const std::function<bool(uint32_t, float*)>& intersect, float* distance) const
+{
+    *distance = maxDistance;
+
+    float entryDistance = 0.f;
+    XMVECTOR invDirection = XMVectorReciprocal(direction);
+    if (Nodes.empty() || !IntersectRayBox(origin, invDirection, Nodes[0], maxDistance, &entryDistance))
+    {
+        return UINT32_MAX;
+    }
+
+    // Nearer child on top, and anything entered beyond the closest hit so far is skipped
+    struct Entry
+    {
+        uint32_t    Node;
+        float       Distance;
+    };
+    Entry stack[MaxBvhDepth + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize].Node = 0;
+    stack[stackSize++].Distance = entryDistance;
+
+    uint32_t closest = UINT32_MAX;
+    while (stackSize > 0)
+    {
+        Entry entry = stack[--stackSize];
+        if (entry.Distance > *distance)
+        {
+            continue;
+        }
+
+        const BvhNode& node = Nodes[entry.Node];
+        if (node.Count > 0)
+        {
+            for (uint32_t i = node.First; i < node.First + node.Count; ++i)
+            {
+                if (intersect(Items[i], distance))
+                {
+                    closest = Items[i];
+                }
+            }
+            continue;
+        }
+
+        float leftDistance = 0.f;
+        float rightDistance = 0.f;
+        bool hitLeft = IntersectRayBox(origin, invDirection, Nodes[node.First], *distance, &leftDistance);
+        bool hitRight = IntersectRayBox(origin, invDirection, Nodes[node.First + 1], *distance, &rightDistance);
+        if (hitLeft && hitRight)
+        {
+            bool leftFirst = leftDistance <= rightDistance;
+            stack[stackSize].Node = leftFirst ? node.First + 1 : node.First;
+            stack[stackSize++].Distance = leftFirst ? rightDistance : leftDistance;
+            stack[stackSize].Node = leftFirst ? node.First : node.First + 1;
+            stack[stackSize++].Distance = leftFirst ? leftDistance : rightDistance;
+        }
+        else if (hitLeft || hitRight)
+        {
+            stack[stackSize].Node = hitLeft ? node.First : node.First + 1;
+            stack[stackSize++].Distance = hitLeft ? leftDistance : rightDistance;
+        }
+    }
+
+    return closest;
+}
+
+uint32_t Bvh::OverlapQuery(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, uint32_t* overlapping) const
+{
+    if (Nodes.empty())
+    {
+        return 0;
+    }
+
+    XMVECTOR queryMin = XMLoadFloat3(&boxMin);
+    XMVECTOR queryMax = XMLoadFloat3(&boxMax);
+
+    uint32_t stack[MaxBvhDepth + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+
+    uint32_t numOverlapping = 0;
+    while (stackSize > 0)
+    {
+        const BvhNode& node = Nodes[stack[--stackSize]];
+        if (!XMVector3LessOrEqual(XMLoadFloat3(&node.Min), queryMax) || !XMVector3GreaterOrEqual(XMLoadFloat3(&node.Max), queryMin))
+        {
+            continue;
+        }
+
+        if (node.Count > 0)
+        {
+            for (uint32_t i = node.First; i < node.First + node.Count; ++i)
+            {
+                XMVECTOR center = XMVectorSet(LeafBoxes.CenterX[i], LeafBoxes.CenterY[i], LeafBoxes.CenterZ[i], 0.f);
+                XMVECTOR extents = XMVectorSet(LeafBoxes.ExtentX[i], LeafBoxes.ExtentY[i], LeafBoxes.ExtentZ[i], 0.f);
+                if (XMVector3LessOrEqual(center - extents, queryMax) && XMVector3GreaterOrEqual(center + extents, queryMin))
+                {
+                    overlapping[numOverlapping++] = Items[i];
+                }
+            }
+        }
+        else
+        {
+            stack[stackSize++] = node.First + 1;
+            stack[stackSize++] = node.First;
+        }
+    }
+
+    return numOverlapping;
+}
+
+float Bvh::GetSahCost() const
+{
+    if (Nodes.empty())
+    {
+        return 0.f;
+    }
+
+    float rootArea = SurfaceArea(XMLoadFloat3(&Nodes[0].Min), XMLoadFloat3(&Nodes[0].Max));
+    if (rootArea <= 0.f)
+    {
+        return (float)GetNumItems();
+    }
+
+    float cost = 0.f;
+    for (auto& node : Nodes)
+    {
+        float probability = SurfaceArea(XMLoadFloat3(&node.Min), XMLoadFloat3(&node.Max)) / rootArea;
+        cost += probability * (node.Count > 0 ? (float)node.Count : NodeTestCost);
+    }
+    return cost;
+}
+
+bool IntersectRayTriangle(FXMVECTOR origin, FXMVECTOR direction, const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2, float* distance)
+{
+    XMVECTOR p0 = XMLoadFloat3(&v0);
+    XMVECTOR edge1 = XMLoadFloat3(&v1) - p0;
+    XMVECTOR edge2 = XMLoadFloat3(&v2) - p0;
+
+    XMVECTOR p = XMVector3Cross(direction, edge2);
+    float determinant = XMVectorGetX(XMVector3Dot(edge1, p));
+    if (fabsf(determinant) < 1e-12f)
+    {
+        // Parallel to the triangle
+        return false;
+    }
+    float invDeterminant = 1.f / determinant;
+
+    XMVECTOR s = origin - p0;
+    float u = XMVectorGetX(XMVector3Dot(s, p)) * invDeterminant;
+    if (u < 0.f || u > 1.f)
+    {
+        return false;
+    }
+
+    XMVECTOR q = XMVector3Cross(s, edge1);
+    float v = XMVectorGetX(XMVector3Dot(direction, q)) * invDeterminant;
+    if (v < 0.f || u + v > 1.f)
+    {
+        return false;
+    }
+
+    float t = XMVectorGetX(XMVector3Dot(edge2, q)) * invDeterminant;
+    if (t < 0.f)
+    {
+        return false;
+    }
+
+    *distance = t;
+    return true;
+}
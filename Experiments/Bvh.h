@@ -0,0 +1,95 @@
+#pragma once
+
+#include "Culling.h"
+
+class JobSystem;
+
+// Deepest a Bvh gets. Nodes at this depth are made leaves, however many items they have
+static const uint32_t MaxBvhDepth = 64;
+
+// Node of a Bvh. Children are allocated in pairs, so the right child is always left + 1 and
+// siblings are tested from the same cache line.
+struct BvhNode
+{
+    XMFLOAT3    Min;
+    uint32_t    First;      // Leaf: index of its first item in GetItems(). Otherwise: left child
+    XMFLOAT3    Max;
+    uint32_t    Count;      // Leaf: number of items. 0 for inner nodes
+};
+
+// Bounding volume hierarchy over a set of boxes, so spatial queries only touch the items near
+// them: frustum culling, ray casts for picking, and box overlap tests.
+//
+// Built top down, splitting each node where the surface area heuristic says is cheapest,
+// estimated from the item centers sorted into a few bins along each axis. Subtrees are built
+// as jobs. When items move, Refit recomputes the node bounds bottom up and keeps the tree,
+// which is much cheaper than a build but gets less efficient the further things move from
+// where they were. Item boxes are kept in leaf order, so a leaf's items are read linearly.
+// Independent of any graphics API.
+class Bvh : public NonCopyable
+{
+public:
+    Bvh();
+
+    // jobs may be null, to build on the calling thread
+    void Build(const CullingBoxes& boxes, JobSystem* jobs);
+
+    // boxes must be the same items Build was given, in the same order
+    void Refit(const CullingBoxes& boxes);
+
+    uint32_t GetNumItems() const { return (uint32_t)Items.size(); }
+
+    // Same results as FrustumCull on the boxes (using the same test), in tree order rather than
+    // increasing order. visible must have room for every item.
+    uint32_t FrustumQuery(CXMMATRIX viewProjection, uint32_t* visible) const;
+
+    // Finds the closest item hit by a ray, calling intersect for each item whose box the ray
+    // enters before the closest hit so far, nearest boxes first. intersect is given the distance
+    // of the closest hit so far, and returns true after lowering it if the item is hit closer.
+    // Distances are in units of direction's length. Returns UINT32_MAX if nothing was hit.
+    uint32_t RayQuery(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+        const std::function<bool(uint32_t, float*)>& intersect, float* distance) const;
+
+    // Writes every item whose box overlaps [boxMin, boxMax], and returns how many were written.
+    // overlapping must have room for every item.
+    uint32_t OverlapQuery(const XMFLOAT3& boxMin, const XMFLOAT3& boxMax, uint32_t* overlapping) const;
+
+    const std::vector<BvhNode>& GetNodes() const { return Nodes; }
+
+    // Item indices (into the boxes given to Build), grouped by leaf
+    const std::vector<uint32_t>& GetItems() const { return Items; }
+
+    uint32_t GetDepth() const { return Depth; }
+
+    // Expected number of node and item tests for a random ray through the root, by the surface
+    // area heuristic. Testing every item would cost the number of items
+    float GetSahCost() const;
+
+private:
+    void BuildNode(uint32_t node, uint32_t first, uint32_t count, uint32_t depth, JobSystem* jobs);
+
+    // Range of GetItems() under node
+    void GetItemRange(uint32_t node, uint32_t* first, uint32_t* end) const;
+
+    std::vector<BvhNode>    Nodes;
+    std::vector<uint32_t>   Items;
+    volatile LONG           NumNodes;       // Allocated so far, while building
+    uint32_t                Depth;
+
+    // Scratch for building. Partitioned in place along with Items, so each node's items are
+    // read linearly rather than gathered
+    struct BuildItem
+    {
+        XMFLOAT3    Center;
+        XMFLOAT3    Min;
+        XMFLOAT3    Max;
+    };
+    std::vector<BuildItem>  BuildItems;
+
+    // The item boxes, in GetItems() order
+    CullingBoxes            LeafBoxes;
+};
+
+// Moller-Trumbore ray/triangle test, both sides. Sets distance (in units of direction's length)
+// and returns true if the ray hits the triangle at a distance of at least 0.
+bool IntersectRayTriangle(FXMVECTOR origin, FXMVECTOR direction, const XMFLOAT3& v0, const XMFLOAT3& v1, const XMFLOAT3& v2, float* distance);
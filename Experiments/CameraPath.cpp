@@ -0,0 +1,76 @@
+#include "Precomp.h"
+#include "CameraPath.h"
+#include <stdio.h>
+
+XMMATRIX ComputeCameraView(const XMFLOAT3& position, float yaw, float pitch)
+{
+    XMVECTOR forward = XMVector3TransformNormal(XMVectorSet(0.f, 0.f, -1.f, 0.f), XMMatrixRotationY(yaw));
+    XMVECTOR right = XMVector3Cross(forward, XMVectorSet(0.f, 1.f, 0.f, 0.f));
+    XMVECTOR up = XMVector3TransformNormal(XMVectorSet(0.f, 1.f, 0.f, 0.f), XMMatrixRotationAxis(right, pitch));
+    forward = XMVector3Cross(up, right);
+
+    return XMMatrixLookToRH(XMLoadFloat3(&position), forward, up);
+}
+
+bool LoadCameraPath(const std::wstring& filename, std::vector<CameraKey>* path)
+{
+    path->clear();
+
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, filename.c_str(), L"r") != 0 || !file)
+    {
+        LogError(L"Failed to open camera path: %s.", filename.c_str());
+        return false;
+    }
+
+    CameraKey key{};
+    while (fscanf_s(file, "%f %f %f %f %f", &key.Position.x, &key.Position.y, &key.Position.z, &key.Yaw, &key.Pitch) == 5)
+    {
+        path->push_back(key);
+    }
+
+    fclose(file);
+
+    if (path->empty())
+    {
+        LogError(L"Camera path is empty: %s.", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool SaveCameraPath(const std::wstring& filename, const std::vector<CameraKey>& path)
+{
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, filename.c_str(), L"w") != 0 || !file)
+    {
+        LogError(L"Failed to create camera path: %s.", filename.c_str());
+        return false;
+    }
+
+    for (auto& key : path)
+    {
+        fprintf(file, "%f %f %f %f %f\n", key.Position.x, key.Position.y, key.Position.z, key.Yaw, key.Pitch);
+    }
+
+    fclose(file);
+    return true;
+}
+
+void GetDefaultCameraPath(uint32_t numKeys, std::vector<CameraKey>* path)
+{
+    path->resize(numKeys);
+
+    for (uint32_t i = 0; i < numKeys; ++i)
+    {
+        // Ellipse along the length of the atrium, looking along the direction of travel
+        float angle = XM_2PI * i / numKeys;
+
+        CameraKey& key = (*path)[i];
+        key.Position = XMFLOAT3(cosf(angle) * 1100.f, 150.f, sinf(angle) * 350.f);
+        // Forward is (-sin(yaw), 0, -cos(yaw)), so solve for the yaw matching the ellipse tangent
+        key.Yaw = atan2f(sinf(angle) * 1100.f, -cosf(angle) * 350.f);
+        key.Pitch = 0.f;
+    }
+}
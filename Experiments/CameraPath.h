@@ -0,0 +1,19 @@
+#pragma once
+
+// Recorded fly-through cameras, for repeatable benchmarks.
+// Stored as text, one key per line: "x y z yaw pitch".
+struct CameraKey
+{
+    XMFLOAT3    Position;
+    float       Yaw;
+    float       Pitch;
+};
+
+// Same first person camera as the interactive app
+XMMATRIX ComputeCameraView(const XMFLOAT3& position, float yaw, float pitch);
+
+bool LoadCameraPath(const std::wstring& filename, std::vector<CameraKey>* path);
+bool SaveCameraPath(const std::wstring& filename, const std::vector<CameraKey>& path);
+
+// A loop around the sponza atrium, used when no path has been recorded
+void GetDefaultCameraPath(uint32_t numKeys, std::vector<CameraKey>* path);
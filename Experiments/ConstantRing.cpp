@@ -0,0 +1,186 @@
+#include "Precomp.h"
+#include "ConstantRing.h"
+
+RingAllocator::RingAllocator(uint32_t capacity)
+    : Capacity(capacity)
+    , Head(0)
+    , Tail(0)
+{
+}
+
+bool RingAllocator::Allocate(uint32_t size, uint32_t alignment, uint32_t* offset)
+{
+    if (size > Capacity)
+    {
+        return false;
+    }
+
+    uint32_t position = (uint32_t)(Head % Capacity);
+    uint32_t aligned = (position + alignment - 1) / alignment * alignment;
+
+    // Ranges never straddle the end, so skip what's left and start over at 0
+    if ((uint64_t)aligned + size > Capacity)
+    {
+        aligned = Capacity;
+    }
+
+    uint64_t newHead = Head + (aligned - position) + size;
+    if (newHead - Tail > Capacity)
+    {
+        return false;
+    }
+
+    Head = newHead;
+    *offset = aligned % Capacity;
+    return true;
+}
+
+void RingAllocator::EndFrame(uint64_t fence)
+{
+    FrameMarker marker;
+    marker.Fence = fence;
+    marker.End = Head;
+    Frames.push_back(marker);
+}
+
+void RingAllocator::Retire(uint64_t completedFence)
+{
+    while (!Frames.empty() && Frames.front().Fence <= completedFence)
+    {
+        Tail = Frames.front().End;
+        Frames.pop_front();
+    }
+}
+
+bool ConstantRing::IsSupported(const ComPtr<ID3D11Device>& device)
+{
+    D3D11_FEATURE_DATA_D3D11_OPTIONS options{};
+    if (FAILED(device->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))))
+    {
+        return false;
+    }
+
+    return options.ConstantBufferOffsetting && options.MapNoOverwriteOnDynamicConstantBuffer;
+}
+
+std::unique_ptr<ConstantRing> ConstantRing::Create(const ComPtr<ID3D11Device>& device, uint32_t capacity)
+{
+    std::unique_ptr<ConstantRing> ring(new ConstantRing((capacity + BlockAlignment - 1) / BlockAlignment * BlockAlignment));
+    if (ring)
+    {
+        if (ring->Initialize(device))
+        {
+            return ring;
+        }
+    }
+    return nullptr;
+}
+
+ConstantRing::ConstantRing(uint32_t capacity)
+    : Allocator(capacity)
+    , NextFence(0)
+    , HasMapped(false)
+{
+}
+
+bool ConstantRing::Initialize(const ComPtr<ID3D11Device>& device)
+{
+    device->GetImmediateContext(&Context);
+
+    D3D11_BUFFER_DESC bd{};
+    bd.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    bd.ByteWidth = Allocator.GetCapacity();
+    bd.Usage = D3D11_USAGE_DYNAMIC;
+    bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+    CheckResult(device->CreateBuffer(&bd, nullptr, &Buffer));
+
+    D3D11_QUERY_DESC qd{};
+    qd.Query = D3D11_QUERY_EVENT;
+
+    for (uint32_t i = 0; i < MaxFramesInFlight; ++i)
+    {
+        CheckResult(device->CreateQuery(&qd, &FrameQueries[i]));
+    }
+
+    return true;
+}
+
+void ConstantRing::BeginFrame()
+{
+    while (Allocator.HasFramesInFlight())
+    {
+        uint64_t fence = Allocator.GetOldestFence();
+        if (Context->GetData(FrameQueries[fence % MaxFramesInFlight].Get(), nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        {
+            break;
+        }
+        Allocator.Retire(fence);
+    }
+}
+
+uint8_t* ConstantRing::Map(uint32_t count, uint32_t blockSize, uint32_t* firstConstant, uint32_t* blockConstants)
+{
+    uint32_t blockStride = (blockSize + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+    if ((uint64_t)count * blockStride > Allocator.GetCapacity())
+    {
+        return nullptr;
+    }
+
+    uint32_t offset = 0;
+    while (!Allocator.Allocate(count * blockStride, BlockAlignment, &offset))
+    {
+        if (!Allocator.HasFramesInFlight())
+        {
+            return nullptr;
+        }
+
+        // Out of room, so wait for the oldest frame
+        WaitForOldestFrame();
+    }
+
+    // The first map of a dynamic buffer has to discard
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    if (FAILED(Context->Map(Buffer.Get(), 0, HasMapped ? D3D11_MAP_WRITE_NO_OVERWRITE : D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+    {
+        LogError(L"Failed to map constant ring.");
+        return nullptr;
+    }
+    HasMapped = true;
+
+    *firstConstant = offset / 16;
+    *blockConstants = blockStride / 16;
+    return (uint8_t*)mapped.pData + offset;
+}
+
+void ConstantRing::Unmap()
+{
+    Context->Unmap(Buffer.Get(), 0);
+}
+
+void ConstantRing::EndFrame()
+{
+    // The query slot is about to be reused, so that frame must be finished first
+    if (NextFence >= MaxFramesInFlight)
+    {
+        uint64_t oldFence = NextFence - MaxFramesInFlight;
+        while (Allocator.HasFramesInFlight() && Allocator.GetOldestFence() <= oldFence)
+        {
+            WaitForOldestFrame();
+        }
+    }
+
+    Context->End(FrameQueries[NextFence % MaxFramesInFlight].Get());
+    Allocator.EndFrame(NextFence);
+    ++NextFence;
+}
+
+void ConstantRing::WaitForOldestFrame()
+{
+    uint64_t fence = Allocator.GetOldestFence();
+    while (Context->GetData(FrameQueries[fence % MaxFramesInFlight].Get(), nullptr, 0, 0) == S_FALSE)
+    {
+        YieldProcessor();
+    }
+    Allocator.Retire(fence);
+}
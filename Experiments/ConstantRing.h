@@ -0,0 +1,74 @@
+#pragma once
+
+// Hands out ranges of a fixed size ring, front to back. The ranges allocated during a frame
+// are tagged with a fence value when the frame ends, and only become reusable once that
+// fence has completed. Independent of any graphics API.
+class RingAllocator
+{
+public:
+    explicit RingAllocator(uint32_t capacity);
+
+    // Returns false if there's no room until older frames retire.
+    // capacity should be a multiple of alignment, so that wrapping to 0 stays aligned
+    bool Allocate(uint32_t size, uint32_t alignment, uint32_t* offset);
+
+    void EndFrame(uint64_t fence);
+    void Retire(uint64_t completedFence);
+
+    uint32_t GetCapacity() const { return Capacity; }
+    uint32_t GetUsedBytes() const { return (uint32_t)(Head - Tail); }
+    bool HasFramesInFlight() const { return !Frames.empty(); }
+    uint64_t GetOldestFence() const { return Frames.front().Fence; }
+
+private:
+    struct FrameMarker
+    {
+        uint64_t Fence;
+        uint64_t End;
+    };
+
+    uint32_t                Capacity;
+    uint64_t                Head;       // Total bytes handed out (including padding), Head % Capacity is the next offset
+    uint64_t                Tail;       // Where the oldest frame still in flight starts
+    std::deque<FrameMarker> Frames;
+};
+
+// Per draw constants in one large dynamic constant buffer, written with map no-overwrite and
+// bound with offsets (VSSetConstantBuffers1). Frames are fenced with event queries, so space
+// is only reused once the GPU is done with it. Requires D3D11.1 constant buffer offsetting.
+class ConstantRing : public NonCopyable
+{
+public:
+    // Offsets given to VSSetConstantBuffers1 must be multiples of 16 constants (256 bytes)
+    static const uint32_t BlockAlignment = 256;
+
+    static bool IsSupported(const ComPtr<ID3D11Device>& device);
+    static std::unique_ptr<ConstantRing> Create(const ComPtr<ID3D11Device>& device, uint32_t capacity);
+
+    // Frees space from frames the GPU has finished with
+    void BeginFrame();
+
+    // Maps room for count blocks of blockSize bytes, each padded to BlockAlignment. Block i starts at
+    // data + i * (*blockConstants * 16), and is bound with firstConstant + i * *blockConstants.
+    // Waits on the GPU if the ring is full, and returns nullptr if it still doesn't fit.
+    uint8_t* Map(uint32_t count, uint32_t blockSize, uint32_t* firstConstant, uint32_t* blockConstants);
+    void Unmap();
+
+    void EndFrame();
+
+    const ComPtr<ID3D11Buffer>& GetBuffer() const { return Buffer; }
+
+private:
+    ConstantRing(uint32_t capacity);
+    bool Initialize(const ComPtr<ID3D11Device>& device);
+    void WaitForOldestFrame();
+
+    static const uint32_t MaxFramesInFlight = 4;
+
+    ComPtr<ID3D11DeviceContext> Context;
+    ComPtr<ID3D11Buffer>        Buffer;
+    ComPtr<ID3D11Query>         FrameQueries[MaxFramesInFlight];
+    RingAllocator               Allocator;
+    uint64_t                    NextFence;
+    bool                        HasMapped;
+};
@@ -1,280 +1,2042 @@
 #include "Precomp.h"
 #include "ContentLoader.h"
+#include "MemoryTelemetry.h"
+#include "FileWatcher.h"
 #include "Geometry.h"
 
+static bool ReadFileData(const std::wstring& filename, std::vector<uint8_t>* data)
+{
+    FileHandle file(CreateFile(filename.c_str(), GENERIC_READ,
+        FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid())
+    {
+        LogError(L"Failed to open asset file.");
+        return false;
+    }
+
+    DWORD bytesRead{};
+    data->resize(GetFileSize(file.Get(), nullptr));
+    if (!ReadFile(file.Get(), data->data(), (DWORD)data->size(), &bytesRead, nullptr) || bytesRead != data->size())
+    {
+        LogError(L"Failed to read file.");
+        return false;
+    }
+
+    return true;
+}
+
+// Advances p past the next 'size' bytes, failing if that runs past the end of the data
+static bool ReadData(const uint8_t** p, const uint8_t* end, size_t size, const uint8_t** result)
+{
+    if ((size_t)(end - *p) < size)
+    {
+        LogError(L"Unexpected end of data.");
+        return false;
+    }
+
+    *result = *p;
+    *p += size;
+    return true;
+}
+
+// Reads the header, vertices & indices at the start of a model file
+static bool ReadGeometry(const uint8_t** p, const uint8_t* end, ModelHeader* header, const StandardVertex** vertices, const uint32_t** indices)
+{
+    const uint8_t* chunk = nullptr;
+
+    if (!ReadData(p, end, sizeof(ModelHeader), &chunk))
+    {
+        LogError(L"Invalid model file.");
+        return false;
+    }
+
+    *header = *(const ModelHeader*)chunk;
+    if (header->Signature != header->ExpectedSignature)
+    {
+        LogError(L"Invalid model file.");
+        return false;
+    }
+
+    if (!ReadData(p, end, header->NumVertices * sizeof(StandardVertex), &chunk))
+    {
+        LogError(L"Failed to read vertices.");
+        return false;
+    }
+    *vertices = (const StandardVertex*)chunk;
+
+    if (!ReadData(p, end, header->NumIndices * sizeof(uint32_t), &chunk))
+    {
+        LogError(L"Failed to read indices.");
+        return false;
+    }
+    *indices = (const uint32_t*)chunk;
+
+    return true;
+}
+
+// Steps over the objects & parts following the geometry, for reading what comes after them
+static bool SkipObjects(const uint8_t** p, const uint8_t* end, uint32_t numObjects)
+{
+    const uint8_t* chunk = nullptr;
+    for (uint32_t i = 0; i < numObjects; ++i)
+    {
+        if (!ReadData(p, end, sizeof(ModelObject), &chunk) ||
+            !ReadData(p, end, ((const ModelObject*)chunk)->NumParts * sizeof(ModelPart), &chunk))
+        {
+            LogError(L"Failed to read objects.");
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads the baked ambient occlusion after the last object, if the model has any. ambient is set
+// to null (and p left where it was) if not
+static bool ReadAmbient(const uint8_t** p, const uint8_t* end, uint32_t numVertices, const AmbientVertex** ambient)
+{
+    static_assert(sizeof(ModelAmbientVertex) == sizeof(AmbientVertex), "Make sure structures (and padding) match so we can read directly!");
+
+    // The bake is optional, so the next chunk may be a later one
+    *ambient = nullptr;
+    if ((size_t)(end - *p) < sizeof(ModelAmbientHeader) || *(const uint32_t*)*p != ModelAmbientHeader::ExpectedSignature)
+    {
+        return true;
+    }
+
+    const uint8_t* chunk = nullptr;
+    ReadData(p, end, sizeof(ModelAmbientHeader), &chunk);
+    const ModelAmbientHeader& header = *(const ModelAmbientHeader*)chunk;
+    if (header.NumVertices != numVertices)
+    {
+        LogError(L"Invalid ambient occlusion data.");
+        return false;
+    }
+
+    if (!ReadData(p, end, numVertices * sizeof(AmbientVertex), &chunk))
+    {
+        LogError(L"Failed to read ambient occlusion.");
+        return false;
+    }
+    *ambient = (const AmbientVertex*)chunk;
+    return true;
+}
+
+// Reads the potentially visible sets after the ambient occlusion, if the model has any. pvs is
+// left empty if not
+static bool ReadVisibility(const uint8_t** p, const uint8_t* end, uint32_t numParts, PotentiallyVisibleSets* pvs)
+{
+    pvs->Bits.clear();
+    if ((size_t)(end - *p) < sizeof(ModelVisibilityHeader))
+    {
+        return true;
+    }
+
+    const uint8_t* chunk = nullptr;
+    ReadData(p, end, sizeof(ModelVisibilityHeader), &chunk);
+    const ModelVisibilityHeader& header = *(const ModelVisibilityHeader*)chunk;
+    if (header.Signature != header.ExpectedSignature || header.NumParts != numParts || header.WordsPerCell != (numParts + 31) / 32 ||
+        header.CellsX == 0 || header.CellsY == 0 || header.CellsZ == 0 ||
+        !(header.CellSize.x > 0.f && header.CellSize.y > 0.f && header.CellSize.z > 0.f))
+    {
+        LogError(L"Invalid visibility data.");
+        return false;
+    }
+
+    size_t numWords = (size_t)header.CellsX * header.CellsY * header.CellsZ * header.WordsPerCell;
+    if (!ReadData(p, end, numWords * sizeof(uint32_t), &chunk))
+    {
+        LogError(L"Failed to read visibility.");
+        return false;
+    }
+
+    pvs->BoundsMin = header.BoundsMin;
+    pvs->CellSize = header.CellSize;
+    pvs->NumCells[0] = header.CellsX;
+    pvs->NumCells[1] = header.CellsY;
+    pvs->NumCells[2] = header.CellsZ;
+    pvs->WordsPerCell = header.WordsPerCell;
+    pvs->Bits.assign((const uint32_t*)chunk, (const uint32_t*)chunk + numWords);
+    return true;
+}
+
+static DXGI_FORMAT GetTextureFormat(DXGI_FORMAT format)
+{
+#if USE_SRGB
+    if (format == DXGI_FORMAT_R8G8B8A8_UNORM)
+    {
+        return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+    }
+    else if (format == DXGI_FORMAT_B8G8R8A8_UNORM)
+    {
+        return DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+    }
+#endif
+    return format;
+}
+
+// Bytes of mips [mostDetailedMip, MipLevels). Mips are stored most detailed first, after the header
+static uint64_t GetMipChainBytes(const TextureHeader& header, uint32_t mostDetailedMip)
+{
+    return TextureStreamer::GetMipChainBytes(header.Width, header.MipLevels, (uint32_t)BitsPerPixel(header.Format) / 8, mostDetailedMip);
+}
+
+static const wchar_t* FormatName(DXGI_FORMAT format)
+{
+    switch (format)
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:        return L"R8G8B8A8_UNORM";
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:   return L"R8G8B8A8_UNORM_SRGB";
+    case DXGI_FORMAT_B8G8R8A8_UNORM:        return L"B8G8R8A8_UNORM";
+    case DXGI_FORMAT_B8G8R8X8_UNORM:        return L"B8G8R8X8_UNORM";
+    case DXGI_FORMAT_R8G8_UNORM:            return L"R8G8_UNORM";
+    case DXGI_FORMAT_R8_UNORM:              return L"R8_UNORM";
+    case DXGI_FORMAT_R16_UNORM:             return L"R16_UNORM";
+    case DXGI_FORMAT_BC1_UNORM:             return L"BC1_UNORM";
+    case DXGI_FORMAT_BC1_UNORM_SRGB:        return L"BC1_UNORM_SRGB";
+    case DXGI_FORMAT_BC2_UNORM:             return L"BC2_UNORM";
+    case DXGI_FORMAT_BC3_UNORM:             return L"BC3_UNORM";
+    case DXGI_FORMAT_BC3_UNORM_SRGB:        return L"BC3_UNORM_SRGB";
+    case DXGI_FORMAT_BC4_UNORM:             return L"BC4_UNORM";
+    case DXGI_FORMAT_BC5_UNORM:             return L"BC5_UNORM";
+    case DXGI_FORMAT_BC7_UNORM:             return L"BC7_UNORM";
+    case DXGI_FORMAT_BC7_UNORM_SRGB:        return L"BC7_UNORM_SRGB";
+    default:                                return L"OTHER";
+    }
+}
+
+static std::wstring GetTextureCategory(DXGI_FORMAT format)
+{
+    return std::wstring(L"Textures/") + FormatName(format);
+}
+
+// Only square textures get mips (see LoadTextureFromMemory), and there's nothing to gain on small ones
+static bool IsStreamable(const TextureHeader& header)
+{
+    return header.Width == header.Height && header.MipLevels > 1 && header.ArrayCount == 1 && header.Width > MinStreamedMipSize;
+}
+
 ContentLoader::ContentLoader(const ComPtr<ID3D11Device>& device, const std::wstring& contentRoot)
     : Device(device)
     , ContentRoot(contentRoot)
+    , GeometryBudget(DefaultGeometryBudget)
+    , StagedBytes(0)
+    , ShuttingDown(false)
+    , NextMaterialId(0)
+    , NextMipRead(1)
+    , Telemetry(nullptr)
+    , GeometryCategory(0)
+    , StagingCategory(0)
+    , LastFrame(0)
+{
+    Streamer = std::unique_ptr<TextureStreamer>(new TextureStreamer(this, DefaultTextureBudget));
+}
+
+ContentLoader::~ContentLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        ShuttingDown = true;
+    }
+    JobAvailable.notify_all();
+    StagingAvailable.notify_all();
+
+    for (auto& worker : Workers)
+    {
+        worker.join();
+    }
+
+    // Everything reported goes with the loader
+    if (Telemetry)
+    {
+        Telemetry->SetBytes(GeometryCategory, 0);
+        Telemetry->SetBytes(StagingCategory, 0);
+        for (auto& format : TextureBytes)
+        {
+            Telemetry->SetBytes(Telemetry->GetCategory(GetTextureCategory(format.first)), 0);
+        }
+    }
+}
+
+void ContentLoader::SetGeometryBudget(uint64_t bytes)
+{
+    GeometryBudget = bytes;
+    if (Telemetry)
+    {
+        Telemetry->SetBudget(L"Geometry", bytes);
+    }
+}
+
+void ContentLoader::SetTextureBudget(uint64_t bytes)
+{
+    Streamer->SetBudget(bytes);
+    if (Telemetry)
+    {
+        Telemetry->SetBudget(L"Textures", bytes);
+    }
+}
+
+void ContentLoader::SetMemoryTelemetry(MemoryTelemetry* telemetry)
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    Telemetry = telemetry;
+    if (!Telemetry)
+    {
+        return;
+    }
+
+    GeometryCategory = Telemetry->GetCategory(L"Geometry/Pools");
+    StagingCategory = Telemetry->GetCategory(L"Staging/Loads");
+    Telemetry->SetBudget(L"Geometry", GeometryBudget);
+    Telemetry->SetBudget(L"Textures", Streamer->GetStats().BudgetBytes);
+    Telemetry->SetBudget(L"Staging", MaxStagedBytes);
+
+    ReportGeometryBytes(0);
+    ReportStagedBytes();
+    for (auto& format : TextureBytes)
+    {
+        Telemetry->SetBytes(Telemetry->GetCategory(GetTextureCategory(format.first)), format.second);
+    }
+}
+
+void ContentLoader::ReportGeometryBytes(uint64_t extraBytes)
+{
+    if (Telemetry)
+    {
+        Telemetry->SetBytes(GeometryCategory, GetGeometryBytes() + extraBytes);
+    }
+}
+
+void ContentLoader::ReportStagedBytes()
+{
+    if (Telemetry)
+    {
+        Telemetry->SetBytes(StagingCategory, StagedBytes);
+    }
+}
+
+void ContentLoader::CacheTexture(const std::wstring& path, const ComPtr<ID3D11ShaderResourceView>& srv)
+{
+    ComPtr<ID3D11ShaderResourceView>& cached = CachedTextureMap[path];
+    if (cached)
+    {
+        TrackTextureBytes(cached.Get(), false);
+    }
+    cached = srv;
+    TrackTextureBytes(cached.Get(), true);
+}
+
+void ContentLoader::TrackTextureBytes(ID3D11ShaderResourceView* srv, bool add)
 {
+    ComPtr<ID3D11Resource> resource;
+    srv->GetResource(&resource);
+
+    ComPtr<ID3D11Texture2D> texture;
+    if (FAILED(resource.As(&texture)))
+    {
+        return;
+    }
+
+    D3D11_TEXTURE2D_DESC td{};
+    texture->GetDesc(&td);
+
+    uint64_t bytes = 0;
+    for (uint32_t mip = 0; mip < td.MipLevels; ++mip)
+    {
+        size_t rowPitch = 0;
+        size_t slicePitch = 0;
+        ComputePitch(td.Format, max(td.Width >> mip, 1u), max(td.Height >> mip, 1u), rowPitch, slicePitch);
+        bytes += slicePitch;
+    }
+    bytes *= td.ArraySize;
+
+    uint64_t& total = TextureBytes[td.Format];
+    total = add ? total + bytes : total - bytes;
+    if (Telemetry)
+    {
+        Telemetry->SetBytes(Telemetry->GetCategory(GetTextureCategory(td.Format)), total);
+    }
 }
 
 bool ContentLoader::LoadObject(const std::wstring& filename, std::shared_ptr<Object>* object)
 {
-    static_assert(sizeof(ModelVertex) == sizeof(StandardVertex), "Make sure structures (and padding) match so we can read directly!");
+    object->reset();
+
+    std::vector<uint8_t> data;
+    if (!ReadFileData(ContentRoot + filename, &data))
+    {
+        LogError(L"Failed to read model file.");
+        return false;
+    }
+
+    return CreateObject(filename, data.data(), data.size(), nullptr, object);
+}
 
+bool ContentLoader::LoadObjectFromMemory(const ImportedModel& model, std::shared_ptr<Object>* object)
+{
     object->reset();
+    return CreateObject(std::wstring(), model.Data.data(), model.Data.size(), &model, object);
+}
 
-    FileHandle modelFile(CreateFile((ContentRoot + filename).c_str(), GENERIC_READ,
-        FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
-    if (!modelFile.IsValid())
+bool ContentLoader::ParseModel(const uint8_t* data, size_t size, std::shared_ptr<Object>* object, std::vector<PartTextures>* textures,
+    LoadedModel* model, const StandardVertex** vertices, const AmbientVertex** ambient, const uint32_t** indices)
+{
+    static_assert(sizeof(ModelVertex) == sizeof(StandardVertex), "Make sure structures (and padding) match so we can read directly!");
+
+    const uint8_t* p = data;
+    const uint8_t* end = data + size;
+    const uint8_t* chunk = nullptr;
+
+    ModelHeader header{};
+    if (!ReadGeometry(&p, end, &header, vertices, indices))
+    {
+        LogError(L"Failed to read model geometry.");
+        return false;
+    }
+
+    for (uint32_t i = 0; i < header.NumIndices; ++i)
+    {
+        if ((*indices)[i] >= header.NumVertices)
+        {
+            LogError(L"Invalid vertex index.");
+            return false;
+        }
+    }
+
+    *object = std::make_shared<Object>();
+    (*object)->LastUsedFrame = 0;
+
+    // Positions are kept on the CPU for bounds and occlusion culling
+    (*object)->Positions.resize(header.NumVertices);
+    for (uint32_t i = 0; i < header.NumVertices; ++i)
+    {
+        (*object)->Positions[i] = (*vertices)[i].Position;
+    }
+    (*object)->Indices.assign(*indices, *indices + header.NumIndices);
+
+    model->Owner = *object;
+    model->NumVertices = header.NumVertices;
+    model->NumIndices = header.NumIndices;
+
+    // Load objects
+    for (int iObj = 0; iObj < (int)header.NumObjects; ++iObj)
+    {
+        if (!ReadData(&p, end, sizeof(ModelObject), &chunk))
+        {
+            LogError(L"Failed to read object.");
+            return false;
+        }
+
+        const ModelObject& obj = *(const ModelObject*)chunk;
+
+        XMStoreFloat4x4(&(*object)->RootTransform, XMMatrixIdentity());
+
+        for (int iPart = 0; iPart < (int)obj.NumParts; ++iPart)
+        {
+            if (!ReadData(&p, end, sizeof(ModelPart), &chunk))
+            {
+                LogError(L"Failed to read part.");
+                return false;
+            }
+
+            const ModelPart& part = *(const ModelPart*)chunk;
+
+            std::shared_ptr<Object::Part> meshPart = std::make_shared<Object::Part>();
+            (*object)->Parts.push_back(meshPart);
+
+            XMStoreFloat4x4(&meshPart->RelativeTransform, XMMatrixIdentity());
+
+            if ((uint64_t)part.StartIndex + part.NumIndices > header.NumIndices)
+            {
+                LogError(L"Invalid part index range.");
+                return false;
+            }
+
+            meshPart->StartIndex = part.StartIndex;
+            meshPart->NumIndices = part.NumIndices;
+            meshPart->IsOccluder = false;
+            meshPart->MaterialId = 0;
+            meshPart->LastVisibleFrame = 0;
+            meshPart->ScreenSize = 0.f;
+
+            XMVECTOR minBounds = XMVectorReplicate(FLT_MAX);
+            XMVECTOR maxBounds = XMVectorReplicate(-FLT_MAX);
+            for (uint32_t i = part.StartIndex; i < part.StartIndex + part.NumIndices; ++i)
+            {
+                XMVECTOR position = XMLoadFloat3(&(*vertices)[(*indices)[i]].Position);
+                minBounds = XMVectorMin(minBounds, position);
+                maxBounds = XMVectorMax(maxBounds, position);
+            }
+            if (part.NumIndices == 0)
+            {
+                minBounds = maxBounds = XMVectorZero();
+            }
+            XMStoreFloat3(&meshPart->BoundsCenter, (minBounds + maxBounds) * 0.5f);
+            XMStoreFloat3(&meshPart->BoundsExtents, (maxBounds - minBounds) * 0.5f);
+
+            PartTextures partTextures;
+            partTextures.Names[0] = part.DiffuseTexture;
+            partTextures.Names[1] = part.NormalTexture;
+            partTextures.Names[2] = part.SpecularTexture;
+            textures->push_back(partTextures);
+        }
+    }
+
+    if (!ReadAmbient(&p, end, header.NumVertices, ambient))
+    {
+        LogError(L"Failed to read model ambient occlusion.");
+        return false;
+    }
+
+    if (!ReadVisibility(&p, end, (uint32_t)(*object)->Parts.size(), &(*object)->Pvs))
+    {
+        LogError(L"Failed to read model visibility.");
+        return false;
+    }
+
+    return true;
+}
+
+bool ContentLoader::CreateObject(const std::wstring& filename, const uint8_t* data, size_t size, const ImportedModel* imported, std::shared_ptr<Object>* object)
+{
+    LoadedModel model{};
+    model.Filename = filename;
+
+    std::vector<PartTextures> textures;
+    const StandardVertex* vertices = nullptr;
+    const AmbientVertex* ambient = nullptr;
+    const uint32_t* indices = nullptr;
+    if (!ParseModel(data, size, object, &textures, &model, &vertices, &ambient, &indices))
+    {
+        LogError(L"Failed to parse model.");
+        return false;
+    }
+
+    // Without a device, only the CPU side data is loaded (for headless tools and benchmarks)
+    if (!Device)
+    {
+        return true;
+    }
+
+    // Vertices and indices are uploaded directly from the source data
+    if (!UploadGeometry(vertices, ambient, indices, &model))
+    {
+        LogError(L"Failed to upload model geometry.");
+        return false;
+    }
+
+    for (auto& part : (*object)->Parts)
+    {
+        part->Mesh = std::make_shared<GeoMesh>();
+        part->Mesh->NumIndices = part->NumIndices;
+    }
+    UpdateMeshes(model);
+    Models.push_back(model);
+
+    for (size_t i = 0; i < textures.size(); ++i)
+    {
+        const std::shared_ptr<Object::Part>& part = (*object)->Parts[i];
+        for (uint32_t slot = 0; slot < _countof(textures[i].Names); ++slot)
+        {
+            const std::wstring& name = textures[i].Names[slot];
+            if (!GetTexture(name.c_str(), imported, GetTextureSlot(part.get(), slot)))
+            {
+                LogError(L"Failed to load texture.");
+                return false;
+            }
+
+            if (!name.empty())
+            {
+                TrackTextureUser(ContentRoot + name, part, slot);
+            }
+        }
+        AssignMaterial(part.get());
+    }
+
+    return true;
+}
+
+ComPtr<ID3D11ShaderResourceView>* ContentLoader::GetTextureSlot(Object::Part* part, uint32_t slot)
+{
+    switch (slot)
+    {
+    case 0: return &part->AlbedoSRV;
+    case 1: return &part->NormalSRV;
+    default: return &part->SpecularSRV;
+    }
+}
+
+void ContentLoader::AssignMaterial(Object::Part* part)
+{
+    TextureSet textures(part->AlbedoSRV.Get(), part->NormalSRV.Get(), part->SpecularSRV.Get());
+    auto it = MaterialIds.find(textures);
+    if (it == MaterialIds.end())
+    {
+        uint32_t id = NextMaterialId;
+        if (!FreeMaterialIds.empty())
+        {
+            id = FreeMaterialIds.back();
+            FreeMaterialIds.pop_back();
+        }
+        else
+        {
+            ++NextMaterialId;
+        }
+        it = MaterialIds.insert(std::make_pair(textures, id)).first;
+    }
+    part->MaterialId = it->second;
+}
+
+void ContentLoader::ReleaseMaterials(ID3D11ShaderResourceView* srv)
+{
+    for (auto it = MaterialIds.begin(); it != MaterialIds.end();)
+    {
+        if (std::get<0>(it->first) == srv || std::get<1>(it->first) == srv || std::get<2>(it->first) == srv)
+        {
+            FreeMaterialIds.push_back(it->second);
+            it = MaterialIds.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+bool ContentLoader::UploadGeometry(const StandardVertex* vertices, const AmbientVertex* ambient, const uint32_t* indices, LoadedModel* model)
+{
+    // Try existing pools first, then compacted ones, then fall back to a new pool
+    std::shared_ptr<GeometryPool> pool;
+    for (auto& candidate : Pools)
+    {
+        if (candidate->ReserveRange(model->NumVertices, model->NumIndices, &model->BaseVertex, &model->BaseIndex))
+        {
+            pool = candidate;
+            break;
+        }
+    }
+
+    if (!pool)
+    {
+        for (auto& candidate : Pools)
+        {
+            if (candidate->IsFragmented() && CompactPool(candidate) &&
+                candidate->ReserveRange(model->NumVertices, model->NumIndices, &model->BaseVertex, &model->BaseIndex))
+            {
+                pool = candidate;
+                break;
+            }
+        }
+    }
+
+    if (!pool)
+    {
+        pool = GeometryPool::Create(Device, VertexType::Standard, max(DefaultPoolVertices, model->NumVertices), max(DefaultPoolIndices, model->NumIndices));
+        if (!pool || !pool->ReserveRange(model->NumVertices, model->NumIndices, &model->BaseVertex, &model->BaseIndex))
+        {
+            LogError(L"Not enough room in geo pool.");
+            return false;
+        }
+        Pools.push_back(pool);
+        ReportGeometryBytes(0);
+    }
+
+    model->Pool = pool;
+
+    ComPtr<ID3D11DeviceContext> context;
+    Device->GetImmediateContext(&context);
+
+    D3D11_BOX box{};
+    box.left = model->BaseVertex * sizeof(StandardVertex);
+    box.right = box.left + model->NumVertices * sizeof(StandardVertex);
+    box.bottom = 1;
+    box.back = 1;
+
+    if (model->NumVertices > 0)
+    {
+        context->UpdateSubresource(pool->GetVertexBuffer().Get(), 0, &box, vertices, model->NumVertices * sizeof(StandardVertex), 0);
+    }
+
+    // Without a bake, every vertex is unoccluded and bends nowhere
+    std::vector<AmbientVertex> unbaked;
+    if (!ambient)
+    {
+        unbaked.resize(model->NumVertices);
+        for (uint32_t i = 0; i < model->NumVertices; ++i)
+        {
+            XMFLOAT3 normal;
+            XMStoreFloat3(&normal, XMVector3Normalize(XMLoadFloat3(&vertices[i].Normal)) * 0.5f + XMVectorReplicate(0.5f));
+            unbaked[i].BentNormal[0] = (uint8_t)(normal.x * 255.f + 0.5f);
+            unbaked[i].BentNormal[1] = (uint8_t)(normal.y * 255.f + 0.5f);
+            unbaked[i].BentNormal[2] = (uint8_t)(normal.z * 255.f + 0.5f);
+            unbaked[i].Visibility = 255;
+        }
+        ambient = unbaked.data();
+    }
+
+    box.left = model->BaseVertex * sizeof(AmbientVertex);
+    box.right = box.left + model->NumVertices * sizeof(AmbientVertex);
+
+    if (model->NumVertices > 0)
+    {
+        context->UpdateSubresource(pool->GetAmbientBuffer().Get(), 0, &box, ambient, model->NumVertices * sizeof(AmbientVertex), 0);
+    }
+
+    box.left = model->BaseIndex * sizeof(uint32_t);
+    box.right = box.left + model->NumIndices * sizeof(uint32_t);
+
+    if (model->NumIndices > 0)
+    {
+        context->UpdateSubresource(pool->GetIndexBuffer().Get(), 0, &box, indices, model->NumIndices * sizeof(uint32_t), 0);
+    }
+
+    return true;
+}
+
+bool ContentLoader::ReloadGeometry(LoadedModel* model)
+{
+    std::vector<uint8_t> data;
+    if (!ReadFileData(ContentRoot + model->Filename, &data))
+    {
+        LogError(L"Failed to read model file.");
+        return false;
+    }
+
+    const uint8_t* p = data.data();
+    ModelHeader header{};
+    const StandardVertex* vertices = nullptr;
+    const uint32_t* indices = nullptr;
+    if (!ReadGeometry(&p, data.data() + data.size(), &header, &vertices, &indices))
+    {
+        LogError(L"Failed to read model geometry.");
+        return false;
+    }
+
+    if (header.NumVertices != model->NumVertices || header.NumIndices != model->NumIndices)
+    {
+        LogError(L"Model file changed since it was loaded.");
+        return false;
+    }
+
+    const AmbientVertex* ambient = nullptr;
+    if (!SkipObjects(&p, data.data() + data.size(), header.NumObjects) ||
+        !ReadAmbient(&p, data.data() + data.size(), header.NumVertices, &ambient))
+    {
+        LogError(L"Failed to read model ambient occlusion.");
+        return false;
+    }
+
+    if (!UploadGeometry(vertices, ambient, indices, model))
+    {
+        LogError(L"Failed to upload model geometry.");
+        return false;
+    }
+
+    UpdateMeshes(*model);
+    return true;
+}
+
+void ContentLoader::UpdateMeshes(const LoadedModel& model)
+{
+    std::shared_ptr<Object> object = model.Owner.lock();
+    if (!object)
+    {
+        return;
+    }
+
+    for (auto& part : object->Parts)
+    {
+        if (part->Mesh)
+        {
+            part->Mesh->Pool = model.Pool;
+            part->Mesh->BaseVertex = model.BaseVertex;
+            part->Mesh->BaseIndex = model.BaseIndex + part->StartIndex;
+        }
+    }
+}
+
+uint64_t ContentLoader::GetGeometryBytes() const
+{
+    uint64_t bytes = 0;
+    for (auto& pool : Pools)
+    {
+        bytes += pool->GetEstVRAMBytes();
+    }
+    return bytes;
+}
+
+void ContentLoader::UpdateResidency(uint64_t frame)
+{
+    LastFrame = frame;
+    ReleaseRetired(frame);
+
+    // Give back the ranges of objects that no longer exist
+    for (size_t i = 0; i < Models.size();)
+    {
+        if (Models[i].Owner.expired())
+        {
+            if (Models[i].Pool)
+            {
+                Models[i].Pool->ReleaseRange(Models[i].BaseVertex, Models[i].BaseIndex);
+            }
+            Models[i] = Models.back();
+            Models.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    // Bring back anything evicted that was needed last frame. Those parts weren't drawn
+    for (auto& model : Models)
+    {
+        std::shared_ptr<Object> object = model.Owner.lock();
+        if (!model.Pool && object->LastUsedFrame >= frame)
+        {
+            if (!ReloadGeometry(&model))
+            {
+                LogError(L"Failed to reload model geometry.");
+            }
+        }
+    }
+
+    // Pools are paged as a unit, so evict whole pools, least recently used first. Pools
+    // holding anything used last frame, or anything imported, are never evicted
+    while (GetGeometryBytes() > GeometryBudget)
+    {
+        std::shared_ptr<GeometryPool> victim;
+        uint64_t victimLastUsed = UINT64_MAX;
+
+        for (auto& pool : Pools)
+        {
+            uint64_t lastUsed = 0;
+            for (auto& model : Models)
+            {
+                if (model.Pool == pool)
+                {
+                    lastUsed = model.Filename.empty() ? UINT64_MAX : max(lastUsed, model.Owner.lock()->LastUsedFrame);
+                    if (lastUsed >= frame)
+                    {
+                        break;
+                    }
+                }
+            }
+
+            if (lastUsed < frame && lastUsed < victimLastUsed)
+            {
+                victim = pool;
+                victimLastUsed = lastUsed;
+            }
+        }
+
+        if (!victim)
+        {
+            break;
+        }
+
+        EvictPool(victim);
+    }
+
+    // Streamed textures want enough detail for the biggest visible part using them
+    for (auto& texture : StreamedTextures)
+    {
+        auto& users = texture.second.Users;
+        for (size_t i = 0; i < users.size();)
+        {
+            std::shared_ptr<Object::Part> part = users[i].first.lock();
+            if (!part)
+            {
+                users[i] = users.back();
+                users.pop_back();
+                continue;
+            }
+
+            if (part->LastVisibleFrame == frame)
+            {
+                Streamer->MarkVisible(texture.first, part->ScreenSize);
+            }
+            ++i;
+        }
+    }
+    Streamer->Update(frame);
+
+    // Empty pools only cost memory
+    for (size_t i = 0; i < Pools.size();)
+    {
+        if (Pools[i]->IsEmpty())
+        {
+            Pools[i] = Pools.back();
+            Pools.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    ReportGeometryBytes(0);
+}
+
+void ContentLoader::EvictPool(const std::shared_ptr<GeometryPool>& pool)
+{
+    for (auto& model : Models)
+    {
+        if (model.Pool == pool)
+        {
+            pool->ReleaseRange(model.BaseVertex, model.BaseIndex);
+            model.Pool = nullptr;
+            UpdateMeshes(model);
+        }
+    }
+
+    Pools.erase(std::find(Pools.begin(), Pools.end(), pool));
+    ReportGeometryBytes(0);
+}
+
+bool ContentLoader::Defragment()
+{
+    for (auto& pool : Pools)
+    {
+        if (pool->IsFragmented() && !CompactPool(pool))
+        {
+            LogError(L"Failed to compact geometry pool.");
+            return false;
+        }
+    }
+    return true;
+}
+
+bool ContentLoader::CompactPool(const std::shared_ptr<GeometryPool>& pool)
+{
+    // The old buffers are copied from, so both sets exist for a moment
+    ReportGeometryBytes(pool->GetEstVRAMBytes());
+
+    std::vector<RangeMove> vertexMoves;
+    std::vector<RangeMove> indexMoves;
+    bool compacted = pool->Compact(&vertexMoves, &indexMoves);
+    ReportGeometryBytes(0);
+    if (!compacted)
+    {
+        return false;
+    }
+
+    std::map<uint32_t, uint32_t> newVertexOffsets;
+    for (auto& move : vertexMoves)
+    {
+        newVertexOffsets[move.OldOffset] = move.NewOffset;
+    }
+
+    std::map<uint32_t, uint32_t> newIndexOffsets;
+    for (auto& move : indexMoves)
+    {
+        newIndexOffsets[move.OldOffset] = move.NewOffset;
+    }
+
+    for (auto& model : Models)
+    {
+        if (model.Pool != pool)
+        {
+            continue;
+        }
+
+        auto vertexIt = newVertexOffsets.find(model.BaseVertex);
+        if (vertexIt != newVertexOffsets.end())
+        {
+            model.BaseVertex = vertexIt->second;
+        }
+
+        auto indexIt = newIndexOffsets.find(model.BaseIndex);
+        if (indexIt != newIndexOffsets.end())
+        {
+            model.BaseIndex = indexIt->second;
+        }
+
+        UpdateMeshes(model);
+    }
+
+    // Ranges replaced by hot reloads are still allocated, so they move too
+    for (auto& retired : Retired)
+    {
+        if (retired.Pool != pool)
+        {
+            continue;
+        }
+
+        auto vertexIt = newVertexOffsets.find(retired.BaseVertex);
+        if (vertexIt != newVertexOffsets.end())
+        {
+            retired.BaseVertex = vertexIt->second;
+        }
+
+        auto indexIt = newIndexOffsets.find(retired.BaseIndex);
+        if (indexIt != newIndexOffsets.end())
+        {
+            retired.BaseIndex = indexIt->second;
+        }
+    }
+
+    return true;
+}
+
+bool ContentLoader::GetTexture(const wchar_t* name, const ImportedModel* imported, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    if (name[0] == 0)
+    {
+        return true;
+    }
+
+    std::wstring path = ContentRoot + name;
+
+    // Freshly imported textures always win over the cache, so edits show up
+    if (imported)
+    {
+        for (auto& texture : imported->Textures)
+        {
+            if (texture.Name == name)
+            {
+                if (!LoadTextureFromMemory(texture.Data.data(), texture.Data.size(), srv))
+                {
+                    return false;
+                }
+                StopStreaming(path);
+                CacheTexture(path, *srv);
+                return true;
+            }
+        }
+    }
+
+    auto it = CachedTextureMap.find(path);
+    if (it != CachedTextureMap.end())
+    {
+        *srv = it->second;
+        return true;
+    }
+
+    if (!LoadDiskTexture(path, srv))
+    {
+        return false;
+    }
+    CacheTexture(path, *srv);
+    return true;
+}
+
+bool ContentLoader::LoadTexture(const std::wstring& filename, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    std::vector<uint8_t> data;
+    if (!ReadFileData(filename, &data))
+    {
+        LogError(L"Failed to open texture.");
+        return false;
+    }
+
+    return LoadTextureFromMemory(data.data(), data.size(), srv);
+}
+
+bool ContentLoader::LoadTextureFromMemory(const uint8_t* data, size_t size, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    if (size < sizeof(TextureHeader))
+    {
+        LogError(L"Failed to read texture.");
+        return false;
+    }
+
+    const TextureHeader& texHeader = *(const TextureHeader*)data;
+    if (texHeader.Signature != TextureHeader::ExpectedSignature)
+    {
+        LogError(L"Invalid texture file.");
+        return false;
+    }
+
+    // One initial data entry per mip, and only one array slice, are filled in below
+    D3D11_SUBRESOURCE_DATA init[20] {};
+    uint32_t bpp = (uint32_t)BitsPerPixel(texHeader.Format) / 8;
+    if (texHeader.ArrayCount != 1 || texHeader.MipLevels == 0 || texHeader.MipLevels > _countof(init) || bpp == 0)
+    {
+        LogError(L"Unsupported texture layout.");
+        return false;
+    }
+
+    bool useMips = texHeader.Width == texHeader.Height && texHeader.MipLevels > 1;
+    uint64_t pixelBytes = useMips ? GetMipChainBytes(texHeader, 0) : (uint64_t)texHeader.Width * texHeader.Height * bpp;
+    if (size - sizeof(TextureHeader) < pixelBytes)
+    {
+        LogError(L"Texture file is truncated.");
+        return false;
+    }
+
+    const uint8_t* pixelData = data + sizeof(TextureHeader);
+
+    D3D11_TEXTURE2D_DESC td{};
+    td.ArraySize = texHeader.ArrayCount;
+    td.Format = GetTextureFormat(texHeader.Format);
+    td.Width = texHeader.Width;
+    td.Height = texHeader.Height;
+    td.MipLevels = texHeader.MipLevels;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_DEFAULT;
+
+    ComPtr<ID3D11Texture2D> texture;
+    HRESULT hr = S_OK;
+
+    // Only try to use mips if width & height are the same size
+    if (useMips)
+    {
+        uint32_t width = td.Width;
+        uint32_t height = td.Height;
+        const uint8_t* pPixels = pixelData;
+
+        for (int m = 0; m < (int)td.MipLevels; ++m)
+        {
+            init[m].pSysMem = pPixels;
+            init[m].SysMemPitch = width * bpp;
+            init[m].SysMemSlicePitch = width * height * bpp;
+
+            width >>= 1;
+            height >>= 1;
+            pPixels += init[m].SysMemSlicePitch;
+        }
+
+        hr = Device->CreateTexture2D(&td, init, &texture);
+    }
+    else
+    {
+        td.MipLevels = 1;
+
+        init[0].pSysMem = pixelData;
+        init[0].SysMemPitch = td.Width * bpp;
+        init[0].SysMemSlicePitch = td.Width * td.Height * bpp;
+
+        hr = Device->CreateTexture2D(&td, init, &texture);
+    }
+    if (FAILED(hr))
+    {
+        LogError(L"Failed to create texture.");
+        return false;
+    }
+
+    hr = Device->CreateShaderResourceView(texture.Get(), nullptr, srv->ReleaseAndGetAddressOf());
+    if (FAILED(hr))
+    {
+        LogError(L"Failed to create texture SRV.");
+        return false;
+    }
+
+    return true;
+}
+
+// 1x1 texture of a single RGBA color
+static bool CreateSolidTexture(const ComPtr<ID3D11Device>& device, uint32_t color, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    D3D11_TEXTURE2D_DESC td{};
+    td.ArraySize = 1;
+    td.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    td.Width = 1;
+    td.Height = 1;
+    td.MipLevels = 1;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_IMMUTABLE;
+
+    D3D11_SUBRESOURCE_DATA init{};
+    init.pSysMem = &color;
+    init.SysMemPitch = sizeof(color);
+
+    ComPtr<ID3D11Texture2D> texture;
+    CheckResult(device->CreateTexture2D(&td, &init, &texture));
+    CheckResult(device->CreateShaderResourceView(texture.Get(), nullptr, srv->ReleaseAndGetAddressOf()));
+    return true;
+}
+
+// Reads mips [firstMip, endMip) of a texture file
+static bool ReadMipChain(const std::wstring& path, const TextureHeader& header, uint32_t firstMip, uint32_t endMip, std::vector<uint8_t>* data)
+{
+    FileHandle file(CreateFile(path.c_str(), GENERIC_READ,
+        FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
+    if (!file.IsValid())
+    {
+        LogError(L"Failed to open texture.");
+        return false;
+    }
+
+    LARGE_INTEGER offset{};
+    offset.QuadPart = sizeof(TextureHeader) + GetMipChainBytes(header, 0) - GetMipChainBytes(header, firstMip);
+    if (!SetFilePointerEx(file.Get(), offset, nullptr, FILE_BEGIN))
+    {
+        LogError(L"Failed to seek texture.");
+        return false;
+    }
+
+    DWORD bytesRead{};
+    data->resize((size_t)(GetMipChainBytes(header, firstMip) - GetMipChainBytes(header, endMip)));
+    if (!ReadFile(file.Get(), data->data(), (DWORD)data->size(), &bytesRead, nullptr) || bytesRead != data->size())
+    {
+        LogError(L"Failed to read texture mips.");
+        return false;
+    }
+
+    return true;
+}
+
+bool ContentLoader::StartWorkers()
+{
+    if (!Workers.empty())
+    {
+        return true;
+    }
+
+    // White albedo. The geometry pass treats black normal & specular maps as missing, and uses defaults
+    if (!CreateSolidTexture(Device, 0xFFFFFFFF, &PlaceholderSRVs[0]) ||
+        !CreateSolidTexture(Device, 0x00000000, &PlaceholderSRVs[1]))
+    {
+        LogError(L"Failed to create placeholder textures.");
+        return false;
+    }
+    PlaceholderSRVs[2] = PlaceholderSRVs[1];
+    TrackTextureBytes(PlaceholderSRVs[0].Get(), true);
+    TrackTextureBytes(PlaceholderSRVs[1].Get(), true);
+
+    // Leave a core for the render thread
+    uint32_t numThreads = min(max(std::thread::hardware_concurrency(), 2u) - 1, MaxLoaderThreads);
+    for (uint32_t i = 0; i < numThreads; ++i)
+    {
+        Workers.push_back(std::thread(&ContentLoader::WorkerThread, this));
+    }
+
+    return true;
+}
+
+void ContentLoader::WorkerThread()
+{
+    for (;;)
+    {
+        LoadJob job;
+        {
+            std::unique_lock<std::mutex> lock(Lock);
+            JobAvailable.wait(lock, [this]() { return ShuttingDown || !Jobs.empty(); });
+            if (ShuttingDown)
+            {
+                return;
+            }
+            job = Jobs.front();
+            Jobs.pop_front();
+        }
+
+        std::shared_ptr<StagedLoad> load = std::make_shared<StagedLoad>();
+        load->Filename = job.Filename;
+        load->PendingObject = job.PendingObject;
+        load->IsModel = job.IsModel;
+        load->IsReload = job.IsReload;
+        load->IsMips = job.IsMips;
+        load->Mips = job.Mips;
+        load->Succeeded = job.IsMips ?
+            ReadMipChain(job.Mips.Path, job.Mips.Header, job.Mips.FirstMip, job.Mips.EndMip, &load->Data) :
+            ReadFileData(ContentRoot + job.Filename, &load->Data);
+        load->UploadBytes = 0;
+        load->Vertices = nullptr;
+        load->Ambient = nullptr;
+        load->Indices = nullptr;
+
+        if (load->Succeeded && load->IsModel)
+        {
+            load->Model.Filename = job.Filename;
+            load->Succeeded = ParseModel(load->Data.data(), load->Data.size(), &load->Result, &load->Textures, &load->Model,
+                &load->Vertices, &load->Ambient, &load->Indices);
+            load->UploadBytes = load->Model.NumVertices * (sizeof(StandardVertex) + sizeof(AmbientVertex)) + load->Model.NumIndices * sizeof(uint32_t);
+        }
+        else if (load->Succeeded)
+        {
+            load->UploadBytes = load->Data.size();
+        }
+
+        // Don't read further ahead than the staging budget, unless nothing else is staged
+        std::unique_lock<std::mutex> lock(Lock);
+        StagingAvailable.wait(lock, [&]()
+        {
+            return ShuttingDown || StagedBytes == 0 || StagedBytes + load->UploadBytes <= MaxStagedBytes;
+        });
+        if (ShuttingDown)
+        {
+            return;
+        }
+        StagedBytes += load->UploadBytes;
+        Staged.push_back(load);
+        ReportStagedBytes();
+    }
+}
+
+void ContentLoader::QueueLoad(const std::wstring& filename, const std::shared_ptr<ObjectLoad>& object, bool isModel, bool isReload)
+{
+    LoadJob job;
+    job.Filename = filename;
+    job.PendingObject = object;
+    job.IsModel = isModel;
+    job.IsReload = isReload;
+    job.IsMips = false;
+    QueueJob(job);
+}
+
+void ContentLoader::QueueJob(const LoadJob& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Jobs.push_back(job);
+    }
+    JobAvailable.notify_one();
+}
+
+std::shared_ptr<ObjectLoad> ContentLoader::LoadObjectAsync(const std::wstring& filename)
+{
+    std::shared_ptr<ObjectLoad> load = std::make_shared<ObjectLoad>();
+    load->Status = LoadStatus::Pending;
+    load->TexturesRemaining = 0;
+
+    if (!Device || !StartWorkers())
+    {
+        LogError(L"Async loading requires a device.");
+        load->Status = LoadStatus::Failed;
+        return load;
+    }
+
+    QueueLoad(filename, load, true, false);
+    return load;
+}
+
+std::shared_ptr<TextureLoad> ContentLoader::LoadTextureAsync(const std::wstring& filename)
+{
+    std::shared_ptr<TextureLoad> load = std::make_shared<TextureLoad>();
+    load->Status = LoadStatus::Pending;
+
+    auto it = CachedTextureMap.find(ContentRoot + filename);
+    if (it != CachedTextureMap.end())
+    {
+        load->Result = it->second;
+        load->Status = LoadStatus::Complete;
+        return load;
+    }
+
+    if (!Device || !StartWorkers())
+    {
+        LogError(L"Async loading requires a device.");
+        load->Status = LoadStatus::Failed;
+        return load;
+    }
+
+    TextureWaiter waiter{};
+    waiter.PendingTexture = load;
+    WaitForTexture(filename, waiter);
+    return load;
+}
+
+void ContentLoader::WaitForTexture(const std::wstring& name, const TextureWaiter& waiter)
+{
+    // Only the first waiter on a texture needs to queue it
+    std::vector<TextureWaiter>& waiters = PendingTextures[ContentRoot + name];
+    if (waiters.empty())
+    {
+        QueueLoad(name, nullptr, false, false);
+    }
+    waiters.push_back(waiter);
+}
+
+void ContentLoader::ProcessUploads(uint64_t byteBudget)
+{
+    if (Watcher)
+    {
+        QueueReloads();
+    }
+
+    uint64_t uploaded = 0;
+    uint32_t processed = 0;
+
+    while (processed == 0 || uploaded < byteBudget)
+    {
+        std::shared_ptr<StagedLoad> load;
+        {
+            std::lock_guard<std::mutex> lock(Lock);
+            if (Staged.empty())
+            {
+                break;
+            }
+            load = Staged.front();
+            Staged.pop_front();
+            StagedBytes -= load->UploadBytes;
+            ReportStagedBytes();
+        }
+        StagingAvailable.notify_all();
+
+        if (load->IsMips)
+        {
+            FinishMipRead(load.get());
+        }
+        else if (load->IsReload)
+        {
+            if (load->IsModel)
+            {
+                FinishModelReload(load.get());
+            }
+            else
+            {
+                FinishTextureReload(load.get());
+            }
+        }
+        else if (load->IsModel)
+        {
+            FinishObjectLoad(load.get());
+        }
+        else
+        {
+            FinishTextureLoad(load.get());
+        }
+
+        uploaded += load->UploadBytes;
+        ++processed;
+    }
+
+    if (Telemetry)
+    {
+        Telemetry->AddUploadBytes(uploaded);
+    }
+}
+
+void ContentLoader::FinishObjectLoad(StagedLoad* load)
+{
+    ObjectLoad* pending = load->PendingObject.get();
+
+    if (!load->Succeeded || !UploadGeometry(load->Vertices, load->Ambient, load->Indices, &load->Model))
+    {
+        LogError(L"Failed to load object: %s.", load->Filename.c_str());
+        pending->Status = LoadStatus::Failed;
+        return;
+    }
+
+    std::shared_ptr<Object>& object = load->Result;
+    for (auto& part : object->Parts)
+    {
+        part->Mesh = std::make_shared<GeoMesh>();
+        part->Mesh->NumIndices = part->NumIndices;
+    }
+    UpdateMeshes(load->Model);
+    Models.push_back(load->Model);
+
+    for (size_t i = 0; i < load->Textures.size(); ++i)
+    {
+        SetPartTextures(object->Parts[i], load->Textures[i], load->PendingObject);
+    }
+
+    pending->Result = object;
+    if (pending->TexturesRemaining == 0)
+    {
+        pending->Status = LoadStatus::Complete;
+    }
+}
+
+void ContentLoader::SetPartTextures(const std::shared_ptr<Object::Part>& part, const PartTextures& textures, const std::shared_ptr<ObjectLoad>& pending)
+{
+    // Textures that aren't loaded yet get placeholders, and are patched in as they arrive
+    for (uint32_t slot = 0; slot < _countof(textures.Names); ++slot)
+    {
+        const std::wstring& name = textures.Names[slot];
+        if (name.empty())
+        {
+            GetTextureSlot(part.get(), slot)->Reset();
+            continue;
+        }
+
+        auto it = CachedTextureMap.find(ContentRoot + name);
+        if (it != CachedTextureMap.end())
+        {
+            *GetTextureSlot(part.get(), slot) = it->second;
+            TrackTextureUser(it->first, part, slot);
+            continue;
+        }
+
+        *GetTextureSlot(part.get(), slot) = PlaceholderSRVs[slot];
+
+        TextureWaiter waiter{};
+        waiter.Part = part;
+        waiter.Slot = slot;
+        waiter.PendingObject = pending;
+        WaitForTexture(name, waiter);
+        ++pending->TexturesRemaining;
+    }
+    AssignMaterial(part.get());
+}
+
+bool ContentLoader::CreateStagedTexture(const StagedLoad& load, const std::wstring& path, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    if (!load.Succeeded || load.Data.size() < sizeof(TextureHeader))
+    {
+        return false;
+    }
+
+    const TextureHeader& header = *(const TextureHeader*)load.Data.data();
+    if (header.Signature == TextureHeader::ExpectedSignature && IsStreamable(header) &&
+        load.Data.size() >= sizeof(TextureHeader) + GetMipChainBytes(header, 0))
+    {
+        return CreateStreamedTexture(path, header, load.Data.data() + sizeof(TextureHeader), srv);
+    }
+    return LoadTextureFromMemory(load.Data.data(), load.Data.size(), srv);
+}
+
+void ContentLoader::FinishTextureLoad(StagedLoad* load)
+{
+    std::wstring path = ContentRoot + load->Filename;
+
+    ComPtr<ID3D11ShaderResourceView> srv;
+    bool loaded = CreateStagedTexture(*load, path, &srv);
+    if (loaded)
+    {
+        CacheTexture(path, srv);
+    }
+    else
     {
-        LogError(L"Failed to open asset file.");
-        return false;
+        // Parts waiting on it keep their placeholder
+        LogError(L"Failed to load texture: %s.", path.c_str());
     }
 
-    DWORD bytesRead{};
-    ModelHeader header{};
-    if (!ReadFile(modelFile.Get(), &header, sizeof(header), &bytesRead, nullptr))
+    auto it = PendingTextures.find(path);
+    if (it == PendingTextures.end())
     {
-        LogError(L"Failed to read file.");
-        return false;
+        return;
     }
 
-    if (header.Signature != header.ExpectedSignature)
+    std::vector<TextureWaiter> waiters;
+    waiters.swap(it->second);
+    PendingTextures.erase(it);
+
+    for (auto& waiter : waiters)
     {
-        LogError(L"Invalid model file.");
-        return false;
+        if (waiter.Part)
+        {
+            if (loaded)
+            {
+                *GetTextureSlot(waiter.Part.get(), waiter.Slot) = srv;
+                AssignMaterial(waiter.Part.get());
+                TrackTextureUser(path, waiter.Part, waiter.Slot);
+            }
+
+            if (--waiter.PendingObject->TexturesRemaining == 0)
+            {
+                waiter.PendingObject->Status = LoadStatus::Complete;
+            }
+        }
+
+        if (waiter.PendingTexture)
+        {
+            waiter.PendingTexture->Result = srv;
+            waiter.PendingTexture->Status = loaded ? LoadStatus::Complete : LoadStatus::Failed;
+        }
     }
+}
 
-    uint32_t baseVertex = 0;
-    uint32_t baseIndex = 0;
+bool ContentLoader::EnableHotReload()
+{
+    if (Watcher)
+    {
+        return true;
+    }
 
-    std::shared_ptr<GeometryPool> pool = GeometryPool::Create(Device, VertexType::Standard, header.NumVertices, header.NumIndices);
-    if (!pool->ReserveRange(header.NumVertices, header.NumIndices, &baseVertex, &baseIndex))
+    if (!Device || !StartWorkers())
     {
-        LogError(L"Not enough room in geo pool.");
+        LogError(L"Hot reloading requires a device.");
         return false;
     }
 
-    std::unique_ptr<StandardVertex[]> vertices(new StandardVertex[header.NumVertices]);
-    if (!ReadFile(modelFile.Get(), vertices.get(), header.NumVertices * sizeof(StandardVertex), &bytesRead, nullptr))
+    Watcher = FileWatcher::Create(ContentRoot);
+    if (!Watcher)
     {
-        LogError(L"Failed to read file.");
+        LogError(L"Failed to watch %s for changes.", ContentRoot.c_str());
         return false;
     }
+    return true;
+}
 
-    D3D11_BOX box{};
-    box.right = header.NumVertices * sizeof(StandardVertex);
-    box.bottom = 1;
-    box.back = 1;
+void ContentLoader::QueueReloads()
+{
+    std::vector<std::wstring> changes;
+    Watcher->TakeChanges(&changes);
 
-    ComPtr<ID3D11DeviceContext> context;
-    Device->GetImmediateContext(&context);
-    context->UpdateSubresource(pool->GetVertexBuffer().Get(), 0, &box, vertices.get(), header.NumVertices * sizeof(StandardVertex), 0);
+    // Only files that are loaded are reloaded, under the name they were loaded with
+    for (auto& change : changes)
+    {
+        for (auto& model : Models)
+        {
+            if (!model.Filename.empty() && FileWatcher::NormalizePath(model.Filename) == change)
+            {
+                QueueLoad(model.Filename, nullptr, true, true);
+                break;
+            }
+        }
 
-    // Free up memory
-    vertices.reset();
+        for (auto& texture : CachedTextureMap)
+        {
+            std::wstring name = texture.first.substr(ContentRoot.size());
+            if (FileWatcher::NormalizePath(name) == change)
+            {
+                QueueLoad(name, nullptr, false, true);
+                break;
+            }
+        }
+    }
+}
 
-    std::unique_ptr<uint32_t[]> indices(new uint32_t[header.NumIndices]);
-    if (!ReadFile(modelFile.Get(), indices.get(), header.NumIndices * sizeof(uint32_t), &bytesRead, nullptr))
+void ContentLoader::FinishModelReload(StagedLoad* load)
+{
+    if (!load->Succeeded)
     {
-        LogError(L"Failed to read file.");
-        return false;
+        LogError(L"Failed to reload model: %s.", load->Filename.c_str());
+        return;
     }
 
-    box.right = header.NumIndices * sizeof(uint32_t);
+    // Nobody waits on a reload, but any textures it has to load still count down on something
+    std::shared_ptr<ObjectLoad> pending = std::make_shared<ObjectLoad>();
+    pending->Status = LoadStatus::Pending;
+    pending->TexturesRemaining = 0;
 
-    context->UpdateSubresource(pool->GetIndexBuffer().Get(), 0, &box, indices.get(), header.NumIndices * sizeof(uint32_t), 0);
+    const Object& source = *load->Result;
+    for (auto& model : Models)
+    {
+        std::shared_ptr<Object> object = model.Owner.lock();
+        if (!object || model.Filename != load->Filename)
+        {
+            continue;
+        }
 
-    // Free up memory
-    indices.reset();
+        // The renderer keeps pointers to the parts (and their meshes), so they're updated in place
+        if (object->Parts.size() != source.Parts.size())
+        {
+            LogError(L"Can't reload %s, its number of parts changed.", load->Filename.c_str());
+            continue;
+        }
 
-    *object = std::make_shared<Object>();
+        LoadedModel reloaded = load->Model;
+        reloaded.Owner = object;
+        if (!UploadGeometry(load->Vertices, load->Ambient, load->Indices, &reloaded))
+        {
+            LogError(L"Failed to upload reloaded geometry: %s.", load->Filename.c_str());
+            continue;
+        }
+        RetireGeometry(model);
+        model = reloaded;
 
-    // Load objects
-    for (int iObj = 0; iObj < (int)header.NumObjects; ++iObj)
-    {
-        ModelObject obj{};
-        if (!ReadFile(modelFile.Get(), &obj, sizeof(obj), &bytesRead, nullptr))
+        object->Positions = source.Positions;
+        object->Indices = source.Indices;
+        object->Pvs = source.Pvs;
+        for (size_t i = 0; i < object->Parts.size(); ++i)
         {
-            LogError(L"Failed to read file.");
-            return false;
+            const std::shared_ptr<Object::Part>& part = object->Parts[i];
+            const Object::Part& sourcePart = *source.Parts[i];
+            part->StartIndex = sourcePart.StartIndex;
+            part->NumIndices = sourcePart.NumIndices;
+            part->BoundsCenter = sourcePart.BoundsCenter;
+            part->BoundsExtents = sourcePart.BoundsExtents;
+            part->Mesh->NumIndices = part->NumIndices;
+
+            UntrackTextureUser(part.get());
+            SetPartTextures(part, load->Textures[i], pending);
         }
+        UpdateMeshes(model);
 
-        XMStoreFloat4x4(&(*object)->RootTransform, XMMatrixIdentity());
+        Log(L"Reloaded %s.", load->Filename.c_str());
+    }
 
-        for (int iPart = 0; iPart < (int)obj.NumParts; ++iPart)
-        {
-            ModelPart part{};
-            if (!ReadFile(modelFile.Get(), &part, sizeof(part), &bytesRead, nullptr))
-            {
-                LogError(L"Failed to read file.");
-                return false;
-            }
+    ReportGeometryBytes(0);
+}
 
-            std::shared_ptr<Object::Part> meshPart = std::make_shared<Object::Part>();
-            (*object)->Parts.push_back(meshPart);
+void ContentLoader::FinishTextureReload(StagedLoad* load)
+{
+    std::wstring path = ContentRoot + load->Filename;
+    auto it = CachedTextureMap.find(path);
+    if (it == CachedTextureMap.end())
+    {
+        return;
+    }
+    ComPtr<ID3D11ShaderResourceView> old = it->second;
 
-            XMStoreFloat4x4(&meshPart->RelativeTransform, XMMatrixIdentity());
+    // Whether or not it's streamed now, it starts over from the new file
+    StopStreaming(path);
+
+    ComPtr<ID3D11ShaderResourceView> srv;
+    if (!CreateStagedTexture(*load, path, &srv))
+    {
+        LogError(L"Failed to reload texture: %s.", path.c_str());
+        return;
+    }
 
-            meshPart->Mesh = std::make_shared<GeoMesh>();
-            meshPart->Mesh->Pool = pool;
-            meshPart->Mesh->BaseIndex = part.StartIndex;
-            meshPart->Mesh->NumIndices = part.NumIndices;
-            meshPart->Mesh->BaseVertex = baseVertex;
+    // Every part using the old version gets a new material below, so its ids can be reused
+    ReleaseMaterials(old.Get());
+    CacheTexture(path, srv);
+
+    for (auto& model : Models)
+    {
+        std::shared_ptr<Object> object = model.Owner.lock();
+        if (!object)
+        {
+            continue;
+        }
 
-            if (part.DiffuseTexture[0] != 0)
+        for (auto& part : object->Parts)
+        {
+            bool changed = false;
+            for (uint32_t slot = 0; slot < _countof(PlaceholderSRVs); ++slot)
             {
-                std::wstring path = ContentRoot + part.DiffuseTexture;
-                auto it = CachedTextureMap.find(path);
-                if (it == CachedTextureMap.end())
-                {
-                    if (!LoadTexture(path, &meshPart->AlbedoSRV))
-                    {
-                        LogError(L"Failed to load texture.");
-                        return false;
-                    }
-                    CachedTextureMap[path] = meshPart->AlbedoSRV;
-                }
-                else
+                ComPtr<ID3D11ShaderResourceView>* texture = GetTextureSlot(part.get(), slot);
+                if (texture->Get() == old.Get())
                 {
-                    meshPart->AlbedoSRV = it->second;
+                    *texture = srv;
+                    TrackTextureUser(path, part, slot);
+                    changed = true;
                 }
             }
-            if (part.NormalTexture[0] != 0)
+
+            if (changed)
             {
-                std::wstring path = ContentRoot + part.NormalTexture;
-                auto it = CachedTextureMap.find(path);
-                if (it == CachedTextureMap.end())
-                {
-                    if (!LoadTexture(path, &meshPart->NormalSRV))
-                    {
-                        LogError(L"Failed to load texture.");
-                        return false;
-                    }
-                    CachedTextureMap[path] = meshPart->NormalSRV;
-                }
-                else
-                {
-                    meshPart->NormalSRV = it->second;
-                }
+                AssignMaterial(part.get());
             }
-            if (part.SpecularTexture[0] != 0)
+        }
+    }
+
+    RetiredResource retired{};
+    retired.Frame = LastFrame;
+    retired.SRV = old;
+    Retired.push_back(retired);
+
+    Log(L"Reloaded %s.", path.c_str());
+}
+
+void ContentLoader::RetireGeometry(const LoadedModel& model)
+{
+    if (!model.Pool)
+    {
+        return;
+    }
+
+    RetiredResource retired{};
+    retired.Frame = LastFrame;
+    retired.Pool = model.Pool;
+    retired.BaseVertex = model.BaseVertex;
+    retired.BaseIndex = model.BaseIndex;
+    Retired.push_back(retired);
+}
+
+void ContentLoader::ReleaseRetired(uint64_t frame)
+{
+    for (size_t i = 0; i < Retired.size();)
+    {
+        if (frame >= Retired[i].Frame + ReloadRetireFrames)
+        {
+            if (Retired[i].Pool)
             {
-                std::wstring path = ContentRoot + part.SpecularTexture;
-                auto it = CachedTextureMap.find(path);
-                if (it == CachedTextureMap.end())
-                {
-                    if (!LoadTexture(path, &meshPart->SpecularSRV))
-                    {
-                        LogError(L"Failed to load texture.");
-                        return false;
-                    }
-                    CachedTextureMap[path] = meshPart->SpecularSRV;
-                }
-                else
-                {
-                    meshPart->SpecularSRV = it->second;
-                }
+                Retired[i].Pool->ReleaseRange(Retired[i].BaseVertex, Retired[i].BaseIndex);
             }
+            Retired[i] = Retired.back();
+            Retired.pop_back();
+        }
+        else
+        {
+            ++i;
         }
     }
-
-    return true;
 }
 
-bool ContentLoader::LoadTexture(const std::wstring& filename, ComPtr<ID3D11ShaderResourceView>* srv)
+bool ContentLoader::LoadDiskTexture(const std::wstring& path, ComPtr<ID3D11ShaderResourceView>* srv)
 {
-    FileHandle texFile(CreateFile(filename.c_str(), GENERIC_READ,
+    FileHandle file(CreateFile(path.c_str(), GENERIC_READ,
         FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr));
-    if (!texFile.IsValid())
+    if (!file.IsValid())
     {
         LogError(L"Failed to open texture.");
         return false;
     }
 
+    TextureHeader header{};
     DWORD bytesRead{};
-    uint32_t fileSize = GetFileSize(texFile.Get(), nullptr);
-
-    TextureHeader texHeader{};
-    if (!ReadFile(texFile.Get(), &texHeader, sizeof(texHeader), &bytesRead, nullptr))
+    if (!ReadFile(file.Get(), &header, sizeof(header), &bytesRead, nullptr) || bytesRead != sizeof(header))
     {
         LogError(L"Failed to read texture.");
         return false;
     }
 
-    if (texHeader.Signature != TextureHeader::ExpectedSignature)
+    if (header.Signature == TextureHeader::ExpectedSignature && IsStreamable(header))
     {
-        LogError(L"Invalid texture file.");
-        return false;
+        return CreateStreamedTexture(path, header, nullptr, srv);
     }
 
-    uint32_t pixelDataSize = fileSize - sizeof(TextureHeader);
-    std::unique_ptr<uint8_t[]> pixelData(new uint8_t[pixelDataSize]);
-    if (!ReadFile(texFile.Get(), pixelData.get(), pixelDataSize, &bytesRead, nullptr))
+    return LoadTexture(path, srv);
+}
+
+bool ContentLoader::CreateStreamedTexture(const std::wstring& path, const TextureHeader& header, const uint8_t* pixels, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    StopStreaming(path);
+
+    uint32_t id = Streamer->AddTexture(header.Width, header.MipLevels, (uint32_t)BitsPerPixel(header.Format) / 8);
+    uint32_t mip = Streamer->GetResidentMip(id);
+
+    // Start with just the small mips, either from the already loaded pixels or from disk
+    std::vector<uint8_t> data;
+    if (pixels)
     {
-        LogError(L"Failed to read texture data.");
-        return false;
+        pixels += GetMipChainBytes(header, 0) - GetMipChainBytes(header, mip);
     }
-
-    D3D11_TEXTURE2D_DESC td{};
-    td.ArraySize = texHeader.ArrayCount;
-    td.Format = texHeader.Format;
-#if USE_SRGB
-    if (td.Format == DXGI_FORMAT_R8G8B8A8_UNORM)
+    else
     {
-        td.Format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+        if (!ReadMipChain(path, header, mip, header.MipLevels, &data))
+        {
+            Streamer->RemoveTexture(id);
+            return false;
+        }
+        pixels = data.data();
     }
-    else if (td.Format == DXGI_FORMAT_B8G8R8A8_UNORM)
+
+    if (!CreateMipChain(header, mip, pixels, srv))
     {
-        td.Format = DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+        Streamer->RemoveTexture(id);
+        return false;
     }
-#endif
-    td.Width = texHeader.Width;
-    td.Height = texHeader.Height;
-    td.MipLevels = texHeader.MipLevels;
+
+    StreamedTextureFile& texture = StreamedTextures[id];
+    texture.Path = path;
+    texture.Header = header;
+    texture.ResidentMip = mip;
+    texture.TargetMip = mip;
+    texture.ReadSerial = 0;
+    texture.Users.clear();
+    StreamedTextureIds[path] = id;
+    return true;
+}
+
+bool ContentLoader::CreateMipChain(const TextureHeader& header, uint32_t mostDetailedMip, const uint8_t* pixels, ComPtr<ID3D11ShaderResourceView>* srv)
+{
+    D3D11_TEXTURE2D_DESC td{};
+    td.ArraySize = 1;
+    td.Format = GetTextureFormat(header.Format);
+    td.Width = max(header.Width >> mostDetailedMip, 1u);
+    td.Height = td.Width;
+    td.MipLevels = header.MipLevels - mostDetailedMip;
     td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
     td.SampleDesc.Count = 1;
     td.Usage = D3D11_USAGE_DEFAULT;
 
     D3D11_SUBRESOURCE_DATA init[20] {};
-    uint32_t bpp = (uint32_t)BitsPerPixel(td.Format) / 8;
+    uint32_t bpp = (uint32_t)BitsPerPixel(header.Format) / 8;
+    uint32_t size = td.Width;
+    for (uint32_t m = 0; m < td.MipLevels && m < _countof(init); ++m)
+    {
+        init[m].pSysMem = pixels;
+        init[m].SysMemPitch = size * bpp;
+        init[m].SysMemSlicePitch = size * size * bpp;
+
+        pixels += init[m].SysMemSlicePitch;
+        size = max(size >> 1, 1u);
+    }
 
     ComPtr<ID3D11Texture2D> texture;
-    HRESULT hr = S_OK;
+    HRESULT hr = Device->CreateTexture2D(&td, init, &texture);
+    if (FAILED(hr))
+    {
+        LogError(L"Failed to create texture.");
+        return false;
+    }
 
-    // Only try to use mips if width & height are the same size
-    if (td.Width == td.Height && td.MipLevels > 1)
+    hr = Device->CreateShaderResourceView(texture.Get(), nullptr, srv->ReleaseAndGetAddressOf());
+    if (FAILED(hr))
     {
-        uint32_t width = td.Width;
-        uint32_t height = td.Height;
-        uint8_t* pPixels = pixelData.get();
+        LogError(L"Failed to create texture SRV.");
+        return false;
+    }
 
-        for (int m = 0; m < (int)td.MipLevels; ++m)
+    return true;
+}
+
+void ContentLoader::StopStreaming(const std::wstring& path)
+{
+    auto it = StreamedTextureIds.find(path);
+    if (it != StreamedTextureIds.end())
+    {
+        Streamer->RemoveTexture(it->second);
+        StreamedTextures.erase(it->second);
+        StreamedTextureIds.erase(it);
+    }
+}
+
+void ContentLoader::TrackTextureUser(const std::wstring& path, const std::shared_ptr<Object::Part>& part, uint32_t slot)
+{
+    auto it = StreamedTextureIds.find(path);
+    if (it != StreamedTextureIds.end())
+    {
+        StreamedTextures[it->second].Users.push_back(std::make_pair(std::weak_ptr<Object::Part>(part), slot));
+    }
+}
+
+void ContentLoader::UntrackTextureUser(const Object::Part* part)
+{
+    for (auto& texture : StreamedTextures)
+    {
+        auto& users = texture.second.Users;
+        users.erase(std::remove_if(users.begin(), users.end(), [part](const std::pair<std::weak_ptr<Object::Part>, uint32_t>& user)
         {
-            init[m].pSysMem = pPixels;
-            init[m].SysMemPitch = width * bpp;
-            init[m].SysMemSlicePitch = width * height * bpp;
+            return user.first.lock().get() == part;
+        }), users.end());
+    }
+}
 
-            width >>= 1;
-            height >>= 1;
-            pPixels += init[m].SysMemSlicePitch;
+bool ContentLoader::SetResidentMips(uint32_t id, uint32_t mostDetailedMip)
+{
+    StreamedTextureFile& texture = StreamedTextures[id];
+
+    // A read already on the workers picks up the new target when it finishes
+    if (texture.ReadSerial != 0)
+    {
+        texture.TargetMip = mostDetailedMip;
+        return true;
+    }
+
+    if (mostDetailedMip < texture.ResidentMip)
+    {
+        texture.TargetMip = mostDetailedMip;
+        if (!QueueMipRead(id, &texture))
+        {
+            texture.TargetMip = texture.ResidentMip;
+            return false;
         }
+        return true;
+    }
 
-        hr = Device->CreateTexture2D(&td, init, &texture);
+    // Fewer mips only need the ones already on the GPU
+    if (mostDetailedMip > texture.ResidentMip && !ChangeResidentMips(&texture, mostDetailedMip, nullptr))
+    {
+        return false;
     }
-    else
+    texture.TargetMip = mostDetailedMip;
+    return true;
+}
+
+bool ContentLoader::QueueMipRead(uint32_t id, StreamedTextureFile* texture)
+{
+    if (!StartWorkers())
     {
-        td.MipLevels = 1;
+        return false;
+    }
 
-        init[0].pSysMem = pixelData.get();
-        init[0].SysMemPitch = td.Width * bpp;
-        init[0].SysMemSlicePitch = td.Width * td.Height * bpp;
+    LoadJob job;
+    job.IsModel = false;
+    job.IsReload = false;
+    job.IsMips = true;
+    job.Mips.Path = texture->Path;
+    job.Mips.Header = texture->Header;
+    job.Mips.Id = id;
+    job.Mips.Serial = NextMipRead++;
+    job.Mips.FirstMip = texture->TargetMip;
+    job.Mips.EndMip = texture->ResidentMip;
+    texture->ReadSerial = job.Mips.Serial;
+    QueueJob(job);
+    return true;
+}
 
-        hr = Device->CreateTexture2D(&td, init, &texture);
+void ContentLoader::FinishMipRead(StagedLoad* load)
+{
+    // Dropped if the texture stopped streaming (or was reloaded) while it was read
+    auto it = StreamedTextures.find(load->Mips.Id);
+    if (it == StreamedTextures.end() || it->second.ReadSerial != load->Mips.Serial)
+    {
+        return;
     }
-    if (FAILED(hr))
+
+    StreamedTextureFile& texture = it->second;
+    texture.ReadSerial = 0;
+    if (!load->Succeeded)
     {
-        LogError(L"Failed to create texture.");
+        // Stays at the resident mips. The streamer counts the target, so this only leaves it under budget
+        LogError(L"Failed to stream texture: %s.", texture.Path.c_str());
+        return;
+    }
+
+    // Evictions since the read was queued may leave only some (or none) of it wanted
+    uint32_t mip = max(texture.TargetMip, load->Mips.FirstMip);
+    const uint8_t* pixels = nullptr;
+    if (mip < texture.ResidentMip)
+    {
+        pixels = load->Data.data() + (size_t)(GetMipChainBytes(texture.Header, load->Mips.FirstMip) - GetMipChainBytes(texture.Header, mip));
+    }
+    if (mip != texture.ResidentMip && !ChangeResidentMips(&texture, mip, pixels))
+    {
+        return;
+    }
+
+    // Asked for more detail again while this was read
+    if (texture.TargetMip < texture.ResidentMip)
+    {
+        QueueMipRead(load->Mips.Id, &texture);
+    }
+}
+
+bool ContentLoader::ChangeResidentMips(StreamedTextureFile* texture, uint32_t mostDetailedMip, const uint8_t* pixels)
+{
+    // pixels holds mips [mostDetailedMip, ResidentMip), if any. The rest are copied from the current texture
+    auto cached = CachedTextureMap.find(texture->Path);
+    if (cached == CachedTextureMap.end() || !cached->second)
+    {
+        LogError(L"Failed to stream texture: %s.", texture->Path.c_str());
         return false;
     }
+    ID3D11ShaderResourceView* currentSRV = cached->second.Get();
+    ComPtr<ID3D11Resource> current;
+    currentSRV->GetResource(&current);
 
-    hr = Device->CreateShaderResourceView(texture.Get(), nullptr, srv->ReleaseAndGetAddressOf());
-    if (FAILED(hr))
+    D3D11_TEXTURE2D_DESC td{};
+    td.ArraySize = 1;
+    td.Format = GetTextureFormat(texture->Header.Format);
+    td.Width = max(texture->Header.Width >> mostDetailedMip, 1u);
+    td.Height = td.Width;
+    td.MipLevels = texture->Header.MipLevels - mostDetailedMip;
+    td.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    td.SampleDesc.Count = 1;
+    td.Usage = D3D11_USAGE_DEFAULT;
+
+    ComPtr<ID3D11Texture2D> mips;
+    ComPtr<ID3D11ShaderResourceView> srv;
+    if (FAILED(Device->CreateTexture2D(&td, nullptr, &mips)) ||
+        FAILED(Device->CreateShaderResourceView(mips.Get(), nullptr, &srv)))
     {
-        LogError(L"Failed to create texture SRV.");
+        LogError(L"Failed to stream texture: %s.", texture->Path.c_str());
         return false;
     }
 
+    ComPtr<ID3D11DeviceContext> context;
+    Device->GetImmediateContext(&context);
+
+    uint32_t bpp = (uint32_t)BitsPerPixel(texture->Header.Format) / 8;
+    uint32_t size = td.Width;
+    for (uint32_t m = 0; m < td.MipLevels; ++m)
+    {
+        uint32_t mip = mostDetailedMip + m;
+        if (mip >= texture->ResidentMip)
+        {
+            context->CopySubresourceRegion(mips.Get(), m, 0, 0, 0, current.Get(), mip - texture->ResidentMip, nullptr);
+        }
+        else
+        {
+            context->UpdateSubresource(mips.Get(), m, nullptr, pixels, size * bpp, size * size * bpp);
+            pixels += size * size * bpp;
+        }
+        size = max(size >> 1, 1u);
+    }
+
+    // Every part using the old texture gets a new material below, so its ids can be reused
+    ReleaseMaterials(currentSRV);
+    CacheTexture(texture->Path, srv);
+    texture->ResidentMip = mostDetailedMip;
+
+    for (auto& user : texture->Users)
+    {
+        std::shared_ptr<Object::Part> part = user.first.lock();
+        if (part)
+        {
+            *GetTextureSlot(part.get(), user.second) = srv;
+            AssignMaterial(part.get());
+        }
+    }
+
     return true;
 }
@@ -1,18 +1,294 @@
 #pragma once
 
 #include "Object.h"
+#include "TextureStreamer.h"
 
-class ContentLoader : public NonCopyable
+class GeometryPool;
+class MemoryTelemetry;
+class FileWatcher;
+struct StandardVertex;
+struct AmbientVertex;
+
+// Models share geometry pools of at least this many vertices & indices
+static const uint32_t DefaultPoolVertices = 1024 * 1024;
+static const uint32_t DefaultPoolIndices = 3 * 1024 * 1024;
+
+static const uint64_t DefaultGeometryBudget = 512ull * 1024 * 1024;
+
+// Worker threads stop reading ahead once this much is waiting to be uploaded
+static const uint64_t MaxStagedBytes = 128ull * 1024 * 1024;
+static const uint32_t MaxLoaderThreads = 4;
+
+// What a hot reload replaces is kept for this many frames, so frames still queued for the GPU
+// (up to MaxFrameLatency of them) can finish with it
+static const uint64_t ReloadRetireFrames = 4;
+
+enum class LoadStatus
+{
+    Pending = 0,
+    Complete,
+    Failed,
+};
+
+// Handles for async loads. Only ever updated by ProcessUploads, on the thread calling it.
+// Result is set as soon as the object can be rendered, which is before all of its
+// textures have arrived (placeholders are used until then).
+struct ObjectLoad
+{
+    LoadStatus                          Status;
+    std::shared_ptr<Object>             Result;
+    uint32_t                            TexturesRemaining;
+};
+
+struct TextureLoad
+{
+    LoadStatus                          Status;
+    ComPtr<ID3D11ShaderResourceView>    Result;
+};
+
+class ContentLoader : public NonCopyable, private TextureStreamBackend
 {
 public:
+    // device may be null, in which case objects only get their CPU side data (bounds, positions & indices)
     ContentLoader(const ComPtr<ID3D11Device>& device, const std::wstring& contentRoot);
+    ~ContentLoader();
 
     bool LoadObject(const std::wstring& filename, std::shared_ptr<Object>* object);
     bool LoadTexture(const std::wstring& filename, ComPtr<ID3D11ShaderResourceView>* srv);
 
+    // Create objects straight from in-process imports (see AssetImport.h), without touching disk.
+    // Imported textures replace any cached texture of the same name.
+    bool LoadObjectFromMemory(const ImportedModel& model, std::shared_ptr<Object>* object);
+    bool LoadTextureFromMemory(const uint8_t* data, size_t size, ComPtr<ID3D11ShaderResourceView>* srv);
+
+    // Files (relative to the content root) are read and parsed on worker threads, and queued up
+    // for upload. Requires a device.
+    std::shared_ptr<ObjectLoad> LoadObjectAsync(const std::wstring& filename);
+    std::shared_ptr<TextureLoad> LoadTextureAsync(const std::wstring& filename);
+
+    // Uploads queued loads until byteBudget is used up (at least one is always processed,
+    // so large ones still make progress). Call once per frame, before rendering.
+    void ProcessUploads(uint64_t byteBudget);
+
+    // Geometry of models loaded from disk is evicted (least recently used pool first) while
+    // GetGeometryBytes is over budget, and reloaded when they're used again. Call once per
+    // frame, after rendering, with the renderer's frame index.
+    void SetGeometryBudget(uint64_t bytes);
+    uint64_t GetGeometryBytes() const;
+    void UpdateResidency(uint64_t frame);
+
+    // Compacts any pools whose free space has become too fragmented to use
+    bool Defragment();
+
+    // Square textures with mips loaded from disk are streamed: only their small mips are loaded
+    // up front, and more detail is loaded for parts as they get bigger on screen (also from
+    // UpdateResidency), within the texture budget. New mips are read on the workers and swapped
+    // in by ProcessUploads. Evicted mips are dropped by copying the rest to a smaller texture.
+    void SetTextureBudget(uint64_t bytes);
+    const TextureStreamStats& GetTextureStats() const { return Streamer->GetStats(); }
+
+    // Reports the geometry pools, textures (by format) & staged loads to telemetry from now on,
+    // along with the bytes uploaded by each ProcessUploads. The budgets above are set on it too.
+    // May be null, to stop reporting.
+    void SetMemoryTelemetry(MemoryTelemetry* telemetry);
+
+    // Watches the content root, and reloads the models & textures loaded from it as their files
+    // change (read on the workers, as above). New versions are swapped in by ProcessUploads, so
+    // always between frames, and what they replace is released ReloadRetireFrames frames later by
+    // UpdateResidency. Models are only reloaded if they still have the same number of parts, as
+    // the renderer holds on to those. Requires a device.
+    bool EnableHotReload();
+
 private:
+    // Where a loaded model's geometry lives. Pool is null while evicted
+    struct LoadedModel
+    {
+        std::wstring                    Filename;   // Empty for imported models, which can't be evicted
+        std::weak_ptr<Object>           Owner;
+        std::shared_ptr<GeometryPool>   Pool;
+        uint32_t                        BaseVertex;
+        uint32_t                        BaseIndex;
+        uint32_t                        NumVertices;
+        uint32_t                        NumIndices;
+    };
+
+    // Texture names for each part, in the same order as Object::Parts
+    struct PartTextures
+    {
+        std::wstring                    Names[3];   // Albedo, Normal & Specular
+    };
+
+    // More detail for a streamed texture: mips [FirstMip, EndMip) of the file at Path
+    struct MipRead
+    {
+        std::wstring                    Path;
+        TextureHeader                   Header;
+        uint32_t                        Id;         // TextureStreamer id
+        uint64_t                        Serial;     // Matches the texture's ReadSerial while it's still wanted
+        uint32_t                        FirstMip;
+        uint32_t                        EndMip;
+    };
+
+    // Waiting for a worker thread to read it
+    struct LoadJob
+    {
+        std::wstring                    Filename;   // Relative to ContentRoot. Empty for mip reads
+        std::shared_ptr<ObjectLoad>     PendingObject;  // Null for texture loads & reloads
+        bool                            IsModel;
+        bool                            IsReload;
+        bool                            IsMips;
+        MipRead                         Mips;
+    };
+
+    // Read from disk by a worker thread, waiting to be uploaded
+    struct StagedLoad
+    {
+        std::wstring                    Filename;   // Relative to ContentRoot. Empty for mip reads
+        std::shared_ptr<ObjectLoad>     PendingObject;  // Null for texture loads & reloads
+        bool                            IsModel;
+        bool                            IsReload;
+        bool                            IsMips;
+        MipRead                         Mips;
+        bool                            Succeeded;
+        uint64_t                        UploadBytes;
+        std::vector<uint8_t>            Data;
+
+        // Parsed model, with vertices & indices pointing into Data. Ambient is null if it has no bake
+        std::shared_ptr<Object>         Result;
+        std::vector<PartTextures>       Textures;
+        LoadedModel                     Model;
+        const StandardVertex*           Vertices;
+        const AmbientVertex*            Ambient;
+        const uint32_t*                 Indices;
+    };
+
+    // Streamed texture, by TextureStreamer id
+    struct StreamedTextureFile
+    {
+        std::wstring                    Path;
+        TextureHeader                   Header;
+
+        // Most detailed mip of the cached texture, and the one the streamer last asked for. They
+        // differ while a read for more detail is on the workers (ReadSerial isn't 0)
+        uint32_t                        ResidentMip;
+        uint32_t                        TargetMip;
+        uint64_t                        ReadSerial;
+
+        // Parts (and which of their texture slots) using it, to update when its mips change
+        std::vector<std::pair<std::weak_ptr<Object::Part>, uint32_t>> Users;
+    };
+
+    // Something waiting on a texture that's loading
+    struct TextureWaiter
+    {
+        std::shared_ptr<Object::Part>   Part;
+        uint32_t                        Slot;
+        std::shared_ptr<ObjectLoad>     PendingObject;
+        std::shared_ptr<TextureLoad>    PendingTexture;
+    };
+
+    // Geometry range and/or texture replaced by a hot reload, on its way out
+    struct RetiredResource
+    {
+        uint64_t                            Frame;      // Last frame rendered with it
+        std::shared_ptr<GeometryPool>       Pool;       // Null if there's no range
+        uint32_t                            BaseVertex;
+        uint32_t                            BaseIndex;
+        ComPtr<ID3D11ShaderResourceView>    SRV;
+    };
+
+    static bool ParseModel(const uint8_t* data, size_t size, std::shared_ptr<Object>* object, std::vector<PartTextures>* textures,
+        LoadedModel* model, const StandardVertex** vertices, const AmbientVertex** ambient, const uint32_t** indices);
+    static ComPtr<ID3D11ShaderResourceView>* GetTextureSlot(Object::Part* part, uint32_t slot);
+
+    bool CreateObject(const std::wstring& filename, const uint8_t* data, size_t size, const ImportedModel* imported, std::shared_ptr<Object>* object);
+    bool GetTexture(const wchar_t* name, const ImportedModel* imported, ComPtr<ID3D11ShaderResourceView>* srv);
+    void AssignMaterial(Object::Part* part);
+    void ReleaseMaterials(ID3D11ShaderResourceView* srv);
+
+    bool StartWorkers();
+    void WorkerThread();
+    void QueueLoad(const std::wstring& filename, const std::shared_ptr<ObjectLoad>& object, bool isModel, bool isReload);
+    void QueueJob(const LoadJob& job);
+    void WaitForTexture(const std::wstring& name, const TextureWaiter& waiter);
+    void SetPartTextures(const std::shared_ptr<Object::Part>& part, const PartTextures& textures, const std::shared_ptr<ObjectLoad>& pending);
+    bool CreateStagedTexture(const StagedLoad& load, const std::wstring& path, ComPtr<ID3D11ShaderResourceView>* srv);
+    void FinishObjectLoad(StagedLoad* load);
+    void FinishTextureLoad(StagedLoad* load);
+
+    // Hot reloading
+    void QueueReloads();
+    void FinishModelReload(StagedLoad* load);
+    void FinishTextureReload(StagedLoad* load);
+    void RetireGeometry(const LoadedModel& model);
+    void ReleaseRetired(uint64_t frame);
+
+    // Every texture kept in CachedTextureMap goes through here, so its memory is accounted for
+    void CacheTexture(const std::wstring& path, const ComPtr<ID3D11ShaderResourceView>& srv);
+    void TrackTextureBytes(ID3D11ShaderResourceView* srv, bool add);
+    void ReportGeometryBytes(uint64_t extraBytes);
+    void ReportStagedBytes();   // Lock must be held
+
+    bool LoadDiskTexture(const std::wstring& path, ComPtr<ID3D11ShaderResourceView>* srv);
+    bool CreateStreamedTexture(const std::wstring& path, const TextureHeader& header, const uint8_t* pixels, ComPtr<ID3D11ShaderResourceView>* srv);
+    bool CreateMipChain(const TextureHeader& header, uint32_t mostDetailedMip, const uint8_t* pixels, ComPtr<ID3D11ShaderResourceView>* srv);
+    void StopStreaming(const std::wstring& path);
+    void TrackTextureUser(const std::wstring& path, const std::shared_ptr<Object::Part>& part, uint32_t slot);
+    void UntrackTextureUser(const Object::Part* part);
+    bool SetResidentMips(uint32_t id, uint32_t mostDetailedMip) override;
+    bool QueueMipRead(uint32_t id, StreamedTextureFile* texture);
+    void FinishMipRead(StagedLoad* load);
+    bool ChangeResidentMips(StreamedTextureFile* texture, uint32_t mostDetailedMip, const uint8_t* pixels);
+
+    // ambient may be null, for models without baked ambient occlusion
+    bool UploadGeometry(const StandardVertex* vertices, const AmbientVertex* ambient, const uint32_t* indices, LoadedModel* model);
+    bool ReloadGeometry(LoadedModel* model);
+    void EvictPool(const std::shared_ptr<GeometryPool>& pool);
+    bool CompactPool(const std::shared_ptr<GeometryPool>& pool);
+    void UpdateMeshes(const LoadedModel& model);
+
     std::wstring ContentRoot;
     ComPtr<ID3D11Device> Device;
 
     std::map<std::wstring, ComPtr<ID3D11ShaderResourceView>> CachedTextureMap;
+
+    // Keyed by Albedo, Normal & Specular SRV
+    typedef std::tuple<ID3D11ShaderResourceView*, ID3D11ShaderResourceView*, ID3D11ShaderResourceView*> TextureSet;
+    std::map<TextureSet, uint32_t> MaterialIds;
+    uint32_t NextMaterialId;
+    std::vector<uint32_t> FreeMaterialIds;
+
+    std::vector<std::shared_ptr<GeometryPool>> Pools;
+    std::vector<LoadedModel> Models;
+    uint64_t GeometryBudget;
+
+    // Async loading. Jobs and Staged (and ShuttingDown) are shared with the workers, under Lock
+    std::vector<std::thread> Workers;
+    std::mutex Lock;
+    std::condition_variable JobAvailable;
+    std::condition_variable StagingAvailable;
+    std::deque<LoadJob> Jobs;
+    std::deque<std::shared_ptr<StagedLoad>> Staged;
+    uint64_t StagedBytes;
+    bool ShuttingDown;
+
+    // Keyed by full path. Only touched by the thread calling ProcessUploads
+    std::map<std::wstring, std::vector<TextureWaiter>> PendingTextures;
+    ComPtr<ID3D11ShaderResourceView> PlaceholderSRVs[3];
+
+    std::unique_ptr<TextureStreamer> Streamer;
+    std::map<uint32_t, StreamedTextureFile> StreamedTextures;
+    std::map<std::wstring, uint32_t> StreamedTextureIds;    // Keyed by full path
+    uint64_t NextMipRead;
+
+    // Hot reloading. LastFrame is the frame last passed to UpdateResidency
+    std::unique_ptr<FileWatcher> Watcher;
+    std::vector<RetiredResource> Retired;
+    uint64_t LastFrame;
+
+    // Bytes of cached & placeholder textures, by format. Kept whether or not there's telemetry
+    std::map<DXGI_FORMAT, uint64_t> TextureBytes;
+    MemoryTelemetry* Telemetry;
+    uint32_t GeometryCategory;
+    uint32_t StagingCategory;
 };
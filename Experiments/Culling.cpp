@@ -0,0 +1,248 @@
+#include "Precomp.h"
+#include "Culling.h"
+#include <intrin.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+void CullingBoxes::Clear()
+{
+    CenterX.clear();
+    CenterY.clear();
+    CenterZ.clear();
+    ExtentX.clear();
+    ExtentY.clear();
+    ExtentZ.clear();
+}
+
+void CullingBoxes::Reserve(uint32_t count)
+{
+    CenterX.reserve(count);
+    CenterY.reserve(count);
+    CenterZ.reserve(count);
+    ExtentX.reserve(count);
+    ExtentY.reserve(count);
+    ExtentZ.reserve(count);
+}
+
+void CullingBoxes::Add(const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+    CenterX.push_back(center.x);
+    CenterY.push_back(center.y);
+    CenterZ.push_back(center.z);
+    ExtentX.push_back(extents.x);
+    ExtentY.push_back(extents.y);
+    ExtentZ.push_back(extents.z);
+}
+
+// Row vector convention, so each row of the upper 3x3 is where a local axis ends up.
+// The new half size along each world axis is the sum of the absolute projections.
+static void TransformBox(const XMFLOAT3& center, const XMFLOAT3& extents, CXMMATRIX world, XMFLOAT3* worldCenter, XMFLOAT3* worldExtents)
+{
+    XMStoreFloat3(worldCenter, XMVector3Transform(XMLoadFloat3(&center), world));
+    XMStoreFloat3(worldExtents,
+        XMVectorAbs(world.r[0]) * extents.x +
+        XMVectorAbs(world.r[1]) * extents.y +
+        XMVectorAbs(world.r[2]) * extents.z);
+}
+
+void CullingBoxes::AddTransformed(const XMFLOAT3& center, const XMFLOAT3& extents, CXMMATRIX world)
+{
+    XMFLOAT3 c, e;
+    TransformBox(center, extents, world, &c, &e);
+    Add(c, e);
+}
+
+void CullingBoxes::Resize(uint32_t count)
+{
+    CenterX.resize(count);
+    CenterY.resize(count);
+    CenterZ.resize(count);
+    ExtentX.resize(count);
+    ExtentY.resize(count);
+    ExtentZ.resize(count);
+}
+
+void CullingBoxes::SetTransformed(uint32_t index, const XMFLOAT3& center, const XMFLOAT3& extents, CXMMATRIX world)
+{
+    XMFLOAT3 c, e;
+    TransformBox(center, extents, world, &c, &e);
+    CenterX[index] = c.x;
+    CenterY[index] = c.y;
+    CenterZ[index] = c.z;
+    ExtentX[index] = e.x;
+    ExtentY[index] = e.y;
+    ExtentZ[index] = e.z;
+}
+
+void CullingBoxes::SetHidden(uint32_t index)
+{
+    // Negative extents take the box's far corner behind every plane
+    CenterX[index] = 0.f;
+    CenterY[index] = 0.f;
+    CenterZ[index] = 0.f;
+    ExtentX[index] = -FLT_MAX;
+    ExtentY[index] = -FLT_MAX;
+    ExtentZ[index] = -FLT_MAX;
+}
+
+void ExtractFrustumPlanes(CXMMATRIX viewProjection, XMFLOAT4 planes[6])
+{
+    XMMATRIX m = XMMatrixTranspose(viewProjection);
+
+    XMStoreFloat4(&planes[0], m.r[3] + m.r[0]);     // Left
+    XMStoreFloat4(&planes[1], m.r[3] - m.r[0]);     // Right
+    XMStoreFloat4(&planes[2], m.r[3] + m.r[1]);     // Bottom
+    XMStoreFloat4(&planes[3], m.r[3] - m.r[1]);     // Top
+    XMStoreFloat4(&planes[4], m.r[2]);              // Near
+    XMStoreFloat4(&planes[5], m.r[3] - m.r[2]);     // Far
+}
+
+bool IsBoxVisible(const CullingBoxes& boxes, uint32_t i, const XMFLOAT4 planes[6])
+{
+    for (int p = 0; p < 6; ++p)
+    {
+        const XMFLOAT4& plane = planes[p];
+        // Same order of operations as the SIMD paths, so results match exactly
+        float d = (plane.x * boxes.CenterX[i] + plane.y * boxes.CenterY[i]) + (plane.z * boxes.CenterZ[i] + plane.w);
+        float r = (fabsf(plane.x) * boxes.ExtentX[i] + fabsf(plane.y) * boxes.ExtentY[i]) + fabsf(plane.z) * boxes.ExtentZ[i];
+        if (d + r < 0.f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t FrustumCullScalar(const CullingBoxes& boxes, CXMMATRIX viewProjection, uint32_t* visible)
+{
+    XMFLOAT4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+
+    uint32_t numVisible = 0;
+    for (uint32_t i = 0; i < boxes.Size(); ++i)
+    {
+        if (IsBoxVisible(boxes, i, planes))
+        {
+            visible[numVisible++] = i;
+        }
+    }
+    return numVisible;
+}
+
+// Appends base + index of every set bit in mask
+static uint32_t AppendVisible(uint32_t mask, uint32_t base, uint32_t* visible)
+{
+    uint32_t count = 0;
+    unsigned long bit = 0;
+    while (_BitScanForward(&bit, mask))
+    {
+        visible[count++] = base + bit;
+        mask &= mask - 1;
+    }
+    return count;
+}
+
+uint32_t FrustumCull(const CullingBoxes& boxes, CXMMATRIX viewProjection, uint32_t* visible)
+{
+    return FrustumCullRange(boxes, 0, boxes.Size(), viewProjection, visible);
+}
+
+uint32_t FrustumCullRange(const CullingBoxes& boxes, uint32_t first, uint32_t count, CXMMATRIX viewProjection, uint32_t* visible)
+{
+    XMFLOAT4 planes[6];
+    ExtractFrustumPlanes(viewProjection, planes);
+
+    const uint32_t end = first + count;
+    uint32_t numVisible = 0;
+    uint32_t i = first;
+
+#if defined(__AVX__)
+    {
+        __m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            planeX[p] = _mm256_set1_ps(planes[p].x);
+            planeY[p] = _mm256_set1_ps(planes[p].y);
+            planeZ[p] = _mm256_set1_ps(planes[p].z);
+            planeW[p] = _mm256_set1_ps(planes[p].w);
+            absX[p] = _mm256_set1_ps(fabsf(planes[p].x));
+            absY[p] = _mm256_set1_ps(fabsf(planes[p].y));
+            absZ[p] = _mm256_set1_ps(fabsf(planes[p].z));
+        }
+
+        const __m256 zero = _mm256_setzero_ps();
+        for (; i + 8 <= end; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(&boxes.CenterX[i]);
+            __m256 cy = _mm256_loadu_ps(&boxes.CenterY[i]);
+            __m256 cz = _mm256_loadu_ps(&boxes.CenterZ[i]);
+            __m256 ex = _mm256_loadu_ps(&boxes.ExtentX[i]);
+            __m256 ey = _mm256_loadu_ps(&boxes.ExtentY[i]);
+            __m256 ez = _mm256_loadu_ps(&boxes.ExtentZ[i]);
+
+            __m256 outside = zero;
+            for (int p = 0; p < 6; ++p)
+            {
+                __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], cx), _mm256_mul_ps(planeY[p], cy)),
+                                         _mm256_add_ps(_mm256_mul_ps(planeZ[p], cz), planeW[p]));
+                __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], ex), _mm256_mul_ps(absY[p], ey)),
+                                         _mm256_mul_ps(absZ[p], ez));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_LT_OQ));
+            }
+
+            uint32_t mask = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFF;
+            numVisible += AppendVisible(mask, i, visible + numVisible);
+        }
+    }
+#endif
+
+    {
+        __m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+        for (int p = 0; p < 6; ++p)
+        {
+            planeX[p] = _mm_set1_ps(planes[p].x);
+            planeY[p] = _mm_set1_ps(planes[p].y);
+            planeZ[p] = _mm_set1_ps(planes[p].z);
+            planeW[p] = _mm_set1_ps(planes[p].w);
+            absX[p] = _mm_set1_ps(fabsf(planes[p].x));
+            absY[p] = _mm_set1_ps(fabsf(planes[p].y));
+            absZ[p] = _mm_set1_ps(fabsf(planes[p].z));
+        }
+
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= end; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&boxes.CenterX[i]);
+            __m128 cy = _mm_loadu_ps(&boxes.CenterY[i]);
+            __m128 cz = _mm_loadu_ps(&boxes.CenterZ[i]);
+            __m128 ex = _mm_loadu_ps(&boxes.ExtentX[i]);
+            __m128 ey = _mm_loadu_ps(&boxes.ExtentY[i]);
+            __m128 ez = _mm_loadu_ps(&boxes.ExtentZ[i]);
+
+            __m128 outside = zero;
+            for (int p = 0; p < 6; ++p)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], cx), _mm_mul_ps(planeY[p], cy)),
+                                      _mm_add_ps(_mm_mul_ps(planeZ[p], cz), planeW[p]));
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)),
+                                      _mm_mul_ps(absZ[p], ez));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            }
+
+            uint32_t mask = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+            numVisible += AppendVisible(mask, i, visible + numVisible);
+        }
+    }
+
+    // Remainder
+    for (; i < end; ++i)
+    {
+        if (IsBoxVisible(boxes, i, planes))
+        {
+            visible[numVisible++] = i;
+        }
+    }
+
+    return numVisible;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+// World space axis aligned boxes, stored as structure of arrays so the culling kernels
+// can test 4 (SSE) or 8 (AVX) boxes per instruction. Independent of any graphics API.
+class CullingBoxes
+{
+public:
+    void Clear();
+    void Reserve(uint32_t count);
+
+    void Add(const XMFLOAT3& center, const XMFLOAT3& extents);
+
+    // Adds the world space box enclosing a local space box transformed by world
+    void AddTransformed(const XMFLOAT3& center, const XMFLOAT3& extents, CXMMATRIX world);
+
+    // For filling boxes in parallel: size up front, then set each one
+    void Resize(uint32_t count);
+    void SetTransformed(uint32_t index, const XMFLOAT3& center, const XMFLOAT3& extents, CXMMATRIX world);
+
+    // Makes the box one no frustum contains, for things already known to be hidden
+    void SetHidden(uint32_t index);
+
+    uint32_t Size() const { return (uint32_t)CenterX.size(); }
+
+    std::vector<float> CenterX;
+    std::vector<float> CenterY;
+    std::vector<float> CenterZ;
+    std::vector<float> ExtentX;
+    std::vector<float> ExtentY;
+    std::vector<float> ExtentZ;
+};
+
+// Writes the indices of every box intersecting the view frustum, in increasing order,
+// and returns how many were written. visible must have room for boxes.Size() entries.
+// Boxes straddling a frustum corner may be conservatively reported as visible.
+uint32_t FrustumCull(const CullingBoxes& boxes, CXMMATRIX viewProjection, uint32_t* visible);
+
+// As FrustumCull, for boxes [first, first + count) only, so ranges can be culled in parallel.
+// Writes indices into the whole set of boxes. visible must have room for count entries.
+uint32_t FrustumCullRange(const CullingBoxes& boxes, uint32_t first, uint32_t count, CXMMATRIX viewProjection, uint32_t* visible);
+
+// One box at a time. Same results as FrustumCull, used for validation and as a baseline.
+uint32_t FrustumCullScalar(const CullingBoxes& boxes, CXMMATRIX viewProjection, uint32_t* visible);
+
+// Frustum planes from a row vector view projection matrix, in D3D clip space (0 <= z <= w).
+// Not normalized, since only the sign of the distance is used. Inside is positive.
+void ExtractFrustumPlanes(CXMMATRIX viewProjection, XMFLOAT4 planes[6]);
+
+// The test the culling functions use on each box, for planes from ExtractFrustumPlanes. A box is
+// outside if it's entirely on the negative side of any plane.
+bool IsBoxVisible(const CullingBoxes& boxes, uint32_t i, const XMFLOAT4 planes[6]);
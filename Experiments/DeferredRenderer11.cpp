@@ -2,15 +2,36 @@
 #include "DeferredRenderer11.h"
 #include "Geometry.h"
 #include "Object.h"
+#include "MemoryTelemetry.h"
 #include "Shaders/GeometryPassVS.h"
+#include "Shaders/GeometryPassInstancedVS.h"
 #include "Shaders/GeometryPassPS.h"
 #include "Shaders/ClipSpacePassthroughVS.h"
 #include "Shaders/DirectionalLightsPS.h"
+#include "Shaders/PointLightsPS.h"
 #include "Shaders/DbgRenderDepthPS.h"
 
 ID3D11ShaderResourceView* const  DeferredRenderer11::NullSRVs[8] {};
 ID3D11RenderTargetView* const    DeferredRenderer11::NullRTVs[8] {};
 
+// View space distance mapped to the full range of the draw sort key's depth bits
+static const float MaxSortDepth = 10000.f;
+
+// Frame preparation job sizes
+static const uint32_t PartsPerJob = 1024;
+static const uint32_t ConstantsPerJob = 512;
+
+// Parts whose mesh is used by at least this many parts are drawn instanced
+static const uint32_t MinInstancedParts = 2;
+
+// Room for 16K draws per frame, several frames deep
+static const uint32_t GeometryConstantsBytes = 16 * 1024 * 1024;
+
+static double ElapsedMs(const LARGE_INTEGER& start, const LARGE_INTEGER& end, const LARGE_INTEGER& frequency)
+{
+    return (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
 std::unique_ptr<DeferredRenderer11> DeferredRenderer11::Create(HWND window)
 {
     std::unique_ptr<DeferredRenderer11> renderer(new DeferredRenderer11());
@@ -25,16 +46,102 @@ std::unique_ptr<DeferredRenderer11> DeferredRenderer11::Create(HWND window)
 }
 
 DeferredRenderer11::DeferredRenderer11()
+    : InstancingEnabled(true), OccludersDirty(false), PvsEnabled(true), FrameIndex(0), Telemetry(nullptr), FrameUploadBytes(0),
+      InstanceCapacity(0), ClusterCapacity(0), LightIndexCapacity(0), PointLightCapacity(0)
 {
     ZeroMemory(PSShaderResources, sizeof(PSShaderResources));
     ZeroMemory(RenderTargets, sizeof(RenderTargets));
     ZeroMemory(NumShaderResources, sizeof(NumShaderResources));
     ZeroMemory(NumRenderTargets, sizeof(NumRenderTargets));
     ZeroMemory(&Viewport, sizeof(Viewport));
+    ZeroMemory(&Stats, sizeof(Stats));
 }
 
 DeferredRenderer11::~DeferredRenderer11()
 {
+    // Everything reported goes with the renderer
+    SetMemoryTelemetry(nullptr);
+}
+
+void DeferredRenderer11::SetMemoryTelemetry(MemoryTelemetry* telemetry)
+{
+    if (Telemetry)
+    {
+        static const wchar_t* categories[] = { L"Render targets/Swap chain", L"Render targets/G-buffer", L"Render targets/Depth",
+            L"Geometry/Renderer", L"Dynamic buffers/Constants", L"Dynamic buffers/Instances", L"Dynamic buffers/Lights" };
+        for (auto& category : categories)
+        {
+            Telemetry->SetBytes(Telemetry->GetCategory(category), 0);
+        }
+    }
+
+    Telemetry = telemetry;
+    ReportMemory();
+}
+
+void DeferredRenderer11::ReportMemory()
+{
+    if (!Telemetry)
+    {
+        return;
+    }
+
+    // Every target is the size of the back buffer, at 4 bytes per pixel
+    DXGI_SWAP_CHAIN_DESC1 scd{};
+    SwapChain->GetDesc1(&scd);
+    uint64_t targetBytes = (uint64_t)scd.Width * scd.Height * 4;
+
+    uint64_t constantBytes = sizeof(GeometryVSConstants) + sizeof(DLightPSConstants) + sizeof(PLightPSConstants) +
+        (GeometryConstants ? GeometryConstantsBytes : 0);
+    uint64_t lightBytes = (uint64_t)ClusterCapacity * sizeof(ClusterRange) + (uint64_t)LightIndexCapacity * sizeof(uint32_t) +
+        (uint64_t)PointLightCapacity * sizeof(PointLight);
+
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Render targets/Swap chain"), targetBytes * scd.BufferCount);
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Render targets/G-buffer"), targetBytes * ((uint32_t)GBufferSlice::Count - 1));
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Render targets/Depth"), targetBytes);
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Geometry/Renderer"), FullscreenQuad ? FullscreenQuad->Pool->GetEstVRAMBytes() : 0);
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Dynamic buffers/Constants"), constantBytes);
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Dynamic buffers/Instances"), (uint64_t)InstanceCapacity * sizeof(XMFLOAT4X4));
+    Telemetry->SetBytes(Telemetry->GetCategory(L"Dynamic buffers/Lights"), lightBytes);
+}
+
+void DeferredRenderer11::AddObject(const std::shared_ptr<Object>& object)
+{
+    Objects.push_back(object);
+
+    // The object's root, then its parts right after it, so their world matrices are read in order
+    uint32_t root = Transforms.Add(NoParentTransform, XMLoadFloat4x4(&object->RootTransform));
+    ObjectTransforms.push_back(root);
+    for (uint32_t i = 0; i < (uint32_t)object->Parts.size(); ++i)
+    {
+        Object::Part* part = object->Parts[i].get();
+        CullableObjects.push_back(object.get());
+        CullableParts.push_back(part);
+        PartTransforms.push_back(Transforms.Add(root, XMLoadFloat4x4(&part->RelativeTransform)));
+        PartObjects.push_back((uint32_t)Objects.size() - 1);
+        PartIndices.push_back(i);
+
+        // Meshes are updated in place by the content loader, so the pointer identifies one for good
+        auto batch = MeshBatches.insert(std::make_pair(part->Mesh.get(), (uint32_t)BatchPartCounts.size()));
+        if (batch.second)
+        {
+            BatchPartCounts.push_back(0);
+        }
+        ++BatchPartCounts[batch.first->second];
+        PartBatches.push_back(batch.first->second);
+    }
+
+    // Occluders are picked from everything in the scene. Deferred, so adding many objects at once stays cheap
+    OccludersDirty = true;
+}
+
+void DeferredRenderer11::AddPointLight(const XMFLOAT3& position, float radius, const XMFLOAT3& color)
+{
+    PointLight light{};
+    light.Position = position;
+    light.Radius = radius;
+    light.Color = color;
+    PointLights.push_back(light);
 }
 
 bool DeferredRenderer11::Render(FXMMATRIX view, FXMMATRIX projection, bool vsync)
@@ -54,6 +161,19 @@ bool DeferredRenderer11::Render(FXMMATRIX view, FXMMATRIX projection, bool vsync
     Context->PSSetSamplers(0, 1, LinearWrapSampler.GetAddressOf());
     Context->PSSetSamplers(1, 1, PointClampSampler.GetAddressOf());
 
+    ++FrameIndex;
+
+    ZeroMemory(&Stats, sizeof(Stats));
+    FrameUploadBytes = 0;
+
+    LARGE_INTEGER frequency, stageStart, stageEnd;
+    QueryPerformanceFrequency(&frequency);
+
+    if (GeometryConstants)
+    {
+        GeometryConstants->BeginFrame();
+    }
+
     ////////////////////////////////
     // Geometry pass
 
@@ -65,35 +185,314 @@ bool DeferredRenderer11::Render(FXMMATRIX view, FXMMATRIX projection, bool vsync
     XMStoreFloat4x4(&constants.View, view);
     XMStoreFloat4x4(&constants.Projection, projection);
 
-    for (auto& obj : Objects)
+    // Pick up moved objects, then bring the world matrices of whatever changed up to date
+    QueryPerformanceCounter(&stageStart);
+    if (OccludersDirty)
     {
-        XMMATRIX root = XMLoadFloat4x4(&obj->RootTransform);
+        SelectOccluders(Objects, OccluderTriangleBudget);
+        OccludersDirty = false;
+    }
 
-        for (auto& part : obj->Parts)
+    for (uint32_t i = 0; i < (uint32_t)Objects.size(); ++i)
+    {
+        const XMFLOAT4X4& root = Objects[i]->RootTransform;
+        if (memcmp(&root, &Transforms.GetLocal(ObjectTransforms[i]), sizeof(root)) != 0)
         {
-            XMMATRIX xform = XMLoadFloat4x4(&part->RelativeTransform);
+            Transforms.SetLocal(ObjectTransforms[i], XMLoadFloat4x4(&root));
+        }
+    }
+    Transforms.Update(Jobs.get());
 
-            // We should map this as a dynamic CB most likely, for better perf (or at least split out world from the camera stuff)
-            XMStoreFloat4x4(&constants.World, xform * root);
-            Context->UpdateSubresource(GeometryCB.Get(), 0, nullptr, &constants, sizeof(constants), 0);
+    // Where the camera is in each object with potentially visible sets picks the set to use
+    XMVECTOR det;
+    XMVECTOR cameraPosition = XMMatrixInverse(&det, view).r[3];
+    ObjectCells.resize(Objects.size());
+    for (uint32_t i = 0; i < (uint32_t)Objects.size(); ++i)
+    {
+        ObjectCells[i] = nullptr;
+        if (PvsEnabled && !Objects[i]->Pvs.Bits.empty())
+        {
+            XMFLOAT3 localCamera;
+            XMStoreFloat3(&localCamera, XMVector3TransformCoord(cameraPosition,
+                XMMatrixInverse(&det, XMLoadFloat4x4(&Transforms.GetWorld(ObjectTransforms[i])))));
+            ObjectCells[i] = Objects[i]->Pvs.GetCell(localCamera);
+        }
+    }
+
+    // Bound & cull the parts (flattened by AddObject) in ranges on the job system
+    uint32_t numParts = (uint32_t)CullableParts.size();
+    uint32_t numRanges = (numParts + PartsPerJob - 1) / PartsPerJob;
+    PartBounds.Resize(numParts);
+    VisibleParts.resize(numParts);
+    RangeVisible.resize(numRanges);
+
+    XMFLOAT4X4 viewProjection;
+    XMStoreFloat4x4(&viewProjection, view * projection);
+
+    // Each range's visible parts are left at the start of the range
+    JobHandle cull = Jobs->ParallelFor(numParts, PartsPerJob, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const uint32_t* cell = ObjectCells[PartObjects[i]];
+            if (cell && !PotentiallyVisibleSets::IsVisible(cell, PartIndices[i]))
+            {
+                PartBounds.SetHidden(i);
+                continue;
+            }
+
+            const Object::Part* part = CullableParts[i];
+            PartBounds.SetTransformed(i, part->BoundsCenter, part->BoundsExtents, XMLoadFloat4x4(&Transforms.GetWorld(PartTransforms[i])));
+        }
+        RangeVisible[begin / PartsPerJob] = FrustumCullRange(PartBounds, begin, end - begin, XMLoadFloat4x4(&viewProjection), &VisibleParts[begin]);
+    });
+    Jobs->Wait(cull);
+
+    uint32_t numVisible = 0;
+    for (uint32_t i = 0; i < numRanges; ++i)
+    {
+        memmove(&VisibleParts[numVisible], &VisibleParts[i * PartsPerJob], RangeVisible[i] * sizeof(uint32_t));
+        numVisible += RangeVisible[i];
+    }
 
+    Occlusion->ClearOccluders();
+    for (uint32_t i = 0; i < numParts; ++i)
+    {
+        const Object::Part* part = CullableParts[i];
+        // Parts shared with objects that have no CPU geometry are only rasterized for their owner
+        const Object* obj = CullableObjects[i];
+        if (part->IsOccluder && !obj->Positions.empty())
+        {
+            Occlusion->AddOccluder(obj->Positions.data(), obj->Indices.data() + part->StartIndex, part->NumIndices, XMLoadFloat4x4(&Transforms.GetWorld(PartTransforms[i])));
+        }
+    }
+    QueryPerformanceCounter(&stageEnd);
+    Stats.CullMs = ElapsedMs(stageStart, stageEnd, frequency);
+
+    // Rasterized on the frame's jobs, then tested on this thread
+    stageStart = stageEnd;
+    Occlusion->Render(XMLoadFloat4x4(&viewProjection), Jobs.get());
+    numVisible = Occlusion->TestVisibility(PartBounds, VisibleParts.data(), numVisible, VisibleParts.data());
+    QueryPerformanceCounter(&stageEnd);
+    Stats.OcclusionMs = ElapsedMs(stageStart, stageEnd, frequency);
+
+    // Pixels per unit of size at a view depth of 1
+    float projectionScale = XMVectorGetY(projection.r[1]) * Viewport.Height * 0.5f;
+
+    // Sort by pool, then textures, then front to back by distance to the bounds center.
+    // Instanced parts sort after the rest, with each batch's parts together instead of by
+    // depth. Parts with evicted geometry get no key
+    stageStart = stageEnd;
+    XMFLOAT4X4 viewMatrix;
+    XMStoreFloat4x4(&viewMatrix, view);
+    DrawKeys.resize(numVisible);
+    ScreenSizes.resize(numVisible);
+    JobHandle keys = Jobs->ParallelFor(numVisible, PartsPerJob, [&](uint32_t begin, uint32_t end)
+    {
+        XMMATRIX viewTransform = XMLoadFloat4x4(&viewMatrix);
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            uint32_t index = VisibleParts[i];
+            Object::Part* part = CullableParts[index];
+
+            XMVECTOR center = XMVectorSet(PartBounds.CenterX[index], PartBounds.CenterY[index], PartBounds.CenterZ[index], 1.f);
+            XMVECTOR extents = XMVectorSet(PartBounds.ExtentX[index], PartBounds.ExtentY[index], PartBounds.ExtentZ[index], 0.f);
+            float viewDepth = -XMVectorGetZ(XMVector3Transform(center, viewTransform));
+            float radius = XMVectorGetX(XMVector3Length(extents));
+
+            // Screen size of the bounding sphere, for texture streaming. Clamped for parts around the camera
+            ScreenSizes[i] = 2.f * radius * projectionScale / max(viewDepth, radius);
+
+            if (!part->Mesh->Pool)
+            {
+                DrawKeys[i] = UINT64_MAX;
+                continue;
+            }
+
+            uint32_t batch = PartBatches[index];
+            if (InstancingEnabled && BatchPartCounts[batch] >= MinInstancedParts)
+            {
+                DrawKeys[i] = DrawQueue::MakeBatchKey((uint32_t)PassType::GeometryInstanced, part->Mesh->Pool->GetId(), part->MaterialId, batch);
+                continue;
+            }
+
+            float depth = viewDepth / MaxSortDepth;
+            DrawKeys[i] = DrawQueue::MakeKey((uint32_t)PassType::Geometry, part->Mesh->Pool->GetId(), part->MaterialId, depth);
+        }
+    });
+    Jobs->Wait(keys);
+
+    // Evicted geometry is skipped, and reloaded by the content loader since it's now in use
+    GeometryDraws.Clear();
+    for (uint32_t i = 0; i < numVisible; ++i)
+    {
+        uint32_t index = VisibleParts[i];
+        CullableObjects[index]->LastUsedFrame = FrameIndex;
+
+        // Objects can share parts (see GetStressInstances), which keep the largest size they're seen at
+        Object::Part* part = CullableParts[index];
+        part->ScreenSize = part->LastVisibleFrame == FrameIndex ? max(part->ScreenSize, ScreenSizes[i]) : ScreenSizes[i];
+        part->LastVisibleFrame = FrameIndex;
+
+        if (DrawKeys[i] != UINT64_MAX)
+        {
+            GeometryDraws.Add(DrawKeys[i], index);
+        }
+    }
+
+    GeometryDraws.Sort();
+    QueryPerformanceCounter(&stageEnd);
+    Stats.SortMs = ElapsedMs(stageStart, stageEnd, frequency);
+
+    stageStart = stageEnd;
+
+    const std::vector<DrawPacket>& packets = GeometryDraws.GetPackets();
+
+    // Keys lead with the pass, so the parts drawn on their own come first
+    uint64_t firstInstancedKey = DrawQueue::MakeKey((uint32_t)PassType::GeometryInstanced, 0, 0, 0.f);
+    uint32_t numSingleDraws = (uint32_t)(std::lower_bound(packets.begin(), packets.end(), firstInstancedKey,
+        [](const DrawPacket& packet, uint64_t key) { return packet.Key < key; }) - packets.begin());
+
+    // Write all the draw constants up front with a single map, then bind each by offset
+    uint32_t firstConstant = 0;
+    uint32_t drawConstants = 0;
+    uint8_t* mappedConstants = nullptr;
+    FrameUploadBytes += numSingleDraws * sizeof(GeometryVSConstants);
+    if (GeometryConstants && numSingleDraws > 0)
+    {
+        mappedConstants = GeometryConstants->Map(numSingleDraws, sizeof(GeometryVSConstants), &firstConstant, &drawConstants);
+        if (mappedConstants)
+        {
+            JobHandle writes = Jobs->ParallelFor(numSingleDraws, ConstantsPerJob, [&](uint32_t begin, uint32_t end)
+            {
+                GeometryVSConstants drawConstant = constants;
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    drawConstant.World = Transforms.GetWorld(PartTransforms[packets[i].Index]);
+                    memcpy(mappedConstants + i * drawConstants * 16, &drawConstant, sizeof(drawConstant));
+                }
+            });
+            Jobs->Wait(writes);
+            GeometryConstants->Unmap();
+        }
+    }
+
+    const GeometryPool* boundPool = nullptr;
+    uint32_t boundMaterial = UINT32_MAX;
+
+    auto bindPart = [&](const Object::Part* part)
+    {
+        // Texture sets are only ever shared by parts with the same material id
+        if (part->MaterialId != boundMaterial)
+        {
             ID3D11ShaderResourceView* srvs[] = { part->AlbedoSRV.Get(), part->NormalSRV.Get(), part->SpecularSRV.Get() };
             Context->PSSetShaderResources(0, _countof(srvs), srvs);
+            boundMaterial = part->MaterialId;
+            ++Stats.MaterialBinds;
+        }
+        else
+        {
+            ++Stats.MaterialBindsSkipped;
+        }
 
+        if (part->Mesh->Pool.get() != boundPool)
+        {
             BindGeometryPool(part->Mesh->Pool);
-            DrawMesh(part->Mesh);
+            boundPool = part->Mesh->Pool.get();
+            ++Stats.PoolBinds;
+        }
+        else
+        {
+            ++Stats.PoolBindsSkipped;
+        }
+    };
+
+    for (uint32_t i = 0; i < numSingleDraws; ++i)
+    {
+        const DrawPacket& packet = packets[i];
+        Object::Part* part = CullableParts[packet.Index];
+
+        if (mappedConstants)
+        {
+            uint32_t offset = firstConstant + i * drawConstants;
+            Context1->VSSetConstantBuffers1(0, 1, GeometryConstants->GetBuffer().GetAddressOf(), &offset, &drawConstants);
+        }
+        else
+        {
+            constants.World = Transforms.GetWorld(PartTransforms[packet.Index]);
+            Context->UpdateSubresource(GeometryCB.Get(), 0, nullptr, &constants, sizeof(constants), 0);
+        }
+
+        bindPart(part);
+        DrawMesh(part->Mesh);
+        ++Stats.Draws;
+    }
+
+    // The instanced parts' world matrices are written in packet order, so each batch (a run of
+    // packets with the same key and mesh) is a contiguous range of instances
+    uint32_t numInstances = (uint32_t)packets.size() - numSingleDraws;
+    if (numInstances > 0)
+    {
+        XMFLOAT4X4* instances = nullptr;
+        if (!MapInstanceBuffer(numInstances, &instances))
+        {
+            return false;
+        }
+
+        JobHandle writes = Jobs->ParallelFor(numInstances, ConstantsPerJob, [&](uint32_t begin, uint32_t end)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                instances[i] = Transforms.GetWorld(PartTransforms[packets[numSingleDraws + i].Index]);
+            }
+        });
+        Jobs->Wait(writes);
+        Context->Unmap(InstanceBuffer.Get(), 0);
+
+        // Only View & Projection are used. Applying the pass unbinds the textures
+        ApplyPass(PassType::GeometryInstanced, DepthStencilView);
+        boundMaterial = UINT32_MAX;
+
+        XMStoreFloat4x4(&constants.World, XMMatrixIdentity());
+        Context->VSSetConstantBuffers(0, 1, GeometryCB.GetAddressOf());
+        Context->UpdateSubresource(GeometryCB.Get(), 0, nullptr, &constants, sizeof(constants), 0);
+
+        uint32_t stride = sizeof(XMFLOAT4X4);
+        uint32_t offset = 0;
+        Context->IASetVertexBuffers(InstanceSlot, 1, InstanceBuffer.GetAddressOf(), &stride, &offset);
+
+        for (uint32_t first = numSingleDraws; first < (uint32_t)packets.size();)
+        {
+            const Object::Part* part = CullableParts[packets[first].Index];
+            uint32_t end = first + 1;
+            while (end < (uint32_t)packets.size() && packets[end].Key == packets[first].Key &&
+                CullableParts[packets[end].Index]->Mesh == part->Mesh)
+            {
+                ++end;
+            }
+
+            bindPart(part);
+            const GeoMesh* mesh = part->Mesh.get();
+            Context->DrawIndexedInstanced(mesh->NumIndices, end - first, mesh->BaseIndex, mesh->BaseVertex, first - numSingleDraws);
+            ++Stats.Draws;
+            ++Stats.InstancedDraws;
+            Stats.Instances += end - first;
+
+            first = end;
         }
     }
 
+    QueryPerformanceCounter(&stageEnd);
+    Stats.SubmitMs = ElapsedMs(stageStart, stageEnd, frequency);
+
     ////////////////////////////////
     // Geometry pass
 
+    stageStart = stageEnd;
     ApplyPass(PassType::DirectionalLighting, nullptr);
 
     Context->PSSetConstantBuffers(0, 1, DLightCB.GetAddressOf());
 
-    XMVECTOR det;
-
     DLightPSConstants dLightConstants;
     dLightConstants.NumLights = 1;
     XMStoreFloat3(&dLightConstants.Lights[0].Dir, XMVector3TransformNormal(XMVector3Normalize(XMVectorSet(1.f, 1.f, 1.f, 0.f)), view));
@@ -106,11 +505,39 @@ bool DeferredRenderer11::Render(FXMMATRIX view, FXMMATRIX projection, bool vsync
     BindGeometryPool(FullscreenQuad->Pool);
     DrawMesh(FullscreenQuad);
 
+    ////////////////////////////////
+    // Point light pass
+
+    if (!PointLights.empty())
+    {
+        if (!RenderPointLights(view, projection))
+        {
+            return false;
+        }
+    }
+
+    QueryPerformanceCounter(&stageEnd);
+    Stats.LightingMs = ElapsedMs(stageStart, stageEnd, frequency);
+
     //Context->CopyResource(GBuffer[(uint32_t)GBufferSlice::LightAccum].Get(), GBuffer[(uint32_t)GBufferSlice::Color].Get());
     //Context->CopyResource(GBuffer[(uint32_t)GBufferSlice::LightAccum].Get(), GBuffer[(uint32_t)GBufferSlice::Normals].Get());
     //Context->CopyResource(GBuffer[(uint32_t)GBufferSlice::LightAccum].Get(), GBuffer[(uint32_t)GBufferSlice::SpecularRoughness].Get());
 
+    stageStart = stageEnd;
     CheckResult(SwapChain->Present(vsync ? 1 : 0, 0));
+    QueryPerformanceCounter(&stageEnd);
+    Stats.PresentMs = ElapsedMs(stageStart, stageEnd, frequency);
+
+    if (GeometryConstants)
+    {
+        GeometryConstants->EndFrame();
+    }
+
+    if (Telemetry)
+    {
+        Telemetry->AddUploadBytes(FrameUploadBytes);
+        Telemetry->AddDraws(Stats.Draws, Stats.PoolBinds + Stats.MaterialBinds);
+    }
 
     return true;
 }
@@ -179,11 +606,34 @@ bool DeferredRenderer11::Initialize(HWND window)
 
     CheckResult(Device->CreateBuffer(&bd, nullptr, &GeometryCB));
 
+    // Offset binding needs the 11.1 runtime and driver support, otherwise stay on GeometryCB
+    if (SUCCEEDED(Context.As(&Context1)) && ConstantRing::IsSupported(Device))
+    {
+        GeometryConstants = ConstantRing::Create(Device, GeometryConstantsBytes);
+        if (!GeometryConstants)
+        {
+            LogError(L"Failed to create geometry constant ring.");
+            return false;
+        }
+    }
+
     bd.ByteWidth = sizeof(DLightPSConstants);
     bd.StructureByteStride = sizeof(DLightPSConstants);
 
     CheckResult(Device->CreateBuffer(&bd, nullptr, &DLightCB));
 
+    bd.ByteWidth = sizeof(PLightPSConstants);
+    bd.StructureByteStride = sizeof(PLightPSConstants);
+
+    CheckResult(Device->CreateBuffer(&bd, nullptr, &PLightCB));
+
+    Clusters = LightClusters::Create();
+    if (!Clusters)
+    {
+        LogError(L"Failed to create light clusters.");
+        return false;
+    }
+
     // Create fullscreen quad
     ClipSpace2DVertex verts[] =
     {
@@ -218,6 +668,20 @@ bool DeferredRenderer11::Initialize(HWND window)
     box.right = FullscreenQuad->NumIndices * sizeof(uint32_t);
     Context->UpdateSubresource(FullscreenQuad->Pool->GetIndexBuffer().Get(), 0, &box, &indices, sizeof(indices), 0);
 
+    Occlusion = OcclusionBuffer::Create(OcclusionBufferWidth, OcclusionBufferHeight);
+    if (!Occlusion)
+    {
+        LogError(L"Failed to create occlusion buffer.");
+        return false;
+    }
+
+    Jobs = JobSystem::Create();
+    if (!Jobs)
+    {
+        LogError(L"Failed to create job system.");
+        return false;
+    }
+
     return true;
 }
 
@@ -315,6 +779,19 @@ bool DeferredRenderer11::InitializePasses()
     RenderTargets[(uint32_t)PassType::Geometry][3] = GBufferRTV[(uint32_t)GBufferSlice::Color].Get();
     NumRenderTargets[(uint32_t)PassType::Geometry] = 4;
 
+    // Instanced Geometry Pass. Standard vertices, plus the per instance world matrix
+    D3D11_INPUT_ELEMENT_DESC instancedElements[_countof(VertexElements[0])];
+    uint32_t numVertexElements = VertexElementCount[(uint32_t)VertexType::Standard];
+    assert(numVertexElements + _countof(InstanceElements) <= _countof(instancedElements));
+    memcpy(instancedElements, VertexElements[(uint32_t)VertexType::Standard], numVertexElements * sizeof(D3D11_INPUT_ELEMENT_DESC));
+    memcpy(instancedElements + numVertexElements, InstanceElements, sizeof(InstanceElements));
+
+    CheckResult(Device->CreateVertexShader(GeometryPassInstancedVS, sizeof(GeometryPassInstancedVS), nullptr, &VertexShader[(uint32_t)PassType::GeometryInstanced]));
+    PixelShader[(uint32_t)PassType::GeometryInstanced] = PixelShader[(uint32_t)PassType::Geometry];
+    CheckResult(Device->CreateInputLayout(instancedElements, numVertexElements + _countof(InstanceElements), GeometryPassInstancedVS, sizeof(GeometryPassInstancedVS), &InputLayout[(uint32_t)PassType::GeometryInstanced]));
+    memcpy(RenderTargets[(uint32_t)PassType::GeometryInstanced], RenderTargets[(uint32_t)PassType::Geometry], sizeof(RenderTargets[0]));
+    NumRenderTargets[(uint32_t)PassType::GeometryInstanced] = NumRenderTargets[(uint32_t)PassType::Geometry];
+
     // Directional Lights Pass
     CheckResult(Device->CreateVertexShader(ClipSpacePassthroughVS, sizeof(ClipSpacePassthroughVS), nullptr, &VertexShader[(uint32_t)PassType::DirectionalLighting]));
     CheckResult(Device->CreatePixelShader(DirectionalLightsPS, sizeof(DirectionalLightsPS), nullptr, &PixelShader[(uint32_t)PassType::DirectionalLighting]));
@@ -328,6 +805,19 @@ bool DeferredRenderer11::InitializePasses()
     NumRenderTargets[(uint32_t)PassType::DirectionalLighting] = 1;
     BlendStates[(uint32_t)PassType::DirectionalLighting] = AdditiveBlendState;
 
+    // Point Lights Pass. Cluster & light buffers (t4 - t6) are filled in when they're created
+    CheckResult(Device->CreateVertexShader(ClipSpacePassthroughVS, sizeof(ClipSpacePassthroughVS), nullptr, &VertexShader[(uint32_t)PassType::PointLighting]));
+    CheckResult(Device->CreatePixelShader(PointLightsPS, sizeof(PointLightsPS), nullptr, &PixelShader[(uint32_t)PassType::PointLighting]));
+    CheckResult(Device->CreateInputLayout(VertexElements[(uint32_t)VertexType::ClipSpace2D], VertexElementCount[(uint32_t)VertexType::ClipSpace2D], ClipSpacePassthroughVS, sizeof(ClipSpacePassthroughVS), &InputLayout[(uint32_t)PassType::PointLighting]));
+    PSShaderResources[(uint32_t)PassType::PointLighting][0] = DepthStencilSRV.Get();
+    PSShaderResources[(uint32_t)PassType::PointLighting][1] = GBufferSRV[(uint32_t)GBufferSlice::Normals].Get();
+    PSShaderResources[(uint32_t)PassType::PointLighting][2] = GBufferSRV[(uint32_t)GBufferSlice::SpecularRoughness].Get();
+    PSShaderResources[(uint32_t)PassType::PointLighting][3] = GBufferSRV[(uint32_t)GBufferSlice::Color].Get();
+    NumShaderResources[(uint32_t)PassType::PointLighting] = 7;
+    RenderTargets[(uint32_t)PassType::PointLighting][0] = GBufferRTV[(uint32_t)GBufferSlice::LightAccum].Get();
+    NumRenderTargets[(uint32_t)PassType::PointLighting] = 1;
+    BlendStates[(uint32_t)PassType::PointLighting] = AdditiveBlendState;
+
     // Dbg Render Depth Pass
     CheckResult(Device->CreateVertexShader(ClipSpacePassthroughVS, sizeof(ClipSpacePassthroughVS), nullptr, &VertexShader[(uint32_t)PassType::DebugDisplayDepth]));
     CheckResult(Device->CreatePixelShader(DbgRenderDepthPS, sizeof(DbgRenderDepthPS), nullptr, &PixelShader[(uint32_t)PassType::DebugDisplayDepth]));
@@ -378,6 +868,11 @@ void DeferredRenderer11::BindGeometryPool(const std::shared_ptr<GeometryPool>& p
 
     uint32_t offset = 0;
     Context->IASetVertexBuffers(0, 1, pool->GetVertexBuffer().GetAddressOf(), &VertexStride[(uint32_t)pool->GetType()], &offset);
+    if (pool->GetAmbientBuffer())
+    {
+        uint32_t stride = sizeof(AmbientVertex);
+        Context->IASetVertexBuffers(AmbientSlot, 1, pool->GetAmbientBuffer().GetAddressOf(), &stride, &offset);
+    }
     Context->IASetIndexBuffer(pool->GetIndexBuffer().Get(), DXGI_FORMAT_R32_UINT, offset);
 }
 
@@ -385,3 +880,118 @@ void DeferredRenderer11::DrawMesh(const std::shared_ptr<GeoMesh>& mesh)
 {
     Context->DrawIndexed(mesh->NumIndices, mesh->BaseIndex, mesh->BaseVertex);
 }
+
+bool DeferredRenderer11::MapInstanceBuffer(uint32_t count, XMFLOAT4X4** instances)
+{
+    if (!InstanceBuffer || count > InstanceCapacity)
+    {
+        // Grow by half again, like the structured buffers below
+        uint32_t newCapacity = max(max(count, InstanceCapacity + InstanceCapacity / 2), 1u);
+
+        D3D11_BUFFER_DESC bd{};
+        bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+        bd.ByteWidth = newCapacity * sizeof(XMFLOAT4X4);
+        bd.Usage = D3D11_USAGE_DYNAMIC;
+        bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        CheckResult(Device->CreateBuffer(&bd, nullptr, InstanceBuffer.ReleaseAndGetAddressOf()));
+        InstanceCapacity = newCapacity;
+        ReportMemory();
+    }
+    FrameUploadBytes += count * sizeof(XMFLOAT4X4);
+
+    D3D11_MAPPED_SUBRESOURCE mapped{};
+    CheckResult(Context->Map(InstanceBuffer.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+    *instances = static_cast<XMFLOAT4X4*>(mapped.pData);
+    return true;
+}
+
+bool DeferredRenderer11::RenderPointLights(FXMMATRIX view, FXMMATRIX projection)
+{
+    // Cluster in view space, which is also what the shader lights in
+    ViewPointLights.resize(PointLights.size());
+    ViewLightSpheres.resize(PointLights.size());
+    for (uint32_t i = 0; i < (uint32_t)PointLights.size(); ++i)
+    {
+        PointLight& light = ViewPointLights[i];
+        light = PointLights[i];
+        XMStoreFloat3(&light.Position, XMVector3TransformCoord(XMLoadFloat3(&PointLights[i].Position), view));
+        ViewLightSpheres[i] = XMFLOAT4(light.Position.x, light.Position.y, light.Position.z, light.Radius);
+    }
+
+    Clusters->Build(ViewLightSpheres.data(), (uint32_t)ViewLightSpheres.size(), projection, Jobs.get());
+
+    const std::vector<ClusterRange>& clusters = Clusters->GetClusters();
+    const std::vector<uint32_t>& lightIndices = Clusters->GetLightIndices();
+    if (!UpdateStructuredBuffer(clusters.data(), (uint32_t)clusters.size(), sizeof(ClusterRange), &ClusterBuffer, &ClusterSRV, &ClusterCapacity) ||
+        !UpdateStructuredBuffer(lightIndices.data(), (uint32_t)lightIndices.size(), sizeof(uint32_t), &LightIndexBuffer, &LightIndexSRV, &LightIndexCapacity) ||
+        !UpdateStructuredBuffer(ViewPointLights.data(), (uint32_t)ViewPointLights.size(), sizeof(PointLight), &PointLightBuffer, &PointLightSRV, &PointLightCapacity))
+    {
+        return false;
+    }
+
+    PSShaderResources[(uint32_t)PassType::PointLighting][4] = ClusterSRV.Get();
+    PSShaderResources[(uint32_t)PassType::PointLighting][5] = LightIndexSRV.Get();
+    PSShaderResources[(uint32_t)PassType::PointLighting][6] = PointLightSRV.Get();
+
+    ApplyPass(PassType::PointLighting, nullptr);
+
+    Context->PSSetConstantBuffers(0, 1, PLightCB.GetAddressOf());
+
+    XMVECTOR det;
+
+    PLightPSConstants pLightConstants{};
+    pLightConstants.ClusterCounts[0] = ClusterTilesX;
+    pLightConstants.ClusterCounts[1] = ClusterTilesY;
+    pLightConstants.ClusterCounts[2] = ClusterSlices;
+    pLightConstants.SliceScale = Clusters->GetSliceScale();
+    pLightConstants.SliceBias = Clusters->GetSliceBias();
+    pLightConstants.InvViewportSize.x = 1.f / Viewport.Width;
+    pLightConstants.InvViewportSize.y = 1.f / Viewport.Height;
+    XMStoreFloat4x4(&pLightConstants.InvProjection, XMMatrixInverse(&det, projection));
+    Context->UpdateSubresource(PLightCB.Get(), 0, nullptr, &pLightConstants, sizeof(pLightConstants), 0);
+
+    BindGeometryPool(FullscreenQuad->Pool);
+    DrawMesh(FullscreenQuad);
+    return true;
+}
+
+bool DeferredRenderer11::UpdateStructuredBuffer(const void* data, uint32_t count, uint32_t stride, ComPtr<ID3D11Buffer>* buffer,
+    ComPtr<ID3D11ShaderResourceView>* srv, uint32_t* capacity)
+{
+    if (!*buffer || count > *capacity)
+    {
+        // Grow by half again, so a slowly growing count doesn't recreate it every frame
+        uint32_t newCapacity = max(max(count, *capacity + *capacity / 2), 1u);
+
+        D3D11_BUFFER_DESC bd{};
+        bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        bd.ByteWidth = newCapacity * stride;
+        bd.StructureByteStride = stride;
+        bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        bd.Usage = D3D11_USAGE_DYNAMIC;
+        bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+        CheckResult(Device->CreateBuffer(&bd, nullptr, buffer->ReleaseAndGetAddressOf()));
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc{};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.NumElements = newCapacity;
+        CheckResult(Device->CreateShaderResourceView(buffer->Get(), &srvDesc, srv->ReleaseAndGetAddressOf()));
+
+        *capacity = newCapacity;
+        ReportMemory();
+    }
+
+    if (count > 0)
+    {
+        FrameUploadBytes += count * stride;
+        D3D11_MAPPED_SUBRESOURCE mapped{};
+        CheckResult(Context->Map(buffer->Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped));
+        memcpy(mapped.pData, data, count * stride);
+        Context->Unmap(buffer->Get(), 0);
+    }
+
+    return true;
+}
@@ -1,8 +1,17 @@
 #pragma once
 
+#include "Object.h"
+#include "Culling.h"
+#include "OcclusionCulling.h"
+#include "DrawQueue.h"
+#include "ConstantRing.h"
+#include "LightClustering.h"
+#include "JobSystem.h"
+#include "TransformSystem.h"
+
 class GeometryPool;
+class MemoryTelemetry;
 struct GeoMesh;
-struct Object;
 
 // D3D11 based deferred renderer
 class DeferredRenderer11
@@ -22,6 +31,7 @@ class DeferredRenderer11
     enum class PassType
     {
         Geometry = 0,               // Render Geometry into GBuffer
+        GeometryInstanced,          // Same, for batches of parts sharing a mesh, world matrices per instance
         DirectionalLighting,        // Render directional light full screen passes
         PointLighting,              // Render point light spheres
         DebugDisplayDepth,          // Dbg rendering of depth buffer
@@ -34,10 +44,32 @@ public:
 
     const ComPtr<ID3D11Device>& GetDevice() const { return Device; }
 
-    void AddObject(const std::shared_ptr<Object>& object) { Objects.push_back(object); }
+    void AddObject(const std::shared_ptr<Object>& object);
+
+    // World space point lights, shaded through light clusters built each frame
+    void AddPointLight(const XMFLOAT3& position, float radius, const XMFLOAT3& color);
+    void ClearPointLights() { PointLights.clear(); }
+    uint32_t GetNumPointLights() const { return (uint32_t)PointLights.size(); }
 
     bool Render(FXMMATRIX view, FXMMATRIX projection, bool vsync);
 
+    // On by default. Off draws every part on its own, for comparison
+    void SetInstancingEnabled(bool enabled) { InstancingEnabled = enabled; }
+
+    // On by default. Parts outside the potentially visible set of the camera's cell (for objects
+    // that have them) are hidden before frustum & occlusion culling. Off for comparison
+    void SetPvsEnabled(bool enabled) { PvsEnabled = enabled; }
+
+    // Counters from the last Render
+    const DrawStats& GetDrawStats() const { return Stats; }
+
+    // Reports the render targets & dynamic buffers to telemetry from now on, along with each
+    // Render's draws, binds & bytes written to dynamic buffers. May be null, to stop reporting.
+    void SetMemoryTelemetry(MemoryTelemetry* telemetry);
+
+    // Incremented by each Render. Objects with visible parts get their LastUsedFrame set to it
+    uint64_t GetFrameIndex() const { return FrameIndex; }
+
 private:
     DeferredRenderer11();
     DeferredRenderer11(const DeferredRenderer11&);
@@ -55,6 +87,11 @@ private:
     void ApplyPass(PassType type, const ComPtr<ID3D11DepthStencilView>& dsv);
     void BindGeometryPool(const std::shared_ptr<GeometryPool>& pool);
     void DrawMesh(const std::shared_ptr<GeoMesh>& mesh);
+    bool MapInstanceBuffer(uint32_t count, XMFLOAT4X4** instances);
+    bool RenderPointLights(FXMMATRIX view, FXMMATRIX projection);
+    void ReportMemory();
+    bool UpdateStructuredBuffer(const void* data, uint32_t count, uint32_t stride, ComPtr<ID3D11Buffer>* buffer,
+        ComPtr<ID3D11ShaderResourceView>* srv, uint32_t* capacity);
 
 private:
     // Always nullptr. Used to clear out bindings for clean input->output or output->input transitions
@@ -65,6 +102,7 @@ private:
     ComPtr<IDXGISwapChain1>         SwapChain;
     ComPtr<ID3D11Device>            Device;
     ComPtr<ID3D11DeviceContext>     Context;
+    ComPtr<ID3D11DeviceContext1>    Context1;
     ComPtr<ID3D11Texture2D>         DepthStencilBuffer;
     ComPtr<ID3D11ShaderResourceView> DepthStencilSRV;
     ComPtr<ID3D11DepthStencilView>  DepthStencilView;
@@ -96,6 +134,52 @@ private:
 
     std::vector<std::shared_ptr<Object>> Objects;
 
+    // Every object's root & part transforms. Objects are checked for a new RootTransform each frame
+    TransformSystem                 Transforms;
+    std::vector<uint32_t>           ObjectTransforms;   // Same order as Objects
+
+    // Every part of every object, flattened as they're added
+    std::vector<Object*>            CullableObjects;
+    std::vector<Object::Part*>      CullableParts;
+    std::vector<uint32_t>           PartTransforms;
+    std::vector<uint32_t>           PartBatches;
+    std::vector<uint32_t>           PartObjects;        // Index into Objects
+    std::vector<uint32_t>           PartIndices;        // Index into its object's Parts
+
+    // Parts sharing a mesh with other parts are drawn instanced, in batches of the ones with the
+    // same material. Batch ids are handed out per mesh as parts are added
+    std::unordered_map<const GeoMesh*, uint32_t> MeshBatches;
+    std::vector<uint32_t>           BatchPartCounts;    // Parts using each batch's mesh
+    bool                            InstancingEnabled;
+
+    // Picked again by the first Render after objects are added
+    bool                            OccludersDirty;
+
+    // Frustum culling, rebuilt each frame. Kept as members to avoid reallocating
+    CullingBoxes                    PartBounds;
+    std::vector<uint32_t>           VisibleParts;
+    std::vector<uint32_t>           RangeVisible;       // Visible parts in each culling job's range
+    std::vector<uint64_t>           DrawKeys;           // Per visible part. UINT64_MAX if it can't be drawn
+    std::vector<float>              ScreenSizes;        // Per visible part, in pixels across
+
+    // Per object, the potentially visible set of the cell the camera is in. Null for all visible
+    std::vector<const uint32_t*>    ObjectCells;
+    bool                            PvsEnabled;
+
+    // Frame preparation (culling, draw keys & constants) is split into jobs on this
+    std::unique_ptr<JobSystem>      Jobs;
+
+    // Occlusion culling of the frustum culled parts, against the parts marked as occluders
+    std::unique_ptr<OcclusionBuffer> Occlusion;
+
+    // Visible parts, sorted to minimize state changes
+    DrawQueue                       GeometryDraws;
+    DrawStats                       Stats;
+    uint64_t                        FrameIndex;
+
+    MemoryTelemetry*                Telemetry;
+    uint64_t                        FrameUploadBytes;   // Written to dynamic buffers this frame
+
     // Fullscreen quad (Post-projection vertices)
     std::shared_ptr<GeoMesh>        FullscreenQuad;
 
@@ -111,6 +195,14 @@ private:
     };
     ComPtr<ID3D11Buffer>            GeometryCB;
 
+    // World matrix of each instance of the instanced draws (in InstanceSlot), rewritten each frame
+    ComPtr<ID3D11Buffer>            InstanceBuffer;
+    uint32_t                        InstanceCapacity;
+
+    // Per draw geometry constants, when the device supports binding constant buffers with offsets.
+    // Otherwise every draw updates GeometryCB
+    std::unique_ptr<ConstantRing>   GeometryConstants;
+
     static const uint32_t MAX_DLIGHTS_PER_PASS = 4;
     struct DLight
     {
@@ -130,4 +222,40 @@ private:
         XMFLOAT4X4 InvProjection;
     };
     ComPtr<ID3D11Buffer>            DLightCB;
+
+    // Same layout as the shader's StructuredBuffer. Position is in world space until uploaded
+    struct PointLight
+    {
+        XMFLOAT3 Position;
+        float Radius;
+        XMFLOAT3 Color;
+        float Pad0;
+    };
+
+    struct PLightPSConstants
+    {
+        uint32_t ClusterCounts[3];
+        float Pad0;
+        float SliceScale;
+        float SliceBias;
+        XMFLOAT2 InvViewportSize;
+        XMFLOAT4X4 InvProjection;
+    };
+    ComPtr<ID3D11Buffer>            PLightCB;
+
+    std::vector<PointLight>         PointLights;
+    std::vector<PointLight>         ViewPointLights;    // Kept as members to avoid reallocating
+    std::vector<XMFLOAT4>           ViewLightSpheres;
+    std::unique_ptr<LightClusters>  Clusters;
+
+    // Dynamic structured buffers, grown as needed
+    ComPtr<ID3D11Buffer>            ClusterBuffer;
+    ComPtr<ID3D11ShaderResourceView> ClusterSRV;
+    uint32_t                        ClusterCapacity;
+    ComPtr<ID3D11Buffer>            LightIndexBuffer;
+    ComPtr<ID3D11ShaderResourceView> LightIndexSRV;
+    uint32_t                        LightIndexCapacity;
+    ComPtr<ID3D11Buffer>            PointLightBuffer;
+    ComPtr<ID3D11ShaderResourceView> PointLightSRV;
+    uint32_t                        PointLightCapacity;
 };
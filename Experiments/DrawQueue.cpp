@@ -0,0 +1,83 @@
+#include "Precomp.h"
+#include "DrawQueue.h"
+
+uint64_t DrawQueue::MakeKey(uint32_t pass, uint32_t pool, uint32_t material, float depth)
+{
+    static const uint32_t maxDepth = (1 << DepthBits) - 1;
+    uint32_t depthBucket = (uint32_t)(min(max(depth, 0.f), 1.f) * maxDepth);
+
+    return
+        ((uint64_t)(pass & ((1 << PassBits) - 1)) << (PoolBits + MaterialBits + DepthBits)) |
+        ((uint64_t)(pool & ((1 << PoolBits) - 1)) << (MaterialBits + DepthBits)) |
+        ((uint64_t)(material & ((1 << MaterialBits) - 1)) << DepthBits) |
+        (uint64_t)depthBucket;
+}
+
+uint64_t DrawQueue::MakeBatchKey(uint32_t pass, uint32_t pool, uint32_t material, uint32_t batch)
+{
+    // Depth 0 leaves the low bits clear
+    return MakeKey(pass, pool, material, 0.f) | (uint64_t)(batch & ((1 << DepthBits) - 1));
+}
+
+void DrawQueue::Add(uint64_t key, uint32_t index)
+{
+    DrawPacket packet;
+    packet.Key = key;
+    packet.Index = index;
+    Packets.push_back(packet);
+}
+
+void DrawQueue::Sort()
+{
+    const size_t count = Packets.size();
+    if (count < 2)
+    {
+        return;
+    }
+
+    Scratch.resize(count);
+
+    // Histograms for all 8 digits in one pass over the keys
+    uint32_t histograms[8][256] = {};
+    for (auto& packet : Packets)
+    {
+        for (int d = 0; d < 8; ++d)
+        {
+            ++histograms[d][(packet.Key >> (d * 8)) & 0xFF];
+        }
+    }
+
+    DrawPacket* source = Packets.data();
+    DrawPacket* dest = Scratch.data();
+
+    for (int d = 0; d < 8; ++d)
+    {
+        uint32_t* histogram = histograms[d];
+
+        // Every key has the same digit here, so this pass wouldn't change anything
+        if (histogram[(source[0].Key >> (d * 8)) & 0xFF] == count)
+        {
+            continue;
+        }
+
+        uint32_t offsets[256];
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; ++i)
+        {
+            offsets[i] = sum;
+            sum += histogram[i];
+        }
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            dest[offsets[(source[i].Key >> (d * 8)) & 0xFF]++] = source[i];
+        }
+
+        std::swap(source, dest);
+    }
+
+    if (source != Packets.data())
+    {
+        Packets.swap(Scratch);
+    }
+}
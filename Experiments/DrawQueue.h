@@ -0,0 +1,61 @@
+#pragma once
+
+// Draws are recorded as packets with a 64 bit sort key, radix sorted, and then submitted
+// in key order so that consecutive draws can skip redundant state changes.
+// Key layout, from most to least significant:
+//   [63..60] Pass
+//   [59..44] Geometry pool
+//   [43..24] Material (texture set)
+//   [23..0]  Depth bucket, front to back. Or, for instanced passes, a batch id, so that the
+//            instances of a batch end up next to each other
+// Independent of any graphics API.
+struct DrawPacket
+{
+    uint64_t    Key;
+    uint32_t    Index;      // Caller defined, usually an index into its own draw list
+};
+
+// Per frame submission counters, and CPU time spent in each stage of the frame
+struct DrawStats
+{
+    uint32_t    Draws;
+    uint32_t    PoolBinds;
+    uint32_t    PoolBindsSkipped;
+    uint32_t    MaterialBinds;
+    uint32_t    MaterialBindsSkipped;
+    uint32_t    InstancedDraws; // Draws (included in Draws above) covering several parts
+    uint32_t    Instances;      // Parts drawn by them
+    double      CullMs;         // Transform updates, bounds & frustum culling
+    double      OcclusionMs;    // Occlusion buffer render & test
+    double      SortMs;         // Building draw keys & sorting them
+    double      SubmitMs;       // Geometry pass draws
+    double      LightingMs;     // Lighting passes, including light clustering
+    double      PresentMs;
+};
+
+class DrawQueue
+{
+public:
+    static const uint32_t PassBits = 4;
+    static const uint32_t PoolBits = 16;
+    static const uint32_t MaterialBits = 20;
+    static const uint32_t DepthBits = 24;
+
+    // depth is normalized to [0, 1] (values outside are clamped). IDs are masked to fit.
+    static uint64_t MakeKey(uint32_t pass, uint32_t pool, uint32_t material, float depth);
+
+    // Same as above, with a caller defined batch id in place of depth. Masked to fit
+    static uint64_t MakeBatchKey(uint32_t pass, uint32_t pool, uint32_t material, uint32_t batch);
+
+    void Clear() { Packets.clear(); }
+    void Add(uint64_t key, uint32_t index);
+
+    // Stable LSD radix sort on 8 bit digits. Digits that are the same in every key are skipped.
+    void Sort();
+
+    const std::vector<DrawPacket>& GetPackets() const { return Packets; }
+
+private:
+    std::vector<DrawPacket> Packets;
+    std::vector<DrawPacket> Scratch;
+};
@@ -0,0 +1,143 @@
+#include "Precomp.h"
+#include "FileWatcher.h"
+#include <wctype.h>
+
+// Notifications that don't fit are dropped, so leave room for a whole directory being rewritten
+static const uint32_t NotifyBufferBytes = 64 * 1024;
+
+std::unique_ptr<FileWatcher> FileWatcher::Create(const std::wstring& directory)
+{
+    std::unique_ptr<FileWatcher> watcher(new FileWatcher());
+    if (watcher)
+    {
+        if (watcher->Initialize(directory))
+        {
+            return watcher;
+        }
+    }
+    return nullptr;
+}
+
+FileWatcher::FileWatcher()
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+    if (Thread.joinable())
+    {
+        SetEvent(StopEvent.Get());
+        Thread.join();
+    }
+}
+
+bool FileWatcher::Initialize(const std::wstring& directory)
+{
+    Directory.Attach(CreateFile(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr));
+    if (!Directory.IsValid())
+    {
+        LogError(L"Failed to open %s for watching.", directory.c_str());
+        return false;
+    }
+
+    ChangeEvent.Attach(CreateEventEx(nullptr, nullptr, 0, EVENT_ALL_ACCESS));
+    StopEvent.Attach(CreateEventEx(nullptr, nullptr, CREATE_EVENT_MANUAL_RESET, EVENT_ALL_ACCESS));
+    if (!ChangeEvent.IsValid() || !StopEvent.IsValid())
+    {
+        LogError(L"Failed to create file watcher events.");
+        return false;
+    }
+
+    Thread = std::thread(&FileWatcher::WatchThread, this);
+    return true;
+}
+
+std::wstring FileWatcher::NormalizePath(const std::wstring& path)
+{
+    std::wstring normalized(path);
+    for (auto& c : normalized)
+    {
+        c = (c == L'\\') ? L'/' : (wchar_t)towlower(c);
+    }
+    return normalized;
+}
+
+void FileWatcher::WatchThread()
+{
+    // ReadDirectoryChangesW needs a DWORD aligned buffer
+    std::vector<DWORD> buffer(NotifyBufferBytes / sizeof(DWORD));
+
+    for (;;)
+    {
+        OVERLAPPED overlapped{};
+        overlapped.hEvent = ChangeEvent.Get();
+        if (!ReadDirectoryChangesW(Directory.Get(), buffer.data(), NotifyBufferBytes, TRUE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE, nullptr, &overlapped, nullptr))
+        {
+            LogError(L"Failed to watch for file changes.");
+            return;
+        }
+
+        HANDLE events[] = { StopEvent.Get(), ChangeEvent.Get() };
+        if (WaitForMultipleObjects(_countof(events), events, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+        {
+            // The read has to be finished with the buffer before it goes away
+            DWORD unused = 0;
+            CancelIoEx(Directory.Get(), &overlapped);
+            GetOverlappedResult(Directory.Get(), &overlapped, &unused, TRUE);
+            return;
+        }
+
+        DWORD bytes = 0;
+        if (!GetOverlappedResult(Directory.Get(), &overlapped, &bytes, FALSE))
+        {
+            LogError(L"Failed to read file changes.");
+            return;
+        }
+
+        if (bytes == 0)
+        {
+            Log(L"Too many files changed at once, some changes were missed.");
+            continue;
+        }
+
+        ULONGLONG now = GetTickCount64();
+        std::lock_guard<std::mutex> lock(Lock);
+
+        const uint8_t* p = (const uint8_t*)buffer.data();
+        for (;;)
+        {
+            const FILE_NOTIFY_INFORMATION& info = *(const FILE_NOTIFY_INFORMATION*)p;
+            if (info.Action != FILE_ACTION_REMOVED && info.Action != FILE_ACTION_RENAMED_OLD_NAME)
+            {
+                Changes[NormalizePath(std::wstring(info.FileName, info.FileNameLength / sizeof(wchar_t)))] = now;
+            }
+
+            if (info.NextEntryOffset == 0)
+            {
+                break;
+            }
+            p += info.NextEntryOffset;
+        }
+    }
+}
+
+void FileWatcher::TakeChanges(std::vector<std::wstring>* paths)
+{
+    ULONGLONG now = GetTickCount64();
+    std::lock_guard<std::mutex> lock(Lock);
+
+    for (auto it = Changes.begin(); it != Changes.end();)
+    {
+        if (now - it->second >= FileSettleMs)
+        {
+            paths->push_back(it->first);
+            it = Changes.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+// How long a file must go without changing before it's reported, so files still being written
+// (or written in several steps) aren't picked up half done
+static const uint32_t FileSettleMs = 250;
+
+// Watches a directory tree for files being written or renamed into place, on its own thread.
+// Changes to the same file are merged, and only handed out once it has settled.
+class FileWatcher : public NonCopyable
+{
+public:
+    // Returns null if the directory can't be watched
+    static std::unique_ptr<FileWatcher> Create(const std::wstring& directory);
+    ~FileWatcher();
+
+    // Appends the files that changed and have since settled, relative to the directory (see
+    // NormalizePath). Each change is only returned once.
+    void TakeChanges(std::vector<std::wstring>* paths);
+
+    // Lower case, with '/' separators, for comparing paths the way the file system does
+    static std::wstring NormalizePath(const std::wstring& path);
+
+private:
+    FileWatcher();
+    bool Initialize(const std::wstring& directory);
+    void WatchThread();
+
+    FileHandle Directory;
+    Event ChangeEvent;
+    Event StopEvent;
+    std::thread Thread;
+
+    // Normalized path to when it last changed (GetTickCount64), under Lock
+    std::mutex Lock;
+    std::map<std::wstring, ULONGLONG> Changes;
+};
@@ -0,0 +1,163 @@
+#include "Precomp.h"
+#include "FramePipeline.h"
+
+static double ElapsedMs(const LARGE_INTEGER& start, const LARGE_INTEGER& end, const LARGE_INTEGER& frequency)
+{
+    return (end.QuadPart - start.QuadPart) * 1000.0 / frequency.QuadPart;
+}
+
+std::unique_ptr<FramePipeline> FramePipeline::Create(uint32_t latency)
+{
+    std::unique_ptr<FramePipeline> pipeline(new FramePipeline());
+    if (pipeline)
+    {
+        if (pipeline->Initialize(latency))
+        {
+            return pipeline;
+        }
+    }
+    return nullptr;
+}
+
+FramePipeline::FramePipeline()
+    : NumPublished(0), NumRendered(0), Updating(false), Rendering(false), Stopped(false)
+    , UpdateWaitMs(0.0), RenderWaitMs(0.0)
+{
+    QueryPerformanceFrequency(&Frequency);
+}
+
+bool FramePipeline::Initialize(uint32_t latency)
+{
+    if (latency > MaxFrameLatency)
+    {
+        LogError(L"Frame latency must be at most %u.", MaxFrameLatency);
+        return false;
+    }
+
+    Snapshots.resize(latency + 1);
+    for (auto& snapshot : Snapshots)
+    {
+        snapshot.FrameIndex = 0;
+        snapshot.InputTime.QuadPart = 0;
+        snapshot.TimeStep = 0.0;
+        snapshot.UpdateMs = 0.0;
+        snapshot.CameraPosition = XMFLOAT3(0.f, 0.f, 0.f);
+        XMStoreFloat4x4(&snapshot.View, XMMatrixIdentity());
+        XMStoreFloat4x4(&snapshot.Projection, XMMatrixIdentity());
+        snapshot.Measured = false;
+    }
+
+    return true;
+}
+
+SceneSnapshot* FramePipeline::BeginUpdate(DWORD timeoutMs)
+{
+    assert(!Updating);
+
+    LARGE_INTEGER start, end;
+    QueryPerformanceCounter(&start);
+
+    // The snapshot being rendered still counts against the ring until EndRender
+    std::unique_lock<std::mutex> lock(Lock);
+    auto isFree = [this]() { return Stopped || NumPublished - NumRendered < Snapshots.size(); };
+    if (timeoutMs == INFINITE)
+    {
+        SnapshotFree.wait(lock, isFree);
+    }
+    else
+    {
+        SnapshotFree.wait_for(lock, std::chrono::milliseconds(timeoutMs), isFree);
+    }
+
+    QueryPerformanceCounter(&end);
+    UpdateWaitMs += ElapsedMs(start, end, Frequency);
+
+    if (Stopped || !isFree())
+    {
+        return nullptr;
+    }
+
+    Updating = true;
+    SceneSnapshot* snapshot = &Snapshots[NumPublished % Snapshots.size()];
+    snapshot->FrameIndex = NumPublished;
+    return snapshot;
+}
+
+void FramePipeline::EndUpdate()
+{
+    assert(Updating);
+    Updating = false;
+
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        if (Stopped)
+        {
+            return;
+        }
+        ++NumPublished;
+    }
+    SnapshotReady.notify_one();
+}
+
+const SceneSnapshot* FramePipeline::BeginRender()
+{
+    assert(!Rendering);
+
+    LARGE_INTEGER start, end;
+    QueryPerformanceCounter(&start);
+
+    std::unique_lock<std::mutex> lock(Lock);
+    SnapshotReady.wait(lock, [this]() { return Stopped || NumRendered < NumPublished; });
+
+    QueryPerformanceCounter(&end);
+    RenderWaitMs += ElapsedMs(start, end, Frequency);
+
+    // Drain what was published before stopping
+    if (NumRendered == NumPublished)
+    {
+        return nullptr;
+    }
+
+    Rendering = true;
+    return &Snapshots[NumRendered % Snapshots.size()];
+}
+
+void FramePipeline::EndRender()
+{
+    assert(Rendering);
+    Rendering = false;
+
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        ++NumRendered;
+    }
+    SnapshotFree.notify_one();
+}
+
+void FramePipeline::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(Lock);
+        Stopped = true;
+    }
+    SnapshotFree.notify_all();
+    SnapshotReady.notify_all();
+}
+
+bool FramePipeline::IsStopped()
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    return Stopped;
+}
+
+double FramePipeline::GetUpdateWaitMs()
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    return UpdateWaitMs;
+}
+
+double FramePipeline::GetRenderWaitMs()
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    return RenderWaitMs;
+}
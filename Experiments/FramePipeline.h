@@ -0,0 +1,82 @@
+#pragma once
+
+// Most snapshots the update thread may queue up ahead of the one being rendered
+static const uint32_t MaxFrameLatency = 3;
+
+// Everything the render thread needs to draw a frame, as of one update. Filled in by the
+// update thread, then never touched by it again until the render thread is done with it.
+struct SceneSnapshot
+{
+    uint64_t                    FrameIndex;     // Set by FramePipeline. Counts up from 0
+    LARGE_INTEGER               InputTime;      // When the update sampled input, for input to present latency
+    double                      TimeStep;       // Seconds simulated by this update
+    double                      UpdateMs;       // CPU time the update took
+
+    XMFLOAT3                    CameraPosition;
+    XMFLOAT4X4                  View;
+    XMFLOAT4X4                  Projection;
+
+    // Root transforms of the scene's objects, in the order they were added to the renderer
+    std::vector<XMFLOAT4X4>     Transforms;
+
+    // World space point lights. xyz = position, w = radius
+    std::vector<XMFLOAT4>       LightSpheres;
+    std::vector<XMFLOAT3>       LightColors;
+
+    bool                        Measured;       // Counted by the camera path benchmark
+};
+
+// Hands scene snapshots from an update thread to a render thread through a ring of
+// latency + 1 of them, so the next frames are simulated while the current one is rendered.
+// With a latency of 0 the two threads take turns (the old single threaded loop), with 1 the
+// update runs a frame ahead, and so on, trading input latency for overlap. Snapshots (and
+// their vectors) are reused round the ring, so steady state updates don't allocate.
+//
+// One thread updates and one renders. Independent of any graphics API.
+class FramePipeline : public NonCopyable
+{
+public:
+    static std::unique_ptr<FramePipeline> Create(uint32_t latency);
+
+    uint32_t GetLatency() const { return (uint32_t)Snapshots.size() - 1; }
+
+    // Update thread. Returns the next snapshot to fill in (still holding whatever was last
+    // written to it), waiting up to timeoutMs for the render thread to free one up. Returns
+    // nullptr on timeout, or once stopped.
+    SceneSnapshot* BeginUpdate(DWORD timeoutMs = INFINITE);
+    void EndUpdate();
+
+    // Render thread. Returns the oldest snapshot not yet rendered, waiting for one. Returns
+    // nullptr once stopped and everything published before then has been rendered.
+    const SceneSnapshot* BeginRender();
+    void EndRender();
+
+    // Either thread. Nothing more is published, and both sides are woken
+    void Stop();
+    bool IsStopped();
+
+    // Time each side has spent blocked on the other
+    double GetUpdateWaitMs();
+    double GetRenderWaitMs();
+
+private:
+    FramePipeline();
+    bool Initialize(uint32_t latency);
+
+    std::vector<SceneSnapshot> Snapshots;
+
+    // Snapshot i lives at Snapshots[i % size]. Updating & Rendering are only touched by their
+    // own side, everything else is shared under Lock
+    std::mutex Lock;
+    std::condition_variable SnapshotFree;
+    std::condition_variable SnapshotReady;
+    uint64_t NumPublished;
+    uint64_t NumRendered;
+    bool Updating;
+    bool Rendering;
+    bool Stopped;
+
+    LARGE_INTEGER Frequency;
+    double UpdateWaitMs;
+    double RenderWaitMs;
+};
@@ -0,0 +1,88 @@
+#include "Precomp.h"
+#include "FrameTimings.h"
+#include <stdio.h>
+
+FrameTimings::FrameTimings(const std::vector<std::wstring>& stageNames)
+    : StageNames(stageNames), NumFrames(0)
+{
+}
+
+void FrameTimings::AddFrame(const double* stageMs)
+{
+    Samples.insert(Samples.end(), stageMs, stageMs + StageNames.size());
+    ++NumFrames;
+}
+
+FrameTimings::Summary FrameTimings::Summarize(uint32_t stage) const
+{
+    Summary summary{};
+    if (NumFrames == 0)
+    {
+        return summary;
+    }
+
+    std::vector<double> sorted(NumFrames);
+    double total = 0.0;
+    for (uint32_t i = 0; i < NumFrames; ++i)
+    {
+        sorted[i] = Samples[i * StageNames.size() + stage];
+        total += sorted[i];
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest rank: the smallest sample with at least p percent of samples at or below it
+    auto percentile = [&sorted](double p)
+    {
+        size_t rank = (size_t)ceil(p / 100.0 * (double)sorted.size());
+        return sorted[max(rank, (size_t)1) - 1];
+    };
+
+    summary.Average = total / NumFrames;
+    summary.P50 = percentile(50.0);
+    summary.P95 = percentile(95.0);
+    summary.P99 = percentile(99.0);
+    summary.Max = sorted.back();
+    return summary;
+}
+
+void FrameTimings::PrintSummary(const std::wstring& title) const
+{
+    wprintf(L"%s, %u frames (ms)\n", title.c_str(), NumFrames);
+    wprintf(L"  %-12s %9s %9s %9s %9s %9s\n", L"Stage", L"Avg", L"P50", L"P95", L"P99", L"Max");
+    for (uint32_t stage = 0; stage < (uint32_t)StageNames.size(); ++stage)
+    {
+        Summary summary = Summarize(stage);
+        wprintf(L"  %-12s %9.4f %9.4f %9.4f %9.4f %9.4f\n", StageNames[stage].c_str(),
+            summary.Average, summary.P50, summary.P95, summary.P99, summary.Max);
+    }
+}
+
+bool FrameTimings::SaveCsv(const std::wstring& filename) const
+{
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, filename.c_str(), L"w") != 0 || !file)
+    {
+        LogError(L"Failed to create frame timings: %s.", filename.c_str());
+        return false;
+    }
+
+    fprintf(file, "Frame");
+    for (auto& name : StageNames)
+    {
+        fprintf(file, ",%S", name.c_str());
+    }
+    fprintf(file, "\n");
+
+    for (uint32_t i = 0; i < NumFrames; ++i)
+    {
+        fprintf(file, "%u", i);
+        for (uint32_t stage = 0; stage < (uint32_t)StageNames.size(); ++stage)
+        {
+            fprintf(file, ",%.4f", Samples[i * StageNames.size() + stage]);
+        }
+        fprintf(file, "\n");
+    }
+
+    fclose(file);
+    return true;
+}
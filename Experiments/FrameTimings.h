@@ -0,0 +1,37 @@
+#pragma once
+
+// Per frame CPU timings of a fixed set of named stages, for benchmark runs. Summarized as
+// average, median, 95th & 99th percentile and worst, and saved per frame as CSV so runs can
+// be compared between builds. Independent of any graphics API.
+class FrameTimings
+{
+public:
+    explicit FrameTimings(const std::vector<std::wstring>& stageNames);
+
+    // stageMs has one entry per stage, in the same order as the names
+    void AddFrame(const double* stageMs);
+
+    uint32_t GetNumFrames() const { return NumFrames; }
+
+    // Printed to stdout
+    void PrintSummary(const std::wstring& title) const;
+
+    // Header row of stage names, then a row per frame
+    bool SaveCsv(const std::wstring& filename) const;
+
+private:
+    struct Summary
+    {
+        double  Average;
+        double  P50;
+        double  P95;
+        double  P99;
+        double  Max;
+    };
+
+    Summary Summarize(uint32_t stage) const;
+
+    std::vector<std::wstring> StageNames;
+    std::vector<double> Samples;    // NumFrames x stages, a frame at a time
+    uint32_t NumFrames;
+};
@@ -16,6 +16,7 @@ const D3D11_INPUT_ELEMENT_DESC VertexElements[(uint32_t)VertexType::Count][16] =
         { "TANGENT", 0,     DXGI_FORMAT_R32G32B32_FLOAT,    0, sizeof(XMFLOAT3) * 2,    D3D11_INPUT_PER_VERTEX_DATA, 0 },
         { "BITANGENT", 0,   DXGI_FORMAT_R32G32B32_FLOAT,    0, sizeof(XMFLOAT3) * 3,    D3D11_INPUT_PER_VERTEX_DATA, 0 },
         { "TEXCOORD", 0,    DXGI_FORMAT_R32G32_FLOAT,       0, sizeof(XMFLOAT3) * 4,    D3D11_INPUT_PER_VERTEX_DATA, 0 },
+        { "AMBIENT", 0,     DXGI_FORMAT_R8G8B8A8_UNORM,     AmbientSlot, 0,             D3D11_INPUT_PER_VERTEX_DATA, 0 },
     },
     { // ClipSpace2DVertex
         { "POSITION", 0,    DXGI_FORMAT_R32G32_FLOAT,       0, 0,                   D3D11_INPUT_PER_VERTEX_DATA, 0 },
@@ -25,10 +26,18 @@ const D3D11_INPUT_ELEMENT_DESC VertexElements[(uint32_t)VertexType::Count][16] =
 
 const uint32_t VertexElementCount[(uint32_t)VertexType::Count] =
 {
-    5,  // StandardVertex
+    6,  // StandardVertex, and its AmbientVertex
     2,  // ClipSpace2DVertex
 };
 
+const D3D11_INPUT_ELEMENT_DESC InstanceElements[4] =
+{
+    { "WORLD", 0,   DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceSlot, 0,                       D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    { "WORLD", 1,   DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceSlot, sizeof(XMFLOAT4),        D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    { "WORLD", 2,   DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceSlot, sizeof(XMFLOAT4) * 2,    D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+    { "WORLD", 3,   DXGI_FORMAT_R32G32B32A32_FLOAT, InstanceSlot, sizeof(XMFLOAT4) * 3,    D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+};
+
 
 /////////////////////////
 // GeometryPool
@@ -46,50 +55,148 @@ std::shared_ptr<GeometryPool> GeometryPool::Create(const ComPtr<ID3D11Device>& d
     return nullptr;
 }
 
+// Pools are created from the loader's worker threads too
+static volatile LONG NextPoolId = 0;
+
 GeometryPool::GeometryPool(VertexType type)
     : Type(type)
-    , VertexCount(0)
+    , Id((uint32_t)InterlockedIncrement(&NextPoolId) - 1)
     , VertexCapacity(0)
-    , IndexCount(0)
     , IndexCapacity(0)
+    , VertexRanges(0)
+    , IndexRanges(0)
 {
 }
 
 bool GeometryPool::Initialize(const ComPtr<ID3D11Device>& device, uint32_t vertexCapacity, uint32_t indexCapacity)
+{
+    Device = device;
+    VertexCapacity = vertexCapacity;
+    IndexCapacity = indexCapacity;
+
+    if (!CreateBuffers(&VertexBuffer, &AmbientBuffer, &IndexBuffer))
+    {
+        return false;
+    }
+
+    VertexRanges = RangeAllocator(vertexCapacity);
+    IndexRanges = RangeAllocator(indexCapacity);
+
+    return true;
+}
+
+bool GeometryPool::CreateBuffers(ComPtr<ID3D11Buffer>* vertexBuffer, ComPtr<ID3D11Buffer>* ambientBuffer, ComPtr<ID3D11Buffer>* indexBuffer)
 {
     D3D11_BUFFER_DESC bd{};
     bd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-    bd.ByteWidth = VertexStride[(uint32_t)Type] * vertexCapacity;
+    bd.ByteWidth = VertexStride[(uint32_t)Type] * VertexCapacity;
     bd.StructureByteStride = VertexStride[(uint32_t)Type];
     bd.Usage = D3D11_USAGE_DEFAULT;
 
-    CheckResult(device->CreateBuffer(&bd, nullptr, &VertexBuffer));
-    VertexCapacity = vertexCapacity;
+    CheckResult(Device->CreateBuffer(&bd, nullptr, vertexBuffer->ReleaseAndGetAddressOf()));
+
+    if (Type == VertexType::Standard)
+    {
+        bd.ByteWidth = sizeof(AmbientVertex) * VertexCapacity;
+        bd.StructureByteStride = sizeof(AmbientVertex);
+
+        CheckResult(Device->CreateBuffer(&bd, nullptr, ambientBuffer->ReleaseAndGetAddressOf()));
+    }
 
     bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
-    bd.ByteWidth = sizeof(uint32_t) * indexCapacity;
+    bd.ByteWidth = sizeof(uint32_t) * IndexCapacity;
     bd.StructureByteStride = sizeof(uint32_t);
 
-    CheckResult(device->CreateBuffer(&bd, nullptr, &IndexBuffer));
-    IndexCapacity = indexCapacity;
+    CheckResult(Device->CreateBuffer(&bd, nullptr, indexBuffer->ReleaseAndGetAddressOf()));
 
     return true;
 }
 
 bool GeometryPool::ReserveRange(uint32_t vertexCount, uint32_t indexCount, uint32_t* baseVertex, uint32_t* baseIndex)
 {
-    if ((VertexCount + vertexCount > VertexCapacity) ||
-        (IndexCount + indexCount > IndexCapacity))
+    if (!VertexRanges.Allocate(vertexCount, baseVertex))
     {
         // Not enough room
         return false;
     }
 
-    *baseVertex = VertexCount;
-    *baseIndex = IndexCount;
+    if (!IndexRanges.Allocate(indexCount, baseIndex))
+    {
+        VertexRanges.Free(*baseVertex);
+        return false;
+    }
+
+    return true;
+}
+
+void GeometryPool::ReleaseRange(uint32_t baseVertex, uint32_t baseIndex)
+{
+    VertexRanges.Free(baseVertex);
+    IndexRanges.Free(baseIndex);
+}
+
+bool GeometryPool::IsFragmented() const
+{
+    uint32_t freeVertices = VertexRanges.GetCapacity() - VertexRanges.GetUsedSize();
+    uint32_t freeIndices = IndexRanges.GetCapacity() - IndexRanges.GetUsedSize();
+
+    return
+        VertexRanges.GetLargestFreeRange() < freeVertices / 2 ||
+        IndexRanges.GetLargestFreeRange() < freeIndices / 2;
+}
+
+// Copies every range of a buffer of elements of the given size into a fresh one, following the
+// moves from RangeAllocator::Compact. usedSize is the allocator's size after compacting
+static void CopyCompactedRanges(ID3D11DeviceContext* context, ID3D11Buffer* destination, ID3D11Buffer* source, uint32_t stride,
+    uint32_t usedSize, const std::vector<RangeMove>& moves)
+{
+    D3D11_BOX box{};
+    box.bottom = 1;
+    box.back = 1;
+
+    // Everything before the first move stayed in place
+    uint32_t unmoved = moves.empty() ? usedSize : moves.front().NewOffset;
+    if (unmoved > 0)
+    {
+        box.left = 0;
+        box.right = unmoved * stride;
+        context->CopySubresourceRegion(destination, 0, 0, 0, 0, source, 0, &box);
+    }
+    for (auto& move : moves)
+    {
+        box.left = move.OldOffset * stride;
+        box.right = (move.OldOffset + move.Size) * stride;
+        context->CopySubresourceRegion(destination, 0, move.NewOffset * stride, 0, 0, source, 0, &box);
+    }
+}
 
-    VertexCount += vertexCount;
-    IndexCount += indexCount;
+bool GeometryPool::Compact(std::vector<RangeMove>* vertexMoves, std::vector<RangeMove>* indexMoves)
+{
+    // Copy into fresh buffers, since copies within one buffer can't overlap
+    ComPtr<ID3D11Buffer> vertexBuffer;
+    ComPtr<ID3D11Buffer> ambientBuffer;
+    ComPtr<ID3D11Buffer> indexBuffer;
+    if (!CreateBuffers(&vertexBuffer, &ambientBuffer, &indexBuffer))
+    {
+        LogError(L"Failed to create buffers for compaction.");
+        return false;
+    }
+
+    VertexRanges.Compact(vertexMoves);
+    IndexRanges.Compact(indexMoves);
+
+    ComPtr<ID3D11DeviceContext> context;
+    Device->GetImmediateContext(&context);
+
+    CopyCompactedRanges(context.Get(), vertexBuffer.Get(), VertexBuffer.Get(), VertexStride[(uint32_t)Type], VertexRanges.GetUsedSize(), *vertexMoves);
+    if (AmbientBuffer)
+    {
+        CopyCompactedRanges(context.Get(), ambientBuffer.Get(), AmbientBuffer.Get(), (uint32_t)sizeof(AmbientVertex), VertexRanges.GetUsedSize(), *vertexMoves);
+    }
+    CopyCompactedRanges(context.Get(), indexBuffer.Get(), IndexBuffer.Get(), (uint32_t)sizeof(uint32_t), IndexRanges.GetUsedSize(), *indexMoves);
 
+    VertexBuffer = vertexBuffer;
+    AmbientBuffer = ambientBuffer;
+    IndexBuffer = indexBuffer;
     return true;
 }
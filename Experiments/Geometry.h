@@ -1,5 +1,7 @@
 #pragma once
 
+#include "RangeAllocator.h"
+
 // Types of vertex layouts
 enum class VertexType
 {
@@ -13,6 +15,15 @@ extern const uint32_t VertexStride[(uint32_t)VertexType::Count];
 extern const D3D11_INPUT_ELEMENT_DESC VertexElements[(uint32_t)VertexType::Count][16];
 extern const uint32_t VertexElementCount[(uint32_t)VertexType::Count];
 
+// Standard pools have a second vertex stream in this slot, parallel to the first, with an
+// AmbientVertex per vertex. Part of the Standard vertex elements
+static const uint32_t AmbientSlot = 1;
+
+// Per instance world matrix, as 4 rows in input slot 2. Appended to a vertex type's elements
+// for instanced draws
+static const uint32_t InstanceSlot = 2;
+extern const D3D11_INPUT_ELEMENT_DESC InstanceElements[4];
+
 // Standard vertex type used by most things.
 // TODO: We could probably optimize this a bit if we cared.
 // I'm too lazy for that right now
@@ -25,6 +36,14 @@ struct StandardVertex
     XMFLOAT2 TexCoord;
 };
 
+// Baked ambient occlusion (see ModelAmbientVertex), as R8G8B8A8_UNORM. Models without a bake
+// get their normal as the bent normal, and no occlusion
+struct AmbientVertex
+{
+    uint8_t BentNormal[3];
+    uint8_t Visibility;
+};
+
 // normalized clip space. For D3D, that's x and y in [-1, 1], with -y being down
 struct ClipSpace2DVertex
 {
@@ -35,6 +54,8 @@ struct ClipSpace2DVertex
 // A GeometryPool is a single (large) chunk of vertex buffer & index buffer memory
 // that can be shared by many meshes. This single chunk is homogenous in vertex type,
 // and is paged in/out as a unit by the OS (so batch accordingly to avoid thrash).
+// Vertex and index ranges are suballocated with RangeAllocators, so they can be released
+// and reused, and the pool compacted when free space gets too fragmented.
 class GeometryPool :
     public std::enable_shared_from_this<GeometryPool>,
     public NonCopyable
@@ -44,32 +65,54 @@ public:
 
     VertexType GetType() const { return Type; }
 
+    // Unique per pool, for sorting draws
+    uint32_t GetId() const { return Id; }
+
     uint64_t GetEstVRAMBytes() const
     {
         return 
-            VertexStride[(uint32_t)Type] * (uint64_t)VertexCapacity +
+            (VertexStride[(uint32_t)Type] + (AmbientBuffer ? sizeof(AmbientVertex) : 0)) * (uint64_t)VertexCapacity +
             sizeof(uint32_t) * (uint64_t)IndexCapacity;
     }
 
     // Try to reserve a chunk of the buffer. If successful, returns base vertex & index of the range.
     bool ReserveRange(uint32_t vertexCount, uint32_t indexCount, uint32_t* baseVertex, uint32_t* baseIndex);
 
+    // Returns a range from ReserveRange to the pool
+    void ReleaseRange(uint32_t baseVertex, uint32_t baseIndex);
+
+    bool IsEmpty() const { return VertexRanges.GetNumAllocations() == 0 && IndexRanges.GetNumAllocations() == 0; }
+
+    // True if less than half of the free space is usable by a single range
+    bool IsFragmented() const;
+
+    // Moves all ranges to the front of new buffers, copying on the GPU. Returns which ranges moved
+    // (by base vertex & index), and callers must rebase any meshes referencing them.
+    bool Compact(std::vector<RangeMove>* vertexMoves, std::vector<RangeMove>* indexMoves);
+
     const ComPtr<ID3D11Buffer>& GetVertexBuffer() const { return VertexBuffer; }
+
+    // Null unless the pool is of Standard vertices
+    const ComPtr<ID3D11Buffer>& GetAmbientBuffer() const { return AmbientBuffer; }
     const ComPtr<ID3D11Buffer>& GetIndexBuffer() const { return IndexBuffer; }
 
 private:
     GeometryPool(VertexType type);
 
     bool Initialize(const ComPtr<ID3D11Device>& device, uint32_t vertexCapacity, uint32_t indexCapacity);
+    bool CreateBuffers(ComPtr<ID3D11Buffer>* vertexBuffer, ComPtr<ID3D11Buffer>* ambientBuffer, ComPtr<ID3D11Buffer>* indexBuffer);
 
     VertexType Type;
+    uint32_t Id;
+    ComPtr<ID3D11Device> Device;
     ComPtr<ID3D11Buffer> VertexBuffer;
+    ComPtr<ID3D11Buffer> AmbientBuffer;
     ComPtr<ID3D11Buffer> IndexBuffer;
 
-    uint32_t VertexCount;
     uint32_t VertexCapacity;
-    uint32_t IndexCount;
     uint32_t IndexCapacity;
+    RangeAllocator VertexRanges;
+    RangeAllocator IndexRanges;
 };
 
 // A GeoMesh is a reference to a vertex buffer & index buffer,
@@ -0,0 +1,255 @@
+#include "Precomp.h"
+#include "JobSystem.h"
+
+struct Job
+{
+    std::function<void()>   Work;
+    volatile LONG           PendingDependencies;    // Plus one while Run is still adding them
+    volatile LONG           Finished;
+    std::vector<JobHandle>  Dependents;             // Under JobSystem::DependencyLock
+};
+
+// The system & deque of the worker running on this thread, if any
+static __declspec(thread) JobSystem* CurrentSystem = nullptr;
+static __declspec(thread) uint32_t CurrentQueue = 0;
+
+std::unique_ptr<JobSystem> JobSystem::Create(uint32_t numWorkers)
+{
+    std::unique_ptr<JobSystem> jobs(new JobSystem());
+    if (jobs)
+    {
+        if (jobs->Initialize(numWorkers))
+        {
+            return jobs;
+        }
+    }
+    return nullptr;
+}
+
+JobSystem::JobSystem()
+    : NumSleeping(0), ShuttingDown(false), QueuedJobs(0), NumSteals(0)
+{
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(SleepLock);
+        ShuttingDown = true;
+    }
+    WorkAvailable.notify_all();
+
+    for (auto& worker : Workers)
+    {
+        worker.join();
+    }
+}
+
+bool JobSystem::Initialize(uint32_t numWorkers)
+{
+    if (numWorkers == 0)
+    {
+        numWorkers = max(std::thread::hardware_concurrency(), 1u) - 1;
+    }
+
+    Queues.resize(numWorkers + 1);
+    for (auto& queue : Queues)
+    {
+        queue.reset(new WorkQueue());
+    }
+
+    for (uint32_t i = 0; i < numWorkers; ++i)
+    {
+        Workers.push_back(std::thread(&JobSystem::WorkerThread, this, i + 1));
+    }
+
+    return true;
+}
+
+JobHandle JobSystem::Run(const std::function<void()>& work, const JobHandle* dependencies, uint32_t numDependencies)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->Work = work;
+    job->PendingDependencies = 1;
+    job->Finished = 0;
+
+    if (numDependencies > 0)
+    {
+        std::lock_guard<std::mutex> lock(DependencyLock);
+        for (uint32_t i = 0; i < numDependencies; ++i)
+        {
+            const JobHandle& dependency = dependencies[i];
+            if (dependency && !dependency->Finished)
+            {
+                dependency->Dependents.push_back(job);
+                ++job->PendingDependencies;
+            }
+        }
+    }
+
+    // Whichever of this and the last dependency finishing gets here second queues it
+    if (InterlockedDecrement(&job->PendingDependencies) == 0)
+    {
+        Push(job);
+    }
+    return job;
+}
+
+JobHandle JobSystem::ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& work,
+    const JobHandle* dependencies, uint32_t numDependencies)
+{
+    grainSize = max(grainSize, 1u);
+    uint32_t numRanges = (count + grainSize - 1) / grainSize;
+    if (numRanges == 0)
+    {
+        return Run([]() {}, dependencies, numDependencies);
+    }
+
+    // Shared by the range jobs, rather than copying work into each of them
+    auto rangeWork = std::make_shared<std::function<void(uint32_t, uint32_t)>>(work);
+
+    std::vector<JobHandle> ranges(numRanges);
+    for (uint32_t i = 0; i < numRanges; ++i)
+    {
+        uint32_t begin = i * grainSize;
+        uint32_t end = min(begin + grainSize, count);
+        ranges[i] = Run([rangeWork, begin, end]() { (*rangeWork)(begin, end); }, dependencies, numDependencies);
+    }
+
+    return Run([]() {}, ranges.data(), numRanges);
+}
+
+void JobSystem::Wait(const JobHandle& job)
+{
+    while (!job->Finished)
+    {
+        JobHandle next;
+        if (FindJob(&next))
+        {
+            Execute(next);
+        }
+        else
+        {
+            // What's left is running on other threads
+            YieldProcessor();
+        }
+    }
+}
+
+void JobSystem::WorkerThread(uint32_t queue)
+{
+    CurrentSystem = this;
+    CurrentQueue = queue;
+
+    for (;;)
+    {
+        JobHandle job;
+        if (FindJob(&job))
+        {
+            Execute(job);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(SleepLock);
+        ++NumSleeping;
+        WorkAvailable.wait(lock, [this]() { return ShuttingDown || QueuedJobs > 0; });
+        --NumSleeping;
+        if (ShuttingDown)
+        {
+            return;
+        }
+    }
+}
+
+void JobSystem::Push(const JobHandle& job)
+{
+    WorkQueue& queue = *Queues[CurrentSystem == this ? CurrentQueue : 0];
+    {
+        std::lock_guard<std::mutex> lock(queue.Lock);
+        queue.Jobs.push_back(job);
+    }
+    InterlockedIncrement(&QueuedJobs);
+
+    // Taking the lock orders this against a worker checking QueuedJobs before it sleeps
+    {
+        std::lock_guard<std::mutex> lock(SleepLock);
+        if (NumSleeping == 0)
+        {
+            return;
+        }
+    }
+    WorkAvailable.notify_one();
+}
+
+bool JobSystem::FindJob(JobHandle* job)
+{
+    if (QueuedJobs == 0)
+    {
+        return false;
+    }
+
+    // Newest first from our own deque
+    uint32_t own = CurrentSystem == this ? CurrentQueue : 0;
+    {
+        WorkQueue& queue = *Queues[own];
+        std::lock_guard<std::mutex> lock(queue.Lock);
+        if (!queue.Jobs.empty())
+        {
+            *job = std::move(queue.Jobs.back());
+            queue.Jobs.pop_back();
+            InterlockedDecrement(&QueuedJobs);
+            return true;
+        }
+    }
+
+    // Then oldest first from everyone else's, starting with our neighbor so thieves spread out
+    uint32_t numQueues = (uint32_t)Queues.size();
+    for (uint32_t i = 1; i < numQueues; ++i)
+    {
+        WorkQueue& queue = *Queues[(own + i) % numQueues];
+        std::lock_guard<std::mutex> lock(queue.Lock);
+        if (!queue.Jobs.empty())
+        {
+            *job = std::move(queue.Jobs.front());
+            queue.Jobs.pop_front();
+            InterlockedDecrement(&QueuedJobs);
+            InterlockedIncrement64(&NumSteals);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::Execute(const JobHandle& job)
+{
+    job->Work();
+    job->Work = nullptr;
+
+    std::vector<JobHandle> dependents;
+    {
+        std::lock_guard<std::mutex> lock(DependencyLock);
+        job->Finished = 1;
+        dependents.swap(job->Dependents);
+    }
+
+    for (auto& dependent : dependents)
+    {
+        if (InterlockedDecrement(&dependent->PendingDependencies) == 0)
+        {
+            Push(dependent);
+        }
+    }
+}
+
+void ParallelForAndWait(JobSystem* jobs, uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& work)
+{
+    if (jobs && count > grainSize)
+    {
+        jobs->Wait(jobs->ParallelFor(count, grainSize, work));
+    }
+    else if (count > 0)
+    {
+        work(0, count);
+    }
+}
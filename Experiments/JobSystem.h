@@ -0,0 +1,70 @@
+#pragma once
+
+struct Job;
+typedef std::shared_ptr<Job> JobHandle;
+
+// Small work stealing scheduler for frame work. Each worker thread has its own deque of
+// ready jobs: it pushes and pops at the back (most recent first, while its data is still in
+// cache) and, when it runs dry, steals from the front of the others. Threads that aren't
+// workers share one more deque, and help run jobs while they wait on one.
+//
+// Jobs start once all of their dependencies have finished, so a frame can be described as a
+// graph up front and waited on once. Independent of any graphics API.
+class JobSystem : public NonCopyable
+{
+public:
+    // Starts numWorkers threads. 0 means one per core, less one for the thread that waits
+    static std::unique_ptr<JobSystem> Create(uint32_t numWorkers = 0);
+    ~JobSystem();
+
+    // Workers, plus the waiting thread
+    uint32_t GetNumThreads() const { return (uint32_t)Workers.size() + 1; }
+
+    // Runs work once every job in dependencies has finished. Null dependencies are ignored
+    JobHandle Run(const std::function<void()>& work, const JobHandle* dependencies = nullptr, uint32_t numDependencies = 0);
+
+    // Splits [0, count) into ranges of up to grainSize, calling work(begin, end) for each range
+    // as its own job. The returned job finishes once they all have.
+    JobHandle ParallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& work,
+        const JobHandle* dependencies = nullptr, uint32_t numDependencies = 0);
+
+    // Runs jobs until job has finished. Can be called from any thread, including from a job
+    void Wait(const JobHandle& job);
+
+    // Jobs taken from another thread's deque since Create
+    uint64_t GetNumSteals() const { return (uint64_t)NumSteals; }
+
+private:
+    JobSystem();
+    bool Initialize(uint32_t numWorkers);
+
+    struct WorkQueue
+    {
+        std::mutex              Lock;
+        std::deque<JobHandle>   Jobs;
+    };
+
+    void WorkerThread(uint32_t queue);
+    void Push(const JobHandle& job);
+    bool FindJob(JobHandle* job);
+    void Execute(const JobHandle& job);
+
+    // Queues[0] is shared by threads that aren't workers. Worker i owns Queues[i + 1]
+    std::vector<std::unique_ptr<WorkQueue>> Queues;
+    std::vector<std::thread> Workers;
+
+    // Guards every job's list of dependents
+    std::mutex DependencyLock;
+
+    // Idle workers sleep until something is queued
+    std::mutex SleepLock;
+    std::condition_variable WorkAvailable;
+    uint32_t NumSleeping;
+    bool ShuttingDown;
+
+    volatile LONG QueuedJobs;
+    volatile LONG64 NumSteals;
+};
+
+// ParallelFor on jobs and waits for it. With null jobs, runs the whole range on the calling thread
+void ParallelForAndWait(JobSystem* jobs, uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& work);
@@ -0,0 +1,221 @@
+#include "Precomp.h"
+#include "LightClustering.h"
+#include "JobSystem.h"
+
+// Lights per bounds job. A multiple of 4, as they're done 4 at a time
+static const uint32_t LightsPerChunk = 1024;
+
+static const uint32_t NumClusters = ClusterTilesX * ClusterTilesY * ClusterSlices;
+
+std::unique_ptr<LightClusters> LightClusters::Create()
+{
+    std::unique_ptr<LightClusters> clusters(new LightClusters());
+    if (clusters)
+    {
+        if (clusters->Initialize())
+        {
+            return clusters;
+        }
+    }
+    return nullptr;
+}
+
+LightClusters::LightClusters()
+    : Lights(nullptr), NumLights(0), NearZ(0.f), FarZ(0.f), ProjectionX(0.f), ProjectionY(0.f)
+    , SliceScale(0.f), SliceBias(0.f), NumDropped(0)
+{
+}
+
+bool LightClusters::Initialize()
+{
+    ClusterLists.resize(NumClusters);
+    Clusters.resize(NumClusters);
+    return true;
+}
+
+void LightClusters::Build(const XMFLOAT4* lights, uint32_t numLights, CXMMATRIX projection, JobSystem* jobs)
+{
+    Lights = lights;
+    NumLights = numLights;
+
+    // Right handed perspective: z' = z * A + B, w' = -z, with A = f / (n - f) & B = n * f / (n - f)
+    XMFLOAT4X4 proj;
+    XMStoreFloat4x4(&proj, projection);
+    ProjectionX = proj._11;
+    ProjectionY = proj._22;
+    NearZ = proj._43 / proj._33;
+    FarZ = fabsf(proj._33 + 1.f) > 1e-6f ? proj._43 / (proj._33 + 1.f) : NearZ * 1e6f;
+
+    float range = log2f(FarZ / NearZ);
+    SliceScale = (float)ClusterSlices / range;
+    SliceBias = -(float)ClusterSlices * log2f(NearZ) / range;
+
+    Bounds.resize(NumLights);
+    ParallelForAndWait(jobs, NumLights, LightsPerChunk, [this](uint32_t begin, uint32_t end)
+    {
+        ComputeBounds(begin, end);
+    });
+    ParallelForAndWait(jobs, ClusterSlices, 1, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t slice = begin; slice < end; ++slice)
+        {
+            AssignSlice(slice);
+        }
+    });
+
+    // Prefix sum the counts serially (it's only a few thousand clusters), then copy in parallel
+    uint32_t offset = 0;
+    NumDropped = 0;
+    for (uint32_t i = 0; i < NumClusters; ++i)
+    {
+        uint32_t count = (uint32_t)ClusterLists[i].size();
+        if (count > MaxLightsPerCluster)
+        {
+            NumDropped += count - MaxLightsPerCluster;
+            count = MaxLightsPerCluster;
+        }
+
+        Clusters[i].Offset = offset;
+        Clusters[i].Count = count;
+        offset += count;
+    }
+
+    LightIndices.resize(offset);
+    ParallelForAndWait(jobs, ClusterSlices, 1, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t slice = begin; slice < end; ++slice)
+        {
+            CompactSlice(slice);
+        }
+    });
+}
+
+void LightClusters::ComputeBounds(uint32_t first, uint32_t last)
+{
+    const XMVECTOR nearZ = XMVectorReplicate(NearZ);
+    const XMVECTOR farZ = XMVectorReplicate(FarZ);
+    const XMVECTOR projX = XMVectorReplicate(ProjectionX);
+    const XMVECTOR projY = XMVectorReplicate(ProjectionY);
+    const XMVECTOR sliceScale = XMVectorReplicate(SliceScale);
+    const XMVECTOR sliceBias = XMVectorReplicate(SliceBias);
+    const XMVECTOR maxTile = XMVectorSet((float)(ClusterTilesX - 1), (float)(ClusterTilesY - 1), (float)(ClusterSlices - 1), 0.f);
+    const XMVECTOR zero = XMVectorZero();
+    const XMVECTOR one = XMVectorSplatOne();
+    const XMVECTOR halfTilesX = XMVectorReplicate(0.5f * ClusterTilesX);
+    const XMVECTOR halfTilesY = XMVectorReplicate(0.5f * ClusterTilesY);
+
+    for (uint32_t i = first; i < last; i += 4)
+    {
+        // The tail is padded with empty lights, which end up culled (they're behind the near plane)
+        XMFLOAT4 padded[4];
+        const XMFLOAT4* src = Lights + i;
+        uint32_t count = min(last - i, 4u);
+        if (count < 4)
+        {
+            ZeroMemory(padded, sizeof(padded));
+            memcpy(padded, src, count * sizeof(XMFLOAT4));
+            src = padded;
+        }
+
+        // Transpose to x, y, z & radius of 4 lights
+        XMMATRIX m = XMMatrixTranspose(XMMATRIX(
+            XMLoadFloat4(&src[0]), XMLoadFloat4(&src[1]), XMLoadFloat4(&src[2]), XMLoadFloat4(&src[3])));
+        XMVECTOR x = m.r[0];
+        XMVECTOR y = m.r[1];
+        XMVECTOR depth = XMVectorNegate(m.r[2]);
+        XMVECTOR radius = m.r[3];
+
+        XMVECTOR minDepth = XMVectorMax(depth - radius, nearZ);
+        XMVECTOR maxDepth = XMVectorMin(depth + radius, farZ);
+
+        // Screen bounds of the light's view space box. Each edge is divided by the depth that
+        // pushes it furthest out, which is the near side of the box when the edge is off center.
+        XMVECTOR minX = x - radius;
+        XMVECTOR maxX = x + radius;
+        XMVECTOR minY = y - radius;
+        XMVECTOR maxY = y + radius;
+        XMVECTOR ndcMinX = minX * projX / XMVectorSelect(maxDepth, minDepth, XMVectorLess(minX, zero));
+        XMVECTOR ndcMaxX = maxX * projX / XMVectorSelect(maxDepth, minDepth, XMVectorGreater(maxX, zero));
+        XMVECTOR ndcMinY = minY * projY / XMVectorSelect(maxDepth, minDepth, XMVectorLess(minY, zero));
+        XMVECTOR ndcMaxY = maxY * projY / XMVectorSelect(maxDepth, minDepth, XMVectorGreater(maxY, zero));
+
+        XMVECTOR culled = XMVectorGreater(minDepth, maxDepth);
+        culled = XMVectorOrInt(culled, XMVectorGreater(ndcMinX, one));
+        culled = XMVectorOrInt(culled, XMVectorLess(ndcMaxX, -one));
+        culled = XMVectorOrInt(culled, XMVectorGreater(ndcMinY, one));
+        culled = XMVectorOrInt(culled, XMVectorLess(ndcMaxY, -one));
+
+        // Tile y = 0 is the top, so the y range flips
+        XMVECTOR tileMinX = XMVectorFloor((ndcMinX + one) * halfTilesX);
+        XMVECTOR tileMaxX = XMVectorFloor((ndcMaxX + one) * halfTilesX);
+        XMVECTOR tileMinY = XMVectorFloor((one - ndcMaxY) * halfTilesY);
+        XMVECTOR tileMaxY = XMVectorFloor((one - ndcMinY) * halfTilesY);
+        XMVECTOR sliceMin = XMVectorFloor(XMVectorLog(minDepth) * sliceScale + sliceBias);
+        XMVECTOR sliceMax = XMVectorFloor(XMVectorLog(maxDepth) * sliceScale + sliceBias);
+
+        XMFLOAT4A minXs, maxXs, minYs, maxYs, minZs, maxZs, culls;
+        XMStoreFloat4A(&minXs, XMVectorClamp(tileMinX, zero, XMVectorSplatX(maxTile)));
+        XMStoreFloat4A(&maxXs, XMVectorClamp(tileMaxX, zero, XMVectorSplatX(maxTile)));
+        XMStoreFloat4A(&minYs, XMVectorClamp(tileMinY, zero, XMVectorSplatY(maxTile)));
+        XMStoreFloat4A(&maxYs, XMVectorClamp(tileMaxY, zero, XMVectorSplatY(maxTile)));
+        XMStoreFloat4A(&minZs, XMVectorClamp(sliceMin, zero, XMVectorSplatZ(maxTile)));
+        XMStoreFloat4A(&maxZs, XMVectorClamp(sliceMax, zero, XMVectorSplatZ(maxTile)));
+        XMStoreFloat4A(&culls, XMVectorSelect(zero, one, culled));
+
+        const float* lanes[7] = { &minXs.x, &maxXs.x, &minYs.x, &maxYs.x, &minZs.x, &maxZs.x, &culls.x };
+        for (uint32_t j = 0; j < count; ++j)
+        {
+            LightBounds& bounds = Bounds[i + j];
+            bounds.MinX = (uint16_t)lanes[0][j];
+            bounds.MaxX = (uint16_t)lanes[1][j];
+            bounds.MinY = (uint16_t)lanes[2][j];
+            bounds.MaxY = (uint16_t)lanes[3][j];
+            bounds.MinZ = (uint16_t)lanes[4][j];
+            bounds.MaxZ = (uint16_t)lanes[5][j];
+            if (lanes[6][j] != 0.f)
+            {
+                bounds.MinZ = 1;
+                bounds.MaxZ = 0;
+            }
+        }
+    }
+}
+
+void LightClusters::AssignSlice(uint32_t slice)
+{
+    std::vector<uint32_t>* lists = &ClusterLists[slice * ClusterTilesX * ClusterTilesY];
+    for (uint32_t i = 0; i < ClusterTilesX * ClusterTilesY; ++i)
+    {
+        lists[i].clear();
+    }
+
+    for (uint32_t light = 0; light < NumLights; ++light)
+    {
+        const LightBounds& bounds = Bounds[light];
+        if (slice < bounds.MinZ || slice > bounds.MaxZ)
+        {
+            continue;
+        }
+
+        for (uint32_t y = bounds.MinY; y <= bounds.MaxY; ++y)
+        {
+            for (uint32_t x = bounds.MinX; x <= bounds.MaxX; ++x)
+            {
+                lists[y * ClusterTilesX + x].push_back(light);
+            }
+        }
+    }
+}
+
+void LightClusters::CompactSlice(uint32_t slice)
+{
+    uint32_t first = slice * ClusterTilesX * ClusterTilesY;
+    for (uint32_t i = first; i < first + ClusterTilesX * ClusterTilesY; ++i)
+    {
+        const ClusterRange& cluster = Clusters[i];
+        if (cluster.Count > 0)
+        {
+            memcpy(&LightIndices[cluster.Offset], ClusterLists[i].data(), cluster.Count * sizeof(uint32_t));
+        }
+    }
+}
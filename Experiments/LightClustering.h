@@ -0,0 +1,76 @@
+#pragma once
+
+// Cluster grid. Tiles split the screen, and slices split view depth exponentially
+static const uint32_t ClusterTilesX = 16;
+static const uint32_t ClusterTilesY = 9;
+static const uint32_t ClusterSlices = 24;
+
+// Bounds the cost of shading any one pixel. Extra lights in a cluster are dropped
+static const uint32_t MaxLightsPerCluster = 256;
+
+class JobSystem;
+
+// Range of a cluster's lights within the light index list
+struct ClusterRange
+{
+    uint32_t    Offset;
+    uint32_t    Count;
+};
+
+// Bins point lights into a froxel grid, so each pixel only shades the lights whose bounds
+// touch its cluster. Light bounds are computed 4 at a time with SIMD, then clusters are
+// filled a slice per job. Independent of any graphics API.
+class LightClusters : public NonCopyable
+{
+public:
+    static std::unique_ptr<LightClusters> Create();
+
+    // lights are view space spheres (xyz = center, w = radius), looking down -Z. projection
+    // must be a symmetric, right handed perspective projection. jobs may be null, to build on
+    // the calling thread.
+    void Build(const XMFLOAT4* lights, uint32_t numLights, CXMMATRIX projection, JobSystem* jobs);
+
+    // ClusterTilesX * ClusterTilesY * ClusterSlices entries, x fastest, then y, then slice.
+    // Tile y = 0 is the top of the screen.
+    const std::vector<ClusterRange>& GetClusters() const { return Clusters; }
+    const std::vector<uint32_t>& GetLightIndices() const { return LightIndices; }
+
+    // slice = log2(view depth) * scale + bias
+    float GetSliceScale() const { return SliceScale; }
+    float GetSliceBias() const { return SliceBias; }
+
+    uint32_t GetNumDroppedLights() const { return NumDropped; }
+
+private:
+    LightClusters();
+
+    bool Initialize();
+
+    // Cluster range touched by a light. Empty (MinZ > MaxZ) when it's outside the frustum
+    struct LightBounds
+    {
+        uint16_t    MinX, MaxX;
+        uint16_t    MinY, MaxY;
+        uint16_t    MinZ, MaxZ;
+    };
+
+    void ComputeBounds(uint32_t first, uint32_t last);
+    void AssignSlice(uint32_t slice);
+    void CompactSlice(uint32_t slice);
+
+private:
+    const XMFLOAT4*             Lights;
+    uint32_t                    NumLights;
+    float                       NearZ;
+    float                       FarZ;
+    float                       ProjectionX;    // Projection scale of x & y
+    float                       ProjectionY;
+    float                       SliceScale;
+    float                       SliceBias;
+
+    std::vector<LightBounds>    Bounds;
+    std::vector<std::vector<uint32_t>> ClusterLists;    // Kept to reuse their memory
+    std::vector<ClusterRange>   Clusters;
+    std::vector<uint32_t>       LightIndices;
+    uint32_t                    NumDropped;
+};
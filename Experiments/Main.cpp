@@ -4,6 +4,12 @@
 #include "DeferredRenderer11.h"
 #include "ContentLoader.h"
 #include "Renderer.h"
+#include "Benchmark.h"
+#include "CameraPath.h"
+#include "FrameTimings.h"
+#include "FramePipeline.h"
+#include "MemoryTelemetry.h"
+#include <random>
 
 // Constants
 static const wchar_t ClassName[] = L"Experiments Test Application";
@@ -16,6 +22,16 @@ static const float CameraMoveSpeed = 4.f;
 static const float CameraTurnSpeed = 0.025f;
 static const float MouseTurnSpeed = 0.005f;
 static const bool VSyncEnabled = true;
+static const wchar_t ContentRoot[] = L"../ProcessedContent/";
+static const wchar_t ModelFilename[] = L"crytek-sponza/sponza.model";
+static const wchar_t CameraPathFilename[] = L"CameraPath.txt";
+static const wchar_t FrameTimesFilename[] = L"FrameTimes.csv";
+static const wchar_t MemoryTelemetryFilename[] = L"MemoryTelemetry.json";
+static const uint64_t UploadBytesPerFrame = 32 * 1024 * 1024;
+static const uint32_t NumDemoLights = 1024;
+static const uint32_t DefaultFrameLatency = 1;
+static const uint32_t DefaultStressInstances = 50000;
+static const DWORD MessagePollMs = 4;
 
 // Application variables
 static HINSTANCE Instance;
@@ -25,11 +41,133 @@ static HWND Window;
 static bool Initialize();
 static void Shutdown();
 static LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
+static bool TakeArgument(std::string* arguments, const char* flag, uint32_t* value);
+#ifndef ENABLE_DX12_SUPPORT
+static bool GetLevelBounds(const Object* level, const XMFLOAT4X4& rootTransform, XMFLOAT3* minCorner, XMFLOAT3* maxCorner);
+static void GetDemoLights(const Object* level, const XMFLOAT4X4& rootTransform, std::vector<XMFLOAT4>* spheres, std::vector<XMFLOAT3>* colors);
+static void GetStressInstances(const Object* level, uint32_t count, std::vector<std::shared_ptr<Object>>* instances);
+#endif
 
 // Entry point
 _Use_decl_annotations_
-int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
+int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR commandLine, int)
 {
+    // Headless benchmarks. These exit without creating a window
+    if (strncmp(commandLine, "-benchcull", 10) == 0)
+    {
+        uint32_t numParts = 10000;
+        sscanf_s(commandLine + 10, "%u", &numParts);
+        return RunCullingBenchmark(numParts, 1000) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchconstants", 15) == 0)
+    {
+        uint32_t drawsPerFrame = 10000;
+        sscanf_s(commandLine + 15, "%u", &drawsPerFrame);
+        return RunConstantsBenchmark(drawsPerFrame, 1000) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchocclusion", 15) == 0)
+    {
+        // Optional camera path, as recorded with F9
+        std::string cameraPath(commandLine + 15);
+        cameraPath.erase(0, cameraPath.find_first_not_of(' '));
+        return RunOcclusionBenchmark(ContentRoot, ModelFilename, std::wstring(cameraPath.begin(), cameraPath.end())) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchlights", 12) == 0)
+    {
+        uint32_t frames = 100;
+        sscanf_s(commandLine + 12, "%u", &frames);
+        return RunLightClusteringBenchmark(frames) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchpath-null", 15) == 0 || strncmp(commandLine, "-benchpath-software", 19) == 0)
+    {
+        // Same playback as -benchpath below, without a device. Optional camera path
+        bool software = strncmp(commandLine, "-benchpath-software", 19) == 0;
+        std::string cameraPath(commandLine + (software ? 19 : 15));
+        cameraPath.erase(0, cameraPath.find_first_not_of(' '));
+        return RunCameraPathBenchmark(ContentRoot, ModelFilename, std::wstring(cameraPath.begin(), cameraPath.end()),
+            software ? BenchmarkBackend::Software : BenchmarkBackend::Null, FrameTimesFilename) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchjobs", 10) == 0)
+    {
+        uint32_t numParts = 100000;
+        sscanf_s(commandLine + 10, "%u", &numParts);
+        return RunJobScalingBenchmark(numParts, 100) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchpipeline", 14) == 0)
+    {
+        uint32_t frames = 600;
+        sscanf_s(commandLine + 14, "%u", &frames);
+        return RunFramePipelineBenchmark(frames) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchbvh", 9) == 0)
+    {
+        return RunBvhBenchmark(ContentRoot, ModelFilename) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchbrdf", 10) == 0)
+    {
+        uint32_t numSamples = 1000000;
+        sscanf_s(commandLine + 10, "%u", &numSamples);
+        return RunBrdfBenchmark(numSamples, 100) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchranges", 12) == 0)
+    {
+        uint32_t operations = 1000000;
+        sscanf_s(commandLine + 12, "%u", &operations);
+        return RunRangeAllocatorBenchmark(operations) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchstreaming", 15) == 0)
+    {
+        uint32_t frames = 1000;
+        sscanf_s(commandLine + 15, "%u", &frames);
+        return RunTextureStreamingBenchmark(frames) ? 0 : -1;
+    }
+    if (strncmp(commandLine, "-benchsoftware", 14) == 0)
+    {
+        // Optional bitmap to save the first frame to
+        std::string imageFilename(commandLine + 14);
+        imageFilename.erase(0, imageFilename.find_first_not_of(' '));
+        return RunSoftwareRenderBenchmark(ContentRoot, ModelFilename, std::wstring(imageFilename.begin(), imageFilename.end())) ? 0 : -1;
+    }
+
+    // Optional, anywhere after any flag below: how many frames the update may run ahead of rendering
+    std::string arguments(commandLine);
+    uint32_t frameLatency = DefaultFrameLatency;
+    TakeArgument(&arguments, "-latency", &frameLatency);
+
+    // Optional, anywhere: copies of one of the level's parts added once it's in, to stress draw
+    // submission. And turning instancing off, to compare against
+    uint32_t numStressInstances = DefaultStressInstances;
+    if (!TakeArgument(&arguments, "-stressinstances", &numStressInstances))
+    {
+        numStressInstances = 0;
+    }
+    bool instancing = !TakeArgument(&arguments, "-noinstancing", nullptr);
+
+    // Optional, anywhere: draw parts even when the baked visibility says they can't be seen from
+    // the camera's cell, to compare against
+    bool pvs = !TakeArgument(&arguments, "-nopvs", nullptr);
+
+    // Plays a camera path (a recorded one, or the default loop) a key per frame with vsync off
+    // and no input, then prints frame time statistics, saves them and exits
+    bool benchmarking = false;
+    std::vector<CameraKey> benchmarkPath;
+    if (strncmp(arguments.c_str(), "-benchpath", 10) == 0)
+    {
+        std::string cameraPath(arguments.c_str() + 10);
+        cameraPath.erase(0, cameraPath.find_first_not_of(' '));
+        cameraPath.erase(cameraPath.find_last_not_of(' ') + 1);
+        if (cameraPath.empty())
+        {
+            GetDefaultCameraPath(600, &benchmarkPath);
+        }
+        else if (!LoadCameraPath(std::wstring(cameraPath.begin(), cameraPath.end()), &benchmarkPath))
+        {
+            assert(false);
+            return -1;
+        }
+        benchmarking = true;
+    }
+
     Instance = instance;
     if (!Initialize())
     {
@@ -37,6 +175,11 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
         return -1;
     }
 
+#ifndef ENABLE_DX12_SUPPORT
+    // Reported to by the renderer & content loader, so it outlives both
+    MemoryTelemetry memoryTelemetry;
+#endif
+
     // Initialize graphics
 #ifdef ENABLE_DX12_SUPPORT
     std::unique_ptr<Renderer> renderer(Renderer::Create(Window));
@@ -50,24 +193,46 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
         return -4;
     }
 
+#ifndef ENABLE_DX12_SUPPORT
+    renderer->SetInstancingEnabled(instancing);
+    renderer->SetPvsEnabled(pvs);
+    renderer->SetMemoryTelemetry(&memoryTelemetry);
+#endif
+
 #ifdef ENABLE_DX12_SUPPORT
-    if (!renderer->AddMeshes(L"../ProcessedContent/", L"crytek-sponza/sponza.model"))
+    if (!renderer->AddMeshes(ContentRoot, ModelFilename))
     {
         assert(false);
         return -5;
     }
 #else
-    std::shared_ptr<ContentLoader> contentLoader = std::make_shared<ContentLoader>(renderer->GetDevice(), L"../ProcessedContent/");
+    std::shared_ptr<ContentLoader> contentLoader = std::make_shared<ContentLoader>(renderer->GetDevice(), ContentRoot);
+    contentLoader->SetMemoryTelemetry(&memoryTelemetry);
 
-    std::shared_ptr<Object> level;
-    if (!contentLoader->LoadObject(L"crytek-sponza/sponza.model", &level))
+    // Edits to processed content show up without restarting. Not while benchmarking, as reloads
+    // would be timed
+    if (!benchmarking && !contentLoader->EnableHotReload())
+    {
+        LogError(L"Hot reloading is unavailable.");
+    }
+
+    // The level streams in over the first few frames (see ProcessUploads below)
+    std::shared_ptr<ObjectLoad> levelLoad = contentLoader->LoadObjectAsync(ModelFilename);
+    if (levelLoad->Status == LoadStatus::Failed)
     {
         assert(false);
         return -5;
     }
-    renderer->AddObject(level);
 #endif
 
+    // This thread owns the window, and simulates each frame into a snapshot for the render thread
+    std::unique_ptr<FramePipeline> pipeline(FramePipeline::Create(frameLatency));
+    if (!pipeline)
+    {
+        assert(false);
+        return -6;
+    }
+
     ShowWindow(Window, SW_SHOW);
     UpdateWindow(Window);
 
@@ -76,6 +241,7 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
     LARGE_INTEGER currTime {};
     LARGE_INTEGER frequency {};
     QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&lastTime);
 
     // TODO: Replace with something better as needed
 
@@ -96,7 +262,168 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
         NearClip,
         FarClip);
 
-    wchar_t caption[200] = {};
+    wchar_t caption[256] = {};
+
+    // Camera path recording, toggled with F9
+    std::vector<CameraKey> recordedPath;
+    bool recording = false;
+    bool recordKeyDown = false;
+#ifndef ENABLE_DX12_SUPPORT
+    bool memoryKeyDown = false;
+#endif
+
+    // Simulated scene, copied into each snapshot
+    std::vector<XMFLOAT4X4> objectTransforms;
+    std::vector<XMFLOAT4> lightSpheres;
+    std::vector<XMFLOAT3> lightColors;
+
+    // Sent back by the render thread, for the caption and to start benchmark playback
+    struct RenderFeedback
+    {
+        std::mutex          Lock;
+        bool                LevelLoaded;
+        std::shared_ptr<Object> Level;
+        XMFLOAT4X4          LevelTransform;     // As loaded. The render thread owns Level's from then on
+#ifndef ENABLE_DX12_SUPPORT
+        DrawStats           Stats;
+        TextureStreamStats  TextureStats;
+#endif
+    } feedback;
+#ifdef ENABLE_DX12_SUPPORT
+    feedback.LevelLoaded = true;
+#else
+    feedback.LevelLoaded = false;
+    ZeroMemory(&feedback.Stats, sizeof(feedback.Stats));
+    ZeroMemory(&feedback.TextureStats, sizeof(feedback.TextureStats));
+#endif
+#ifndef ENABLE_DX12_SUPPORT
+    bool levelAdded = false;
+#endif
+
+    // Only measured frames are recorded, which start once the level is in. The render thread
+    // adds them, and is done with them once joined
+#ifdef ENABLE_DX12_SUPPORT
+    enum BenchmarkStage { Update, Wait, Frame, NumBenchmarkStages };
+    FrameTimings benchmarkTimings({ L"Update", L"Wait", L"Frame" });
+#else
+    enum BenchmarkStage { Update, Wait, Uploads, Cull, Occlusion, Sort, Submit, Lighting, Present, Residency, Frame, NumBenchmarkStages };
+    FrameTimings benchmarkTimings({ L"Update", L"Wait", L"Uploads", L"Cull", L"Occlusion", L"Sort", L"Submit", L"Lighting", L"Present", L"Residency", L"Frame" });
+#endif
+    uint32_t benchmarkFrame = 0;
+    bool vsync = VSyncEnabled && !benchmarking;
+
+    // Renders snapshots until the pipeline is stopped. Frame is the time between the end of
+    // one rendered frame and the next, so it includes waiting on the update thread.
+    std::thread renderThread([&]()
+    {
+        LARGE_INTEGER lastFrameEnd {};
+#ifndef ENABLE_DX12_SUPPORT
+        std::vector<std::shared_ptr<Object>> sceneObjects;
+#endif
+        for (;;)
+        {
+            LARGE_INTEGER waitStart {};
+            LARGE_INTEGER frameStart {};
+            LARGE_INTEGER frameEnd {};
+            QueryPerformanceCounter(&waitStart);
+            const SceneSnapshot* snapshot = pipeline->BeginRender();
+            if (!snapshot)
+            {
+                break;
+            }
+            QueryPerformanceCounter(&frameStart);
+
+#ifdef ENABLE_DX12_SUPPORT
+            renderer->Render(XMLoadFloat3(&snapshot->CameraPosition), XMLoadFloat4x4(&snapshot->View), XMLoadFloat4x4(&snapshot->Projection), vsync);
+
+            QueryPerformanceCounter(&frameEnd);
+            double stageMs[NumBenchmarkStages] = {};
+#else
+            LARGE_INTEGER uploadsEnd {};
+            LARGE_INTEGER renderEnd {};
+
+            contentLoader->ProcessUploads(UploadBytesPerFrame);
+            if (levelLoad && levelLoad->Status == LoadStatus::Failed)
+            {
+                assert(false);
+                levelLoad = nullptr;
+
+                std::lock_guard<std::mutex> lock(feedback.Lock);
+                feedback.LevelLoaded = true;
+            }
+            else if (levelLoad && levelLoad->Result)
+            {
+                renderer->AddObject(levelLoad->Result);
+                sceneObjects.push_back(levelLoad->Result);
+
+                // Static, so the update thread doesn't need to know about them
+                std::vector<std::shared_ptr<Object>> stressInstances;
+                GetStressInstances(levelLoad->Result.get(), numStressInstances, &stressInstances);
+                for (auto& instance : stressInstances)
+                {
+                    renderer->AddObject(instance);
+                }
+
+                std::lock_guard<std::mutex> lock(feedback.Lock);
+                feedback.Level = levelLoad->Result;
+                feedback.LevelTransform = levelLoad->Result->RootTransform;
+                feedback.LevelLoaded = true;
+                levelLoad = nullptr;
+            }
+
+            // The update thread only learns about objects once they're in, so it may not have them yet
+            uint32_t numTransforms = min((uint32_t)snapshot->Transforms.size(), (uint32_t)sceneObjects.size());
+            for (uint32_t i = 0; i < numTransforms; ++i)
+            {
+                sceneObjects[i]->RootTransform = snapshot->Transforms[i];
+            }
+
+            renderer->ClearPointLights();
+            for (uint32_t i = 0; i < (uint32_t)snapshot->LightSpheres.size(); ++i)
+            {
+                const XMFLOAT4& sphere = snapshot->LightSpheres[i];
+                renderer->AddPointLight(XMFLOAT3(sphere.x, sphere.y, sphere.z), sphere.w, snapshot->LightColors[i]);
+            }
+            QueryPerformanceCounter(&uploadsEnd);
+
+            renderer->Render(XMLoadFloat4x4(&snapshot->View), XMLoadFloat4x4(&snapshot->Projection), vsync);
+            QueryPerformanceCounter(&renderEnd);
+
+            contentLoader->UpdateResidency(renderer->GetFrameIndex());
+            memoryTelemetry.EndFrame();
+            QueryPerformanceCounter(&frameEnd);
+
+            // The renderer times its own stages
+            const DrawStats& frameStats = renderer->GetDrawStats();
+            double stageMs[NumBenchmarkStages] = {};
+            stageMs[Uploads] = (uploadsEnd.QuadPart - frameStart.QuadPart) * 1000.0 / frequency.QuadPart;
+            stageMs[Cull] = frameStats.CullMs;
+            stageMs[Occlusion] = frameStats.OcclusionMs;
+            stageMs[Sort] = frameStats.SortMs;
+            stageMs[Submit] = frameStats.SubmitMs;
+            stageMs[Lighting] = frameStats.LightingMs;
+            stageMs[Present] = frameStats.PresentMs;
+            stageMs[Residency] = (frameEnd.QuadPart - renderEnd.QuadPart) * 1000.0 / frequency.QuadPart;
+
+            {
+                std::lock_guard<std::mutex> lock(feedback.Lock);
+                feedback.Stats = frameStats;
+                feedback.TextureStats = contentLoader->GetTextureStats();
+            }
+#endif
+            if (snapshot->Measured)
+            {
+                LARGE_INTEGER& frameBegin = lastFrameEnd.QuadPart ? lastFrameEnd : waitStart;
+                stageMs[Update] = snapshot->UpdateMs;
+                stageMs[Wait] = (frameStart.QuadPart - waitStart.QuadPart) * 1000.0 / frequency.QuadPart;
+                stageMs[Frame] = (frameEnd.QuadPart - frameBegin.QuadPart) * 1000.0 / frequency.QuadPart;
+                benchmarkTimings.AddFrame(stageMs);
+            }
+            lastFrameEnd = frameEnd;
+
+            pipeline->EndRender();
+        }
+    });
 
     // Main loop
     MSG msg {};
@@ -109,14 +436,38 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
         }
         else
         {
-            // Idle, measure time and produce a frame
-            QueryPerformanceCounter(&currTime);
-            if (lastTime.QuadPart == 0)
+            // Idle. Wait for the render thread to free up a snapshot, but keep the messages flowing
+            SceneSnapshot* snapshot = pipeline->BeginUpdate(MessagePollMs);
+            if (!snapshot)
             {
-                lastTime.QuadPart = currTime.QuadPart;
                 continue;
             }
 
+            // Measure time and produce a frame
+            QueryPerformanceCounter(&currTime);
+
+            bool levelLoaded = false;
+#ifndef ENABLE_DX12_SUPPORT
+            DrawStats stats;
+            TextureStreamStats textureStats;
+#endif
+            {
+                std::lock_guard<std::mutex> lock(feedback.Lock);
+                levelLoaded = feedback.LevelLoaded;
+#ifndef ENABLE_DX12_SUPPORT
+                stats = feedback.Stats;
+                textureStats = feedback.TextureStats;
+
+                if (feedback.Level && !levelAdded)
+                {
+                    objectTransforms.push_back(feedback.LevelTransform);
+                    GetDemoLights(feedback.Level.get(), feedback.LevelTransform, &lightSpheres, &lightColors);
+                    levelAdded = true;
+                }
+#endif
+            }
+            bool playingBenchmark = benchmarking && levelLoaded;
+
             // Compute time step from last frame until now
             double timeStep = (double)(currTime.QuadPart - lastTime.QuadPart) / (double)frequency.QuadPart;
 
@@ -196,22 +547,113 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
                 lastMousePos = curMousePos;
             }
 
+            if (playingBenchmark)
+            {
+                // Input is ignored while playing back
+                const CameraKey& key = benchmarkPath[benchmarkFrame];
+                position = XMLoadFloat3(&key.Position);
+                yaw = key.Yaw;
+                pitch = key.Pitch;
+            }
+
             forward = XMVector3TransformNormal(XMVectorSet(0.f, 0.f, -1.f, 0.f), XMMatrixRotationY(yaw));
             right = XMVector3Cross(forward, XMVectorSet(0.f, 1.f, 0.f, 0.f));
             up = XMVector3TransformNormal(XMVectorSet(0.f, 1.f, 0.f, 0.f), XMMatrixRotationAxis(right, pitch));
             forward = XMVector3Cross(up, right);
 
-#ifdef ENABLE_DX12_SUPPORT
-            renderer->Render(position, XMMatrixLookToRH(position, forward, up), projection, VSyncEnabled);
-#else
-            renderer->Render(XMMatrixLookToRH(position, forward, up), projection, VSyncEnabled);
+            bool recordKey = (GetAsyncKeyState(VK_F9) & 0x8000) != 0;
+            if (recordKey && !recordKeyDown)
+            {
+                recording = !recording;
+                if (recording)
+                {
+                    recordedPath.clear();
+                }
+                else
+                {
+                    SaveCameraPath(CameraPathFilename, recordedPath);
+                }
+            }
+            recordKeyDown = recordKey;
+
+#ifndef ENABLE_DX12_SUPPORT
+            // Snapshot of the memory telemetry so far
+            bool memoryKey = (GetAsyncKeyState(VK_F10) & 0x8000) != 0;
+            if (memoryKey && !memoryKeyDown)
+            {
+                memoryTelemetry.SaveJson(MemoryTelemetryFilename);
+            }
+            memoryKeyDown = memoryKey;
 #endif
 
+            if (recording)
+            {
+                CameraKey key;
+                XMStoreFloat3(&key.Position, position);
+                key.Yaw = yaw;
+                key.Pitch = pitch;
+                recordedPath.push_back(key);
+            }
+
+            // Assigning reuses the snapshot's memory
+            snapshot->InputTime = currTime;
+            snapshot->TimeStep = timeStep;
+            XMStoreFloat3(&snapshot->CameraPosition, position);
+            XMStoreFloat4x4(&snapshot->View, XMMatrixLookToRH(position, forward, up));
+            XMStoreFloat4x4(&snapshot->Projection, projection);
+            snapshot->Transforms = objectTransforms;
+            snapshot->LightSpheres = lightSpheres;
+            snapshot->LightColors = lightColors;
+            snapshot->Measured = playingBenchmark;
+
+            LARGE_INTEGER updateEnd {};
+            QueryPerformanceCounter(&updateEnd);
+            snapshot->UpdateMs = (updateEnd.QuadPart - currTime.QuadPart) * 1000.0 / frequency.QuadPart;
+            pipeline->EndUpdate();
+
+            // The render thread finishes off the queued frames once the pipeline stops
+            if (playingBenchmark && ++benchmarkFrame == (uint32_t)benchmarkPath.size())
+            {
+                break;
+            }
+
+#ifdef ENABLE_DX12_SUPPORT
             swprintf_s(caption, L"%s (%dx%d) - FPS: %3.2f", ClassName, ScreenWidth, ScreenHeight, frameRate);
+#else
+            swprintf_s(caption, L"%s (%dx%d) - FPS: %3.2f - Draws: %u (%u instanced, %u parts), Binds skipped: %u pool, %u material, Sort: %.3f ms, Textures: %u/%u resident, %llu/%llu MB, Memory: %llu MB",
+                ClassName, ScreenWidth, ScreenHeight, frameRate, stats.Draws, stats.InstancedDraws, stats.Instances, stats.PoolBindsSkipped, stats.MaterialBindsSkipped, stats.SortMs,
+                textureStats.FullyResident, textureStats.NumTextures, textureStats.ResidentBytes / (1024 * 1024), textureStats.BudgetBytes / (1024 * 1024),
+                memoryTelemetry.GetTotalBytes() / (1024 * 1024));
+#endif
             SetWindowText(Window, caption);
         }
     }
 
+    pipeline->Stop();
+    renderThread.join();
+
+    if (benchmarking && benchmarkTimings.GetNumFrames() == (uint32_t)benchmarkPath.size())
+    {
+        OpenConsole();
+        std::wstring title = L"Camera path, interactive, latency " + std::to_wstring(pipeline->GetLatency());
+        if (numStressInstances > 0)
+        {
+            title += L", " + std::to_wstring(numStressInstances) + (instancing ? L" stress instances" : L" stress instances, not instanced");
+        }
+        benchmarkTimings.PrintSummary(title);
+        if (benchmarkTimings.SaveCsv(FrameTimesFilename))
+        {
+            wprintf(L"  Frames saved to %s\n", FrameTimesFilename);
+        }
+#ifndef ENABLE_DX12_SUPPORT
+        memoryTelemetry.PrintSummary();
+        if (memoryTelemetry.SaveJson(MemoryTelemetryFilename))
+        {
+            wprintf(L"  Memory saved to %s\n", MemoryTelemetryFilename);
+        }
+#endif
+    }
+
     renderer.reset();
     Shutdown();
     return 0;
@@ -269,3 +711,120 @@ LRESULT CALLBACK WndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
     return DefWindowProc(hwnd, msg, wParam, lParam);
 }
+
+// Removes flag, and the number after it if there is one, from arguments. value is left as it is
+// when there's no number
+bool TakeArgument(std::string* arguments, const char* flag, uint32_t* value)
+{
+    size_t start = arguments->find(flag);
+    if (start == std::string::npos)
+    {
+        return false;
+    }
+
+    size_t end = start + strlen(flag);
+    size_t number = arguments->find_first_not_of(' ', end);
+    if (number != std::string::npos && isdigit((unsigned char)(*arguments)[number]))
+    {
+        if (value)
+        {
+            *value = strtoul(arguments->c_str() + number, nullptr, 10);
+        }
+        end = min(arguments->find_first_not_of("0123456789", number), arguments->size());
+    }
+
+    arguments->erase(start, end - start);
+    return true;
+}
+
+#ifndef ENABLE_DX12_SUPPORT
+// World space bounds of the level's parts, with the level placed by rootTransform. False if it has none
+bool GetLevelBounds(const Object* level, const XMFLOAT4X4& rootTransform, XMFLOAT3* minCorner, XMFLOAT3* maxCorner)
+{
+    XMVECTOR boundsMin = XMVectorReplicate(FLT_MAX);
+    XMVECTOR boundsMax = XMVectorReplicate(-FLT_MAX);
+    XMMATRIX root = XMLoadFloat4x4(&rootTransform);
+    for (auto& part : level->Parts)
+    {
+        XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&part->BoundsCenter), XMLoadFloat4x4(&part->RelativeTransform) * root);
+        XMVECTOR extents = XMLoadFloat3(&part->BoundsExtents);
+        boundsMin = XMVectorMin(boundsMin, center - extents);
+        boundsMax = XMVectorMax(boundsMax, center + extents);
+    }
+
+    XMStoreFloat3(minCorner, boundsMin);
+    XMStoreFloat3(maxCorner, boundsMax);
+    return minCorner->x <= maxCorner->x;
+}
+
+// Scatters colored point lights through the level's bounds (placed by rootTransform), to exercise
+// the clustered point light pass
+void GetDemoLights(const Object* level, const XMFLOAT4X4& rootTransform, std::vector<XMFLOAT4>* spheres, std::vector<XMFLOAT3>* colors)
+{
+    XMFLOAT3 minCorner, maxCorner;
+    if (!GetLevelBounds(level, rootTransform, &minCorner, &maxCorner))
+    {
+        return;
+    }
+
+    // Fixed seed, so the lighting is the same each run
+    std::mt19937 random(1234);
+    std::uniform_real_distribution<float> x(minCorner.x, maxCorner.x);
+    std::uniform_real_distribution<float> y(minCorner.y, maxCorner.y);
+    std::uniform_real_distribution<float> z(minCorner.z, maxCorner.z);
+    std::uniform_real_distribution<float> radius(30.f, 120.f);
+    std::uniform_real_distribution<float> color(0.2f, 1.f);
+
+    for (uint32_t i = 0; i < NumDemoLights; ++i)
+    {
+        XMFLOAT3 position(x(random), y(random), z(random));
+        float r = radius(random);
+        spheres->push_back(XMFLOAT4(position.x, position.y, position.z, r));
+        colors->push_back(XMFLOAT3(color(random), color(random), color(random)));
+    }
+}
+
+// Objects holding the level's smallest part, in a grid over the floor of its bounds. The part
+// itself is shared rather than copied, so they're drawn as instances of it and follow its
+// textures and material as they're streamed or reloaded. With no CPU geometry of their own,
+// they're never rasterized as occluders
+void GetStressInstances(const Object* level, uint32_t count, std::vector<std::shared_ptr<Object>>* instances)
+{
+    std::shared_ptr<Object::Part> source;
+    for (auto& part : level->Parts)
+    {
+        if (part->NumIndices > 0 && (!source || part->NumIndices < source->NumIndices))
+        {
+            source = part;
+        }
+    }
+
+    XMFLOAT3 minCorner, maxCorner;
+    if (count == 0 || !source || !GetLevelBounds(level, level->RootTransform, &minCorner, &maxCorner))
+    {
+        return;
+    }
+
+    // Where the source part's bounds center is now
+    XMMATRIX root = XMLoadFloat4x4(&level->RootTransform);
+    XMMATRIX sourceWorld = XMLoadFloat4x4(&source->RelativeTransform) * root;
+    XMVECTOR sourceCenter = XMVector3TransformCoord(XMLoadFloat3(&source->BoundsCenter), sourceWorld);
+
+    uint32_t side = (uint32_t)ceilf(sqrtf((float)count));
+    float stepX = (maxCorner.x - minCorner.x) / side;
+    float stepZ = (maxCorner.z - minCorner.z) / side;
+    float height = minCorner.y + source->BoundsExtents.y;
+
+    instances->reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        XMVECTOR center = XMVectorSet(minCorner.x + ((i % side) + 0.5f) * stepX, height, minCorner.z + ((i / side) + 0.5f) * stepZ, 1.f);
+
+        auto instance = std::make_shared<Object>();
+        XMStoreFloat4x4(&instance->RootTransform, root * XMMatrixTranslationFromVector(center - sourceCenter));
+        instance->Parts.push_back(source);
+        instance->LastUsedFrame = 0;
+        instances->push_back(instance);
+    }
+}
+#endif
@@ -0,0 +1,225 @@
+#include "Precomp.h"
+#include "MemoryTelemetry.h"
+#include <stdio.h>
+
+static double ToMB(uint64_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+MemoryTelemetry::MemoryTelemetry()
+    : TotalBytes(0)
+    , PeakTotalBytes(0)
+    , TotalUploadBytes(0)
+    , TotalDraws(0)
+    , TotalBinds(0)
+    , NumFrames(0)
+{
+    ZeroMemory(&Frame, sizeof(Frame));
+    ZeroMemory(&LastFrame, sizeof(LastFrame));
+    ZeroMemory(&PeakFrame, sizeof(PeakFrame));
+}
+
+uint32_t MemoryTelemetry::FindGroup(const std::wstring& name)
+{
+    for (uint32_t i = 0; i < (uint32_t)Groups.size(); ++i)
+    {
+        if (Groups[i].Name == name)
+        {
+            return i;
+        }
+    }
+
+    Group group{};
+    group.Name = name;
+    Groups.push_back(group);
+    return (uint32_t)Groups.size() - 1;
+}
+
+uint32_t MemoryTelemetry::GetCategory(const std::wstring& name)
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    for (uint32_t i = 0; i < (uint32_t)Categories.size(); ++i)
+    {
+        if (Categories[i].Name == name)
+        {
+            return i;
+        }
+    }
+
+    Category category{};
+    category.Name = name;
+    category.Group = FindGroup(name.substr(0, name.find(L'/')));
+    Categories.push_back(category);
+    return (uint32_t)Categories.size() - 1;
+}
+
+void MemoryTelemetry::SetBytes(uint32_t category, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    Category& c = Categories[category];
+    Group& group = Groups[c.Group];
+    group.Bytes = group.Bytes - c.Bytes + bytes;
+    TotalBytes = TotalBytes - c.Bytes + bytes;
+    c.Bytes = bytes;
+
+    c.PeakBytes = max(c.PeakBytes, c.Bytes);
+    group.PeakBytes = max(group.PeakBytes, group.Bytes);
+    PeakTotalBytes = max(PeakTotalBytes, TotalBytes);
+    CheckBudget(&group);
+}
+
+void MemoryTelemetry::SetBudget(const std::wstring& group, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    Group& g = Groups[FindGroup(group)];
+    g.BudgetBytes = bytes;
+    CheckBudget(&g);
+}
+
+void MemoryTelemetry::CheckBudget(Group* group)
+{
+    bool overBudget = group->BudgetBytes > 0 && group->Bytes > group->BudgetBytes;
+    if (overBudget && !group->OverBudget)
+    {
+        Log(L"%s over budget: %.1f / %.1f MB.", group->Name.c_str(), ToMB(group->Bytes), ToMB(group->BudgetBytes));
+    }
+    group->OverBudget = overBudget;
+}
+
+void MemoryTelemetry::AddUploadBytes(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    Frame.UploadBytes += bytes;
+}
+
+void MemoryTelemetry::AddDraws(uint32_t draws, uint32_t binds)
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    Frame.Draws += draws;
+    Frame.Binds += binds;
+}
+
+void MemoryTelemetry::EndFrame()
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    for (auto& group : Groups)
+    {
+        if (group.OverBudget)
+        {
+            ++group.FramesOverBudget;
+        }
+    }
+
+    PeakFrame.UploadBytes = max(PeakFrame.UploadBytes, Frame.UploadBytes);
+    PeakFrame.Draws = max(PeakFrame.Draws, Frame.Draws);
+    PeakFrame.Binds = max(PeakFrame.Binds, Frame.Binds);
+    TotalUploadBytes += Frame.UploadBytes;
+    TotalDraws += Frame.Draws;
+    TotalBinds += Frame.Binds;
+    ++NumFrames;
+
+    LastFrame = Frame;
+    ZeroMemory(&Frame, sizeof(Frame));
+}
+
+uint64_t MemoryTelemetry::GetTotalBytes() const
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    return TotalBytes;
+}
+
+MemoryFrameCounters MemoryTelemetry::GetLastFrame() const
+{
+    std::lock_guard<std::mutex> lock(Lock);
+    return LastFrame;
+}
+
+void MemoryTelemetry::PrintSummary() const
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    wprintf(L"Memory, %u frames (MB)\n", NumFrames);
+    wprintf(L"  %-28s %9s %9s %9s %7s\n", L"Category", L"Current", L"Peak", L"Budget", L"Over");
+    for (uint32_t g = 0; g < (uint32_t)Groups.size(); ++g)
+    {
+        const Group& group = Groups[g];
+        wprintf(L"  %-28s %9.2f %9.2f %9.2f %7u\n", group.Name.c_str(), ToMB(group.Bytes), ToMB(group.PeakBytes),
+            ToMB(group.BudgetBytes), group.FramesOverBudget);
+        for (auto& category : Categories)
+        {
+            if (category.Group == g && category.Name != group.Name)
+            {
+                wprintf(L"    %-26s %9.2f %9.2f\n", category.Name.c_str() + group.Name.size() + 1, ToMB(category.Bytes), ToMB(category.PeakBytes));
+            }
+        }
+    }
+    wprintf(L"  %-28s %9.2f %9.2f\n", L"Total", ToMB(TotalBytes), ToMB(PeakTotalBytes));
+
+    uint32_t frames = max(NumFrames, 1u);
+    wprintf(L"  Per frame     %9s %9s %9s\n", L"Last", L"Avg", L"Peak");
+    wprintf(L"  Uploads (MB)  %9.2f %9.2f %9.2f\n", ToMB(LastFrame.UploadBytes), ToMB(TotalUploadBytes) / frames, ToMB(PeakFrame.UploadBytes));
+    wprintf(L"  Draws         %9u %9.1f %9u\n", LastFrame.Draws, (double)TotalDraws / frames, PeakFrame.Draws);
+    wprintf(L"  Binds         %9u %9.1f %9u\n", LastFrame.Binds, (double)TotalBinds / frames, PeakFrame.Binds);
+}
+
+bool MemoryTelemetry::SaveJson(const std::wstring& filename) const
+{
+    std::lock_guard<std::mutex> lock(Lock);
+
+    char line[1024];
+    std::string json = "{\n  \"groups\": [\n";
+    for (uint32_t g = 0; g < (uint32_t)Groups.size(); ++g)
+    {
+        const Group& group = Groups[g];
+        sprintf_s(line, "    { \"name\": \"%S\", \"bytes\": %llu, \"peakBytes\": %llu, \"budgetBytes\": %llu, \"framesOverBudget\": %u, \"categories\": [",
+            group.Name.c_str(), group.Bytes, group.PeakBytes, group.BudgetBytes, group.FramesOverBudget);
+        json += line;
+
+        bool first = true;
+        for (auto& category : Categories)
+        {
+            if (category.Group == g)
+            {
+                sprintf_s(line, "%s\n      { \"name\": \"%S\", \"bytes\": %llu, \"peakBytes\": %llu }",
+                    first ? "" : ",", category.Name.c_str(), category.Bytes, category.PeakBytes);
+                json += line;
+                first = false;
+            }
+        }
+        json += first ? "] }" : " ] }";
+        json += (g + 1 < Groups.size()) ? ",\n" : "\n";
+    }
+
+    double frames = max(NumFrames, 1u);
+    sprintf_s(line,
+        "  ],\n  \"totals\": { \"bytes\": %llu, \"peakBytes\": %llu },\n"
+        "  \"frames\": %u,\n"
+        "  \"lastFrame\": { \"uploadBytes\": %llu, \"draws\": %u, \"binds\": %u },\n"
+        "  \"averageFrame\": { \"uploadBytes\": %.1f, \"draws\": %.1f, \"binds\": %.1f },\n"
+        "  \"peakFrame\": { \"uploadBytes\": %llu, \"draws\": %u, \"binds\": %u }\n}\n",
+        TotalBytes, PeakTotalBytes, NumFrames,
+        LastFrame.UploadBytes, LastFrame.Draws, LastFrame.Binds,
+        TotalUploadBytes / frames, TotalDraws / frames, TotalBinds / frames,
+        PeakFrame.UploadBytes, PeakFrame.Draws, PeakFrame.Binds);
+    json += line;
+
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, filename.c_str(), L"wb") != 0 || !file)
+    {
+        LogError(L"Failed to create memory telemetry: %s.", filename.c_str());
+        return false;
+    }
+    bool written = fwrite(json.data(), 1, json.size(), file) == json.size();
+    fclose(file);
+
+    if (!written)
+    {
+        LogError(L"Failed to write memory telemetry: %s.", filename.c_str());
+    }
+    return written;
+}
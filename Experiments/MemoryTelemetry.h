@@ -0,0 +1,79 @@
+#pragma once
+
+// What the frame moved and issued, summed over everything reporting to a MemoryTelemetry
+struct MemoryFrameCounters
+{
+    uint64_t    UploadBytes;
+    uint32_t    Draws;
+    uint32_t    Binds;          // Geometry pool & material binds
+};
+
+// Accounting of the memory held by each kind of resource, with high water marks and budgets,
+// plus per frame counters. Owners report the total they hold in a category whenever it changes,
+// rather than each allocation, so nothing is lost if a resource is released behind their back.
+// Categories named "Group/Item" (e.g. "Textures/BC1_UNORM") are summed into their group, and
+// budgets are set per group. Independent of any graphics API. Safe to report to from any thread.
+class MemoryTelemetry : public NonCopyable
+{
+public:
+    MemoryTelemetry();
+
+    // Finds or adds the category. Names are plain ASCII, and written out unescaped
+    uint32_t GetCategory(const std::wstring& name);
+
+    // Total bytes now held in the category
+    void SetBytes(uint32_t category, uint64_t bytes);
+
+    // 0 for no budget. Going over is logged once, and counted per frame until back under
+    void SetBudget(const std::wstring& group, uint64_t bytes);
+
+    // Per frame counters, summed until EndFrame
+    void AddUploadBytes(uint64_t bytes);
+    void AddDraws(uint32_t draws, uint32_t binds);
+    void EndFrame();
+
+    uint64_t GetTotalBytes() const;
+    MemoryFrameCounters GetLastFrame() const;
+
+    // Every group and category, with current & peak bytes and budgets, and the frame counters
+    // (last, average & peak). Printed to stdout, or saved as JSON.
+    void PrintSummary() const;
+    bool SaveJson(const std::wstring& filename) const;
+
+private:
+    struct Category
+    {
+        std::wstring    Name;
+        uint32_t        Group;
+        uint64_t        Bytes;
+        uint64_t        PeakBytes;
+    };
+
+    struct Group
+    {
+        std::wstring    Name;
+        uint64_t        Bytes;
+        uint64_t        PeakBytes;
+        uint64_t        BudgetBytes;
+        uint32_t        FramesOverBudget;
+        bool            OverBudget;
+    };
+
+    // Lock must be held
+    uint32_t FindGroup(const std::wstring& name);
+    void CheckBudget(Group* group);
+
+    mutable std::mutex Lock;
+    std::vector<Category> Categories;
+    std::vector<Group> Groups;
+    uint64_t TotalBytes;
+    uint64_t PeakTotalBytes;
+
+    MemoryFrameCounters Frame;      // So far this frame
+    MemoryFrameCounters LastFrame;
+    MemoryFrameCounters PeakFrame;  // Of each counter on its own
+    uint64_t TotalUploadBytes;
+    uint64_t TotalDraws;
+    uint64_t TotalBinds;
+    uint32_t NumFrames;
+};
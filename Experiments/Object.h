@@ -2,6 +2,45 @@
 
 struct GeoMesh;
 
+// Parts that may be seen from each cell of a grid over an object, as baked by AssetLoader (see
+// ModelVisibilityHeader). Empty for objects without them
+struct PotentiallyVisibleSets
+{
+    XMFLOAT3                                BoundsMin;
+    XMFLOAT3                                CellSize;
+    uint32_t                                NumCells[3];
+    uint32_t                                WordsPerCell;
+    std::vector<uint32_t>                   Bits;
+
+    // A bit per part, in the order of Object::Parts, for the cell holding a position in the
+    // object's space. Null if there are no sets, or the position is outside the grid (where
+    // anything may be visible)
+    const uint32_t* GetCell(const XMFLOAT3& position) const
+    {
+        if (Bits.empty())
+        {
+            return nullptr;
+        }
+
+        float offsets[3] = { (position.x - BoundsMin.x) / CellSize.x, (position.y - BoundsMin.y) / CellSize.y, (position.z - BoundsMin.z) / CellSize.z };
+        uint32_t cell[3];
+        for (uint32_t i = 0; i < 3; ++i)
+        {
+            if (!(offsets[i] >= 0.f && offsets[i] < (float)NumCells[i]))
+            {
+                return nullptr;
+            }
+            cell[i] = min((uint32_t)offsets[i], NumCells[i] - 1);
+        }
+        return &Bits[((size_t)(cell[2] * NumCells[1] + cell[1]) * NumCells[0] + cell[0]) * WordsPerCell];
+    }
+
+    static bool IsVisible(const uint32_t* cell, uint32_t part)
+    {
+        return (cell[part / 32] & (1u << (part % 32))) != 0;
+    }
+};
+
 struct Object
 {
     struct Part
@@ -11,8 +50,36 @@ struct Object
         ComPtr<ID3D11ShaderResourceView>    AlbedoSRV;
         ComPtr<ID3D11ShaderResourceView>    NormalSRV;
         ComPtr<ID3D11ShaderResourceView>    SpecularSRV;
+
+        // Parts with the same set of textures share an id, for sorting draws
+        uint32_t                            MaterialId;
+
+        // Axis aligned bounds of the part's vertices, before any transform
+        XMFLOAT3                            BoundsCenter;
+        XMFLOAT3                            BoundsExtents;
+
+        // Range of the object's Indices used by this part
+        uint32_t                            StartIndex;
+        uint32_t                            NumIndices;
+
+        // Rasterized into the occlusion buffer each frame (see SelectOccluders)
+        bool                                IsOccluder;
+
+        // Last renderer frame the part was visible, and how many pixels across it was then
+        uint64_t                            LastVisibleFrame;
+        float                               ScreenSize;
     };
 
     XMFLOAT4X4  RootTransform;
     std::vector<std::shared_ptr<Part>>      Parts;
+
+    // Last renderer frame any part was visible, for geometry residency (see ContentLoader::UpdateResidency)
+    uint64_t                                LastUsedFrame;
+
+    // CPU copy of the positions and indices, for occlusion culling
+    std::vector<XMFLOAT3>                   Positions;
+    std::vector<uint32_t>                   Indices;
+
+    // Lets the renderer skip parts that can't be seen from where the camera is
+    PotentiallyVisibleSets                  Pvs;
 };
@@ -0,0 +1,259 @@
+#include "Precomp.h"
+#include "OcclusionCulling.h"
+#include "Culling.h"
+#include "JobSystem.h"
+
+std::unique_ptr<OcclusionBuffer> OcclusionBuffer::Create(uint32_t width, uint32_t height)
+{
+    std::unique_ptr<OcclusionBuffer> buffer(new OcclusionBuffer());
+    if (buffer)
+    {
+        if (buffer->Initialize(width, height))
+        {
+            return buffer;
+        }
+    }
+    return nullptr;
+}
+
+OcclusionBuffer::OcclusionBuffer()
+    : Width(0), Height(0), TilesX(0), TilesY(0), BlocksX(0), BlocksY(0)
+    , NumOccluderTriangles(0)
+{
+    XMStoreFloat4x4(&ViewProjection, XMMatrixIdentity());
+}
+
+bool OcclusionBuffer::Initialize(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        LogError(L"Invalid occlusion buffer size.");
+        return false;
+    }
+
+    TilesX = (width + TileSize - 1) / TileSize;
+    TilesY = (height + TileSize - 1) / TileSize;
+    Width = TilesX * TileSize;
+    Height = TilesY * TileSize;
+    BlocksX = Width / BlockSize;
+    BlocksY = Height / BlockSize;
+
+    Depth.resize(Width * Height, 1.f);
+    BlockDepth.resize(BlocksX * BlocksY, 1.f);
+
+    // Occluders are usually not closed, so both sides are kept. Only depth is written, so no normals
+    Binner.Initialize(Width, Height, false, false);
+    return true;
+}
+
+void OcclusionBuffer::ClearOccluders()
+{
+    Occluders.clear();
+    NumOccluderTriangles = 0;
+}
+
+void OcclusionBuffer::AddOccluder(const XMFLOAT3* positions, const uint32_t* indices, uint32_t numIndices, CXMMATRIX world)
+{
+    TriangleBinner::Mesh occluder;
+    occluder.Positions = positions;
+    occluder.Indices = indices;
+    occluder.NumTriangles = numIndices / 3;
+    XMStoreFloat4x4(&occluder.Transform, world);
+
+    Occluders.push_back(occluder);
+    NumOccluderTriangles += occluder.NumTriangles;
+}
+
+uint32_t OcclusionBuffer::GetNumBinnedTriangles() const
+{
+    return Binner.GetNumBinnedTriangles();
+}
+
+void OcclusionBuffer::Render(CXMMATRIX viewProjection, JobSystem* jobs)
+{
+    XMStoreFloat4x4(&ViewProjection, viewProjection);
+
+    Binner.Bin(Occluders.data(), (uint32_t)Occluders.size(), viewProjection, jobs);
+    ParallelForAndWait(jobs, TilesX * TilesY, 1, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t tile = begin; tile < end; ++tile)
+        {
+            RasterizeTile(tile);
+        }
+    });
+}
+
+void OcclusionBuffer::RasterizeTile(uint32_t tile)
+{
+    uint32_t tileX = tile % TilesX;
+    uint32_t tileY = tile / TilesX;
+
+    for (uint32_t y = 0; y < TileSize; ++y)
+    {
+        float* row = &Depth[(tileY * TileSize + y) * Width + tileX * TileSize];
+        std::fill(row, row + TileSize, 1.f);
+    }
+
+    Binner.ForEachTriangle(tile, [&](const ScreenTriangle& triangle)
+    {
+        Binner.Rasterize(triangle, tileX, tileY, [&](uint32_t x, uint32_t y, __m128 inside, __m128 z)
+        {
+            float* depth = &Depth[y * Width + x];
+            __m128 old = _mm_loadu_ps(depth);
+            __m128 nearest = _mm_min_ps(old, z);
+            _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, old)));
+        });
+    });
+
+    // Reduce to the farthest depth in each block
+    for (uint32_t by = 0; by < TileSize / BlockSize; ++by)
+    {
+        for (uint32_t bx = 0; bx < TileSize / BlockSize; ++bx)
+        {
+            uint32_t x = tileX * TileSize + bx * BlockSize;
+            uint32_t y = tileY * TileSize + by * BlockSize;
+
+            __m128 maxDepth = _mm_setzero_ps();
+            for (uint32_t i = 0; i < BlockSize; ++i)
+            {
+                const float* row = &Depth[(y + i) * Width + x];
+                for (uint32_t j = 0; j < BlockSize; j += 4)
+                {
+                    maxDepth = _mm_max_ps(maxDepth, _mm_loadu_ps(row + j));
+                }
+            }
+            maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(1, 0, 3, 2)));
+            maxDepth = _mm_max_ps(maxDepth, _mm_shuffle_ps(maxDepth, maxDepth, _MM_SHUFFLE(2, 3, 0, 1)));
+
+            _mm_store_ss(&BlockDepth[(y / BlockSize) * BlocksX + x / BlockSize], maxDepth);
+        }
+    }
+}
+
+uint32_t OcclusionBuffer::TestVisibility(const CullingBoxes& boxes, const uint32_t* candidates, uint32_t numCandidates, uint32_t* visible) const
+{
+    XMMATRIX viewProjection = XMLoadFloat4x4(&ViewProjection);
+    uint32_t numVisible = 0;
+
+    for (uint32_t n = 0; n < numCandidates; ++n)
+    {
+        uint32_t i = candidates[n];
+
+        // Corners in clip space are the transformed center plus or minus each transformed axis
+        XMVECTOR center = XMVector3Transform(XMVectorSet(boxes.CenterX[i], boxes.CenterY[i], boxes.CenterZ[i], 1.f), viewProjection);
+        XMVECTOR axisX = viewProjection.r[0] * boxes.ExtentX[i];
+        XMVECTOR axisY = viewProjection.r[1] * boxes.ExtentY[i];
+        XMVECTOR axisZ = viewProjection.r[2] * boxes.ExtentZ[i];
+
+        bool crossesNear = false;
+        XMVECTOR minCorner = XMVectorReplicate(FLT_MAX);
+        XMVECTOR maxCorner = XMVectorReplicate(-FLT_MAX);
+
+        for (int c = 0; c < 8; ++c)
+        {
+            XMVECTOR corner = center;
+            corner += (c & 1) ? axisX : -axisX;
+            corner += (c & 2) ? axisY : -axisY;
+            corner += (c & 4) ? axisZ : -axisZ;
+
+            if (XMVectorGetZ(corner) < 0.f)
+            {
+                crossesNear = true;
+                break;
+            }
+
+            XMVECTOR ndc = corner / XMVectorSplatW(corner);
+            minCorner = XMVectorMin(minCorner, ndc);
+            maxCorner = XMVectorMax(maxCorner, ndc);
+        }
+
+        // Boxes reaching the camera can't be rejected
+        if (crossesNear)
+        {
+            visible[numVisible++] = i;
+            continue;
+        }
+
+        XMFLOAT3 minNdc, maxNdc;
+        XMStoreFloat3(&minNdc, minCorner);
+        XMStoreFloat3(&maxNdc, maxCorner);
+
+        // Covered blocks. Note that y is flipped going to screen space
+        float left = (minNdc.x * 0.5f + 0.5f) * (float)Width;
+        float right = (maxNdc.x * 0.5f + 0.5f) * (float)Width;
+        float top = (0.5f - maxNdc.y * 0.5f) * (float)Height;
+        float bottom = (0.5f - minNdc.y * 0.5f) * (float)Height;
+
+        if (right < 0.f || bottom < 0.f || left >= (float)Width || top >= (float)Height)
+        {
+            visible[numVisible++] = i;
+            continue;
+        }
+
+        uint32_t blockX0 = (uint32_t)max(left, 0.f) / BlockSize;
+        uint32_t blockY0 = (uint32_t)max(top, 0.f) / BlockSize;
+        uint32_t blockX1 = (uint32_t)min(right, (float)Width - 1.f) / BlockSize;
+        uint32_t blockY1 = (uint32_t)min(bottom, (float)Height - 1.f) / BlockSize;
+
+        // Visible as soon as any covered block has something at or behind the box's nearest point
+        bool occluded = true;
+        for (uint32_t y = blockY0; y <= blockY1 && occluded; ++y)
+        {
+            const float* blockDepth = &BlockDepth[y * BlocksX];
+            for (uint32_t x = blockX0; x <= blockX1; ++x)
+            {
+                if (blockDepth[x] >= minNdc.z)
+                {
+                    occluded = false;
+                    break;
+                }
+            }
+        }
+
+        if (!occluded)
+        {
+            visible[numVisible++] = i;
+        }
+    }
+
+    return numVisible;
+}
+
+void SelectOccluders(const std::vector<std::shared_ptr<Object>>& objects, uint32_t triangleBudget)
+{
+    std::vector<Object::Part*> parts;
+    for (auto& object : objects)
+    {
+        // Objects without a CPU copy of their geometry can't be rasterized
+        bool hasGeometry = !object->Positions.empty();
+        for (auto& part : object->Parts)
+        {
+            part->IsOccluder = false;
+            if (hasGeometry)
+            {
+                parts.push_back(part.get());
+            }
+        }
+    }
+
+    // Bigger parts hide more, so consider them first
+    auto surfaceArea = [](const Object::Part* part)
+    {
+        const XMFLOAT3& e = part->BoundsExtents;
+        return e.x * e.y + e.y * e.z + e.z * e.x;
+    };
+    std::sort(parts.begin(), parts.end(), [&](const Object::Part* a, const Object::Part* b)
+    {
+        return surfaceArea(a) > surfaceArea(b);
+    });
+
+    for (auto part : parts)
+    {
+        uint32_t numTriangles = part->NumIndices / 3;
+        if (numTriangles <= triangleBudget)
+        {
+            part->IsOccluder = true;
+            triangleBudget -= numTriangles;
+        }
+    }
+}
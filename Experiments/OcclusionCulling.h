@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Object.h"
+#include "TriangleBinning.h"
+
+class CullingBoxes;
+class JobSystem;
+
+// Defaults shared by the renderer and the benchmarks
+static const uint32_t OcclusionBufferWidth = 320;
+static const uint32_t OcclusionBufferHeight = 192;
+static const uint32_t OccluderTriangleBudget = 50000;
+
+// CPU occlusion culling. A small set of occluder meshes is rasterized into a low resolution
+// depth buffer each frame. Triangles are first set up and binned into screen tiles in parallel
+// (see TriangleBinner), then each tile is rasterized and reduced to the max depth of each
+// BlockSize x BlockSize block. Boxes farther than every block they cover are occluded.
+// Independent of any graphics API.
+class OcclusionBuffer : public NonCopyable
+{
+public:
+    static const uint32_t TileSize = TriangleBinner::TileSize;
+    static const uint32_t BlockSize = 8;
+
+    // width and height are rounded up to a multiple of TileSize
+    static std::unique_ptr<OcclusionBuffer> Create(uint32_t width, uint32_t height);
+
+    // Occluder data is referenced, not copied, and must stay alive until Render returns
+    void ClearOccluders();
+    void AddOccluder(const XMFLOAT3* positions, const uint32_t* indices, uint32_t numIndices, CXMMATRIX world);
+
+    // Rasterizes all occluders from this viewpoint and rebuilds the block depths. jobs may be
+    // null, to render on the calling thread
+    void Render(CXMMATRIX viewProjection, JobSystem* jobs);
+
+    // Compacts candidates (indices into boxes) down to the ones not hidden behind the occluders,
+    // as seen from the last Render. visible may be the same array as candidates.
+    uint32_t TestVisibility(const CullingBoxes& boxes, const uint32_t* candidates, uint32_t numCandidates, uint32_t* visible) const;
+
+    uint32_t GetNumOccluderTriangles() const { return NumOccluderTriangles; }
+    uint32_t GetNumBinnedTriangles() const;
+
+private:
+    OcclusionBuffer();
+    bool Initialize(uint32_t width, uint32_t height);
+
+    void RasterizeTile(uint32_t tile);
+
+private:
+    uint32_t                    Width;
+    uint32_t                    Height;
+    uint32_t                    TilesX;
+    uint32_t                    TilesY;
+    uint32_t                    BlocksX;
+    uint32_t                    BlocksY;
+
+    std::vector<float>          Depth;          // Width x Height, row major
+    std::vector<float>          BlockDepth;     // Max depth of each block, BlocksX x BlocksY
+
+    std::vector<TriangleBinner::Mesh> Occluders;    // Transformed to world space
+    uint32_t                    NumOccluderTriangles;
+    XMFLOAT4X4                  ViewProjection;
+
+    TriangleBinner              Binner;
+};
+
+// Marks the parts rasterized as occluders (Part::IsOccluder): the parts with the largest
+// bounds, taken in order while they fit in the triangle budget.
+void SelectOccluders(const std::vector<std::shared_ptr<Object>>& objects, uint32_t triangleBudget);
@@ -11,10 +11,16 @@
 
 #include <memory>
 #include <vector>
+#include <deque>
 #include <string>
 #include <map>
+#include <tuple>
+#include <functional>
 #include <unordered_map>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #define ENABLE_DX12_SUPPORT
 
@@ -35,6 +41,7 @@ using namespace DirectX;
 
 // Custom asset loading
 #include <AssetLoader.h>
+#include <AssetImport.h>
 
 // For RAII wrappers
 #include <wrl.h>
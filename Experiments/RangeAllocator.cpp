@@ -0,0 +1,298 @@
+#include "Precomp.h"
+#include "RangeAllocator.h"
+#include <intrin.h>
+
+static uint32_t FindLastSet(uint32_t value)
+{
+    unsigned long index = 0;
+    _BitScanReverse(&index, value);
+    return index;
+}
+
+static uint32_t FindFirstSet(uint32_t value)
+{
+    unsigned long index = 0;
+    _BitScanForward(&index, value);
+    return index;
+}
+
+RangeAllocator::RangeAllocator(uint32_t capacity)
+    : Capacity(capacity)
+{
+    Reset();
+}
+
+void RangeAllocator::Reset()
+{
+    UsedSize = 0;
+    Blocks.clear();
+    UnusedBlocks.clear();
+    Allocations.clear();
+
+    FirstLevelBitmap = 0;
+    for (uint32_t i = 0; i < FirstLevelCount; ++i)
+    {
+        SecondLevelBitmaps[i] = 0;
+        for (uint32_t j = 0; j < SecondLevelCount; ++j)
+        {
+            FreeLists[i][j] = Invalid;
+        }
+    }
+
+    if (Capacity > 0)
+    {
+        InsertFree(NewBlock(0, Capacity));
+    }
+}
+
+// Small sizes each get their own class. Above that, each power of two is split into SecondLevelCount classes
+void RangeAllocator::Mapping(uint32_t size, uint32_t* firstLevel, uint32_t* secondLevel)
+{
+    if (size < SecondLevelCount)
+    {
+        *firstLevel = 0;
+        *secondLevel = size;
+    }
+    else
+    {
+        uint32_t log2 = FindLastSet(size);
+        *firstLevel = log2 - SecondLevelBits + 1;
+        *secondLevel = (size >> (log2 - SecondLevelBits)) - SecondLevelCount;
+    }
+}
+
+uint32_t RangeAllocator::NewBlock(uint32_t offset, uint32_t size)
+{
+    Block block;
+    block.Offset = offset;
+    block.Size = size;
+    block.PrevPhysical = Invalid;
+    block.NextPhysical = Invalid;
+    block.PrevFree = Invalid;
+    block.NextFree = Invalid;
+    block.IsFree = false;
+
+    if (!UnusedBlocks.empty())
+    {
+        uint32_t index = UnusedBlocks.back();
+        UnusedBlocks.pop_back();
+        Blocks[index] = block;
+        return index;
+    }
+
+    Blocks.push_back(block);
+    return (uint32_t)Blocks.size() - 1;
+}
+
+void RangeAllocator::InsertFree(uint32_t index)
+{
+    Block& block = Blocks[index];
+
+    uint32_t fl, sl;
+    Mapping(block.Size, &fl, &sl);
+
+    block.IsFree = true;
+    block.PrevFree = Invalid;
+    block.NextFree = FreeLists[fl][sl];
+    if (block.NextFree != Invalid)
+    {
+        Blocks[block.NextFree].PrevFree = index;
+    }
+
+    FreeLists[fl][sl] = index;
+    FirstLevelBitmap |= 1u << fl;
+    SecondLevelBitmaps[fl] |= 1u << sl;
+}
+
+void RangeAllocator::RemoveFree(uint32_t index)
+{
+    Block& block = Blocks[index];
+
+    uint32_t fl, sl;
+    Mapping(block.Size, &fl, &sl);
+
+    if (block.PrevFree != Invalid)
+    {
+        Blocks[block.PrevFree].NextFree = block.NextFree;
+    }
+    else
+    {
+        FreeLists[fl][sl] = block.NextFree;
+    }
+    if (block.NextFree != Invalid)
+    {
+        Blocks[block.NextFree].PrevFree = block.PrevFree;
+    }
+
+    if (FreeLists[fl][sl] == Invalid)
+    {
+        SecondLevelBitmaps[fl] &= ~(1u << sl);
+        if (SecondLevelBitmaps[fl] == 0)
+        {
+            FirstLevelBitmap &= ~(1u << fl);
+        }
+    }
+
+    block.IsFree = false;
+    block.PrevFree = Invalid;
+    block.NextFree = Invalid;
+}
+
+bool RangeAllocator::Allocate(uint32_t size, uint32_t* offset)
+{
+    size = max(size, 1u);
+    if (size > Capacity - UsedSize)
+    {
+        return false;
+    }
+
+    // Round up to the next class boundary, so any block in the class found is big enough
+    uint32_t searchSize = size;
+    if (size >= SecondLevelCount)
+    {
+        uint32_t round = (1u << (FindLastSet(size) - SecondLevelBits)) - 1;
+        if (size > 0xFFFFFFFF - round)
+        {
+            return false;
+        }
+        searchSize += round;
+    }
+
+    uint32_t fl, sl;
+    Mapping(searchSize, &fl, &sl);
+
+    uint32_t secondLevelMap = SecondLevelBitmaps[fl] & (0xFFFFFFFF << sl);
+    if (secondLevelMap == 0)
+    {
+        uint32_t firstLevelMap = (fl + 1 < 32) ? FirstLevelBitmap & (0xFFFFFFFF << (fl + 1)) : 0;
+        if (firstLevelMap == 0)
+        {
+            return false;
+        }
+        fl = FindFirstSet(firstLevelMap);
+        secondLevelMap = SecondLevelBitmaps[fl];
+    }
+    sl = FindFirstSet(secondLevelMap);
+
+    uint32_t index = FreeLists[fl][sl];
+    RemoveFree(index);
+
+    // Split off the remainder
+    if (Blocks[index].Size > size)
+    {
+        uint32_t remainder = NewBlock(Blocks[index].Offset + size, Blocks[index].Size - size);
+        Block& block = Blocks[index];
+
+        Blocks[remainder].PrevPhysical = index;
+        Blocks[remainder].NextPhysical = block.NextPhysical;
+        if (block.NextPhysical != Invalid)
+        {
+            Blocks[block.NextPhysical].PrevPhysical = remainder;
+        }
+        block.NextPhysical = remainder;
+        block.Size = size;
+
+        InsertFree(remainder);
+    }
+
+    UsedSize += size;
+    *offset = Blocks[index].Offset;
+    Allocations[*offset] = index;
+    return true;
+}
+
+void RangeAllocator::Free(uint32_t offset)
+{
+    auto it = Allocations.find(offset);
+    if (it == Allocations.end())
+    {
+        LogError(L"Freeing a range that isn't allocated.");
+        return;
+    }
+
+    uint32_t index = it->second;
+    Allocations.erase(it);
+    UsedSize -= Blocks[index].Size;
+
+    // Merge with free neighbors
+    uint32_t prev = Blocks[index].PrevPhysical;
+    if (prev != Invalid && Blocks[prev].IsFree)
+    {
+        RemoveFree(prev);
+        Blocks[prev].Size += Blocks[index].Size;
+        Blocks[prev].NextPhysical = Blocks[index].NextPhysical;
+        if (Blocks[index].NextPhysical != Invalid)
+        {
+            Blocks[Blocks[index].NextPhysical].PrevPhysical = prev;
+        }
+        UnusedBlocks.push_back(index);
+        index = prev;
+    }
+
+    uint32_t next = Blocks[index].NextPhysical;
+    if (next != Invalid && Blocks[next].IsFree)
+    {
+        RemoveFree(next);
+        Blocks[index].Size += Blocks[next].Size;
+        Blocks[index].NextPhysical = Blocks[next].NextPhysical;
+        if (Blocks[next].NextPhysical != Invalid)
+        {
+            Blocks[Blocks[next].NextPhysical].PrevPhysical = index;
+        }
+        UnusedBlocks.push_back(next);
+    }
+
+    InsertFree(index);
+}
+
+uint32_t RangeAllocator::GetLargestFreeRange() const
+{
+    if (FirstLevelBitmap == 0)
+    {
+        return 0;
+    }
+
+    // Only the top class can hold the largest block, but sizes within it vary
+    uint32_t fl = FindLastSet(FirstLevelBitmap);
+    uint32_t sl = FindLastSet(SecondLevelBitmaps[fl]);
+
+    uint32_t largest = 0;
+    for (uint32_t index = FreeLists[fl][sl]; index != Invalid; index = Blocks[index].NextFree)
+    {
+        largest = max(largest, Blocks[index].Size);
+    }
+    return largest;
+}
+
+void RangeAllocator::Compact(std::vector<RangeMove>* moves)
+{
+    moves->clear();
+
+    // Walk allocations in memory order, starting from the block at offset 0
+    std::vector<std::pair<uint32_t, uint32_t>> ranges;
+    for (auto& allocation : Allocations)
+    {
+        ranges.push_back(std::make_pair(allocation.first, Blocks[allocation.second].Size));
+    }
+    std::sort(ranges.begin(), ranges.end());
+
+    Reset();
+
+    uint32_t offset = 0;
+    for (auto& range : ranges)
+    {
+        if (range.first != offset)
+        {
+            RangeMove move;
+            move.OldOffset = range.first;
+            move.NewOffset = offset;
+            move.Size = range.second;
+            moves->push_back(move);
+        }
+
+        uint32_t newOffset = 0;
+        Allocate(range.second, &newOffset);
+        assert(newOffset == offset);
+        offset += range.second;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+// A range that moved during compaction
+struct RangeMove
+{
+    uint32_t OldOffset;
+    uint32_t NewOffset;
+    uint32_t Size;
+};
+
+// Two level segregated fit (TLSF) allocator over [0, capacity), in whatever units the caller
+// uses (vertices, indices, ...). Allocation and release are O(1), and free neighbors are merged
+// on release. Ranges are identified by their offset. Independent of any graphics API.
+class RangeAllocator
+{
+public:
+    explicit RangeAllocator(uint32_t capacity);
+
+    // size 0 is treated as 1, so every range has a unique offset
+    bool Allocate(uint32_t size, uint32_t* offset);
+    void Free(uint32_t offset);
+
+    // Packs every allocation to the front, keeping their order, and reports the ones that moved
+    void Compact(std::vector<RangeMove>* moves);
+
+    uint32_t GetCapacity() const { return Capacity; }
+    uint32_t GetUsedSize() const { return UsedSize; }
+    uint32_t GetNumAllocations() const { return (uint32_t)Allocations.size(); }
+    uint32_t GetLargestFreeRange() const;
+
+private:
+    static const uint32_t SecondLevelBits = 4;
+    static const uint32_t SecondLevelCount = 1 << SecondLevelBits;
+    static const uint32_t FirstLevelCount = 32 - SecondLevelBits + 1;
+    static const uint32_t Invalid = 0xFFFFFFFF;
+
+    struct Block
+    {
+        uint32_t    Offset;
+        uint32_t    Size;
+        uint32_t    PrevPhysical;   // Neighbors in memory
+        uint32_t    NextPhysical;
+        uint32_t    PrevFree;       // Neighbors in the free list for this size class
+        uint32_t    NextFree;
+        bool        IsFree;
+    };
+
+    static void Mapping(uint32_t size, uint32_t* firstLevel, uint32_t* secondLevel);
+
+    uint32_t NewBlock(uint32_t offset, uint32_t size);
+    void InsertFree(uint32_t block);
+    void RemoveFree(uint32_t block);
+    void Reset();
+
+    uint32_t                Capacity;
+    uint32_t                UsedSize;
+
+    std::vector<Block>      Blocks;
+    std::vector<uint32_t>   UnusedBlocks;   // Recycled entries in Blocks
+
+    uint32_t                FirstLevelBitmap;
+    uint32_t                SecondLevelBitmaps[FirstLevelCount];
+    uint32_t                FreeLists[FirstLevelCount][SecondLevelCount];
+
+    std::unordered_map<uint32_t, uint32_t> Allocations;     // Offset to block
+};
@@ -15,6 +15,9 @@ typedef std::unordered_map<ComPtr<ID3D12Resource>, ComPtr<ID3D12Resource>, ComPt
 const UINT kNumBackBuffers = 2;
 const UINT kSampleCount = 4;
 
+// Objects per constant update job
+static const uint32_t ObjectsPerJob = 64;
+
 std::unique_ptr<Renderer> Renderer::Create(HWND window)
 {
     std::unique_ptr<Renderer> renderer(new Renderer(window));
@@ -262,6 +265,13 @@ bool Renderer::Initialize()
         ShaderResourceDescHandle.ptr += DescIncrementSize;
     }
 
+    Jobs = JobSystem::Create();
+    if (!Jobs)
+    {
+        LogError(L"Failed to create job system.");
+        return false;
+    }
+
     return true;
 }
 
@@ -375,20 +385,26 @@ bool Renderer::Render(FXMVECTOR cameraPosition, FXMMATRIX view, FXMMATRIX projec
     }
     else
     {
-        // Just update world and projection matrices
-        for (auto& object : TheScene->Objects)
+        // Just update world and projection matrices. Each object has its own buffer, so they're
+        // mapped & written in parallel
+        const auto& objects = TheScene->Objects;
+        JobHandle updates = Jobs->ParallelFor((uint32_t)objects.size(), ObjectsPerJob, [&](uint32_t begin, uint32_t end)
         {
-            UINT8* pData;
-            object->ConstantBuffers[cmdIdx]->Map(0, nullptr, reinterpret_cast<void**>(&pData));
-            if (pData != nullptr)
+            for (uint32_t i = begin; i < end; ++i)
             {
-                float identityMtx[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
-                memcpy(pData, identityMtx, 16 * sizeof(float));
-                memcpy(pData + 16 * sizeof(float), &viewProjection.m[0][0], 16 * sizeof(float));
-                memcpy(pData + 32 * sizeof(float), &viewProjection.m[0][0], 16 * sizeof(float));
-                object->ConstantBuffers[cmdIdx]->Unmap(0, nullptr);
+                UINT8* pData;
+                objects[i]->ConstantBuffers[cmdIdx]->Map(0, nullptr, reinterpret_cast<void**>(&pData));
+                if (pData != nullptr)
+                {
+                    float identityMtx[] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+                    memcpy(pData, identityMtx, 16 * sizeof(float));
+                    memcpy(pData + 16 * sizeof(float), &viewProjection.m[0][0], 16 * sizeof(float));
+                    memcpy(pData + 32 * sizeof(float), &viewProjection.m[0][0], 16 * sizeof(float));
+                    objects[i]->ConstantBuffers[cmdIdx]->Unmap(0, nullptr);
+                }
             }
-        }
+        });
+        Jobs->Wait(updates);
     }
 
     pCmdList->ExecuteBundle(pBundle);
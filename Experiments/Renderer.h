@@ -2,6 +2,8 @@
 
 #if defined (ENABLE_DX12_SUPPORT)
 
+#include "JobSystem.h"
+
 // Implements all rendering code, used by the main application
 class Renderer
 {
@@ -134,6 +136,9 @@ private:
     UINT DescIncrementSize;
 
     bool BundleCreated;
+
+    // Per object constant updates are split into jobs on this
+    std::unique_ptr<JobSystem> Jobs;
 };
 
 #endif // DX12 support
@@ -27,6 +27,25 @@ struct StandardVertex
     float2 TexCoord : TEXCOORD0;
 };
 
+// Second vertex stream of the geometry pass: baked ambient occlusion
+struct AmbientVertex
+{
+    float4 Ambient : AMBIENT0;  // Model space bent normal in [0, 1] (xyz) & visibility (w)
+};
+
+
+//*****************************************************************************
+// Ambient lighting. A constant sky above and ground below, seen along the
+// bent normal and scaled by how much of the hemisphere is unoccluded
+//*****************************************************************************
+static const float3 AmbientSkyColor = float3(0.12f, 0.13f, 0.15f);
+static const float3 AmbientGroundColor = float3(0.05f, 0.045f, 0.04f);
+
+float3 ComputeAmbient(float3 worldBentNormal, float visibility)
+{
+    return lerp(AmbientGroundColor, AmbientSkyColor, worldBentNormal.y * 0.5f + 0.5f) * visibility;
+}
+
 
 //*****************************************************************************
 // BRDF Normal Distribution Functions (NDFs)
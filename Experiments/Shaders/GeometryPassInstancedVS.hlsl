@@ -0,0 +1,57 @@
+/*
+ * GBuffer Geometry Pass, instanced. Same as GeometryPassVS, with the world matrix
+ * coming from a per instance vertex stream instead of the constant buffer
+ */
+
+#include "Common.hlsli"
+
+cbuffer Constants
+{
+    float4x4 Unused;        // World, for the single draw path. Keeps the layout shared
+    float4x4 View;
+    float4x4 Projection;
+};
+
+// Rows of the application's (row vector) world matrix
+struct InstanceData
+{
+    float4 World0 : WORLD0;
+    float4 World1 : WORLD1;
+    float4 World2 : WORLD2;
+    float4 World3 : WORLD3;
+};
+
+struct VertexOut
+{
+    float4 Position : SV_POSITION;
+    float3 Normal : NORMAL;
+    float3 Tangent : TANGENT;
+    float3 BiTangent : BITANGENT;
+    float2 TexCoord : TEXCOORD;
+    float3 Ambient : AMBIENT;
+};
+
+VertexOut main(StandardVertex input, AmbientVertex ambient, InstanceData instance)
+{
+    VertexOut output;
+
+    // Transposed to match how the constant buffer path sees World
+    float4x4 World = transpose(float4x4(instance.World0, instance.World1, instance.World2, instance.World3));
+
+    float4 worldPos = mul(World, float4(input.Position, 1));
+    output.Position = mul(Projection, mul(View, worldPos));
+
+    // Assumes orthonormal (simple rotation & scaling)
+    float3x3 invTransWorld = (float3x3)World;
+    float3x3 toView = mul(View, invTransWorld);
+    output.Normal = mul(toView, input.Normal);
+    output.Tangent = mul(toView, input.Tangent);
+    output.BiTangent = mul(toView, input.BiTangent);
+
+    output.TexCoord = input.TexCoord;
+
+    float3 bentNormal = normalize(mul(invTransWorld, ambient.Ambient.xyz * 2 - 1));
+    output.Ambient = ComputeAmbient(bentNormal, ambient.Ambient.w);
+
+    return output;
+}
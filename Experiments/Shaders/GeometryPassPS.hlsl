@@ -11,6 +11,7 @@ struct VertexIn
     float3 Tangent : TANGENT;
     float3 BiTangent : BITANGENT;
     float2 TexCoord : TEXCOORD;
+    float3 Ambient : AMBIENT;
 };
 
 struct RenderTargetOut
@@ -59,8 +60,8 @@ RenderTargetOut main(VertexIn input)
     }
     output.SpecularRoughness.w = 0.7f;
 
-    // TODO: implement
-    output.LightAccum = float4(0, 0, 0, 0);// float4(float3(0.1f, 0.1f, 0.1f), 0.f);
+    // Ambient, from the baked occlusion. Lights are added on top
+    output.LightAccum = float4(output.Color.rgb * input.Ambient, 0);
 
     return output;
 }
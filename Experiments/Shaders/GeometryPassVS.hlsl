@@ -18,9 +18,10 @@ struct VertexOut
     float3 Tangent : TANGENT;
     float3 BiTangent : BITANGENT;
     float2 TexCoord : TEXCOORD;
+    float3 Ambient : AMBIENT;
 };
 
-VertexOut main(StandardVertex input)
+VertexOut main(StandardVertex input, AmbientVertex ambient)
 {
     VertexOut output;
 
@@ -36,5 +37,8 @@ VertexOut main(StandardVertex input)
 
     output.TexCoord = input.TexCoord;
 
+    float3 bentNormal = normalize(mul(invTransWorld, ambient.Ambient.xyz * 2 - 1));
+    output.Ambient = ComputeAmbient(bentNormal, ambient.Ambient.w);
+
     return output;
 }
\ No newline at end of file
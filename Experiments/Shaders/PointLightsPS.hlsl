@@ -0,0 +1,103 @@
+/*
+ * Deferred clustered point light pixel shader
+ */
+
+#include "Common.hlsli"
+
+struct PointLight
+{
+    // NOTE: Position is transformed into camera space already!
+    float3 Position;
+    float Radius;
+    float3 Color;
+    float Pad0;
+};
+
+cbuffer Constants
+{
+    uint3 ClusterCounts;    // Tiles in x & y, and depth slices
+    float Pad0;
+    float SliceScale;       // slice = log2(view depth) * SliceScale + SliceBias
+    float SliceBias;
+    float2 InvViewportSize;
+    float4x4 InvProjection;
+};
+
+struct VertexInput
+{
+    float4 Position : SV_POSITION;
+    float2 TexCoord : TEXCOORD;
+};
+
+Texture2D DepthTex : register (t0);
+Texture2D NormalTex : register (t1);
+Texture2D SpecularTex : register (t2);
+Texture2D ColorTex : register (t3);
+
+// Offset & count into LightIndices for each cluster, x fastest, then y, then slice
+StructuredBuffer<uint2> Clusters : register (t4);
+StructuredBuffer<uint> LightIndices : register (t5);
+StructuredBuffer<PointLight> Lights : register (t6);
+
+SamplerState LinearWrapSampler : register (s0);
+SamplerState PointClampSampler : register (s1);
+
+float3 ViewPositionFromDepth(float2 texCoord, float depth)
+{
+    float x = texCoord.x * 2 - 1;
+    float y = (1 - texCoord.y) * 2 - 1;
+    float4 projectedPos = float4(x, y, depth, 1.f);
+    float4 viewSpacePos = mul(InvProjection, projectedPos);
+    return viewSpacePos.xyz / viewSpacePos.w;
+}
+
+float4 main(VertexInput input) : SV_TARGET
+{
+    float depth = DepthTex.Sample(PointClampSampler, input.TexCoord).x;
+    if (depth >= 1.f)
+    {
+        // Nothing was drawn here
+        return float4(0, 0, 0, 0);
+    }
+
+    float3 N = NormalTex.Sample(LinearWrapSampler, input.TexCoord).xyz * 2 - 1;
+    float3 color = ColorTex.Sample(LinearWrapSampler, input.TexCoord).xyz;
+    float4 SR = SpecularTex.Sample(LinearWrapSampler, input.TexCoord);
+    float3 specularColor = SR.xyz;
+    float roughness = SR.w;
+
+    float3 viewPos = ViewPositionFromDepth(input.TexCoord, depth);
+
+    // Find the cluster this pixel is in
+    uint2 tile = min((uint2)(input.TexCoord * ClusterCounts.xy), ClusterCounts.xy - 1);
+    uint slice = (uint)clamp(floor(log2(-viewPos.z) * SliceScale + SliceBias), 0, ClusterCounts.z - 1);
+    uint2 cluster = Clusters[(slice * ClusterCounts.y + tile.y) * ClusterCounts.x + tile.x];
+
+    uint i;
+    float3 diffuse = float3(0, 0, 0);
+    float3 specular = float3(0, 0, 0);
+    float3 V = normalize(-viewPos);
+
+    for (i = 0; i < cluster.y; ++i)
+    {
+        PointLight light = Lights[LightIndices[cluster.x + i]];
+
+        float3 toLight = light.Position - viewPos;
+        float distance = length(toLight);
+        if (distance >= light.Radius)
+        {
+            continue;
+        }
+
+        // Inverse square falloff, windowed to reach zero at the light's radius (which is
+        // what the clusters were built with)
+        float window = saturate(1 - pow(distance / light.Radius, 4));
+        float3 intensity = light.Color * Att_InvSq(distance, light.Radius) * window * window;
+
+        float3 L = toLight / distance;
+        diffuse += color.xyz * intensity * saturate(dot(N, L));
+        specular += intensity * ComputeBRDF(L, N, V, roughness, specularColor);
+    }
+
+    return float4(diffuse + specular, 0.f);
+}
@@ -0,0 +1,281 @@
+#include "Precomp.h"
+#include "SoftwareRenderer.h"
+#include "Brdf.h"
+#include "JobSystem.h"
+#include <stdio.h>
+
+std::unique_ptr<SoftwareRenderer> SoftwareRenderer::Create(uint32_t width, uint32_t height)
+{
+    std::unique_ptr<SoftwareRenderer> renderer(new SoftwareRenderer());
+    if (renderer)
+    {
+        if (renderer->Initialize(width, height))
+        {
+            return renderer;
+        }
+    }
+    return nullptr;
+}
+
+SoftwareRenderer::SoftwareRenderer()
+    : Width(0), Height(0), TilesX(0), TilesY(0), Pitch(0)
+{
+    XMStoreFloat4x4(&Projection, XMMatrixIdentity());
+    XMStoreFloat4x4(&InvProjection, XMMatrixIdentity());
+    LightDir = XMFLOAT3(0.f, 0.f, 1.f);
+}
+
+bool SoftwareRenderer::Initialize(uint32_t width, uint32_t height)
+{
+    if (width == 0 || height == 0)
+    {
+        LogError(L"Invalid software renderer size.");
+        return false;
+    }
+
+    Width = width;
+    Height = height;
+    TilesX = (width + TileSize - 1) / TileSize;
+    TilesY = (height + TileSize - 1) / TileSize;
+    Pitch = TilesX * TileSize;
+
+    uint32_t numPixels = Pitch * TilesY * TileSize;
+    Depth.resize(numPixels, 1.f);
+    NormalX.resize(numPixels);
+    NormalY.resize(numPixels);
+    NormalZ.resize(numPixels);
+    Image.resize(Width * Height);
+
+    // Back faces are culled, as in the D3D11 rasterizer state. Normals go to the G-buffer
+    Binner.Initialize(Width, Height, true, true);
+    return true;
+}
+
+void SoftwareRenderer::AddObject(const std::shared_ptr<Object>& object)
+{
+    Objects.push_back(object);
+}
+
+uint32_t SoftwareRenderer::GetNumBinnedTriangles() const
+{
+    return Binner.GetNumBinnedTriangles();
+}
+
+void SoftwareRenderer::Render(FXMMATRIX view, FXMMATRIX projection, JobSystem* jobs)
+{
+    XMVECTOR det;
+    XMStoreFloat4x4(&Projection, projection);
+    XMStoreFloat4x4(&InvProjection, XMMatrixInverse(&det, projection));
+
+    // Same light as DeferredRenderer11's directional pass
+    XMStoreFloat3(&LightDir, XMVector3TransformNormal(XMVector3Normalize(XMVectorSet(1.f, 1.f, 1.f, 0.f)), view));
+
+    // Frustum cull parts, the same way as the D3D11 renderer
+    PartBounds.Clear();
+    PartDraws.clear();
+    Draws.clear();
+    for (auto& obj : Objects)
+    {
+        XMMATRIX root = XMLoadFloat4x4(&obj->RootTransform);
+        for (auto& part : obj->Parts)
+        {
+            XMMATRIX world = XMLoadFloat4x4(&part->RelativeTransform) * root;
+            PartBounds.AddTransformed(part->BoundsCenter, part->BoundsExtents, world);
+
+            TriangleBinner::Mesh draw;
+            draw.Positions = obj->Positions.data();
+            draw.Indices = obj->Indices.data() + part->StartIndex;
+            draw.NumTriangles = part->NumIndices / 3;
+            XMStoreFloat4x4(&draw.Transform, world * view);
+            PartDraws.push_back(draw);
+        }
+    }
+
+    VisibleParts.resize(PartBounds.Size());
+    uint32_t numVisible = FrustumCull(PartBounds, view * projection, VisibleParts.data());
+
+    for (uint32_t i = 0; i < numVisible; ++i)
+    {
+        Draws.push_back(PartDraws[VisibleParts[i]]);
+    }
+
+    Binner.Bin(Draws.data(), (uint32_t)Draws.size(), projection, jobs);
+    ParallelForAndWait(jobs, TilesX * TilesY, 1, [this](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t tile = begin; tile < end; ++tile)
+        {
+            ShadeTile(tile);
+        }
+    });
+}
+
+void SoftwareRenderer::ShadeTile(uint32_t tile)
+{
+    uint32_t tileX = tile % TilesX;
+    uint32_t tileY = tile / TilesX;
+
+    // G-buffer pass
+    for (uint32_t y = 0; y < TileSize; ++y)
+    {
+        float* row = &Depth[(tileY * TileSize + y) * Pitch + tileX * TileSize];
+        std::fill(row, row + TileSize, 1.f);
+    }
+
+    Binner.ForEachTriangle(tile, [&](const ScreenTriangle& triangle)
+    {
+        const __m128 normal[3] = { _mm_set1_ps(triangle.Normal.x), _mm_set1_ps(triangle.Normal.y), _mm_set1_ps(triangle.Normal.z) };
+
+        Binner.Rasterize(triangle, tileX, tileY, [&](uint32_t x, uint32_t y, __m128 inside, __m128 z)
+        {
+            // Depth test (less), then write depth & normal where it passes
+            uint32_t index = y * Pitch + x;
+            __m128 old = _mm_loadu_ps(&Depth[index]);
+            __m128 pass = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+
+            if (_mm_movemask_ps(pass) == 0)
+            {
+                return;
+            }
+
+            _mm_storeu_ps(&Depth[index], _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+
+            float* normals[3] = { &NormalX[index], &NormalY[index], &NormalZ[index] };
+            for (int i = 0; i < 3; ++i)
+            {
+                __m128 current = _mm_loadu_ps(normals[i]);
+                _mm_storeu_ps(normals[i], _mm_or_ps(_mm_and_ps(pass, normal[i]), _mm_andnot_ps(pass, current)));
+            }
+        });
+    });
+
+    // Lighting pass. The tile's G-buffer is complete, so there's no need to wait for other tiles
+    LightTile(tileX, tileY);
+}
+
+void SoftwareRenderer::LightTile(uint32_t tileX, uint32_t tileY)
+{
+    XMMATRIX invProjection = XMLoadFloat4x4(&InvProjection);
+    XMVECTOR L = XMLoadFloat3(&LightDir);
+    const XMVECTOR lightColor = XMVectorSplatOne();
+    const XMVECTOR albedo = XMVectorReplicate(SoftwareAlbedo);
+
+    uint32_t x0 = tileX * TileSize;
+    uint32_t y0 = tileY * TileSize;
+    uint32_t x1 = min(x0 + TileSize, Width);
+    uint32_t y1 = min(y0 + TileSize, Height);
+
+    // The specular term is shaded a row at a time with the batch BRDF kernel. The light and
+    // material are the same for every pixel
+    float lightX[TileSize], lightY[TileSize], lightZ[TileSize];
+    float roughness[TileSize], specularColor[TileSize];
+    std::fill(lightX, lightX + TileSize, LightDir.x);
+    std::fill(lightY, lightY + TileSize, LightDir.y);
+    std::fill(lightZ, lightZ + TileSize, LightDir.z);
+    std::fill(roughness, roughness + TileSize, SoftwareRoughness);
+    std::fill(specularColor, specularColor + TileSize, SoftwareSpecular);
+
+    // Drawn pixels of the row, packed together
+    uint32_t pixelX[TileSize];
+    float diffuse[TileSize];
+    float normalX[TileSize], normalY[TileSize], normalZ[TileSize];
+    float viewX[TileSize], viewY[TileSize], viewZ[TileSize];
+    float red[TileSize], green[TileSize], blue[TileSize];
+
+    BrdfSamples samples = { lightX, lightY, lightZ, normalX, normalY, normalZ, viewX, viewY, viewZ,
+        roughness, specularColor, specularColor, specularColor };
+
+    for (uint32_t y = y0; y < y1; ++y)
+    {
+        uint32_t numPixels = 0;
+        for (uint32_t x = x0; x < x1; ++x)
+        {
+            uint32_t index = y * Pitch + x;
+            float depth = Depth[index];
+            if (depth >= 1.f)
+            {
+                // Nothing drawn. LightAccum clears to opaque black
+                Image[y * Width + x] = 0xff000000;
+                continue;
+            }
+
+            // Same reconstruction as ViewPositionFromDepth in the shader
+            float ndcX = ((float)x + 0.5f) / (float)Width * 2.f - 1.f;
+            float ndcY = 1.f - ((float)y + 0.5f) / (float)Height * 2.f;
+            XMVECTOR viewPos = XMVector4Transform(XMVectorSet(ndcX, ndcY, depth, 1.f), invProjection);
+            viewPos = viewPos / XMVectorSplatW(viewPos);
+
+            XMVECTOR N = XMVectorSet(NormalX[index], NormalY[index], NormalZ[index], 0.f);
+            XMFLOAT3 V;
+            XMStoreFloat3(&V, XMVector3Normalize(-viewPos));
+
+            pixelX[numPixels] = x;
+            diffuse[numPixels] = Saturate(XMVectorGetX(XMVector3Dot(N, L)));
+            normalX[numPixels] = NormalX[index];
+            normalY[numPixels] = NormalY[index];
+            normalZ[numPixels] = NormalZ[index];
+            viewX[numPixels] = V.x;
+            viewY[numPixels] = V.y;
+            viewZ[numPixels] = V.z;
+            ++numPixels;
+        }
+
+        ComputeBRDFRange(samples, 0, numPixels, red, green, blue);
+
+        for (uint32_t i = 0; i < numPixels; ++i)
+        {
+            XMVECTOR specular = XMVectorSet(red[i], green[i], blue[i], 0.f);
+            XMVECTOR color = albedo * lightColor * diffuse[i] + specular;
+
+            XMFLOAT3 rgb;
+            XMStoreFloat3(&rgb, XMVectorSaturate(color) * 255.f + XMVectorReplicate(0.5f));
+            Image[y * Width + pixelX[i]] = 0xff000000 | ((uint32_t)rgb.z << 16) | ((uint32_t)rgb.y << 8) | (uint32_t)rgb.x;
+        }
+    }
+}
+
+bool SoftwareRenderer::SaveImage(const std::wstring& filename) const
+{
+    FILE* file = nullptr;
+    if (_wfopen_s(&file, filename.c_str(), L"wb") != 0 || !file)
+    {
+        LogError(L"Failed to create image: %s.", filename.c_str());
+        return false;
+    }
+
+    // 32 bit top down bitmap, which wants BGRA
+    BITMAPINFOHEADER info{};
+    info.biSize = sizeof(info);
+    info.biWidth = (LONG)Width;
+    info.biHeight = -(LONG)Height;
+    info.biPlanes = 1;
+    info.biBitCount = 32;
+    info.biCompression = BI_RGB;
+    info.biSizeImage = Width * Height * sizeof(uint32_t);
+
+    BITMAPFILEHEADER header{};
+    header.bfType = 0x4d42;    // "BM"
+    header.bfOffBits = sizeof(header) + sizeof(info);
+    header.bfSize = header.bfOffBits + info.biSizeImage;
+
+    std::vector<uint32_t> pixels(Image.size());
+    for (size_t i = 0; i < Image.size(); ++i)
+    {
+        uint32_t rgba = Image[i];
+        pixels[i] = (rgba & 0xff00ff00) | ((rgba & 0xff) << 16) | ((rgba >> 16) & 0xff);
+    }
+
+    bool succeeded =
+        fwrite(&header, sizeof(header), 1, file) == 1 &&
+        fwrite(&info, sizeof(info), 1, file) == 1 &&
+        fwrite(pixels.data(), info.biSizeImage, 1, file) == 1;
+
+    fclose(file);
+
+    if (!succeeded)
+    {
+        LogError(L"Failed to write image: %s.", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Object.h"
+#include "Culling.h"
+#include "TriangleBinning.h"
+
+class JobSystem;
+
+// Matches the geometry pass defaults for parts without textures (see GeometryPassPS.hlsl)
+static const float SoftwareAlbedo = 0.8f;
+static const float SoftwareSpecular = 0.5f;
+static const float SoftwareRoughness = 0.7f;
+
+// Runs the same frame as DeferredRenderer11 on the CPU, without a device: a G-buffer pass over
+// every visible part, then a full screen directional lighting pass using the BRDF from Brdf.h.
+// Triangles are set up and binned into screen tiles in parallel by a TriangleBinner, as in
+// OcclusionBuffer, then each tile is rasterized and lit on its own. The image doesn't depend
+// on thread timing.
+//
+// Objects only need their CPU side data (as loaded by a ContentLoader without a device).
+// Textures live on the GPU, so every part is shaded with the untextured defaults above,
+// and flat face normals.
+class SoftwareRenderer : public NonCopyable
+{
+public:
+    static const uint32_t TileSize = TriangleBinner::TileSize;
+
+    static std::unique_ptr<SoftwareRenderer> Create(uint32_t width, uint32_t height);
+
+    void AddObject(const std::shared_ptr<Object>& object);
+
+    // jobs may be null, to render on the calling thread
+    void Render(FXMMATRIX view, FXMMATRIX projection, JobSystem* jobs);
+
+    uint32_t GetWidth() const { return Width; }
+    uint32_t GetHeight() const { return Height; }
+
+    // Width x Height RGBA8 pixels, top row first. Same format as the D3D11 back buffer
+    const std::vector<uint32_t>& GetImage() const { return Image; }
+    bool SaveImage(const std::wstring& filename) const;
+
+    // Counters from the last Render
+    uint32_t GetNumVisibleParts() const { return (uint32_t)Draws.size(); }
+    uint32_t GetNumBinnedTriangles() const;
+
+private:
+    SoftwareRenderer();
+    bool Initialize(uint32_t width, uint32_t height);
+
+    void ShadeTile(uint32_t tile);
+    void LightTile(uint32_t tileX, uint32_t tileY);
+
+private:
+    uint32_t                    Width;
+    uint32_t                    Height;
+    uint32_t                    TilesX;
+    uint32_t                    TilesY;
+    uint32_t                    Pitch;          // TilesX * TileSize. The G-buffer covers whole tiles
+
+    // G-buffer, Pitch x (TilesY * TileSize). Normals are view space
+    std::vector<float>          Depth;
+    std::vector<float>          NormalX;
+    std::vector<float>          NormalY;
+    std::vector<float>          NormalZ;
+
+    std::vector<uint32_t>       Image;
+
+    std::vector<std::shared_ptr<Object>> Objects;
+
+    // Rebuilt each frame. Kept as members to avoid reallocating
+    CullingBoxes                PartBounds;
+    std::vector<TriangleBinner::Mesh> PartDraws;    // Every part in view space, in the same order as PartBounds
+    std::vector<TriangleBinner::Mesh> Draws;        // Visible parts
+    std::vector<uint32_t>       VisibleParts;
+
+    XMFLOAT4X4                  Projection;
+    XMFLOAT4X4                  InvProjection;
+    XMFLOAT3                    LightDir;       // View space, pointing towards the light
+
+    TriangleBinner              Binner;
+};
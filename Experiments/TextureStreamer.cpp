@@ -0,0 +1,220 @@
+#include "Precomp.h"
+#include "TextureStreamer.h"
+
+TextureStreamer::TextureStreamer(TextureStreamBackend* backend, uint64_t budgetBytes)
+    : Backend(backend)
+{
+    ZeroMemory(&Stats, sizeof(Stats));
+    Stats.BudgetBytes = budgetBytes;
+}
+
+uint64_t TextureStreamer::GetMipChainBytes(uint32_t size, uint32_t mipLevels, uint32_t bytesPerPixel, uint32_t mostDetailedMip)
+{
+    uint64_t bytes = 0;
+    for (uint32_t mip = mostDetailedMip; mip < mipLevels; ++mip)
+    {
+        uint64_t mipSize = max(size >> mip, 1u);
+        bytes += mipSize * mipSize * bytesPerPixel;
+    }
+    return bytes;
+}
+
+uint64_t TextureStreamer::GetBytes(const StreamedTexture& texture, uint32_t mostDetailedMip) const
+{
+    return GetMipChainBytes(texture.Size, texture.MipLevels, texture.BytesPerPixel, mostDetailedMip);
+}
+
+uint32_t TextureStreamer::AddTexture(uint32_t size, uint32_t mipLevels, uint32_t bytesPerPixel)
+{
+    StreamedTexture texture{};
+    texture.Size = size;
+    texture.MipLevels = max(mipLevels, 1u);
+    texture.BytesPerPixel = bytesPerPixel;
+
+    texture.MinResidentMip = 0;
+    while (texture.MinResidentMip + 1 < texture.MipLevels && (size >> texture.MinResidentMip) > MinStreamedMipSize)
+    {
+        ++texture.MinResidentMip;
+    }
+    texture.ResidentMip = texture.MinResidentMip;
+    texture.WantedMip = texture.MinResidentMip;
+    texture.InUse = true;
+
+    Stats.ResidentBytes += GetBytes(texture, texture.ResidentMip);
+    ++Stats.NumTextures;
+
+    if (!FreeIds.empty())
+    {
+        uint32_t id = FreeIds.back();
+        FreeIds.pop_back();
+        Textures[id] = texture;
+        return id;
+    }
+
+    Textures.push_back(texture);
+    return (uint32_t)Textures.size() - 1;
+}
+
+void TextureStreamer::RemoveTexture(uint32_t id)
+{
+    StreamedTexture& texture = Textures[id];
+    assert(texture.InUse);
+
+    Stats.ResidentBytes -= GetBytes(texture, texture.ResidentMip);
+    --Stats.NumTextures;
+
+    texture.InUse = false;
+    FreeIds.push_back(id);
+}
+
+void TextureStreamer::MarkVisible(uint32_t id, float screenSize)
+{
+    StreamedTexture& texture = Textures[id];
+    texture.ScreenSize = max(texture.ScreenSize, max(screenSize, 1.f));
+}
+
+void TextureStreamer::Update(uint64_t frame)
+{
+    Stats.Uploads = 0;
+    Stats.Evictions = 0;
+
+    // Work out what each visible texture wants. Mip n is a match for a surface Size >> n pixels across
+    std::vector<uint32_t> requests;
+    for (uint32_t id = 0; id < (uint32_t)Textures.size(); ++id)
+    {
+        StreamedTexture& texture = Textures[id];
+        if (!texture.InUse)
+        {
+            continue;
+        }
+
+        texture.WantedMip = texture.MinResidentMip;
+        if (texture.ScreenSize > 0.f)
+        {
+            texture.LastUsedFrame = frame;
+
+            float texelsPerPixel = (float)texture.Size / texture.ScreenSize;
+            uint32_t wanted = texelsPerPixel > 1.f ? (uint32_t)log2f(texelsPerPixel) : 0;
+            texture.WantedMip = min(wanted, texture.MinResidentMip);
+
+            if (texture.WantedMip < texture.ResidentMip)
+            {
+                requests.push_back(id);
+            }
+        }
+    }
+
+    // Furthest from what they want first, then biggest on screen
+    std::sort(requests.begin(), requests.end(), [this](uint32_t a, uint32_t b)
+    {
+        const StreamedTexture& ta = Textures[a];
+        const StreamedTexture& tb = Textures[b];
+        uint32_t missingA = ta.ResidentMip - ta.WantedMip;
+        uint32_t missingB = tb.ResidentMip - tb.WantedMip;
+        if (missingA != missingB)
+        {
+            return missingA > missingB;
+        }
+        return ta.ScreenSize > tb.ScreenSize;
+    });
+
+    // One level at a time, so no single texture hogs the frame's uploads
+    for (uint32_t i = 0; i < (uint32_t)requests.size() && Stats.Uploads < MaxMipUploadsPerFrame; ++i)
+    {
+        uint32_t id = requests[i];
+        const StreamedTexture& texture = Textures[id];
+        uint32_t mip = texture.ResidentMip - 1;
+        uint64_t cost = GetBytes(texture, mip) - GetBytes(texture, texture.ResidentMip);
+
+        if (!EvictFor(cost, frame, id))
+        {
+            continue;
+        }
+
+        if (SetResidentMip(id, mip))
+        {
+            ++Stats.Uploads;
+        }
+    }
+
+    // The budget may have been lowered, or started out exceeded by new textures
+    EvictFor(0, frame, UINT32_MAX);
+
+    Stats.FullyResident = 0;
+    Stats.PendingRequests = 0;
+    Stats.WantedBytes = 0;
+    for (auto& texture : Textures)
+    {
+        if (!texture.InUse)
+        {
+            continue;
+        }
+
+        if (texture.ResidentMip <= texture.WantedMip)
+        {
+            ++Stats.FullyResident;
+        }
+        else
+        {
+            ++Stats.PendingRequests;
+        }
+
+        Stats.WantedBytes += GetBytes(texture, texture.WantedMip);
+        texture.ScreenSize = 0.f;
+    }
+}
+
+bool TextureStreamer::SetResidentMip(uint32_t id, uint32_t mip)
+{
+    StreamedTexture& texture = Textures[id];
+
+    if (!Backend->SetResidentMips(id, mip))
+    {
+        LogError(L"Failed to change resident mips.");
+        return false;
+    }
+
+    Stats.ResidentBytes -= GetBytes(texture, texture.ResidentMip);
+    Stats.ResidentBytes += GetBytes(texture, mip);
+    texture.ResidentMip = mip;
+    return true;
+}
+
+bool TextureStreamer::EvictFor(uint64_t bytes, uint64_t frame, uint32_t exclude)
+{
+    while (Stats.ResidentBytes + bytes > Stats.BudgetBytes)
+    {
+        // Least recently used textures give up their most detailed mip first. Textures used
+        // this frame only give up mips they don't currently want
+        uint32_t victim = UINT32_MAX;
+        for (uint32_t id = 0; id < (uint32_t)Textures.size(); ++id)
+        {
+            const StreamedTexture& texture = Textures[id];
+            if (!texture.InUse || id == exclude)
+            {
+                continue;
+            }
+
+            bool evictable = texture.LastUsedFrame == frame ?
+                texture.ResidentMip < texture.WantedMip :
+                texture.ResidentMip < texture.MinResidentMip;
+            if (!evictable)
+            {
+                continue;
+            }
+
+            if (victim == UINT32_MAX || texture.LastUsedFrame < Textures[victim].LastUsedFrame)
+            {
+                victim = id;
+            }
+        }
+
+        if (victim == UINT32_MAX || !SetResidentMip(victim, Textures[victim].ResidentMip + 1))
+        {
+            return false;
+        }
+        ++Stats.Evictions;
+    }
+
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+// Mips at or below this size are always resident, and are what a texture starts with
+static const uint32_t MinStreamedMipSize = 64;
+static const uint32_t MaxMipUploadsPerFrame = 4;
+static const uint64_t DefaultTextureBudget = 256ull * 1024 * 1024;
+
+// Does the actual work of changing which mips of a texture are resident.
+// Implemented by the content loader for D3D11, and by fakes for testing the policy.
+class TextureStreamBackend
+{
+public:
+    virtual ~TextureStreamBackend() {}
+
+    // Make mips [mostDetailedMip, MipLevels) resident, releasing any more detailed ones. The
+    // change may finish on a later frame, but is accounted for from here on
+    virtual bool SetResidentMips(uint32_t id, uint32_t mostDetailedMip) = 0;
+};
+
+struct TextureStreamStats
+{
+    uint32_t    NumTextures;
+    uint32_t    FullyResident;      // Textures with every mip they want resident
+    uint32_t    PendingRequests;    // Textures still wanting more detail after this frame's uploads
+    uint32_t    Uploads;            // Mip changes this frame
+    uint32_t    Evictions;
+    uint64_t    ResidentBytes;
+    uint64_t    WantedBytes;        // What would be resident with no budget
+    uint64_t    BudgetBytes;
+};
+
+// Decides which mips of each texture should be resident. Visible textures get the mip that
+// matches their screen size, a level per update, and least recently used mips are dropped
+// while over budget. Independent of any graphics API.
+class TextureStreamer : public NonCopyable
+{
+public:
+    TextureStreamer(TextureStreamBackend* backend, uint64_t budgetBytes);
+
+    void SetBudget(uint64_t bytes) { Stats.BudgetBytes = bytes; }
+
+    // Only the mips from GetResidentMip(id) down start out resident, and the caller is
+    // expected to create those itself. Square textures only (as that's all that has mips).
+    uint32_t AddTexture(uint32_t size, uint32_t mipLevels, uint32_t bytesPerPixel);
+    void RemoveTexture(uint32_t id);
+
+    // Called for each visible use of the texture this frame, with the size (in pixels)
+    // along the longest side of the surface it's mapped onto.
+    void MarkVisible(uint32_t id, float screenSize);
+
+    // Services requests and evicts. Call once per frame, after all MarkVisible calls.
+    void Update(uint64_t frame);
+
+    uint32_t GetResidentMip(uint32_t id) const { return Textures[id].ResidentMip; }
+    const TextureStreamStats& GetStats() const { return Stats; }
+
+    // Bytes for mips [mostDetailedMip, mipLevels)
+    static uint64_t GetMipChainBytes(uint32_t size, uint32_t mipLevels, uint32_t bytesPerPixel, uint32_t mostDetailedMip);
+
+private:
+    struct StreamedTexture
+    {
+        uint32_t    Size;
+        uint32_t    MipLevels;
+        uint32_t    BytesPerPixel;
+        uint32_t    ResidentMip;
+        uint32_t    MinResidentMip;     // Least detailed ResidentMip can be
+        uint32_t    WantedMip;
+        float       ScreenSize;         // Largest this frame
+        uint64_t    LastUsedFrame;
+        bool        InUse;
+    };
+
+    uint64_t GetBytes(const StreamedTexture& texture, uint32_t mostDetailedMip) const;
+    bool SetResidentMip(uint32_t id, uint32_t mip);
+    bool EvictFor(uint64_t bytes, uint64_t frame, uint32_t exclude);
+
+    TextureStreamBackend* Backend;
+    std::vector<StreamedTexture> Textures;
+    std::vector<uint32_t> FreeIds;     // Removed entries in Textures, to reuse
+    TextureStreamStats Stats;
+};
@@ -0,0 +1,129 @@
+#include "Precomp.h"
+#include "TransformSystem.h"
+#include "JobSystem.h"
+
+// World matrices per update job
+static const uint32_t TransformsPerJob = 1024;
+
+TransformSystem::TransformSystem()
+    : MaxDepth(0), AnyDirty(false), NumUpdated(0)
+{
+}
+
+uint32_t TransformSystem::Add(uint32_t parent, CXMMATRIX local)
+{
+    assert(parent == NoParentTransform || parent < Size());
+
+    uint32_t index = Size();
+    uint32_t depth = parent == NoParentTransform ? 0 : Depths[parent] + 1;
+    Parents.push_back(parent);
+    Depths.push_back(depth);
+    Dirty.push_back(1);
+    Locals.push_back(XMFLOAT4X4());
+    Worlds.push_back(XMFLOAT4X4());
+    XMStoreFloat4x4(&Locals.back(), local);
+
+    MaxDepth = max(MaxDepth, depth);
+    AnyDirty = true;
+    return index;
+}
+
+void TransformSystem::Clear()
+{
+    Parents.clear();
+    Depths.clear();
+    Dirty.clear();
+    Locals.clear();
+    Worlds.clear();
+    MaxDepth = 0;
+    AnyDirty = false;
+}
+
+void TransformSystem::SetLocal(uint32_t index, CXMMATRIX local)
+{
+    XMStoreFloat4x4(&Locals[index], local);
+    Dirty[index] = 1;
+    AnyDirty = true;
+}
+
+void TransformSystem::Update(JobSystem* jobs)
+{
+    NumUpdated = 0;
+    if (!AnyDirty)
+    {
+        return;
+    }
+
+    // Parents come first, so one pass spreads dirty flags down every subtree. Count dirty
+    // transforms per depth as we go, then bucket them so each level is a contiguous list
+    uint32_t numTransforms = Size();
+    LevelStarts.assign(MaxDepth + 2, 0);
+    for (uint32_t i = 0; i < numTransforms; ++i)
+    {
+        uint32_t parent = Parents[i];
+        if (parent != NoParentTransform)
+        {
+            Dirty[i] |= Dirty[parent];
+        }
+        if (Dirty[i])
+        {
+            ++LevelStarts[Depths[i] + 1];
+        }
+    }
+
+    for (uint32_t depth = 1; depth < (uint32_t)LevelStarts.size(); ++depth)
+    {
+        LevelStarts[depth] += LevelStarts[depth - 1];
+    }
+    NumUpdated = LevelStarts.back();
+
+    // Still in index order within each level, so world matrices are written (and parents read) linearly
+    DirtyIndices.resize(NumUpdated);
+    LevelNext.assign(LevelStarts.begin(), LevelStarts.end() - 1);
+    for (uint32_t i = 0; i < numTransforms; ++i)
+    {
+        if (Dirty[i])
+        {
+            DirtyIndices[LevelNext[Depths[i]]++] = i;
+            Dirty[i] = 0;
+        }
+    }
+
+    // Each level only depends on the one above it
+    for (uint32_t depth = 0; depth <= MaxDepth; ++depth)
+    {
+        const uint32_t* level = DirtyIndices.data() + LevelStarts[depth];
+        uint32_t count = LevelStarts[depth + 1] - LevelStarts[depth];
+        if (jobs && count > TransformsPerJob)
+        {
+            JobHandle batch = jobs->ParallelFor(count, TransformsPerJob, [&](uint32_t begin, uint32_t end)
+            {
+                UpdateRange(level + begin, end - begin);
+            });
+            jobs->Wait(batch);
+        }
+        else
+        {
+            UpdateRange(level, count);
+        }
+    }
+
+    AnyDirty = false;
+}
+
+void TransformSystem::UpdateRange(const uint32_t* indices, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        uint32_t index = indices[i];
+        uint32_t parent = Parents[index];
+
+        // Row vectors, so local then parent
+        XMMATRIX world = XMLoadFloat4x4(&Locals[index]);
+        if (parent != NoParentTransform)
+        {
+            world = world * XMLoadFloat4x4(&Worlds[parent]);
+        }
+        XMStoreFloat4x4(&Worlds[index], world);
+    }
+}
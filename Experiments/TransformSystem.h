@@ -0,0 +1,55 @@
+#pragma once
+
+class JobSystem;
+
+static const uint32_t NoParentTransform = UINT32_MAX;
+
+// Flat transform hierarchy. Each transform is an index into parallel arrays of parent index,
+// depth, local matrix and world matrix. Parents always come before their children, so the
+// arrays are in topological order and the world matrices of a subtree can be read linearly.
+//
+// Changing a local matrix marks it dirty. Update spreads dirty flags down to descendants in
+// one pass, then recomputes only those world matrices, a depth level at a time, with each
+// level split into jobs. Independent of any graphics API.
+class TransformSystem : public NonCopyable
+{
+public:
+    TransformSystem();
+
+    // parent must already exist (or be NoParentTransform). Returns the new transform's index
+    uint32_t Add(uint32_t parent, CXMMATRIX local);
+    void Clear();
+
+    uint32_t Size() const { return (uint32_t)Parents.size(); }
+
+    void SetLocal(uint32_t index, CXMMATRIX local);
+    const XMFLOAT4X4& GetLocal(uint32_t index) const { return Locals[index]; }
+
+    // Up to date as of the last Update
+    const XMFLOAT4X4& GetWorld(uint32_t index) const { return Worlds[index]; }
+    const std::vector<XMFLOAT4X4>& GetWorlds() const { return Worlds; }
+
+    // Brings the world matrices of everything changed since the last Update (and everything
+    // under it) up to date. jobs may be null, to update on the calling thread.
+    void Update(JobSystem* jobs);
+
+    // World matrices recomputed by the last Update
+    uint32_t GetNumUpdated() const { return NumUpdated; }
+
+private:
+    void UpdateRange(const uint32_t* indices, uint32_t count);
+
+    std::vector<uint32_t>       Parents;
+    std::vector<uint32_t>       Depths;
+    std::vector<uint8_t>        Dirty;
+    std::vector<XMFLOAT4X4>     Locals;
+    std::vector<XMFLOAT4X4>     Worlds;
+    uint32_t                    MaxDepth;
+    bool                        AnyDirty;
+
+    // Dirty transforms bucketed by depth, rebuilt by each Update. Kept to avoid reallocating
+    std::vector<uint32_t>       DirtyIndices;
+    std::vector<uint32_t>       LevelStarts;
+    std::vector<uint32_t>       LevelNext;
+    uint32_t                    NumUpdated;
+};
@@ -0,0 +1,213 @@
+#include "Precomp.h"
+#include "TriangleBinning.h"
+#include "JobSystem.h"
+
+// Setup work is split into more chunks than there are cores, to even out the load
+static const uint32_t SetupChunksPerCore = 4;
+
+TriangleBinner::TriangleBinner()
+    : Width(0), Height(0), TilesX(0), TilesY(0), CullBackFaces(false), KeepNormals(false)
+{
+}
+
+void TriangleBinner::Initialize(uint32_t width, uint32_t height, bool cullBackFaces, bool keepNormals)
+{
+    Width = width;
+    Height = height;
+    TilesX = (width + TileSize - 1) / TileSize;
+    TilesY = (height + TileSize - 1) / TileSize;
+    CullBackFaces = cullBackFaces;
+    KeepNormals = keepNormals;
+
+    // The chunks don't depend on how many threads bin, so neither do the results
+    SYSTEM_INFO info{};
+    GetSystemInfo(&info);
+    Bins.resize(max(1u, (uint32_t)info.dwNumberOfProcessors) * SetupChunksPerCore);
+    for (auto& bins : Bins)
+    {
+        bins.Tiles.resize(TilesX * TilesY);
+    }
+}
+
+void TriangleBinner::Bin(const Mesh* meshes, uint32_t numMeshes, CXMMATRIX projection, JobSystem* jobs)
+{
+    uint32_t numTriangles = 0;
+    for (uint32_t i = 0; i < numMeshes; ++i)
+    {
+        numTriangles += meshes[i].NumTriangles;
+    }
+
+    ParallelForAndWait(jobs, (uint32_t)Bins.size(), 1, [&](uint32_t begin, uint32_t end)
+    {
+        for (uint32_t chunk = begin; chunk < end; ++chunk)
+        {
+            SetupTriangles(chunk, meshes, numMeshes, numTriangles, projection);
+        }
+    });
+}
+
+uint32_t TriangleBinner::GetNumBinnedTriangles() const
+{
+    uint32_t count = 0;
+    for (auto& bins : Bins)
+    {
+        count += (uint32_t)bins.Triangles.size();
+    }
+    return count;
+}
+
+void TriangleBinner::SetupTriangles(uint32_t chunk, const Mesh* meshes, uint32_t numMeshes, uint32_t numTriangles, CXMMATRIX projection)
+{
+    TriangleBins& bins = Bins[chunk];
+    bins.Triangles.clear();
+    for (auto& tile : bins.Tiles)
+    {
+        tile.clear();
+    }
+
+    // This chunk's share of all triangles, as if they were one list
+    uint32_t first = (uint32_t)((uint64_t)numTriangles * chunk / Bins.size());
+    uint32_t last = (uint32_t)((uint64_t)numTriangles * (chunk + 1) / Bins.size());
+
+    uint32_t meshStart = 0;
+    for (uint32_t m = 0; m < numMeshes; ++m)
+    {
+        const Mesh& mesh = meshes[m];
+        uint32_t meshEnd = meshStart + mesh.NumTriangles;
+        uint32_t start = max(first, meshStart);
+        uint32_t end = min(last, meshEnd);
+
+        if (start < end)
+        {
+            XMMATRIX transform = XMLoadFloat4x4(&mesh.Transform);
+            XMMATRIX transformProjection = transform * projection;
+
+            for (uint32_t t = start - meshStart; t < end - meshStart; ++t)
+            {
+                const uint32_t* indices = mesh.Indices + t * 3;
+
+                // Normals need the positions before projection. Without them, it's one transform
+                XMVECTOR v[3];
+                XMVECTOR normal = XMVectorZero();
+                if (KeepNormals)
+                {
+                    XMVECTOR p[3];
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        p[i] = XMVector3Transform(XMLoadFloat3(&mesh.Positions[indices[i]]), transform);
+                        v[i] = XMVector4Transform(p[i], projection);
+                    }
+
+                    // Counter clockwise triangles face the camera, so this points out of the front face
+                    normal = XMVector3Normalize(XMVector3Cross(p[1] - p[0], p[2] - p[0]));
+                }
+                else
+                {
+                    for (int i = 0; i < 3; ++i)
+                    {
+                        v[i] = XMVector3Transform(XMLoadFloat3(&mesh.Positions[indices[i]]), transformProjection);
+                    }
+                }
+
+                // Trivially reject triangles entirely outside one of the side or far planes
+                XMVECTOR w0 = XMVectorSplatW(v[0]);
+                XMVECTOR w1 = XMVectorSplatW(v[1]);
+                XMVECTOR w2 = XMVectorSplatW(v[2]);
+                XMVECTOR outsideMax = XMVectorAndInt(XMVectorAndInt(XMVectorGreater(v[0], w0), XMVectorGreater(v[1], w1)), XMVectorGreater(v[2], w2));
+                XMVECTOR outsideMin = XMVectorAndInt(XMVectorAndInt(XMVectorLess(v[0], -w0), XMVectorLess(v[1], -w1)), XMVectorLess(v[2], -w2));
+                if (XMVector3NotEqualInt(XMVectorOrInt(outsideMax, outsideMin), XMVectorFalseInt()))
+                {
+                    continue;
+                }
+
+                // Clip against the near plane (z >= 0), which leaves at most a quad
+                float d[3] = { XMVectorGetZ(v[0]), XMVectorGetZ(v[1]), XMVectorGetZ(v[2]) };
+                if (d[0] >= 0.f && d[1] >= 0.f && d[2] >= 0.f)
+                {
+                    EmitTriangle(bins, v[0], v[1], v[2], normal);
+                    continue;
+                }
+
+                XMVECTOR clipped[4];
+                int numClipped = 0;
+                for (int i = 0; i < 3; ++i)
+                {
+                    int j = (i + 1) % 3;
+                    if (d[i] >= 0.f)
+                    {
+                        clipped[numClipped++] = v[i];
+                    }
+                    if ((d[i] >= 0.f) != (d[j] >= 0.f))
+                    {
+                        clipped[numClipped++] = XMVectorLerp(v[i], v[j], d[i] / (d[i] - d[j]));
+                    }
+                }
+
+                for (int i = 2; i < numClipped; ++i)
+                {
+                    EmitTriangle(bins, clipped[0], clipped[i - 1], clipped[i], normal);
+                }
+            }
+        }
+
+        meshStart = meshEnd;
+    }
+}
+
+void TriangleBinner::EmitTriangle(TriangleBins& bins, FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, GXMVECTOR normal)
+{
+    // Clip space to screen space
+    const XMVECTOR scale = XMVectorSet(0.5f * (float)Width, -0.5f * (float)Height, 1.f, 1.f);
+    const XMVECTOR offset = XMVectorSet(0.5f * (float)Width, 0.5f * (float)Height, 0.f, 0.f);
+
+    XMFLOAT3 p[3];
+    XMStoreFloat3(&p[0], XMVectorMultiplyAdd(v0 / XMVectorSplatW(v0), scale, offset));
+    XMStoreFloat3(&p[1], XMVectorMultiplyAdd(v1 / XMVectorSplatW(v1), scale, offset));
+    XMStoreFloat3(&p[2], XMVectorMultiplyAdd(v2 / XMVectorSplatW(v2), scale, offset));
+
+    // Screen space y points down, so counter clockwise (front facing) triangles have a negative
+    // area here. Back faces are dropped if culled, and the rest are flipped to a positive area
+    float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+    if (area == 0.f || (CullBackFaces && area > 0.f))
+    {
+        return;
+    }
+    if (area < 0.f)
+    {
+        std::swap(p[1], p[2]);
+    }
+
+    float minX = min(min(p[0].x, p[1].x), p[2].x);
+    float maxX = max(max(p[0].x, p[1].x), p[2].x);
+    float minY = min(min(p[0].y, p[1].y), p[2].y);
+    float maxY = max(max(p[0].y, p[1].y), p[2].y);
+    if (maxX < 0.f || maxY < 0.f || minX >= (float)Width || minY >= (float)Height)
+    {
+        return;
+    }
+
+    uint32_t tileX0 = (uint32_t)max(minX, 0.f) / TileSize;
+    uint32_t tileY0 = (uint32_t)max(minY, 0.f) / TileSize;
+    uint32_t tileX1 = (uint32_t)min(maxX, (float)Width - 1.f) / TileSize;
+    uint32_t tileY1 = (uint32_t)min(maxY, (float)Height - 1.f) / TileSize;
+
+    ScreenTriangle triangle;
+    for (int i = 0; i < 3; ++i)
+    {
+        triangle.X[i] = p[i].x;
+        triangle.Y[i] = p[i].y;
+        triangle.Z[i] = min(max(p[i].z, 0.f), 1.f);
+    }
+    XMStoreFloat3(&triangle.Normal, normal);
+
+    uint32_t index = (uint32_t)bins.Triangles.size();
+    bins.Triangles.push_back(triangle);
+
+    for (uint32_t y = tileY0; y <= tileY1; ++y)
+    {
+        for (uint32_t x = tileX0; x <= tileX1; ++x)
+        {
+            bins.Tiles[y * TilesX + x].push_back(index);
+        }
+    }
+}
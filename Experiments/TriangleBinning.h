@@ -0,0 +1,149 @@
+#pragma once
+
+class JobSystem;
+
+// x & y in pixels, z in [0, 1]. Wound so that the signed area is positive
+struct ScreenTriangle
+{
+    float       X[3];
+    float       Y[3];
+    float       Z[3];
+    XMFLOAT3    Normal;     // Face normal in the space of the mesh's transform, if kept
+};
+
+// Triangle setup shared by the CPU rasterizers (OcclusionBuffer & SoftwareRenderer). Meshes are
+// treated as one list of triangles and split into a fixed number of chunks. Each chunk is
+// transformed, trivially rejected, clipped against the near plane and binned into screen tiles
+// on its own, so chunks are set up in parallel. Tiles walk the bins in chunk order, so results
+// don't depend on thread timing.
+class TriangleBinner : public NonCopyable
+{
+public:
+    static const uint32_t TileSize = 32;
+
+    // A range of triangles. Transform takes positions to the space normals are kept in, which
+    // the projection given to Bin takes to clip space
+    struct Mesh
+    {
+        const XMFLOAT3*     Positions;
+        const uint32_t*     Indices;
+        uint32_t            NumTriangles;
+        XMFLOAT4X4          Transform;
+    };
+
+    TriangleBinner();
+
+    // Covers width x height pixels. cullBackFaces keeps only counter clockwise triangles, as in
+    // the D3D11 rasterizer state, otherwise both sides are kept. keepNormals stores face normals
+    void Initialize(uint32_t width, uint32_t height, bool cullBackFaces, bool keepNormals);
+
+    uint32_t GetTilesX() const { return TilesX; }
+    uint32_t GetTilesY() const { return TilesY; }
+
+    // Sets up & bins every triangle of meshes, replacing the last bins. jobs may be null, to
+    // bin on the calling thread
+    void Bin(const Mesh* meshes, uint32_t numMeshes, CXMMATRIX projection, JobSystem* jobs);
+
+    uint32_t GetNumBinnedTriangles() const;
+
+    // Calls function(triangle) for every triangle binned to tile, in the same order every time
+    template <typename Function>
+    void ForEachTriangle(uint32_t tile, Function function) const
+    {
+        for (auto& bins : Bins)
+        {
+            for (auto index : bins.Tiles[tile])
+            {
+                function(bins.Triangles[index]);
+            }
+        }
+    }
+
+    // Walks the pixels of t within a tile (and the screen) 4 at a time with SSE. Calls
+    // pixels(x, y, inside, z) for each group of 4 with any inside, where x is aligned to 4,
+    // inside is the coverage mask and z the depth of each pixel
+    template <typename PixelFunction>
+    void Rasterize(const ScreenTriangle& t, uint32_t tileX, uint32_t tileY, PixelFunction pixels) const
+    {
+        // Pixel bounds, clipped to the tile and screen. Left edge aligned to 4 for the SSE loop.
+        // Clamped as floats first, since vertices can be far off screen
+        float left = (float)(tileX * TileSize);
+        float top = (float)(tileY * TileSize);
+        float right = min(left + (float)(TileSize - 1), (float)Width - 1.f);
+        float bottom = min(top + (float)(TileSize - 1), (float)Height - 1.f);
+
+        int minX = (int)floorf(max(min(min(t.X[0], t.X[1]), t.X[2]), left)) & ~3;
+        int maxX = (int)floorf(min(max(max(t.X[0], t.X[1]), t.X[2]), right));
+        int minY = (int)floorf(max(min(min(t.Y[0], t.Y[1]), t.Y[2]), top));
+        int maxY = (int)floorf(min(max(max(t.Y[0], t.Y[1]), t.Y[2]), bottom));
+
+        // Edge functions A * x + B * y + C, positive inside
+        float a[3], b[3], c[3];
+        for (int i = 0; i < 3; ++i)
+        {
+            int j = (i + 1) % 3;
+            a[i] = t.Y[i] - t.Y[j];
+            b[i] = t.X[j] - t.X[i];
+            c[i] = -(a[i] * t.X[i] + b[i] * t.Y[i]);
+        }
+
+        // z / w is linear in screen space
+        float area = (t.X[1] - t.X[0]) * (t.Y[2] - t.Y[0]) - (t.X[2] - t.X[0]) * (t.Y[1] - t.Y[0]);
+        float dzdx = ((t.Z[1] - t.Z[0]) * (t.Y[2] - t.Y[0]) - (t.Z[2] - t.Z[0]) * (t.Y[1] - t.Y[0])) / area;
+        float dzdy = ((t.X[1] - t.X[0]) * (t.Z[2] - t.Z[0]) - (t.X[2] - t.X[0]) * (t.Z[1] - t.Z[0])) / area;
+
+        const __m128 pixelOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 a0 = _mm_set1_ps(a[0]);
+        const __m128 a1 = _mm_set1_ps(a[1]);
+        const __m128 a2 = _mm_set1_ps(a[2]);
+        const __m128 zx = _mm_set1_ps(dzdx);
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = (float)y + 0.5f;
+            __m128 row0 = _mm_set1_ps(b[0] * py + c[0]);
+            __m128 row1 = _mm_set1_ps(b[1] * py + c[1]);
+            __m128 row2 = _mm_set1_ps(b[2] * py + c[2]);
+            __m128 rowZ = _mm_set1_ps(t.Z[0] + dzdy * (py - t.Y[0]) - dzdx * t.X[0]);
+
+            for (int x = minX; x <= maxX; x += 4)
+            {
+                __m128 px = _mm_add_ps(_mm_set1_ps((float)x), pixelOffsets);
+
+                __m128 inside = _mm_and_ps(
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), row0), zero),
+                               _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), row1), zero)),
+                    _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), row2), zero));
+
+                if (_mm_movemask_ps(inside) == 0)
+                {
+                    continue;
+                }
+
+                pixels((uint32_t)x, (uint32_t)y, inside, _mm_max_ps(_mm_add_ps(_mm_mul_ps(zx, px), rowZ), zero));
+            }
+        }
+    }
+
+private:
+    // Triangles set up by one chunk, with the indices of the ones touching each tile
+    struct TriangleBins
+    {
+        std::vector<ScreenTriangle>         Triangles;
+        std::vector<std::vector<uint32_t>>  Tiles;
+    };
+
+    void SetupTriangles(uint32_t chunk, const Mesh* meshes, uint32_t numMeshes, uint32_t numTriangles, CXMMATRIX projection);
+    void EmitTriangle(TriangleBins& bins, FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2, GXMVECTOR normal);
+
+private:
+    uint32_t                    Width;
+    uint32_t                    Height;
+    uint32_t                    TilesX;
+    uint32_t                    TilesY;
+    bool                        CullBackFaces;
+    bool                        KeepNormals;
+
+    std::vector<TriangleBins>   Bins;           // One per setup chunk
+};